@@ -9,6 +9,7 @@
 #include "User.h"
 
 #ifdef MURMUR
+#	include "PermissionCache.h"
 #	include "ServerUser.h"
 
 #	include <QtCore/QStack>
@@ -93,6 +94,15 @@ ChanACL::operator QString() const {
 
 #ifdef MURMUR
 
+const Group::Specification &ChanACL::groupSpecification() const {
+	if (qsGroup != m_parsedGroup) {
+		m_groupSpecification = Group::Specification::parse(qsGroup);
+		m_parsedGroup        = qsGroup;
+	}
+
+	return m_groupSpecification;
+}
+
 bool ChanACL::hasPermission(ServerUser *p, Channel *chan, QFlags< Perm > perm, ACLCache *cache) {
 	Permissions granted = effectivePermissions(p, chan, cache);
 
@@ -115,9 +125,7 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 #	endif
 
 	if (cache) {
-		QHash< Channel *, Permissions > *h = cache->value(p);
-		if (h)
-			granted = h->value(chan);
+		granted = cache->get(*p, chan->iId);
 	}
 
 	if (granted & Cached) {
@@ -148,7 +156,16 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 
 		foreach (acl, ch->qlACL) {
 			bool matchUser  = (acl->iUserId != -1) && (acl->iUserId == p->iId);
-			bool matchGroup = Group::appliesToUser(*chan, *ch, acl->qsGroup, *p);
+			bool matchGroup = false;
+
+			const Group::Specification &specification = acl->groupSpecification();
+			if (cache && specification.type == Group::Specification::Type::Named) {
+				// Named groups are looked up in the cache's memberships of the user instead of walking up the tree
+				const Channel &context = specification.aclContext ? *ch : *chan;
+				matchGroup = cache->isGroupMember(*p, context, specification.name) != specification.invert;
+			} else {
+				matchGroup = Group::appliesToUser(*chan, *ch, specification, *p);
+			}
 			if (matchUser || matchGroup) {
 				if (acl->pAllow & Traverse)
 					traverse = true;
@@ -190,10 +207,7 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 	}
 
 	if (cache) {
-		if (!cache->contains(p))
-			cache->insert(p, new QHash< Channel *, Permissions >);
-
-		cache->value(p)->insert(chan, granted | Cached);
+		cache->set(*p, chan->iId, granted | Cached);
 	}
 
 	return granted;
@@ -9,9 +9,16 @@
 #include <QtCore/QHash>
 #include <QtCore/QObject>
 
+#ifdef MURMUR
+#	include "Group.h"
+#endif
+
 class Channel;
 class User;
 class ServerUser;
+#ifdef MURMUR
+class PermissionCache;
+#endif
 
 class ChanACL : public QObject {
 private:
@@ -47,8 +54,9 @@ public:
 
 	Q_DECLARE_FLAGS(Permissions, Perm)
 
-	typedef QHash< Channel *, Permissions > ChanCache;
-	typedef QHash< User *, ChanCache * > ACLCache;
+#ifdef MURMUR
+	typedef PermissionCache ACLCache;
+#endif
 
 	Channel *c;
 	bool bApplyHere;
@@ -71,6 +79,9 @@ public:
 	explicit operator QString() const;
 
 #ifdef MURMUR
+	/// @returns qsGroup in its parsed form. It is only parsed again once qsGroup has changed.
+	const Group::Specification &groupSpecification() const;
+
 	static bool hasPermission(ServerUser *p, Channel *c, QFlags< Perm > perm, ACLCache *cache);
 	static QFlags< Perm > effectivePermissions(ServerUser *p, Channel *c, ACLCache *cache);
 #else
@@ -78,6 +89,13 @@ public:
 #endif
 	static QString permName(QFlags< Perm > p);
 	static QString permName(Perm p);
+
+#ifdef MURMUR
+private:
+	/// The value of qsGroup m_groupSpecification has been parsed from
+	mutable QString m_parsedGroup;
+	mutable Group::Specification m_groupSpecification;
+#endif
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(ChanACL::Permissions)
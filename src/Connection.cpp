@@ -7,6 +7,8 @@
 #include "Mumble.pb.h"
 #include "SSL.h"
 
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
 #include <QtCore/QtEndian>
 #include <QtNetwork/QHostAddress>
 
@@ -23,18 +25,12 @@
 HANDLE Connection::hQoS = nullptr;
 #endif
 
-Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
+ConnectionSocket::ConnectionSocket(QSslSocket *qtsSock, QObject *p) : QObject(p) {
 	qtsSocket = qtsSock;
 	qtsSocket->setParent(this);
-	iPacketLength        = -1;
-	bDisconnectedEmitted = false;
-	csCrypt              = std::make_unique< CryptStateOCB2 >();
-
-	static bool bDeclared = false;
-	if (!bDeclared) {
-		bDeclared = true;
-		qRegisterMetaType< QAbstractSocket::SocketError >("QAbstractSocket::SocketError");
-	}
+	iPacketLength    = -1;
+	m_requestedBytes = 0;
+	m_bufferedBytes  = 0;
 
 	int nodelay = 1;
 	setsockopt(static_cast< int >(qtsSocket->socketDescriptor()), IPPROTO_TCP, TCP_NODELAY,
@@ -42,61 +38,101 @@ Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 
 	connect(qtsSocket, SIGNAL(error(QAbstractSocket::SocketError)), this,
 			SLOT(socketError(QAbstractSocket::SocketError)));
-	connect(qtsSocket, SIGNAL(encrypted()), this, SIGNAL(encrypted()));
+	connect(qtsSocket, SIGNAL(connected()), this, SLOT(socketConnected()));
+	connect(qtsSocket, SIGNAL(encrypted()), this, SLOT(socketEncrypted()));
 	connect(qtsSocket, SIGNAL(readyRead()), this, SLOT(socketRead()));
+	connect(qtsSocket, SIGNAL(bytesWritten(qint64)), this, SLOT(socketBytesWritten()));
+	connect(qtsSocket, SIGNAL(encryptedBytesWritten(qint64)), this, SLOT(socketBytesWritten()));
 	connect(qtsSocket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
 	connect(qtsSocket, SIGNAL(sslErrors(const QList< QSslError > &)), this,
 			SLOT(socketSslErrors(const QList< QSslError > &)));
-	qtLastPacket.restart();
-#ifdef Q_OS_WIN
-	dwFlow = 0;
-#endif
+
+	updateProperties();
 }
 
-Connection::~Connection() {
-#ifdef Q_OS_WIN
-	if (dwFlow && hQoS) {
-		if (!QOSRemoveSocketFromFlow(hQoS, 0, dwFlow, 0))
-			qWarning("Connection: Failed to remove flow from QoS");
-	}
-#endif
+void ConnectionSocket::setSslErrorFilter(const SslErrorFilter &filter) {
+	m_sslErrorFilter = filter;
 }
 
-void Connection::setToS() {
-#if defined(Q_OS_WIN)
-	if (dwFlow || !hQoS)
-		return;
+void ConnectionSocket::setMessageParser(const MessageParser &parser) {
+	m_messageParser = parser;
+}
 
-	dwFlow = 0;
-	if (!QOSAddSocketToFlow(hQoS, qtsSocket->socketDescriptor(), nullptr, QOSTrafficTypeAudioVideo,
-							QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&dwFlow)))
-		qWarning("Connection: Failed to add flow to QOS");
-#elif defined(Q_OS_UNIX)
-	int val = 0xa0;
-	if (setsockopt(static_cast< int >(qtsSocket->socketDescriptor()), IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
-		val = 0x60;
-		if (setsockopt(static_cast< int >(qtsSocket->socketDescriptor()), IPPROTO_IP, IP_TOS, &val, sizeof(val)))
-			qWarning("Connection: Failed to set TOS for TCP Socket");
-	}
-#	if defined(SO_PRIORITY)
-	socklen_t optlen = sizeof(val);
-	if (getsockopt(static_cast< int >(qtsSocket->socketDescriptor()), SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
-		if (val == 0) {
-			val = 6;
-			setsockopt(static_cast< int >(qtsSocket->socketDescriptor()), SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
-		}
-	}
-#	endif
+void ConnectionSocket::updateProperties() {
+	QMutexLocker l(&m_propertiesMutex);
 
+	// The documentation of QSslSocket::peerCertificateChain() actually says nothing
+	// about the order of the certificates in the chain. The sentence in the documentation
+	// of Connection::peerCertificateChain() is taken from QSslConfiguration::peerCertificateChain().
+	// Through tests and by looking into Qt's source code it was validated,
+	// that these two functions do the same thing.
+	// See mumble-voip/mumble#5280 for more information.
+	m_peerCertificateChain = qtsSocket->peerCertificateChain();
+	m_sessionCipher        = qtsSocket->sessionCipher();
+#if QT_VERSION >= 0x050400
+	m_sessionProtocol = qtsSocket->sessionProtocol();
+#else
+	m_sessionProtocol = QSsl::UnknownProtocol; // Cannot determine session cipher. We only know it's some TLS variant
 #endif
+	m_peerAddress      = qtsSocket->peerAddress();
+	m_peerPort         = qtsSocket->peerPort();
+	m_localAddress     = qtsSocket->localAddress();
+	m_localPort        = qtsSocket->localPort();
+	m_socketDescriptor = qtsSocket->socketDescriptor();
 }
 
-qint64 Connection::activityTime() const {
-	return qtLastPacket.elapsed();
+QList< QSslCertificate > ConnectionSocket::peerCertificateChain() const {
+	QMutexLocker l(&m_propertiesMutex);
+	return m_peerCertificateChain;
 }
 
-void Connection::resetActivityTime() {
-	qtLastPacket.restart();
+QSslCipher ConnectionSocket::sessionCipher() const {
+	QMutexLocker l(&m_propertiesMutex);
+	return m_sessionCipher;
+}
+
+QSsl::SslProtocol ConnectionSocket::sessionProtocol() const {
+	QMutexLocker l(&m_propertiesMutex);
+	return m_sessionProtocol;
+}
+
+QHostAddress ConnectionSocket::peerAddress() const {
+	QMutexLocker l(&m_propertiesMutex);
+	return m_peerAddress;
+}
+
+quint16 ConnectionSocket::peerPort() const {
+	QMutexLocker l(&m_propertiesMutex);
+	return m_peerPort;
+}
+
+QHostAddress ConnectionSocket::localAddress() const {
+	QMutexLocker l(&m_propertiesMutex);
+	return m_localAddress;
+}
+
+quint16 ConnectionSocket::localPort() const {
+	QMutexLocker l(&m_propertiesMutex);
+	return m_localPort;
+}
+
+qintptr ConnectionSocket::socketDescriptor() const {
+	QMutexLocker l(&m_propertiesMutex);
+	return m_socketDescriptor;
+}
+
+qint64 ConnectionSocket::unsentBytes() const {
+	return m_requestedBytes.load(std::memory_order_relaxed) + m_bufferedBytes.load(std::memory_order_relaxed);
+}
+
+void ConnectionSocket::addUnsentBytes(qint64 bytes) {
+	m_requestedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ConnectionSocket::socketBytesWritten() {
+	// The plain text waits for being encrypted, the encrypted data waits in the unbounded buffer of the underlying
+	// socket until the kernel accepts it, which it only does as fast as the peer reads
+	m_bufferedBytes.store(qtsSocket->bytesToWrite() + qtsSocket->encryptedBytesToWrite(), std::memory_order_relaxed);
 }
 
 /**
@@ -110,7 +146,7 @@ void Connection::resetActivityTime() {
  * @see void ServerHandler::message(unsigned int msgType, const QByteArray &qbaMsg)
  * @see void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *u)
  */
-void Connection::socketRead() {
+void ConnectionSocket::socketRead() {
 	while (true) {
 		qint64 iAvailable = qtsSocket->bytesAvailable();
 		if (iPacketLength == -1) {
@@ -138,24 +174,199 @@ void Connection::socketRead() {
 		iPacketLength        = -1;
 		iAvailable -= iPacketLength;
 
+		if (m_messageParser) {
+			std::shared_ptr< ::google::protobuf::Message > msg;
+			if (!m_messageParser(m_type, qbaBuffer, msg)) {
+				continue;
+			}
+
+			if (msg) {
+				emit parsedMessage(m_type, std::move(msg));
+				continue;
+			}
+		}
+
 		emit message(m_type, qbaBuffer);
 	}
 }
 
-void Connection::socketError(QAbstractSocket::SocketError err) {
+void ConnectionSocket::socketConnected() {
+	updateProperties();
+}
+
+void ConnectionSocket::socketEncrypted() {
+	updateProperties();
+
+	emit encrypted();
+}
+
+void ConnectionSocket::socketError(QAbstractSocket::SocketError err) {
 	emit connectionClosed(err, qtsSocket->errorString());
 }
 
-void Connection::socketSslErrors(const QList< QSslError > &qlErr) {
-	emit handleSslErrors(qlErr);
+void ConnectionSocket::socketSslErrors(const QList< QSslError > &qlErr) {
+	// Whoever handles the errors might want to have a look at the peer's certificate
+	updateProperties();
+
+	// The errors have to be ignored while this signal is being emitted, which is only possible in this thread
+	if (m_sslErrorFilter && m_sslErrorFilter(qlErr)) {
+		qtsSocket->ignoreSslErrors();
+	}
+
+	emit sslErrors(qlErr);
 }
 
-void Connection::proceedAnyway() {
+void ConnectionSocket::socketDisconnected() {
+	emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
+}
+
+void ConnectionSocket::write(const QByteArray &data) {
+	qtsSocket->write(data);
+
+	// The data is accounted for by the socket's buffers first, so that it is never missing from unsentBytes()
+	socketBytesWritten();
+	m_requestedBytes.fetch_sub(data.size(), std::memory_order_relaxed);
+}
+
+void ConnectionSocket::flush() {
+	if (qtsSocket->state() != QAbstractSocket::ConnectedState)
+		return;
+
+	if (!qtsSocket->isEncrypted())
+		return;
+
+	qtsSocket->flush();
+}
+
+void ConnectionSocket::disconnectSocket(bool force) {
+	if (qtsSocket->state() == QAbstractSocket::UnconnectedState) {
+		emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
+		return;
+	}
+
+	if (force)
+		qtsSocket->abort();
+	else
+		qtsSocket->disconnectFromHost();
+}
+
+void ConnectionSocket::ignoreSslErrors() {
 	qtsSocket->ignoreSslErrors();
 }
 
-void Connection::socketDisconnected() {
-	emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
+void ConnectionSocket::startServerEncryption() {
+	qtsSocket->startServerEncryption();
+}
+
+Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
+	bDisconnectedEmitted = false;
+	m_queuedBytes        = 0;
+	m_dropThreshold      = 0;
+	m_outputLimit        = 0;
+	m_outputOverflowed   = false;
+	csCrypt              = std::make_unique< CryptStateOCB2 >();
+
+	static bool bDeclared = false;
+	if (!bDeclared) {
+		bDeclared = true;
+		qRegisterMetaType< QAbstractSocket::SocketError >("QAbstractSocket::SocketError");
+		qRegisterMetaType< Mumble::Protocol::TCPMessageType >("Mumble::Protocol::TCPMessageType");
+		qRegisterMetaType< QList< QSslError > >("QList<QSslError>");
+		qRegisterMetaType< std::shared_ptr< ::google::protobuf::Message > >(
+			"std::shared_ptr<::google::protobuf::Message>");
+	}
+
+	m_socket = new ConnectionSocket(qtsSock, this);
+
+	connect(m_socket, &ConnectionSocket::encrypted, this, &Connection::encrypted);
+	connect(m_socket, &ConnectionSocket::connectionClosed, this, &Connection::connectionClosed);
+	connect(m_socket, &ConnectionSocket::message, this, &Connection::message);
+	connect(m_socket, &ConnectionSocket::parsedMessage, this, &Connection::parsedMessage);
+	connect(m_socket, &ConnectionSocket::sslErrors, this, &Connection::handleSslErrors);
+
+	connect(this, &Connection::socketWriteRequested, m_socket, &ConnectionSocket::write);
+	connect(this, &Connection::socketFlushRequested, m_socket, &ConnectionSocket::flush);
+	connect(this, &Connection::socketDisconnectRequested, m_socket, &ConnectionSocket::disconnectSocket);
+	connect(this, &Connection::socketIgnoreSslErrorsRequested, m_socket, &ConnectionSocket::ignoreSslErrors);
+	connect(this, &Connection::socketServerEncryptionRequested, m_socket, &ConnectionSocket::startServerEncryption);
+
+	qtLastPacket.restart();
+#ifdef Q_OS_WIN
+	dwFlow = 0;
+#endif
+}
+
+Connection::~Connection() {
+#ifdef Q_OS_WIN
+	if (dwFlow && hQoS) {
+		if (!QOSRemoveSocketFromFlow(hQoS, 0, dwFlow, 0))
+			qWarning("Connection: Failed to remove flow from QoS");
+	}
+#endif
+
+	// A socket living in another thread has to be deleted there. As it is no child of this object any more, it is
+	// released only after all operations that have been queued for it.
+	if (m_socket->parent() != this) {
+		m_socket->deleteLater();
+	}
+}
+
+void Connection::moveSocketToThread(QThread *thread) {
+	m_socket->setParent(nullptr);
+	m_socket->moveToThread(thread);
+}
+
+void Connection::setSslErrorFilter(const ConnectionSocket::SslErrorFilter &filter) {
+	m_socket->setSslErrorFilter(filter);
+}
+
+void Connection::setMessageParser(const ConnectionSocket::MessageParser &parser) {
+	m_socket->setMessageParser(parser);
+}
+
+void Connection::startServerEncryption() {
+	emit socketServerEncryptionRequested();
+}
+
+void Connection::setToS() {
+#if defined(Q_OS_WIN)
+	if (dwFlow || !hQoS)
+		return;
+
+	dwFlow = 0;
+	if (!QOSAddSocketToFlow(hQoS, m_socket->socketDescriptor(), nullptr, QOSTrafficTypeAudioVideo,
+							QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&dwFlow)))
+		qWarning("Connection: Failed to add flow to QOS");
+#elif defined(Q_OS_UNIX)
+	int val = 0xa0;
+	if (setsockopt(static_cast< int >(m_socket->socketDescriptor()), IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
+		val = 0x60;
+		if (setsockopt(static_cast< int >(m_socket->socketDescriptor()), IPPROTO_IP, IP_TOS, &val, sizeof(val)))
+			qWarning("Connection: Failed to set TOS for TCP Socket");
+	}
+#	if defined(SO_PRIORITY)
+	socklen_t optlen = sizeof(val);
+	if (getsockopt(static_cast< int >(m_socket->socketDescriptor()), SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
+		if (val == 0) {
+			val = 6;
+			setsockopt(static_cast< int >(m_socket->socketDescriptor()), SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+		}
+	}
+#	endif
+
+#endif
+}
+
+qint64 Connection::activityTime() const {
+	return qtLastPacket.elapsed();
+}
+
+void Connection::resetActivityTime() {
+	qtLastPacket.restart();
+}
+
+void Connection::proceedAnyway() {
+	emit socketIgnoreSslErrorsRequested();
 }
 
 void Connection::messageToNetwork(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
@@ -186,68 +397,131 @@ void Connection::sendMessage(const ::google::protobuf::Message &msg, Mumble::Pro
 }
 
 void Connection::sendMessage(const QByteArray &qbaMsg) {
-	if (!qbaMsg.isEmpty())
-		qtsSocket->write(qbaMsg);
-}
-
-void Connection::forceFlush() {
-	if (qtsSocket->state() != QAbstractSocket::ConnectedState)
+	if (qbaMsg.isEmpty() || m_outputOverflowed)
 		return;
 
-	if (!qtsSocket->isEncrypted())
+	if (m_outputLimit > 0 && unsentBytes() + qbaMsg.size() > m_outputLimit) {
+		overflowOutput();
 		return;
+	}
 
-	qtsSocket->flush();
+	if (!m_queuedMessages.isEmpty()) {
+		// The message must not overtake the queued ones
+		m_queuedMessages << qbaMsg;
+		m_queuedBytes += qbaMsg.size();
+		flushQueue();
+	} else {
+		writeToSocket(qbaMsg);
+	}
 }
 
-void Connection::disconnectSocket(bool force) {
-	if (qtsSocket->state() == QAbstractSocket::UnconnectedState) {
-		emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
+bool Connection::queueMessage(const QByteArray &qbaMsg, bool droppable) {
+	if (qbaMsg.isEmpty() || m_outputOverflowed)
+		return false;
+
+	const qint64 unsent = unsentBytes();
+
+	// Dropping voice in favor of everything else keeps the state of the peer consistent, while it is behind
+	if (droppable && m_dropThreshold > 0 && unsent > m_dropThreshold)
+		return false;
+
+	if (m_outputLimit > 0 && unsent + qbaMsg.size() > m_outputLimit) {
+		overflowOutput();
+		return false;
+	}
+
+	const bool wasEmpty = m_queuedMessages.isEmpty();
+
+	m_queuedMessages << qbaMsg;
+	m_queuedBytes += qbaMsg.size();
+
+	return wasEmpty;
+}
+
+void Connection::flushQueue() {
+	if (m_queuedMessages.isEmpty())
 		return;
+
+	if (m_queuedMessages.size() == 1) {
+		writeToSocket(m_queuedMessages.first());
+	} else {
+		// A single write results in as few TLS records as possible
+		QByteArray merged;
+		merged.reserve(static_cast< int >(m_queuedBytes));
+		for (const QByteArray &queued : m_queuedMessages) {
+			merged.append(queued);
+		}
+
+		writeToSocket(merged);
 	}
 
-	if (force)
-		qtsSocket->abort();
-	else
-		qtsSocket->disconnectFromHost();
+	m_queuedMessages.clear();
+	m_queuedBytes = 0;
+}
+
+void Connection::setOutputLimits(qint64 dropThreshold, qint64 limit) {
+	m_dropThreshold = dropThreshold;
+	m_outputLimit   = limit;
+}
+
+qint64 Connection::unsentBytes() const {
+	return m_socket->unsentBytes() + m_queuedBytes;
+}
+
+void Connection::writeToSocket(const QByteArray &data) {
+	m_socket->addUnsentBytes(data.size());
+
+	emit socketWriteRequested(data);
+}
+
+void Connection::overflowOutput() {
+	m_outputOverflowed = true;
+
+	m_queuedMessages.clear();
+	m_queuedBytes = 0;
+
+	// This may happen in the middle of a broadcast, which must not be interrupted by the connection being closed
+	QMetaObject::invokeMethod(m_socket, "disconnectSocket", Qt::QueuedConnection, Q_ARG(bool, true));
+}
+
+void Connection::forceFlush() {
+	flushQueue();
+
+	emit socketFlushRequested();
+}
+
+void Connection::disconnectSocket(bool force) {
+	flushQueue();
+
+	emit socketDisconnectRequested(force);
 }
 
 QHostAddress Connection::peerAddress() const {
-	return qtsSocket->peerAddress();
+	return m_socket->peerAddress();
 }
 
 quint16 Connection::peerPort() const {
-	return qtsSocket->peerPort();
+	return m_socket->peerPort();
 }
 
 QHostAddress Connection::localAddress() const {
-	return qtsSocket->localAddress();
+	return m_socket->localAddress();
 }
 
 quint16 Connection::localPort() const {
-	return qtsSocket->localPort();
+	return m_socket->localPort();
 }
 
 QList< QSslCertificate > Connection::peerCertificateChain() const {
-	// The documentation of QSslSocket::peerCertificateChain() actually says nothing
-	// about the order of the certificates in the chain. The sentence in this functions
-	// documentation is taken from QSslConfiguration::peerCertificateChain().
-	// Through tests and by looking into Qt's source code it was validated,
-	// that these two functions do the same thing.
-	// See mumble-voip/mumble#5280 for more information.
-	return qtsSocket->peerCertificateChain();
+	return m_socket->peerCertificateChain();
 }
 
 QSslCipher Connection::sessionCipher() const {
-	return qtsSocket->sessionCipher();
+	return m_socket->sessionCipher();
 }
 
 QSsl::SslProtocol Connection::sessionProtocol() const {
-#if QT_VERSION >= 0x050400
-	return qtsSocket->sessionProtocol();
-#else
-	return QSsl::UnknownProtocol; // Cannot determine session cipher. We only know it's some TLS variant
-#endif
+	return m_socket->sessionProtocol();
 }
 
 QString Connection::sessionProtocolString() const {
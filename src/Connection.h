@@ -22,6 +22,9 @@
 #include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtNetwork/QSslSocket>
+
+#include <atomic>
+#include <functional>
 #include <memory>
 
 #ifdef Q_OS_WIN
@@ -34,40 +37,170 @@ namespace protobuf {
 }
 } // namespace google
 
-class Connection : public QObject {
+Q_DECLARE_METATYPE(std::shared_ptr< ::google::protobuf::Message >)
+
+class QThread;
+
+/// Performs the I/O on the socket of a Connection: It splits the incoming data into messages (and parses them, if
+/// a parser has been set), writes the outgoing data and forwards the state changes of the socket. It always lives in
+/// the thread of the socket, which doesn't have to be the thread of the Connection (see
+/// Connection::moveSocketToThread).
+class ConnectionSocket : public QObject {
 private:
 	Q_OBJECT
-	Q_DISABLE_COPY(Connection)
+	Q_DISABLE_COPY(ConnectionSocket)
+public:
+	/// Decides whether the handshake may proceed despite the given errors
+	using SslErrorFilter = std::function< bool(const QList< QSslError > &) >;
+	/// Parses a message into the given pointer. Returns false if the message is invalid and has to be dropped.
+	/// Messages the parser leaves null are passed on unparsed.
+	using MessageParser = std::function< bool(Mumble::Protocol::TCPMessageType, const QByteArray &,
+											  std::shared_ptr< ::google::protobuf::Message > &) >;
+
+	ConnectionSocket(QSslSocket *qtsSocket, QObject *parent);
+
+	/// Sets the filter that is asked about SSL errors in the thread of the socket. Errors that the filter accepts are
+	/// ignored before handleSslErrors is emitted. Has to be set before the handshake starts.
+	void setSslErrorFilter(const SslErrorFilter &filter);
+	/// Sets the parser that the incoming messages are passed through in the thread of the socket. The messages it
+	/// parses are emitted by parsedMessage instead of message. Has to be set before any data is read.
+	void setMessageParser(const MessageParser &parser);
+
+	QList< QSslCertificate > peerCertificateChain() const;
+	QSslCipher sessionCipher() const;
+	QSsl::SslProtocol sessionProtocol() const;
+	QHostAddress peerAddress() const;
+	quint16 peerPort() const;
+	QHostAddress localAddress() const;
+	quint16 localPort() const;
+	qintptr socketDescriptor() const;
+
+	/// @returns The amount of data that has been requested to be written, but hasn't been written to the network yet
+	qint64 unsentBytes() const;
+	/// Accounts for data that is about to be passed to write(). May be called from any thread.
+	void addUnsentBytes(qint64 bytes);
+
 protected:
 	QSslSocket *qtsSocket;
-	QElapsedTimer qtLastPacket;
 	Mumble::Protocol::TCPMessageType m_type;
 	int iPacketLength;
-#ifdef Q_OS_WIN
-	static HANDLE hQoS;
-	DWORD dwFlow;
-#endif
+	SslErrorFilter m_sslErrorFilter;
+	MessageParser m_messageParser;
+
+	/// Protects the copies of the socket's properties below, which may be read from any thread
+	mutable QMutex m_propertiesMutex;
+	QList< QSslCertificate > m_peerCertificateChain;
+	QSslCipher m_sessionCipher;
+	QSsl::SslProtocol m_sessionProtocol;
+	QHostAddress m_peerAddress;
+	quint16 m_peerPort;
+	QHostAddress m_localAddress;
+	quint16 m_localPort;
+	qintptr m_socketDescriptor;
+
+	/// The data that has been accounted for by addUnsentBytes(), but hasn't reached write() yet
+	std::atomic< qint64 > m_requestedBytes;
+	/// The data waiting in the buffers of the socket, both before and after encryption. QSslSocket::bytesWritten() is
+	/// emitted as soon as data has been encrypted, so it alone doesn't tell whether the peer keeps up with reading.
+	std::atomic< qint64 > m_bufferedBytes;
+
+	/// Copies the current properties of the socket
+	void updateProperties();
 protected slots:
 	void socketRead();
+	/// Updates m_bufferedBytes from the socket
+	void socketBytesWritten();
+	void socketConnected();
+	void socketEncrypted();
 	void socketError(QAbstractSocket::SocketError);
 	void socketDisconnected();
 	void socketSslErrors(const QList< QSslError > &errors);
+public slots:
+	void write(const QByteArray &data);
+	void flush();
+	void disconnectSocket(bool force);
+	void ignoreSslErrors();
+	void startServerEncryption();
+signals:
+	void encrypted();
+	void connectionClosed(QAbstractSocket::SocketError, const QString &reason);
+	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &);
+	void parsedMessage(Mumble::Protocol::TCPMessageType type, std::shared_ptr< ::google::protobuf::Message > msg);
+	void sslErrors(const QList< QSslError > &);
+};
+
+class Connection : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(Connection)
+protected:
+	ConnectionSocket *m_socket;
+	QElapsedTimer qtLastPacket;
+	/// Serialised messages waiting to be sent. Broadcasts share their data between the queues of all receivers.
+	QList< QByteArray > m_queuedMessages;
+	qint64 m_queuedBytes;
+	/// The amount of unsent data above which droppable messages are dropped instead of queued (0 to never drop them)
+	qint64 m_dropThreshold;
+	/// The amount of unsent data above which the connection is dropped (0 for no limit)
+	qint64 m_outputLimit;
+	/// Whether the connection is being dropped for exceeding m_outputLimit
+	bool m_outputOverflowed;
+
+	void writeToSocket(const QByteArray &data);
+	/// Drops the connection, as the peer doesn't keep up with reading the data sent to it
+	void overflowOutput();
+#ifdef Q_OS_WIN
+	static HANDLE hQoS;
+	DWORD dwFlow;
+#endif
 public slots:
 	void proceedAnyway();
 signals:
 	void encrypted();
 	void connectionClosed(QAbstractSocket::SocketError, const QString &reason);
 	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &);
+	/// @see ConnectionSocket::setMessageParser
+	void parsedMessage(Mumble::Protocol::TCPMessageType type, std::shared_ptr< ::google::protobuf::Message > msg);
 	void handleSslErrors(const QList< QSslError > &);
 
+	// Hand the operations on the socket to the ConnectionSocket. These are queued, if it lives in another thread.
+	void socketWriteRequested(const QByteArray &data);
+	void socketFlushRequested();
+	void socketDisconnectRequested(bool force);
+	void socketIgnoreSslErrorsRequested();
+	void socketServerEncryptionRequested();
+
 public:
 	Connection(QObject *parent, QSslSocket *qtsSocket);
 	~Connection();
+	/// Moves the socket into the given thread, which from then on performs all I/O of this connection. All
+	/// operations on the socket are queued from then on.
+	void moveSocketToThread(QThread *thread);
+	/// @see ConnectionSocket::setSslErrorFilter
+	void setSslErrorFilter(const ConnectionSocket::SslErrorFilter &filter);
+	/// @see ConnectionSocket::setMessageParser
+	void setMessageParser(const ConnectionSocket::MessageParser &parser);
+	void startServerEncryption();
 	static void messageToNetwork(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
 								 QByteArray &cache);
 	void sendMessage(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
 					 QByteArray &cache);
 	void sendMessage(const QByteArray &qbaMsg);
+	/// Queues the given serialised message. The queued messages are sent all at once by flushQueue(), or before the
+	/// next message that is sent directly.
+	///
+	/// @param droppable Whether the message may be dropped if the peer doesn't keep up with reading (e.g. voice)
+	/// @returns Whether the message has been queued into a queue that has been empty before
+	bool queueMessage(const QByteArray &qbaMsg, bool droppable = false);
+	/// Sends all queued messages with a single write
+	void flushQueue();
+	/// Sets the limits on the amount of data that has been sent, but not yet written to the network
+	///
+	/// @param dropThreshold The amount above which droppable messages are dropped (0 to never drop them)
+	/// @param limit The amount above which the connection is dropped (0 for no limit)
+	void setOutputLimits(qint64 dropThreshold, qint64 limit);
+	/// @returns The amount of data that has been sent or queued, but not yet written to the network
+	qint64 unsentBytes() const;
 	void disconnectSocket(bool force = false);
 	void forceFlush();
 	qint64 activityTime() const;
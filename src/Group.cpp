@@ -11,6 +11,8 @@
 #	include "ServerUser.h"
 
 #	include <QtCore/QStack>
+
+#	include <utility>
 #endif
 
 const Qt::CaseSensitivity Group::accessTokenCaseSensitivity = Qt::CaseInsensitive;
@@ -98,27 +100,21 @@ QSet< QString > Group::groupNames(Channel *chan) {
 	return m;
 }
 
-#	define RET_FALSE (invert ? true : false)
-#	define RET_TRUE (invert ? false : true)
-
-bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChannel, QString groupSpecification,
-						  const ServerUser &user) {
-	bool matches                  = false;
-	bool invert                   = false;
-	bool isAccessToken            = false;
-	bool isCertHash               = false;
-	const Channel *contextChannel = &currentChannel;
+Group::Specification Group::Specification::parse(QString groupSpecification) {
+	Specification specification;
+	bool isAccessToken = false;
+	bool isCertHash    = false;
 
 	while (!groupSpecification.isEmpty()) {
 		if (groupSpecification.startsWith(QChar::fromLatin1('!'))) {
-			invert             = true;
-			groupSpecification = groupSpecification.remove(0, 1);
+			specification.invert = true;
+			groupSpecification   = groupSpecification.remove(0, 1);
 			continue;
 		}
 
 		if (groupSpecification.startsWith(QChar::fromLatin1('~'))) {
-			contextChannel     = &aclChannel;
-			groupSpecification = groupSpecification.remove(0, 1);
+			specification.aclContext = true;
+			groupSpecification       = groupSpecification.remove(0, 1);
 			continue;
 		}
 
@@ -137,116 +133,175 @@ bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChann
 	}
 
 	if (groupSpecification.isEmpty()) {
-		return false;
+		return specification;
 	}
 
+	specification.name = groupSpecification;
 
 	// First, all special cases that aren't even groups and meta groups (groups that don't actually exist as groups but
 	// have a special meaning based on their name
-	if (isAccessToken)
-		matches = user.qslAccessTokens.contains(groupSpecification, Group::accessTokenCaseSensitivity);
-	else if (isCertHash)
-		matches = user.qsHash == groupSpecification;
-	else if (groupSpecification == QLatin1String("none"))
-		matches = false;
-	else if (groupSpecification == QLatin1String("all"))
-		matches = true;
-	else if (groupSpecification == QLatin1String("auth"))
-		matches = (user.iId >= 0);
-	else if (groupSpecification == QLatin1String("strong"))
-		matches = user.bVerified;
-	else if (groupSpecification == QLatin1String("in"))
-		matches = (user.cChannel == contextChannel);
-	else if (groupSpecification == QLatin1String("out"))
-		matches = !(user.cChannel == contextChannel);
-	else if (groupSpecification == QLatin1String("sub") || groupSpecification.startsWith(QLatin1String("sub,"))) {
-		groupSpecification = groupSpecification.remove(0, 4);
-
-		int requiredChannelOffset = 0;
-		int minDescendantLevel    = 1;
-		int maxDescendantLevel    = 1000;
+	if (isAccessToken) {
+		specification.type = Type::AccessToken;
+	} else if (isCertHash) {
+		specification.type = Type::CertHash;
+	} else if (groupSpecification == QLatin1String("none")) {
+		specification.type = Type::None;
+	} else if (groupSpecification == QLatin1String("all")) {
+		specification.type = Type::All;
+	} else if (groupSpecification == QLatin1String("auth")) {
+		specification.type = Type::Auth;
+	} else if (groupSpecification == QLatin1String("strong")) {
+		specification.type = Type::Strong;
+	} else if (groupSpecification == QLatin1String("in")) {
+		specification.type = Type::In;
+	} else if (groupSpecification == QLatin1String("out")) {
+		specification.type = Type::Out;
+	} else if (groupSpecification == QLatin1String("sub") || groupSpecification.startsWith(QLatin1String("sub,"))) {
+		specification.type = Type::Sub;
 
 		// Parse arguments, if any
-		QStringList args = groupSpecification.split(QLatin1String(","));
+		QStringList args = groupSpecification.remove(0, 4).split(QLatin1String(","));
 		if (args.count() >= 1 && !args[0].isEmpty()) {
-			requiredChannelOffset = args[0].toInt();
+			specification.subOffset = args[0].toInt();
 		}
 		if (args.count() >= 2 && !args[1].isEmpty()) {
-			minDescendantLevel = args[1].toInt();
+			specification.subMinLevel = args[1].toInt();
 		}
 		if (args.count() >= 3 && !args[2].isEmpty()) {
-			maxDescendantLevel = args[2].toInt();
+			specification.subMaxLevel = args[2].toInt();
 		}
+	} else {
+		// The group specification is an actual group name
+		specification.type = Type::Named;
+	}
 
-		// Assemble channel hierarchy from root channel to the channel the player is currently in
-		QList< const Channel * > homeChannelHierarchy;
-		const Channel *channel = user.cChannel;
-		while (channel) {
-			homeChannelHierarchy.prepend(channel);
-			channel = channel->cParent;
-		}
+	return specification;
+}
 
-		// Assemble channel hierarchy from root channel to the channel the ACL containing this specification is
-		// evaluated for
-		QList< const Channel * > currentChannelHierarchy;
-		channel = &currentChannel;
-		while (channel) {
-			currentChannelHierarchy.prepend(channel);
-			channel = channel->cParent;
-		}
+bool Group::contains(const ServerUser &user, bool inherited) const {
+	if (qsRemove.contains(user.iId)) {
+		return false;
+	}
 
-		int requiredChannelIndex = currentChannelHierarchy.indexOf(contextChannel);
-		Q_ASSERT(requiredChannelIndex != -1);
+	return inherited || qsAdd.contains(user.iId) || qsTemporary.contains(user.iId)
+		   || qsTemporary.contains(-static_cast< int >(user.uiSession));
+}
 
-		requiredChannelIndex += requiredChannelOffset;
+bool Group::isMember(const Channel &channel, const QString &name, const ServerUser &user) {
+	QStack< const Group * > groupStack;
 
-		if (requiredChannelIndex >= currentChannelHierarchy.count()) {
-			return RET_FALSE;
-		} else if (requiredChannelIndex < 0) {
-			requiredChannelIndex = 0;
-		}
+	const Channel *current = &channel;
+
+	while (current) {
+		const Group *group = current->qhGroups.value(name);
 
-		const Channel *requiredChannel = currentChannelHierarchy[requiredChannelIndex];
-		if (homeChannelHierarchy.indexOf(requiredChannel) == -1) {
-			return RET_FALSE;
+		if (group) {
+			if ((current != &channel) && !group->bInheritable)
+				break;
+			groupStack.push(group);
+			if (!group->bInherit)
+				break;
 		}
 
-		const int minDepth = requiredChannelIndex + minDescendantLevel;
-		const int maxDepth = requiredChannelIndex + maxDescendantLevel;
+		current = current->cParent;
+	}
+
+	bool member = false;
+	while (!groupStack.isEmpty()) {
+		member = groupStack.pop()->contains(user, member);
+	}
 
-		const int totalDepth = homeChannelHierarchy.count() - 1;
+	return member;
+}
 
-		matches = (totalDepth >= minDepth) && (totalDepth <= maxDepth);
-	} else {
-		// The group specification is an actual group name
-		QStack< const Group * > groupStack;
+bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChannel, QString groupSpecification,
+						  const ServerUser &user) {
+	return appliesToUser(currentChannel, aclChannel, Specification::parse(std::move(groupSpecification)), user);
+}
 
-		const Channel *channel = contextChannel;
+bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChannel,
+						  const Specification &specification, const ServerUser &user) {
+	const Channel *contextChannel = specification.aclContext ? &aclChannel : &currentChannel;
+	bool matches                  = false;
 
-		while (channel) {
-			const Group *group = channel->qhGroups.value(groupSpecification);
+	switch (specification.type) {
+		case Specification::Type::Empty:
+			// Not even inverting an empty specification makes it match
+			return false;
+		case Specification::Type::AccessToken:
+			matches = user.qslAccessTokens.contains(specification.name, Group::accessTokenCaseSensitivity);
+			break;
+		case Specification::Type::CertHash:
+			matches = user.qsHash == specification.name;
+			break;
+		case Specification::Type::None:
+			matches = false;
+			break;
+		case Specification::Type::All:
+			matches = true;
+			break;
+		case Specification::Type::Auth:
+			matches = (user.iId >= 0);
+			break;
+		case Specification::Type::Strong:
+			matches = user.bVerified;
+			break;
+		case Specification::Type::In:
+			matches = (user.cChannel == contextChannel);
+			break;
+		case Specification::Type::Out:
+			matches = !(user.cChannel == contextChannel);
+			break;
+		case Specification::Type::Sub: {
+			// Assemble channel hierarchy from root channel to the channel the player is currently in
+			QList< const Channel * > homeChannelHierarchy;
+			const Channel *channel = user.cChannel;
+			while (channel) {
+				homeChannelHierarchy.prepend(channel);
+				channel = channel->cParent;
+			}
 
-			if (group) {
-				if ((channel != contextChannel) && !group->bInheritable)
-					break;
-				groupStack.push(group);
-				if (!group->bInherit)
-					break;
+			// Assemble channel hierarchy from root channel to the channel the ACL containing this specification is
+			// evaluated for
+			QList< const Channel * > currentChannelHierarchy;
+			channel = &currentChannel;
+			while (channel) {
+				currentChannelHierarchy.prepend(channel);
+				channel = channel->cParent;
 			}
 
-			channel = channel->cParent;
-		}
+			int requiredChannelIndex = currentChannelHierarchy.indexOf(contextChannel);
+			Q_ASSERT(requiredChannelIndex != -1);
 
-		while (!groupStack.isEmpty()) {
-			const Group *group = groupStack.pop();
-			if (group->qsAdd.contains(user.iId) || group->qsTemporary.contains(user.iId)
-				|| group->qsTemporary.contains(-static_cast< int >(user.uiSession)))
-				matches = true;
-			if (group->qsRemove.contains(user.iId))
+			requiredChannelIndex += specification.subOffset;
+
+			if (requiredChannelIndex >= currentChannelHierarchy.count()) {
+				matches = false;
+				break;
+			} else if (requiredChannelIndex < 0) {
+				requiredChannelIndex = 0;
+			}
+
+			const Channel *requiredChannel = currentChannelHierarchy[requiredChannelIndex];
+			if (homeChannelHierarchy.indexOf(requiredChannel) == -1) {
 				matches = false;
+				break;
+			}
+
+			const int minDepth = requiredChannelIndex + specification.subMinLevel;
+			const int maxDepth = requiredChannelIndex + specification.subMaxLevel;
+
+			const int totalDepth = homeChannelHierarchy.count() - 1;
+
+			matches = (totalDepth >= minDepth) && (totalDepth <= maxDepth);
+			break;
 		}
+		case Specification::Type::Named:
+			matches = isMember(*contextChannel, specification.name, user);
+			break;
 	}
-	return invert ? !matches : matches;
+
+	return specification.invert ? !matches : matches;
 }
 
 #endif
@@ -7,6 +7,7 @@
 #define MUMBLE_GROUP_H_
 
 #include <QtCore/QSet>
+#include <QtCore/QString>
 
 class Channel;
 class User;
@@ -29,12 +30,41 @@ public:
 	Group(Channel *assoc, const QString &name);
 
 #ifdef MURMUR
+	/// A group specification (e.g. "admin", "!~in" or "#token") broken up into its components, such that it doesn't
+	/// have to be parsed again every time it is evaluated
+	struct Specification {
+		enum class Type { Empty, None, All, Auth, Strong, In, Out, Sub, AccessToken, CertHash, Named };
+
+		Type type   = Type::Empty;
+		bool invert = false;
+		/// Whether the specification is evaluated in the context of the channel the ACL is defined in (~) instead
+		/// of the channel the permissions are evaluated for
+		bool aclContext = false;
+		/// The group name, access token or certificate hash
+		QString name;
+		/// The arguments of the "sub" meta group
+		int subOffset   = 0;
+		int subMinLevel = 1;
+		int subMaxLevel = 1000;
+
+		static Specification parse(QString groupSpecification);
+	};
+
 	QSet< int > members();
 	static QSet< QString > groupNames(Channel *c);
 	static Group *getGroup(Channel *c, QString name);
 
+	/// @returns Whether the given user is a member of this group
+	///
+	/// @param inherited Whether the user is a member of the group this one inherits from
+	bool contains(const ServerUser &user, bool inherited) const;
+	/// @returns Whether the given user is a member of the group with the given name, as seen from the given channel
+	static bool isMember(const Channel &channel, const QString &name, const ServerUser &user);
+
 	static bool appliesToUser(const Channel &currentChannel, const Channel &aclChannel, QString groupSpecification,
 							  const ServerUser &user);
+	static bool appliesToUser(const Channel &currentChannel, const Channel &aclChannel,
+							  const Specification &specification, const ServerUser &user);
 #endif
 };
 
@@ -59,6 +59,209 @@ namespace Protocol {
 		return serializedSize;
 	}
 
+	namespace {
+		// Wire types and field numbers of the Protobuf encoding of MumbleUDP::Audio. Audio packets are encoded and
+		// decoded by hand, as going through the generated message for every packet (and every receiver) doesn't come
+		// for free. See https://developers.google.com/protocol-buffers/docs/encoding
+		enum class WireType : byte { Varint = 0, Fixed64 = 1, LengthDelimited = 2, Fixed32 = 5 };
+
+		namespace AudioField {
+			constexpr unsigned int TARGET            = 1;
+			constexpr unsigned int CONTEXT           = 2;
+			constexpr unsigned int SENDER_SESSION    = 3;
+			constexpr unsigned int FRAME_NUMBER      = 4;
+			constexpr unsigned int OPUS_DATA         = 5;
+			constexpr unsigned int POSITIONAL_DATA   = 6;
+			constexpr unsigned int VOLUME_ADJUSTMENT = 7;
+			constexpr unsigned int IS_TERMINATOR     = 16;
+		} // namespace AudioField
+
+		/**
+		 * Writes Protobuf fields in wire format to a buffer of fixed size. Just as the generated code for proto3
+		 * messages does, fields that are set to their default value are omitted (unless they are part of a oneof).
+		 */
+		class WireWriter {
+		public:
+			WireWriter(byte *buffer, std::size_t capacity) : m_buffer(buffer), m_capacity(capacity) {}
+
+			void writeVarint(std::uint64_t value) {
+				do {
+					byte current = static_cast< byte >(value & 0x7f);
+					value >>= 7;
+					if (value != 0) {
+						current |= 0x80;
+					}
+
+					writeByte(current);
+				} while (value != 0);
+			}
+
+			void writeTag(unsigned int field, WireType type) {
+				writeVarint((static_cast< std::uint64_t >(field) << 3) | static_cast< byte >(type));
+			}
+
+			void writeVarintField(unsigned int field, std::uint64_t value, bool omitDefault = true) {
+				if (value != 0 || !omitDefault) {
+					writeTag(field, WireType::Varint);
+					writeVarint(value);
+				}
+			}
+
+			void writeFloat(float value) {
+				std::uint32_t bits;
+				std::memcpy(&bits, &value, sizeof(bits));
+
+				for (unsigned int i = 0; i < sizeof(bits); ++i) {
+					writeByte(static_cast< byte >(bits >> (8 * i)));
+				}
+			}
+
+			void writeFloatField(unsigned int field, float value) {
+				if (value != 0.0f) {
+					writeTag(field, WireType::Fixed32);
+					writeFloat(value);
+				}
+			}
+
+			void writeBytesField(unsigned int field, gsl::span< const byte > value) {
+				if (value.empty()) {
+					return;
+				}
+
+				writeTag(field, WireType::LengthDelimited);
+				writeVarint(value.size());
+
+				if (m_size + value.size() > m_capacity) {
+					m_valid = false;
+					return;
+				}
+
+				std::memcpy(m_buffer + m_size, value.data(), value.size());
+				m_size += value.size();
+			}
+
+			/// Writes the given floats as a packed repeated field
+			void writePackedFloatField(unsigned int field, gsl::span< const float > values) {
+				writeTag(field, WireType::LengthDelimited);
+				writeVarint(values.size() * sizeof(float));
+
+				for (float current : values) {
+					writeFloat(current);
+				}
+			}
+
+			std::size_t size() const { return m_size; }
+			bool isValid() const { return m_valid; }
+
+		protected:
+			byte *m_buffer;
+			std::size_t m_capacity;
+			std::size_t m_size = 0;
+			bool m_valid       = true;
+
+			void writeByte(byte value) {
+				if (m_size >= m_capacity) {
+					m_valid = false;
+					return;
+				}
+
+				m_buffer[m_size++] = value;
+			}
+		};
+
+		/**
+		 * Reads Protobuf fields in wire format. Length-delimited fields are returned as views into the read data.
+		 */
+		class WireReader {
+		public:
+			explicit WireReader(gsl::span< const byte > data) : m_data(data) {}
+
+			bool atEnd() const { return m_offset >= m_data.size(); }
+
+			bool readVarint(std::uint64_t &value) {
+				value = 0;
+
+				for (unsigned int shift = 0; shift < 64; shift += 7) {
+					if (atEnd()) {
+						return false;
+					}
+
+					const byte current = m_data[m_offset++];
+					value |= static_cast< std::uint64_t >(current & 0x7f) << shift;
+
+					if (!(current & 0x80)) {
+						return true;
+					}
+				}
+
+				// Varints are at most 10 bytes long
+				return false;
+			}
+
+			bool readFixed32(std::uint32_t &value) {
+				if (m_data.size() - m_offset < sizeof(value)) {
+					return false;
+				}
+
+				value = 0;
+				for (unsigned int i = 0; i < sizeof(value); ++i) {
+					value |= static_cast< std::uint32_t >(m_data[m_offset++]) << (8 * i);
+				}
+
+				return true;
+			}
+
+			bool readFloat(float &value) {
+				std::uint32_t bits;
+				if (!readFixed32(bits)) {
+					return false;
+				}
+
+				std::memcpy(&value, &bits, sizeof(value));
+
+				return true;
+			}
+
+			bool readLengthDelimited(gsl::span< const byte > &value) {
+				std::uint64_t length;
+				if (!readVarint(length) || length > m_data.size() - m_offset) {
+					return false;
+				}
+
+				value = m_data.subspan(m_offset, static_cast< std::size_t >(length));
+				m_offset += static_cast< std::size_t >(length);
+
+				return true;
+			}
+
+			/// Skips the value of a field of the given wire type
+			bool skip(byte type) {
+				std::uint64_t varint;
+				std::uint32_t fixed32;
+				gsl::span< const byte > bytes;
+
+				switch (static_cast< WireType >(type)) {
+					case WireType::Varint:
+						return readVarint(varint);
+					case WireType::Fixed64:
+						return readFixed32(fixed32) && readFixed32(fixed32);
+					case WireType::LengthDelimited:
+						return readLengthDelimited(bytes);
+					case WireType::Fixed32:
+						return readFixed32(fixed32);
+				}
+
+				// Groups are deprecated and not used by any of our messages
+				return false;
+			}
+
+		protected:
+			gsl::span< const byte > m_data;
+			std::size_t m_offset = 0;
+		};
+	} // namespace
+
+
 	template< Role role >
 	ProtocolHandler< role >::ProtocolHandler(Version::full_t protocolVersion) : m_protocolVersion(protocolVersion) {}
 
@@ -234,20 +437,29 @@ namespace Protocol {
 		// once in wire-format), which avoids having to re-encode the entire message.
 		// This is mainly important on the server-side.
 
-		m_audioMessage.Clear();
+		m_byteBuffer.resize(MAX_UDP_PACKET_SIZE);
+		m_byteBuffer[0] = static_cast< byte >(UDPMessageType::Audio);
+
+		// The fields are written in the order of their numbers, which is what Protobuf does as well
+		WireWriter writer(m_byteBuffer.data() + 1, m_byteBuffer.size() - 1);
 
 		if (this->getRole() == Role::Server) {
-			m_audioMessage.set_sender_session(data.senderSession);
+			writer.writeVarintField(AudioField::SENDER_SESSION, data.senderSession);
 		}
 
-		m_audioMessage.set_frame_number(data.frameNumber);
-		m_audioMessage.set_opus_data(data.payload.data(), data.payload.size());
-		m_audioMessage.set_is_terminator(data.isLastFrame);
+		writer.writeVarintField(AudioField::FRAME_NUMBER, data.frameNumber);
+		writer.writeBytesField(AudioField::OPUS_DATA, data.payload);
+		writer.writeVarintField(AudioField::IS_TERMINATOR, data.isLastFrame);
+
+		if (writer.isValid()) {
+			// +1 to account for the header byte
+			m_staticPartSize = writer.size() + 1;
+		} else {
+			qWarning("MumbleProtocol: Encoding audio packet (fixed part) overflowed buffer size");
+			m_staticPartSize = 0;
+		}
 
-		// +1 to account for the header byte set below
-		m_staticPartSize      = encodeProtobuf(m_audioMessage, m_byteBuffer, 1, MAX_UDP_PACKET_SIZE, false) + 1;
 		m_positionalAudioSize = m_staticPartSize;
-		m_byteBuffer[0]       = static_cast< byte >(UDPMessageType::Audio);
 	}
 
 	std::size_t writeSnippet(gsl::span< const byte > source, std::vector< byte > &destination, std::size_t offset,
@@ -258,7 +470,7 @@ namespace Protocol {
 					 maxPacketSize, offset + source.size());
 			return 0;
 		}
-		destination.resize(offset + source.size());
+		assert(destination.size() >= offset + source.size());
 
 		std::memcpy(destination.data() + offset, source.data(), source.size());
 
@@ -277,12 +489,16 @@ namespace Protocol {
 
 		switch (this->getRole()) {
 			case Role::Client: {
-				m_audioMessage.Clear();
-				m_audioMessage.set_target(data.targetOrContext);
+				WireWriter writer(m_byteBuffer.data() + offset, m_byteBuffer.size() - offset);
+				// The target is part of a oneof and thus is written even if it is zero
+				writer.writeVarintField(AudioField::TARGET, data.targetOrContext, false);
 
-				offset += encodeProtobuf(m_audioMessage, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE, false);
+				if (!writer.isValid()) {
+					qWarning("MumbleProtocol: Encoding audio packet (variable part) overflowed buffer size");
+					return {};
+				}
 
-				return { m_byteBuffer.data(), offset };
+				return { m_byteBuffer.data(), offset + writer.size() };
 			}
 			case Role::Server: {
 				if (data.volumeAdjustment.factor != 1.0f) {
@@ -292,10 +508,10 @@ namespace Protocol {
 						offset += writeSnippet(buffer, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE);
 					} else {
 						// No pre-encoded snippet found -> use explicit encoding
-						m_audioMessage.Clear();
-						m_audioMessage.set_volume_adjustment(data.volumeAdjustment.factor);
+						WireWriter writer(m_byteBuffer.data() + offset, m_byteBuffer.size() - offset);
+						writer.writeFloatField(AudioField::VOLUME_ADJUSTMENT, data.volumeAdjustment.factor);
 
-						offset += encodeProtobuf(m_audioMessage, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE, false);
+						offset += writer.isValid() ? writer.size() : 0;
 					}
 				}
 
@@ -305,10 +521,10 @@ namespace Protocol {
 					offset += writeSnippet(buffer, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE);
 				} else {
 					// No pre-encoded snippet found -> use explicit encoding
-					m_audioMessage.Clear();
-					m_audioMessage.set_context(data.targetOrContext);
+					WireWriter writer(m_byteBuffer.data() + offset, m_byteBuffer.size() - offset);
+					writer.writeVarintField(AudioField::CONTEXT, data.targetOrContext, false);
 
-					offset += encodeProtobuf(m_audioMessage, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE, false);
+					offset += writer.isValid() ? writer.size() : 0;
 				}
 
 				return { m_byteBuffer.data(), offset };
@@ -322,57 +538,55 @@ namespace Protocol {
 
 	template< Role role > void UDPAudioEncoder< role >::addPositionalData_protobuf(const AudioData &data) {
 		if (data.containsPositionalData) {
-			m_audioMessage.Clear();
+			WireWriter writer(m_byteBuffer.data() + m_staticPartSize, m_byteBuffer.size() - m_staticPartSize);
+			writer.writePackedFloatField(AudioField::POSITIONAL_DATA, data.position);
 
-			for (unsigned int i = 0; i < 3; ++i) {
-				m_audioMessage.add_positional_data(data.position[i]);
+			if (writer.isValid()) {
+				m_positionalAudioSize = m_staticPartSize + writer.size();
+			} else {
+				qWarning("MumbleProtocol: Adding positional data to audio packet overflowed buffer size");
+				m_positionalAudioSize = m_staticPartSize;
 			}
-
-			m_positionalAudioSize =
-				m_staticPartSize
-				+ encodeProtobuf(m_audioMessage, m_byteBuffer, m_staticPartSize, MAX_UDP_PACKET_SIZE, false);
 		}
 	}
 
 	template< Role role > void UDPAudioEncoder< role >::preparePreEncodedSnippets() {
-		m_audioMessage.Clear();
-
 		static_assert(AudioContext::BEGIN == 0, "AudioContext::BEGIN is not zero (breaks assumption)");
 		static_assert(AudioContext::END > 0, "AudioContext::END is not positive (breaks assumption)");
 		m_preEncodedContext.resize(AudioContext::END);
 
 		// Pre-encode the expected voice audio contexts.
 		for (audio_context_t current = AudioContext::BEGIN; current < AudioContext::END; ++current) {
-			m_audioMessage.set_context(current);
+			std::vector< byte > &snippet = m_preEncodedContext[current];
 
 			// The max size of the properly encoded package is the size of the used field type (uint32) plus 1 byte
 			// overhead for the varint-encoding plus 1 byte of overhead for encoding the message type and field number.
-			bool successful =
-				encodeProtobuf(m_audioMessage, m_preEncodedContext[current], 0, sizeof(std::uint32_t) + 1 + 1, false);
-			(void) successful;
-			assert(successful);
-		}
+			snippet.resize(sizeof(std::uint32_t) + 1 + 1);
 
-		m_audioMessage.Clear();
+			WireWriter writer(snippet.data(), snippet.size());
+			writer.writeVarintField(AudioField::CONTEXT, current, false);
+
+			assert(writer.isValid());
+			snippet.resize(writer.size());
+		}
 
 		// Pre-encode the expected volume adjustments (the client UI allows to specify integer values between
 		// -60dB and +30dB).
 		m_preEncodedVolumeAdjustment.resize(preEncodedDBAdjustmentEnd - preEncodedDBAdjustmentBegin);
 
 		for (int dbAdjustment = preEncodedDBAdjustmentBegin; dbAdjustment < preEncodedDBAdjustmentEnd; ++dbAdjustment) {
-			float adjustmentFactor = VolumeAdjustment::toFactor(dbAdjustment);
+			std::vector< byte > &snippet =
+				m_preEncodedVolumeAdjustment[static_cast< std::size_t >(dbAdjustment - preEncodedDBAdjustmentBegin)];
 
-			m_audioMessage.set_volume_adjustment(adjustmentFactor);
-
-			// Store the pre-encoded packet
 			// The max-size is the size of the used field (float) plus 1 byte overhead for encoding the field type and
 			// number
-			bool successful = encodeProtobuf(
-				m_audioMessage,
-				m_preEncodedVolumeAdjustment[static_cast< std::size_t >(dbAdjustment - preEncodedDBAdjustmentBegin)], 0,
-				sizeof(float) + 1, false);
-			(void) successful;
-			assert(successful);
+			snippet.resize(sizeof(float) + 1);
+
+			WireWriter writer(snippet.data(), snippet.size());
+			writer.writeFloatField(AudioField::VOLUME_ADJUSTMENT, VolumeAdjustment::toFactor(dbAdjustment));
+
+			assert(writer.isValid());
+			snippet.resize(writer.size());
 		}
 	}
 
@@ -804,40 +1018,113 @@ namespace Protocol {
 		m_messageType = UDPMessageType::Audio;
 		m_audioData   = {};
 
-		if (!m_audioMessage.ParseFromArray(data.data(), static_cast< int >(data.size()))) {
-			// Invalid format
-			return false;
+		// Atm the only codec supported by the new package format is Opus
+		m_audioData.usedCodec = AudioCodec::Opus;
+
+		// Target and context are part of a oneof, so setting one of them clears the other
+		std::uint64_t target      = 0;
+		std::uint64_t context     = 0;
+		std::size_t positionCount = 0;
+		float volumeAdjustment    = 0.0f;
+
+		WireReader reader(data);
+		while (!reader.atEnd()) {
+			std::uint64_t tag;
+			if (!reader.readVarint(tag)) {
+				// Invalid format
+				return false;
+			}
+
+			const std::uint64_t field = tag >> 3;
+			const byte type           = static_cast< byte >(tag & 0x7);
+
+			std::uint64_t varint = 0;
+			float fixed32        = 0.0f;
+			bool successful      = false;
+
+			if (type == static_cast< byte >(WireType::Varint)) {
+				successful = reader.readVarint(varint);
+
+				switch (field) {
+					case AudioField::TARGET:
+						target  = varint;
+						context = 0;
+						break;
+					case AudioField::CONTEXT:
+						context = varint;
+						target  = 0;
+						break;
+					case AudioField::SENDER_SESSION:
+						m_audioData.senderSession = static_cast< std::uint32_t >(varint);
+						break;
+					case AudioField::FRAME_NUMBER:
+						m_audioData.frameNumber = varint;
+						break;
+					case AudioField::IS_TERMINATOR:
+						m_audioData.isLastFrame = varint != 0;
+						break;
+				}
+			} else if (type == static_cast< byte >(WireType::Fixed32)
+					   && (field == AudioField::VOLUME_ADJUSTMENT || field == AudioField::POSITIONAL_DATA)) {
+				successful = reader.readFloat(fixed32);
+
+				if (field == AudioField::VOLUME_ADJUSTMENT) {
+					volumeAdjustment = fixed32;
+				} else {
+					// Non-packed repeated field
+					if (positionCount < m_audioData.position.size()) {
+						m_audioData.position[positionCount] = fixed32;
+					}
+					positionCount++;
+				}
+			} else if (type == static_cast< byte >(WireType::LengthDelimited)
+					   && (field == AudioField::OPUS_DATA || field == AudioField::POSITIONAL_DATA)) {
+				gsl::span< const byte > bytes;
+				successful = reader.readLengthDelimited(bytes);
+
+				if (field == AudioField::OPUS_DATA) {
+					// The payload is not copied, so it is only valid as long as the decoded data is
+					m_audioData.payload = bytes;
+				} else {
+					// Packed repeated field
+					WireReader packedReader(bytes);
+					while (successful && !packedReader.atEnd()) {
+						successful = packedReader.readFloat(fixed32);
+
+						if (positionCount < m_audioData.position.size()) {
+							m_audioData.position[positionCount] = fixed32;
+						}
+						positionCount++;
+					}
+				}
+			} else {
+				// Unknown field
+				successful = reader.skip(type);
+			}
+
+			if (!successful) {
+				// Invalid format
+				return false;
+			}
 		}
 
-		m_audioData.targetOrContext =
-			this->getRole() == Role::Client ? m_audioMessage.context() : m_audioMessage.target();
-		// Atm the only codec supported by the new package format is Opus
-		m_audioData.usedCodec     = AudioCodec::Opus;
-		m_audioData.senderSession = m_audioMessage.sender_session();
-		m_audioData.frameNumber   = m_audioMessage.frame_number();
-		if (m_audioMessage.opus_data().empty()) {
+		m_audioData.targetOrContext = static_cast< std::uint32_t >(this->getRole() == Role::Client ? context : target);
+
+		if (m_audioData.payload.empty()) {
 			// Audio packets without audio data are invalid
 			return false;
 		}
 
-		std::string &audioPayload = *m_audioMessage.mutable_opus_data();
-		m_audioData.payload = gsl::span< byte >(reinterpret_cast< byte * >(&audioPayload[0]), audioPayload.size());
-
-		m_audioData.isLastFrame = m_audioMessage.is_terminator();
-
-		if (m_audioMessage.positional_data_size() != 0) {
-			if (m_audioMessage.positional_data_size() != 3) {
+		if (positionCount != 0) {
+			if (positionCount != 3) {
 				// We always expect a 3D position, if positional data is present
 				return false;
 			}
-			for (unsigned int i = 0; i < 3; ++i) {
-				m_audioData.position[i] = m_audioMessage.positional_data(static_cast< int >(i));
-			}
 
 			m_audioData.containsPositionalData = true;
 		}
 
-		m_audioData.volumeAdjustment = VolumeAdjustment::fromFactor(m_audioMessage.volume_adjustment());
+		m_audioData.volumeAdjustment = VolumeAdjustment::fromFactor(volumeAdjustment);
 		if (m_audioData.volumeAdjustment.factor == 0.0f) {
 			// No volume adjustment was set, reset to default
 			m_audioData.volumeAdjustment = VolumeAdjustment::fromFactor(1.0f);
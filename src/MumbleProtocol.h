@@ -214,7 +214,6 @@ namespace Protocol {
 		std::vector< byte > m_byteBuffer;
 		std::size_t m_staticPartSize      = 0;
 		std::size_t m_positionalAudioSize = 0;
-		MumbleUDP::Audio m_audioMessage;
 		std::vector< std::vector< byte > > m_preEncodedContext;
 		std::vector< std::vector< byte > > m_preEncodedVolumeAdjustment;
 
@@ -265,7 +264,6 @@ namespace Protocol {
 		AudioData m_audioData = {};
 		PingData m_pingData   = {};
 		MumbleUDP::Ping m_pingMessage;
-		MumbleUDP::Audio m_audioMessage;
 
 		bool decodePing_legacy(const gsl::span< const byte > data);
 		bool decodePing_protobuf(const gsl::span< const byte > data);
@@ -13,9 +13,11 @@
 class Timer {
 protected:
 	quint64 uiStart;
-	static quint64 now();
 
 public:
+	/// @returns The current time of the monotonic clock all timers are based on
+	static quint64 now();
+
 	Timer(bool start = true);
 	bool isElapsed(quint64 us);
 	quint64 elapsed() const;
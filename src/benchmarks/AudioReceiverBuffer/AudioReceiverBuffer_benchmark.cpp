@@ -29,7 +29,7 @@ constexpr const std::size_t DUPLICATE_RANGE      = 1;
 
 constexpr int MULTIPLIER           = 2;
 constexpr int RECEIVER_COUNT_BEGIN = 1;
-constexpr int RECEIVER_COUNT_END   = 512;
+constexpr int RECEIVER_COUNT_END   = 2048;
 
 struct ReceiverData {
 	ServerUser *receiver;
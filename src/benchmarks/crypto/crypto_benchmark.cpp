@@ -0,0 +1,104 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "MumbleProtocol.h"
+#include "crypto/CryptStateOCB2.h"
+
+#include <limits>
+#include <random>
+#include <vector>
+
+std::random_device rd;
+std::mt19937 rng(rd());
+std::uniform_int_distribution< unsigned int > random_byte(0, std::numeric_limits< unsigned char >::max());
+
+constexpr int PACKET_SIZE_RANGE = 0;
+
+constexpr int FROM_PACKET_SIZE       = 16;
+constexpr int TO_PACKET_SIZE         = Mumble::Protocol::MAX_UDP_PACKET_SIZE - 4;
+constexpr int PACKET_SIZE_MULTIPLIER = 2;
+
+// Reports the throughput in packets per second in addition to the time per packet
+void reportThroughput(::benchmark::State &state) {
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()));
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations()) * state.range(PACKET_SIZE_RANGE));
+}
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &state) {
+		plain.resize(static_cast< std::size_t >(state.range(PACKET_SIZE_RANGE)));
+		for (std::size_t i = 0; i < plain.size(); ++i) {
+			plain[i] = static_cast< unsigned char >(random_byte(rng));
+		}
+
+		// Leave room for the crypt header, such that the encrypted payload is aligned the same way it is in the
+		// server (see Server::sendMessage)
+		encrypted.resize(plain.size() + 16);
+		decrypted.resize(plain.size() + 16);
+
+		sender.genKey();
+		// The receiver's decrypt IV has to match the sender's encrypt IV
+		receiver.setKey(sender.getRawKey(), sender.getDecryptIV(), sender.getEncryptIV());
+	}
+
+	std::vector< unsigned char > plain;
+	std::vector< unsigned char > encrypted;
+	std::vector< unsigned char > decrypted;
+
+	CryptStateOCB2 sender;
+	CryptStateOCB2 receiver;
+};
+
+BENCHMARK_DEFINE_F(Fixture, BM_encrypt)(::benchmark::State &state) {
+	for (auto _ : state) {
+		bool success = sender.encrypt(plain.data(), encrypted.data() + 4, static_cast< unsigned int >(plain.size()));
+		benchmark::DoNotOptimize(success);
+	}
+
+	reportThroughput(state);
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encrypt)
+	->RangeMultiplier(PACKET_SIZE_MULTIPLIER)
+	->Range(FROM_PACKET_SIZE, TO_PACKET_SIZE);
+
+BENCHMARK_DEFINE_F(Fixture, BM_encryptDecrypt)(::benchmark::State &state) {
+	for (auto _ : state) {
+		sender.encrypt(plain.data(), encrypted.data() + 4, static_cast< unsigned int >(plain.size()));
+		bool success = receiver.decrypt(encrypted.data() + 4, decrypted.data() + 8,
+										static_cast< unsigned int >(plain.size() + 4));
+		benchmark::DoNotOptimize(success);
+	}
+
+	reportThroughput(state);
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encryptDecrypt)
+	->RangeMultiplier(PACKET_SIZE_MULTIPLIER)
+	->Range(FROM_PACKET_SIZE, TO_PACKET_SIZE);
+
+BENCHMARK_DEFINE_F(Fixture, BM_ocbDecrypt)(::benchmark::State &state) {
+	unsigned char nonce[AES_BLOCK_SIZE] = {};
+	unsigned char tag[AES_BLOCK_SIZE];
+
+	sender.ocb_encrypt(plain.data(), encrypted.data() + 8, static_cast< unsigned int >(plain.size()), nonce, tag);
+
+	for (auto _ : state) {
+		bool success = sender.ocb_decrypt(encrypted.data() + 8, decrypted.data() + 8,
+										  static_cast< unsigned int >(plain.size()), nonce, tag);
+		benchmark::DoNotOptimize(success);
+	}
+
+	reportThroughput(state);
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_ocbDecrypt)
+	->RangeMultiplier(PACKET_SIZE_MULTIPLIER)
+	->Range(FROM_PACKET_SIZE, TO_PACKET_SIZE);
+
+BENCHMARK_MAIN();
@@ -6,6 +6,7 @@
 #include <benchmark/benchmark.h>
 
 #include "MumbleProtocol.h"
+#include "MumbleUDP.pb.h"
 #include "PacketDataStream.h"
 
 #include <limits>
@@ -27,6 +28,14 @@ std::vector< Mumble::Protocol::byte > audioPayload;
 Mumble::Protocol::AudioData audioData;
 
 Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder;
+Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder;
+
+std::vector< Mumble::Protocol::byte > encodedLegacy;
+std::vector< Mumble::Protocol::byte > encodedNew;
+
+std::vector< Mumble::Protocol::byte > toVector(gsl::span< const Mumble::Protocol::byte > data) {
+	return std::vector< Mumble::Protocol::byte >(data.begin(), data.end());
+}
 
 class Fixture : public ::benchmark::Fixture {
 public:
@@ -47,9 +56,9 @@ public:
 		audioData.containsPositionalData = true;
 
 		encoder.setProtocolVersion(Version::fromComponents(1, 3, 0));
-		encoder.encodeAudioPacket(audioData);
+		encodedLegacy = toVector(encoder.encodeAudioPacket(audioData));
 		encoder.setProtocolVersion(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
-		encoder.encodeAudioPacket(audioData);
+		encodedNew = toVector(encoder.encodeAudioPacket(audioData));
 	}
 };
 
@@ -127,5 +136,68 @@ BENCHMARK_REGISTER_F(Fixture, BM_encodeNew_UpdateOnly)
 	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
 	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
 
+// The previous approach of going through the generated message, for comparison
+BENCHMARK_DEFINE_F(Fixture, BM_encodeNew_Libprotobuf)(::benchmark::State &state) {
+	MumbleUDP::Audio message;
+	std::vector< Mumble::Protocol::byte > buffer;
+	buffer.resize(Mumble::Protocol::MAX_UDP_PACKET_SIZE);
+
+	for (auto _ : state) {
+		message.Clear();
+		message.set_sender_session(audioData.senderSession);
+		message.set_frame_number(audioData.frameNumber);
+		message.set_opus_data(audioData.payload.data(), audioData.payload.size());
+		message.set_is_terminator(audioData.isLastFrame);
+		for (float coordinate : audioData.position) {
+			message.add_positional_data(coordinate);
+		}
+		message.set_context(audioData.targetOrContext);
+
+		message.SerializeToArray(buffer.data() + 1, static_cast< int >(buffer.size() - 1));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encodeNew_Libprotobuf)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
+
+BENCHMARK_DEFINE_F(Fixture, BM_decodeLegacy)(::benchmark::State &state) {
+	decoder.setProtocolVersion(Version::fromComponents(1, 3, 0));
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(decoder.decode(encodedLegacy));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeLegacy)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
+
+BENCHMARK_DEFINE_F(Fixture, BM_decodeNew)(::benchmark::State &state) {
+	decoder.setProtocolVersion(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(decoder.decode(encodedNew));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeNew)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
+
+// The previous approach of going through the generated message, for comparison
+BENCHMARK_DEFINE_F(Fixture, BM_decodeNew_Libprotobuf)(::benchmark::State &state) {
+	MumbleUDP::Audio message;
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+			message.ParseFromArray(encodedNew.data() + 1, static_cast< int >(encodedNew.size() - 1)));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeNew_Libprotobuf)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
+
 
 BENCHMARK_MAIN();
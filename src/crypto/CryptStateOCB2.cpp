@@ -36,6 +36,7 @@ CryptStateOCB2::CryptStateOCB2()
 	memset(raw_key, 0, AES_KEY_SIZE_BYTES);
 	memset(encrypt_iv, 0, AES_BLOCK_SIZE);
 	memset(decrypt_iv, 0, AES_BLOCK_SIZE);
+	initializeCipherContexts();
 }
 
 CryptStateOCB2::~CryptStateOCB2() noexcept {
@@ -49,10 +50,24 @@ bool CryptStateOCB2::isValid() const {
 	return bInit;
 }
 
+void CryptStateOCB2::initializeCipherContexts() {
+	// Expanding the key schedule (and looking up the cipher implementation) is done once per key here instead of
+	// once per block. Encrypting or decrypting blocks later on is then merely a matter of calling EVP_*Update.
+	for (EVP_CIPHER_CTX *ctx : { enc_ctx_ocb_enc, enc_ctx_ocb_dec }) {
+		EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, raw_key, NULL);
+		EVP_CIPHER_CTX_set_padding(ctx, 0);
+	}
+	for (EVP_CIPHER_CTX *ctx : { dec_ctx_ocb_enc, dec_ctx_ocb_dec }) {
+		EVP_DecryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, raw_key, NULL);
+		EVP_CIPHER_CTX_set_padding(ctx, 0);
+	}
+}
+
 void CryptStateOCB2::genKey() {
 	CryptographicRandom::fillBuffer(raw_key, AES_KEY_SIZE_BYTES);
 	CryptographicRandom::fillBuffer(encrypt_iv, AES_BLOCK_SIZE);
 	CryptographicRandom::fillBuffer(decrypt_iv, AES_BLOCK_SIZE);
+	initializeCipherContexts();
 	bInit = true;
 }
 
@@ -61,6 +76,7 @@ bool CryptStateOCB2::setKey(const std::string &rkey, const std::string &eiv, con
 		memcpy(raw_key, rkey.data(), AES_KEY_SIZE_BYTES);
 		memcpy(encrypt_iv, eiv.data(), AES_BLOCK_SIZE);
 		memcpy(decrypt_iv, div.data(), AES_BLOCK_SIZE);
+		initializeCipherContexts();
 		bInit = true;
 		return true;
 	}
@@ -70,6 +86,7 @@ bool CryptStateOCB2::setKey(const std::string &rkey, const std::string &eiv, con
 bool CryptStateOCB2::setRawKey(const std::string &rkey) {
 	if (rkey.length() == AES_KEY_SIZE_BYTES) {
 		memcpy(raw_key, rkey.data(), AES_KEY_SIZE_BYTES);
+		initializeCipherContexts();
 		return true;
 	}
 	return false;
@@ -269,83 +286,105 @@ static void inline ZERO(keyblock &block) {
 		block[i] = 0;
 }
 
-#define AESencrypt_ctx(src, dst, key, enc_ctx)                                                      \
-	{                                                                                               \
-		int outlen = 0;                                                                             \
-		EVP_EncryptInit_ex(enc_ctx, EVP_aes_128_ecb(), NULL, key, NULL);                            \
-		EVP_CIPHER_CTX_set_padding(enc_ctx, 0);                                                     \
-		EVP_EncryptUpdate(enc_ctx, reinterpret_cast< unsigned char * >(dst), &outlen,               \
-						  reinterpret_cast< const unsigned char * >(src), AES_BLOCK_SIZE);          \
-		EVP_EncryptFinal_ex(enc_ctx, reinterpret_cast< unsigned char * >((dst) + outlen), &outlen); \
+// The contexts are keyed in initializeCipherContexts(), so all that is left to do is to run the blocks through them.
+// Passing multiple blocks at once allows OpenSSL to use its interleaved multi-block implementations (e.g. AES-NI).
+#define AESencrypt_ctx(src, dst, blocks, enc_ctx)                                                                    \
+	{                                                                                                                \
+		int outlen = 0;                                                                                              \
+		EVP_EncryptUpdate(enc_ctx, reinterpret_cast< unsigned char * >(dst), &outlen,                                \
+						  reinterpret_cast< const unsigned char * >(src), static_cast< int >((blocks)*AES_BLOCK_SIZE)); \
 	}
-#define AESdecrypt_ctx(src, dst, key, dec_ctx)                                                      \
-	{                                                                                               \
-		int outlen = 0;                                                                             \
-		EVP_DecryptInit_ex(dec_ctx, EVP_aes_128_ecb(), NULL, key, NULL);                            \
-		EVP_CIPHER_CTX_set_padding(dec_ctx, 0);                                                     \
-		EVP_DecryptUpdate(dec_ctx, reinterpret_cast< unsigned char * >(dst), &outlen,               \
-						  reinterpret_cast< const unsigned char * >(src), AES_BLOCK_SIZE);          \
-		EVP_DecryptFinal_ex(dec_ctx, reinterpret_cast< unsigned char * >((dst) + outlen), &outlen); \
+#define AESdecrypt_ctx(src, dst, blocks, dec_ctx)                                                                    \
+	{                                                                                                                \
+		int outlen = 0;                                                                                              \
+		EVP_DecryptUpdate(dec_ctx, reinterpret_cast< unsigned char * >(dst), &outlen,                                \
+						  reinterpret_cast< const unsigned char * >(src), static_cast< int >((blocks)*AES_BLOCK_SIZE)); \
 	}
 
-#define AESencrypt(src, dst, key) AESencrypt_ctx(src, dst, key, enc_ctx_ocb_enc)
-#define AESdecrypt(src, dst, key) AESdecrypt_ctx(src, dst, key, dec_ctx_ocb_enc)
+// The maximum amount of blocks that are gathered before passing them to AES at once
+#define CHUNK_BLOCKS 32
+
+#define AESencrypt(src, dst, blocks) AESencrypt_ctx(src, dst, blocks, enc_ctx_ocb_enc)
+#define AESdecrypt(src, dst, blocks) AESdecrypt_ctx(src, dst, blocks, dec_ctx_ocb_enc)
 
 bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack) {
 	keyblock checksum, delta, tmp, pad;
+	// The offsets of the full blocks of the current chunk
+	keyblock deltas[CHUNK_BLOCKS];
+	// The full blocks of the current chunk plus the input for the pad of the final block
+	keyblock blocks[CHUNK_BLOCKS + 1];
 	bool success = true;
 
 	// Initialize
-	AESencrypt(nonce, delta, raw_key);
+	AESencrypt(nonce, delta, 1);
 	ZERO(checksum);
 
-	while (len > AES_BLOCK_SIZE) {
-		// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
-		// For an attack, the second to last block (i.e. the last iteration of this loop)
-		// must be all 0 except for the last byte (which may be 0 - 128).
-		bool flipABit = false; // *plain is const, so we can't directly modify it
-		if (len - AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
-			unsigned char sum = 0;
-			for (int i = 0; i < AES_BLOCK_SIZE - 1; ++i) {
-				sum |= plain[i];
-			}
-			if (sum == 0) {
-				if (modifyPlainOnXEXStarAttack) {
-					// The assumption that critical packets do not turn up by pure chance turned out to be incorrect
-					// since digital silence appears to produce them in mass.
-					// So instead we now modify the packet in a way which should not affect the audio but will
-					// prevent the attack.
-					flipABit = true;
-				} else {
-					// This option still exists but only to allow us to test ocb_decrypt's detection.
-					success = false;
+	for (;;) {
+		unsigned int count = 0;
+
+		while (len > AES_BLOCK_SIZE && count < CHUNK_BLOCKS) {
+			// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
+			// For an attack, the second to last block (i.e. the last iteration of this loop)
+			// must be all 0 except for the last byte (which may be 0 - 128).
+			bool flipABit = false; // *plain is const, so we can't directly modify it
+			if (len - AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
+				unsigned char sum = 0;
+				for (int i = 0; i < AES_BLOCK_SIZE - 1; ++i) {
+					sum |= plain[i];
 				}
+				if (sum == 0) {
+					if (modifyPlainOnXEXStarAttack) {
+						// The assumption that critical packets do not turn up by pure chance turned out to be
+						// incorrect since digital silence appears to produce them in mass.
+						// So instead we now modify the packet in a way which should not affect the audio but will
+						// prevent the attack.
+						flipABit = true;
+					} else {
+						// This option still exists but only to allow us to test ocb_decrypt's detection.
+						success = false;
+					}
+				}
+			}
+
+			S2(delta);
+			memcpy(deltas[count], delta, AES_BLOCK_SIZE);
+			XOR(blocks[count], delta, reinterpret_cast< const subblock * >(plain));
+			if (flipABit) {
+				*reinterpret_cast< unsigned char * >(blocks[count]) ^= 1;
 			}
+			XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
+			if (flipABit) {
+				*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+			}
+
+			len -= AES_BLOCK_SIZE;
+			plain += AES_BLOCK_SIZE;
+			++count;
 		}
 
-		S2(delta);
-		XOR(tmp, delta, reinterpret_cast< const subblock * >(plain));
-		if (flipABit) {
-			*reinterpret_cast< unsigned char * >(tmp) ^= 1;
+		const bool lastChunk = len <= AES_BLOCK_SIZE;
+		if (lastChunk) {
+			// The pad of the final block doesn't depend on the other blocks, so it can be computed along with them
+			S2(delta);
+			ZERO(blocks[count]);
+			blocks[count][BLOCKSIZE - 1] = SWAPPED(len * 8);
+			XOR(blocks[count], blocks[count], delta);
 		}
-		AESencrypt(tmp, tmp, raw_key);
-		XOR(reinterpret_cast< subblock * >(encrypted), delta, tmp);
-		XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
-		if (flipABit) {
-			*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+
+		AESencrypt(blocks, blocks, lastChunk ? count + 1 : count);
+
+		for (unsigned int i = 0; i < count; ++i) {
+			XOR(reinterpret_cast< subblock * >(encrypted), deltas[i], blocks[i]);
+			encrypted += AES_BLOCK_SIZE;
 		}
 
-		len -= AES_BLOCK_SIZE;
-		plain += AES_BLOCK_SIZE;
-		encrypted += AES_BLOCK_SIZE;
+		if (lastChunk) {
+			memcpy(pad, blocks[count], AES_BLOCK_SIZE);
+			break;
+		}
 	}
 
-	S2(delta);
-	ZERO(tmp);
-	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
-	XOR(tmp, tmp, delta);
-	AESencrypt(tmp, pad, raw_key);
 	memcpy(tmp, plain, len);
 	memcpy(reinterpret_cast< unsigned char * >(tmp) + len, reinterpret_cast< const unsigned char * >(pad) + len,
 		   AES_BLOCK_SIZE - len);
@@ -355,7 +394,7 @@ bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encr
 
 	S3(delta);
 	XOR(tmp, delta, checksum);
-	AESencrypt(tmp, tag, raw_key);
+	AESencrypt(tmp, tag, 1);
 
 	return success;
 }
@@ -363,34 +402,49 @@ bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encr
 #undef AESencrypt
 #undef AESdecrypt
 
-#define AESencrypt(src, dst, key) AESencrypt_ctx(src, dst, key, enc_ctx_ocb_dec)
-#define AESdecrypt(src, dst, key) AESdecrypt_ctx(src, dst, key, dec_ctx_ocb_dec)
+#define AESencrypt(src, dst, blocks) AESencrypt_ctx(src, dst, blocks, enc_ctx_ocb_dec)
+#define AESdecrypt(src, dst, blocks) AESdecrypt_ctx(src, dst, blocks, dec_ctx_ocb_dec)
 
 bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag) {
 	keyblock checksum, delta, tmp, pad;
+	// The offsets of the full blocks of the current chunk
+	keyblock deltas[CHUNK_BLOCKS];
+	// The full blocks of the current chunk
+	keyblock blocks[CHUNK_BLOCKS];
 	bool success = true;
 
 	// Initialize
-	AESencrypt(nonce, delta, raw_key);
+	AESencrypt(nonce, delta, 1);
 	ZERO(checksum);
 
 	while (len > AES_BLOCK_SIZE) {
-		S2(delta);
-		XOR(tmp, delta, reinterpret_cast< const subblock * >(encrypted));
-		AESdecrypt(tmp, tmp, raw_key);
-		XOR(reinterpret_cast< subblock * >(plain), delta, tmp);
-		XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
-		len -= AES_BLOCK_SIZE;
-		plain += AES_BLOCK_SIZE;
-		encrypted += AES_BLOCK_SIZE;
+		unsigned int count = 0;
+
+		while (len > AES_BLOCK_SIZE && count < CHUNK_BLOCKS) {
+			S2(delta);
+			memcpy(deltas[count], delta, AES_BLOCK_SIZE);
+			XOR(blocks[count], delta, reinterpret_cast< const subblock * >(encrypted));
+
+			len -= AES_BLOCK_SIZE;
+			encrypted += AES_BLOCK_SIZE;
+			++count;
+		}
+
+		AESdecrypt(blocks, blocks, count);
+
+		for (unsigned int i = 0; i < count; ++i) {
+			XOR(reinterpret_cast< subblock * >(plain), deltas[i], blocks[i]);
+			XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
+			plain += AES_BLOCK_SIZE;
+		}
 	}
 
 	S2(delta);
 	ZERO(tmp);
 	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
 	XOR(tmp, tmp, delta);
-	AESencrypt(tmp, pad, raw_key);
+	AESencrypt(tmp, pad, 1);
 	memset(tmp, 0, AES_BLOCK_SIZE);
 	memcpy(tmp, encrypted, len);
 	XOR(tmp, tmp, pad);
@@ -408,13 +462,14 @@ bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *
 
 	S3(delta);
 	XOR(tmp, delta, checksum);
-	AESencrypt(tmp, tag, raw_key);
+	AESencrypt(tmp, tag, 1);
 
 	return success;
 }
 
 #undef AESencrypt
 #undef AESdecrypt
+#undef CHUNK_BLOCKS
 #undef BLOCKSIZE
 #undef SHIFTBITS
 #undef SWAPPED
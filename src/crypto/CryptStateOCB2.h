@@ -48,6 +48,10 @@ private:
 	EVP_CIPHER_CTX *dec_ctx_ocb_enc;
 	EVP_CIPHER_CTX *enc_ctx_ocb_dec;
 	EVP_CIPHER_CTX *dec_ctx_ocb_dec;
+
+	/// Sets up the cipher contexts for the current raw_key. This has to be called
+	/// whenever raw_key changes.
+	void initializeCipherContexts();
 };
 
 
@@ -0,0 +1,62 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ActiveSpeakerLimiter.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <algorithm>
+
+bool ActiveSpeakerLimiter::admit(unsigned int channelID, unsigned int session, std::size_t maxSpeakers,
+								 bool isLastFrame, quint64 now) {
+	QMutexLocker lock(&m_mutex);
+
+	std::vector< Slot > &slots = m_channels[channelID];
+
+	// Voice threads read the time once per batch of packets, so it isn't necessarily monotonic across threads
+	slots.erase(std::remove_if(slots.begin(), slots.end(),
+							   [now](const Slot &slot) { return slot.lastFrame + SPEAKER_TIMEOUT < now; }),
+				slots.end());
+
+	auto it = std::find_if(slots.begin(), slots.end(), [session](const Slot &slot) { return slot.session == session; });
+
+	if (it != slots.end()) {
+		if (isLastFrame) {
+			slots.erase(it);
+		} else {
+			it->lastFrame = std::max(it->lastFrame, now);
+		}
+
+		return true;
+	}
+
+	// There is no point in occupying a slot for the end of a transmission that hasn't been forwarded
+	if (isLastFrame) {
+		return false;
+	}
+
+	if (slots.size() >= maxSpeakers) {
+		// The limit might have been lowered in the meantime, so there may be more slots than allowed
+		auto longest = std::min_element(slots.begin(), slots.end(),
+										[](const Slot &lhs, const Slot &rhs) { return lhs.since < rhs.since; });
+		if (slots.size() > maxSpeakers || longest == slots.end() || longest->since + MINIMUM_HOLD > now) {
+			return false;
+		}
+
+		slots.erase(longest);
+	}
+
+	slots.push_back({ session, now, now });
+
+	return true;
+}
+
+std::size_t ActiveSpeakerLimiter::activeSpeakers(unsigned int channelID) const {
+	QMutexLocker lock(&m_mutex);
+
+	auto it = m_channels.constFind(channelID);
+
+	return it != m_channels.constEnd() ? it->size() : 0;
+}
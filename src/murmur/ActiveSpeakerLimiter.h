@@ -0,0 +1,57 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_ACTIVESPEAKERLIMITER_H_
+#define MUMBLE_MURMUR_ACTIVESPEAKERLIMITER_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QtGlobal>
+
+#include <cstddef>
+#include <vector>
+
+/// Limits how many users may speak at the same time in a channel.
+///
+/// Every channel has a number of speaker slots. A speaker occupies a slot from its first frame until it sends a
+/// terminator or hasn't sent a frame for SPEAKER_TIMEOUT. The frames of other speakers are dropped while all slots
+/// are occupied, unless a slot has been held for at least MINIMUM_HOLD: Then the speaker that has held its slot the
+/// longest loses it to the new one. This way a user that transmits continuously (e.g. with an open microphone)
+/// can't keep everybody else from speaking. Priority speakers aren't limited at all and thus don't take slots.
+///
+/// The limiter is shared by all voice threads, as the speakers of a channel might be handled by different ones.
+class ActiveSpeakerLimiter {
+public:
+	/// Speakers that haven't sent a frame for this long (in microseconds) lose their slot, e.g. because their
+	/// terminator got lost
+	static constexpr quint64 SPEAKER_TIMEOUT = 500 * 1000;
+	/// The time (in microseconds) a speaker keeps its slot at least before another speaker may take it over
+	static constexpr quint64 MINIMUM_HOLD = 5 * 1000 * 1000;
+
+	/// @param channelID The ID of the channel the speaker speaks in
+	/// @param session The session of the speaker
+	/// @param maxSpeakers The number of slots of the channel
+	/// @param isLastFrame Whether the frame is the terminator of the speaker's transmission
+	/// @param now The time the frame has been received at, as returned by Timer::now()
+	/// @returns Whether the frame may be forwarded
+	bool admit(unsigned int channelID, unsigned int session, std::size_t maxSpeakers, bool isLastFrame, quint64 now);
+
+	/// @returns The number of occupied slots of the given channel, including those that have timed out but haven't
+	/// 	been released yet
+	std::size_t activeSpeakers(unsigned int channelID) const;
+
+protected:
+	struct Slot {
+		unsigned int session;
+		/// The time the speaker got the slot at
+		quint64 since;
+		quint64 lastFrame;
+	};
+
+	mutable QMutex m_mutex;
+	QHash< unsigned int, std::vector< Slot > > m_channels;
+};
+
+#endif
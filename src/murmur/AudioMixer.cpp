@@ -0,0 +1,308 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioMixer.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <opus.h>
+
+#include <algorithm>
+#include <functional>
+
+/// The most samples a single Opus packet can decode to (120 ms)
+static constexpr std::size_t MAX_DECODED_SAMPLES = AudioMixer::SAMPLE_RATE / 1000 * 120;
+/// The largest possible Opus packet
+static constexpr std::size_t MAX_PACKET_SIZE = 1275;
+/// Opus conceals lost audio in multiples of 2.5 ms
+static constexpr std::size_t CONCEALMENT_GRANULARITY = AudioMixer::SAMPLE_RATE / 400;
+/// The clients count their frame numbers in 10 ms units
+static constexpr std::uint64_t FRAME_NUMBER_INCREMENT = AudioMixer::FRAME_SAMPLES / (AudioMixer::SAMPLE_RATE / 100);
+
+void AudioMixer::OpusDecoderDeleter::operator()(OpusDecoder *decoder) const {
+	opus_decoder_destroy(decoder);
+}
+
+void AudioMixer::OpusEncoderDeleter::operator()(OpusEncoder *encoder) const {
+	opus_encoder_destroy(encoder);
+}
+
+AudioMixer::AudioMixer(int bitrate)
+	: m_bitrate(bitrate), m_encoder(createEncoder()), m_frameNumber(0), m_nextFrame(0), m_mix(FRAME_SAMPLES),
+	  m_speakerMix(FRAME_SAMPLES), m_encodeBuffer(MAX_PACKET_SIZE) {
+	if (!m_encoder) {
+		qWarning("AudioMixer: Failed to create Opus encoder");
+	}
+
+	m_listenerStream.active = false;
+	m_listenerStream.sender = 0;
+}
+
+AudioMixer::~AudioMixer() = default;
+
+void AudioMixer::addFrame(unsigned int session, const unsigned char *data, std::size_t size, bool isLastFrame,
+						  quint64 now, std::vector< Frame > &frames) {
+	QMutexLocker lock(&m_mutex);
+
+	if (!m_encoder) {
+		return;
+	}
+
+	// Voice threads read the time once per batch of packets, so it isn't necessarily monotonic across threads
+	auto timedOut = [now](const Speaker &speaker) { return speaker.lastFrame + SPEAKER_TIMEOUT < now; };
+	m_speakers.erase(std::remove_if(m_speakers.begin(), m_speakers.end(), timedOut), m_speakers.end());
+
+	if (m_speakers.empty()) {
+		// The first speaker starts the clock
+		m_nextFrame = now;
+	}
+
+	auto it = std::find_if(m_speakers.begin(), m_speakers.end(),
+						   [session](const Speaker &speaker) { return speaker.session == session; });
+
+	Speaker *speaker = nullptr;
+	if (it != m_speakers.end()) {
+		speaker = &*it;
+	} else if (!isLastFrame) {
+		// There is no point in adding a speaker for the end of a transmission that hasn't been mixed
+		speaker = addSpeaker(session, now);
+	}
+
+	if (speaker) {
+		speaker->lastFrame = std::max(speaker->lastFrame, now);
+
+		if (size > 0) {
+			const std::size_t queued = speaker->samples.size();
+			speaker->samples.resize(queued + MAX_DECODED_SAMPLES);
+
+			const int decoded = opus_decode_float(speaker->decoder.get(), data, static_cast< opus_int32 >(size),
+												  speaker->samples.data() + queued,
+												  static_cast< int >(MAX_DECODED_SAMPLES), 0);
+
+			speaker->samples.resize(queued + static_cast< std::size_t >(std::max(decoded, 0)));
+
+			if (speaker->samples.size() > MAX_QUEUED_SAMPLES) {
+				speaker->samples.erase(speaker->samples.begin(),
+									   speaker->samples.end() - static_cast< std::ptrdiff_t >(MAX_QUEUED_SAMPLES));
+			}
+		}
+
+		speaker->finished = isLastFrame;
+		if (speaker->samples.size() >= JITTER_SAMPLES || speaker->finished) {
+			speaker->buffering = false;
+		}
+	}
+
+	// After a pause, the frames that would have been due in the meantime are skipped instead of being sent in a burst
+	if (now > m_nextFrame + MAX_QUEUED_SAMPLES / FRAME_SAMPLES * FRAME_DURATION) {
+		m_nextFrame = now;
+	}
+
+	while (m_nextFrame <= now) {
+		if (!mixFrame(frames)) {
+			// The clock doesn't run while there is nothing to mix, such that the slack of speakers that have just
+			// finished buffering isn't used up at once to catch up
+			m_nextFrame = now + FRAME_DURATION;
+			break;
+		}
+
+		m_nextFrame += FRAME_DURATION;
+	}
+
+	// Nothing is going to drive the output anymore once everybody has finished speaking, so the rest is sent at once
+	while (!m_speakers.empty()
+		   && std::all_of(m_speakers.begin(), m_speakers.end(), [](const Speaker &speaker) { return speaker.finished; })
+		   && mixFrame(frames)) {
+		m_nextFrame += FRAME_DURATION;
+	}
+}
+
+AudioMixer::Speaker *AudioMixer::addSpeaker(unsigned int session, quint64 now) {
+	int error = OPUS_OK;
+	std::unique_ptr< OpusDecoder, OpusDecoderDeleter > decoder(opus_decoder_create(SAMPLE_RATE, 1, &error));
+	if (error != OPUS_OK) {
+		return nullptr;
+	}
+
+	std::unique_ptr< OpusEncoder, OpusEncoderDeleter > encoder = createEncoder();
+	if (!encoder) {
+		return nullptr;
+	}
+
+	Speaker speaker;
+	speaker.session       = session;
+	speaker.decoder       = std::move(decoder);
+	speaker.encoder       = std::move(encoder);
+	speaker.lastFrame     = now;
+	speaker.buffering     = true;
+	speaker.finished      = false;
+	speaker.stream.active = false;
+	speaker.stream.sender = 0;
+
+	m_speakers.push_back(std::move(speaker));
+
+	return &m_speakers.back();
+}
+
+std::unique_ptr< OpusEncoder, AudioMixer::OpusEncoderDeleter > AudioMixer::createEncoder() const {
+	int error = OPUS_OK;
+	std::unique_ptr< OpusEncoder, OpusEncoderDeleter > encoder(
+		opus_encoder_create(SAMPLE_RATE, 1, OPUS_APPLICATION_AUDIO, &error));
+	if (error != OPUS_OK) {
+		return nullptr;
+	}
+
+	opus_encoder_ctl(encoder.get(), OPUS_SET_BITRATE(m_bitrate));
+
+	return encoder;
+}
+
+bool AudioMixer::encode(OpusEncoder &encoder, const std::vector< float > &samples, Frame &frame) {
+	const opus_int32 length =
+		opus_encode_float(&encoder, samples.data(), static_cast< int >(FRAME_SAMPLES), m_encodeBuffer.data(),
+						  static_cast< opus_int32 >(m_encodeBuffer.size()));
+	if (length < 0) {
+		return false;
+	}
+
+	frame.opusData.assign(m_encodeBuffer.begin(), m_encodeBuffer.begin() + length);
+
+	return true;
+}
+
+void AudioMixer::conceal(Speaker &speaker) {
+	const std::size_t queued = speaker.samples.size();
+	if (queued >= FRAME_SAMPLES) {
+		return;
+	}
+
+	const std::size_t missing =
+		(FRAME_SAMPLES - queued + CONCEALMENT_GRANULARITY - 1) / CONCEALMENT_GRANULARITY * CONCEALMENT_GRANULARITY;
+	speaker.samples.resize(queued + missing);
+
+	const int concealed = opus_decode_float(speaker.decoder.get(), nullptr, 0, speaker.samples.data() + queued,
+											static_cast< int >(missing), 0);
+
+	speaker.samples.resize(queued + static_cast< std::size_t >(std::max(concealed, 0)));
+}
+
+bool AudioMixer::mixFrame(std::vector< Frame > &frames) {
+	// A frame is only mixed once there is something to mix or a speaker's transmission has to be terminated
+	if (std::none_of(m_speakers.begin(), m_speakers.end(), [](const Speaker &speaker) {
+			return (!speaker.buffering && !speaker.samples.empty()) || speaker.finished;
+		})) {
+		return false;
+	}
+
+	for (Speaker &speaker : m_speakers) {
+		if (!speaker.buffering && !speaker.finished) {
+			conceal(speaker);
+		}
+	}
+
+	auto contributed = [](const Speaker &speaker) {
+		if (speaker.buffering) {
+			return static_cast< std::ptrdiff_t >(0);
+		}
+		const std::size_t count = std::min(speaker.samples.size(), static_cast< std::size_t >(FRAME_SAMPLES));
+		return static_cast< std::ptrdiff_t >(count);
+	};
+	// Speakers that have finished are removed along with their last samples
+	auto remains = [](const Speaker &speaker) { return !speaker.finished || speaker.samples.size() > FRAME_SAMPLES; };
+	// Whether the given sender still speaks after this frame. Senders that have timed out are gone already.
+	auto senderRemains = [this, &remains](unsigned int session) {
+		auto it = std::find_if(m_speakers.begin(), m_speakers.end(),
+							   [session](const Speaker &speaker) { return speaker.session == session; });
+		return it != m_speakers.end() && remains(*it);
+	};
+	// The sender of a new stream that is meant for everybody but the given speaker, preferably one that doesn't stop
+	// speaking right away
+	auto chooseSender = [this, &remains](const Speaker *excluded) {
+		const Speaker *sender = nullptr;
+		for (const Speaker &speaker : m_speakers) {
+			if (&speaker != excluded && (!sender || (!remains(*sender) && remains(speaker)))) {
+				sender = &speaker;
+			}
+		}
+		return sender->session;
+	};
+
+	std::fill(m_mix.begin(), m_mix.end(), 0.0f);
+	for (const Speaker &speaker : m_speakers) {
+		std::transform(speaker.samples.begin(), speaker.samples.begin() + contributed(speaker), m_mix.begin(),
+					   m_mix.begin(), std::plus< float >());
+	}
+
+	if (!m_listenerStream.active) {
+		m_listenerStream.active = true;
+		m_listenerStream.sender = chooseSender(nullptr);
+	}
+
+	Frame frame;
+	frame.forListeners = true;
+	frame.receiver     = 0;
+	frame.sender       = m_listenerStream.sender;
+	frame.frameNumber  = m_frameNumber;
+	frame.isLastFrame  = !senderRemains(frame.sender);
+
+	frame.speakers.reserve(m_speakers.size());
+	for (const Speaker &speaker : m_speakers) {
+		frame.speakers.push_back(speaker.session);
+	}
+	std::sort(frame.speakers.begin(), frame.speakers.end());
+
+	// Once the sender stops, the stream is terminated, even if others keep speaking
+	m_listenerStream.active = !frame.isLastFrame;
+
+	if (encode(*m_encoder, m_mix, frame)) {
+		frames.push_back(std::move(frame));
+	}
+
+	for (Speaker &speaker : m_speakers) {
+		if (!speaker.stream.active) {
+			// A speaker that is the only one speaking doesn't need a mix of its own
+			const bool othersContributed =
+				std::any_of(m_speakers.begin(), m_speakers.end(), [&speaker, &contributed](const Speaker &other) {
+					return other.session != speaker.session && contributed(other) > 0;
+				});
+			if (!othersContributed) {
+				continue;
+			}
+
+			speaker.stream.active = true;
+			speaker.stream.sender = chooseSender(&speaker);
+		}
+
+		const std::size_t ownSamples = static_cast< std::size_t >(contributed(speaker));
+		for (std::size_t i = 0; i < FRAME_SAMPLES; ++i) {
+			m_speakerMix[i] = i < ownSamples ? m_mix[i] - speaker.samples[i] : m_mix[i];
+		}
+
+		Frame speakerFrame;
+		speakerFrame.forListeners = false;
+		speakerFrame.receiver     = speaker.session;
+		speakerFrame.sender       = speaker.stream.sender;
+		speakerFrame.frameNumber  = m_frameNumber;
+		speakerFrame.isLastFrame  = !remains(speaker) || !senderRemains(speakerFrame.sender);
+
+		speaker.stream.active = !speakerFrame.isLastFrame;
+
+		if (encode(*speaker.encoder, m_speakerMix, speakerFrame)) {
+			frames.push_back(std::move(speakerFrame));
+		}
+	}
+
+	m_frameNumber += FRAME_NUMBER_INCREMENT;
+
+	m_speakers.erase(std::remove_if(m_speakers.begin(), m_speakers.end(),
+									[&remains](const Speaker &speaker) { return !remains(speaker); }),
+					 m_speakers.end());
+
+	for (Speaker &speaker : m_speakers) {
+		speaker.samples.erase(speaker.samples.begin(), speaker.samples.begin() + contributed(speaker));
+	}
+
+	return true;
+}
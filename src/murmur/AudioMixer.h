@@ -0,0 +1,151 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_AUDIOMIXER_H_
+#define MUMBLE_MURMUR_AUDIOMIXER_H_
+
+#include <QtCore/QMutex>
+#include <QtCore/QtGlobal>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct OpusDecoder;
+struct OpusEncoder;
+
+/// Mixes the speakers of a channel into a single Opus stream (server-side mixing).
+///
+/// The Opus frames of every speaker are decoded into a queue of samples. Whenever a frame arrives and the next
+/// mixed frame is due, FRAME_SAMPLES samples are taken from every queue, summed up and encoded again. There is no
+/// timer of its own: the incoming frames drive the output, so a channel nobody speaks in doesn't cost anything.
+/// New speakers are only mixed once JITTER_SAMPLES are queued, so that frames arriving a little late don't make
+/// their voice drop out. Frames that are later than that are concealed by the speaker's decoder.
+///
+/// Every mixed frame results in one stream for the listeners of the channel and one stream per speaker that
+/// contains everybody but the speaker itself, such that nobody hears their own voice. As a stream has to be
+/// attributed to a session, the mix is sent on behalf of one of the speakers. A stream keeps its sender until the
+/// sender stops speaking, which terminates the stream. The mix then continues in a new stream on behalf of another
+/// speaker, as clients don't expect the sender of a stream to change.
+///
+/// The mixer is shared by all voice threads, as the speakers of a channel might be handled by different ones.
+class AudioMixer {
+public:
+	static constexpr int SAMPLE_RATE = 48000;
+	/// The samples per mixed frame (20 ms)
+	static constexpr std::size_t FRAME_SAMPLES = SAMPLE_RATE / 50;
+	/// The duration of a mixed frame in microseconds
+	static constexpr quint64 FRAME_DURATION = 20 * 1000;
+	/// Samples of a speaker that have not been mixed yet beyond this amount are dropped, which bounds the delay a
+	/// speaker sending too fast can cause
+	static constexpr std::size_t MAX_QUEUED_SAMPLES = 4 * FRAME_SAMPLES;
+	/// The samples of a new speaker that have to be queued before it is mixed: one frame plus one frame of slack for
+	/// frames arriving late
+	static constexpr std::size_t JITTER_SAMPLES = 2 * FRAME_SAMPLES;
+	/// Speakers that haven't sent a frame for this long (in microseconds) are removed, e.g. because their
+	/// terminator got lost
+	static constexpr quint64 SPEAKER_TIMEOUT = 500 * 1000;
+
+	/// A mixed and encoded frame
+	struct Frame {
+		/// Whether the frame is meant for the listeners or for a single speaker
+		bool forListeners;
+		/// The speaker this frame is meant for (if not meant for the listeners)
+		unsigned int receiver;
+		/// The session the frame is attributed to
+		unsigned int sender;
+		/// The sequence number of the frame, counted in 10 ms units like the clients do
+		std::uint64_t frameNumber;
+		bool isLastFrame;
+		std::vector< unsigned char > opusData;
+		/// The sorted sessions of the speakers of the channel at the time the frame has been mixed (only for frames
+		/// meant for the listeners). As these frames contain their own voice, the speakers are not meant to receive
+		/// them.
+		std::vector< unsigned int > speakers;
+	};
+
+	/// @param bitrate The bitrate of the encoded mixes in bits per second
+	explicit AudioMixer(int bitrate);
+	~AudioMixer();
+
+	AudioMixer(const AudioMixer &) = delete;
+	AudioMixer &operator=(const AudioMixer &) = delete;
+
+	/// Adds an Opus frame of the given speaker and mixes all frames that are due.
+	///
+	/// @param session The session of the speaker
+	/// @param data The Opus frame (may be empty for a terminator)
+	/// @param size The size of the Opus frame
+	/// @param isLastFrame Whether the frame is the terminator of the speaker's transmission
+	/// @param now The time the frame has been received at, as returned by Timer::now()
+	/// @param frames The mixed frames are appended to this
+	void addFrame(unsigned int session, const unsigned char *data, std::size_t size, bool isLastFrame, quint64 now,
+				  std::vector< Frame > &frames);
+
+protected:
+	struct OpusDecoderDeleter {
+		void operator()(OpusDecoder *decoder) const;
+	};
+	struct OpusEncoderDeleter {
+		void operator()(OpusEncoder *encoder) const;
+	};
+
+	/// A stream of mixed frames sent to the same receivers
+	struct Stream {
+		/// Whether the stream has been started and not terminated yet
+		bool active;
+		/// The session the frames of the stream are attributed to
+		unsigned int sender;
+	};
+
+	struct Speaker {
+		unsigned int session;
+		std::unique_ptr< OpusDecoder, OpusDecoderDeleter > decoder;
+		/// Encodes the mix without this speaker
+		std::unique_ptr< OpusEncoder, OpusEncoderDeleter > encoder;
+		/// The decoded samples that have not been mixed yet
+		std::vector< float > samples;
+		quint64 lastFrame;
+		/// Whether the speaker is waiting for JITTER_SAMPLES to be queued before it is mixed
+		bool buffering;
+		/// Whether the speaker has sent its terminator
+		bool finished;
+		/// The mix without this speaker, which is sent to it
+		Stream stream;
+	};
+
+	QMutex m_mutex;
+	int m_bitrate;
+	/// In the order they started speaking
+	std::vector< Speaker > m_speakers;
+	std::unique_ptr< OpusEncoder, OpusEncoderDeleter > m_encoder;
+	/// The mix sent to the listeners
+	Stream m_listenerStream;
+	/// The sequence number of the next mixed frame. All streams share it, so that the sequence numbers a client
+	/// receives from a sender keep increasing when it switches between the mix for the listeners and a mix of its own.
+	std::uint64_t m_frameNumber;
+	/// The time the next mixed frame is due at
+	quint64 m_nextFrame;
+
+	std::vector< float > m_mix;
+	std::vector< float > m_speakerMix;
+	std::vector< unsigned char > m_encodeBuffer;
+
+	/// @returns The newly added speaker or nullptr if its decoder or encoder couldn't be created
+	Speaker *addSpeaker(unsigned int session, quint64 now);
+	std::unique_ptr< OpusEncoder, OpusEncoderDeleter > createEncoder() const;
+	/// @returns Whether the samples could be encoded
+	bool encode(OpusEncoder &encoder, const std::vector< float > &samples, Frame &frame);
+	/// Fills up the queued samples of the given speaker to a full frame by concealing the frames that haven't arrived
+	/// in time
+	void conceal(Speaker &speaker);
+	/// Mixes the next frame
+	///
+	/// @returns Whether there was anything to mix
+	bool mixFrame(std::vector< Frame > &frames);
+};
+
+#endif
@@ -6,10 +6,74 @@
 #include "AudioReceiverBuffer.h"
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 
 #include <tracy/Tracy.hpp>
 
+namespace {
+// Receivers are ordered by group (block of compatible protocol versions and audio context) and, within each group, by
+// their volume adjustment in whole decibels (descending). Each of these keys only has a small range of values, which
+// allows for ordering the receivers by means of counting sorts instead of comparison-based sorting.
+constexpr std::size_t CONTEXT_KEY_COUNT = Mumble::Protocol::AudioContext::END + 1;
+constexpr std::size_t GROUP_KEY_COUNT   = 2 * CONTEXT_KEY_COUNT;
+constexpr int MAX_DB_KEY                = 127;
+constexpr std::size_t VOLUME_KEY_COUNT  = 2 * MAX_DB_KEY + 2;
+
+std::size_t groupKey(const AudioReceiver &receiver) {
+	const std::size_t versionBlock =
+		receiver.getReceiver().m_version < Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION ? 0 : 1;
+	// Invalid contexts go last, just like they would when comparing the contexts directly
+	const std::size_t context = std::min(static_cast< std::size_t >(receiver.getContext()), CONTEXT_KEY_COUNT - 1);
+
+	return versionBlock * CONTEXT_KEY_COUNT + context;
+}
+
+std::size_t volumeKey(const AudioReceiver &receiver) {
+	const VolumeAdjustment &adjustment = receiver.getVolumeAdjustment();
+
+	int db = adjustment.dbAdjustment;
+	if (db == VolumeAdjustment::INVALID_DB_ADJUSTMENT) {
+		db = adjustment.factor > 0 ? VolumeAdjustment::toIntegerDBAdjustment(adjustment.factor) : -MAX_DB_KEY - 1;
+	}
+	db = std::max(-MAX_DB_KEY - 1, std::min(db, MAX_DB_KEY));
+
+	// Louder receivers get lower keys
+	return static_cast< std::size_t >(MAX_DB_KEY - db);
+}
+
+/// Stably orders the receivers in source by the given key and writes the result to destination, which has to be of
+/// the same size.
+///
+/// @returns Whether the receivers have been written to destination. If all receivers have the same key, their order
+/// 	doesn't change and the copy is skipped.
+template< std::size_t KeyCount, typename KeyFunction >
+bool countingSort(const std::vector< AudioReceiver > &source, std::vector< AudioReceiver > &destination,
+				  KeyFunction key) {
+	std::array< std::size_t, KeyCount > offsets = {};
+	for (const AudioReceiver &receiver : source) {
+		offsets[key(receiver)]++;
+	}
+
+	std::size_t offset = 0;
+	for (std::size_t &bucket : offsets) {
+		if (bucket == source.size()) {
+			return false;
+		}
+
+		const std::size_t count = bucket;
+		bucket                  = offset;
+		offset += count;
+	}
+
+	for (const AudioReceiver &receiver : source) {
+		destination[offsets[key(receiver)]++] = receiver;
+	}
+
+	return true;
+}
+} // namespace
+
 AudioReceiver::AudioReceiver(ServerUser &receiver, Mumble::Protocol::audio_context_t context,
 							 const VolumeAdjustment &volumeAdjustment)
 	: m_receiver(receiver), m_context(context), m_volumeAdjustment(volumeAdjustment) {
@@ -70,17 +134,23 @@ void AudioReceiverBuffer::forceAddReceiver(ServerUser &receiver, Mumble::Protoco
 	ZoneScoped;
 
 	std::vector< AudioReceiver > &receiverList = includePositionalData ? m_positionalReceivers : m_regularReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > &userEntryIndices =
-		includePositionalData ? m_positionalReceiverIndices : m_regularReceiverIndices;
 
-	auto it = userEntryIndices.find(&receiver);
-	if (it == userEntryIndices.end()) {
+	if (receiver.uiSession >= m_receiverSlots.size()) {
+		m_receiverSlots.resize(receiver.uiSession + 1);
+	}
+
+	ReceiverSlot &slot   = m_receiverSlots[receiver.uiSession];
+	std::uint32_t &epoch = includePositionalData ? slot.positionalEpoch : slot.regularEpoch;
+	std::uint32_t &index = includePositionalData ? slot.positionalIndex : slot.regularIndex;
+
+	if (epoch != m_epoch) {
 		// No entry for that user yet
 		receiverList.emplace_back(receiver, context, volumeAdjustment);
-		userEntryIndices[&receiver] = receiverList.size() - 1;
+		epoch = m_epoch;
+		index = static_cast< std::uint32_t >(receiverList.size() - 1);
 	} else {
 		// We already have an entry for the given user -> update that instead of adding a new one
-		AudioReceiver &receiverEntry = receiverList[it->second];
+		AudioReceiver &receiverEntry = receiverList[index];
 
 		assert(receiverEntry.getReceiver().uiSession == receiver.uiSession);
 
@@ -101,9 +171,13 @@ void AudioReceiverBuffer::preprocessBuffer() {
 
 void AudioReceiverBuffer::clear() {
 	m_regularReceivers.clear();
-	m_regularReceiverIndices.clear();
 	m_positionalReceivers.clear();
-	m_positionalReceiverIndices.clear();
+
+	if (++m_epoch == 0) {
+		// After a wrap-around, slots from long ago could appear to be current again
+		std::fill(m_receiverSlots.begin(), m_receiverSlots.end(), ReceiverSlot());
+		m_epoch = 1;
+	}
 }
 
 std::vector< AudioReceiver > &AudioReceiverBuffer::getReceivers(bool receivePositionalData) {
@@ -117,35 +191,20 @@ std::vector< AudioReceiver > &AudioReceiverBuffer::getReceivers(bool receivePosi
 void AudioReceiverBuffer::preprocessBuffer(std::vector< AudioReceiver > &receiverList) {
 	ZoneScoped;
 
-#ifndef NDEBUG
-	// Sort the list such that entries with same receiver are next to each other
-	std::sort(receiverList.begin(), receiverList.end(), [](const AudioReceiver &lhs, const AudioReceiver &rhs) {
-		return lhs.getReceiver().uiSession < rhs.getReceiver().uiSession;
-	});
-
-	// Assert that our list does not contain any duplicate receivers
-	assert(std::unique(receiverList.begin(), receiverList.end(),
-					   [](const AudioReceiver &lhs, const AudioReceiver &rhs) {
-						   return lhs.getReceiver().uiSession == rhs.getReceiver().uiSession;
-					   })
-		   == receiverList.end());
-#endif
-
-	// Sort the receivers, such that we can efficiently partition them into different regions
-	// Note: The list doesn't contains any duplicate receivers
-	std::sort(receiverList.begin(), receiverList.end(), [](const AudioReceiver &lhs, const AudioReceiver &rhs) {
-		// 1. Sort into block of compatible protocol versions
-		if (!Mumble::Protocol::protocolVersionsAreCompatible(lhs.getReceiver().m_version,
-															 rhs.getReceiver().m_version)) {
-			return lhs.getReceiver().m_version < rhs.getReceiver().m_version;
-		}
+	// Partition the receivers into blocks of compatible protocol versions and, within each block, by audio context.
+	// Within each of these groups, the receivers are ordered by volume adjustment (descending). As both counting sorts
+	// are stable, sorting by the volume first and by the group second yields exactly this order.
+	// Note: The list doesn't contain any duplicate receivers, as forceAddReceiver merges them
+	if (receiverList.size() < 2) {
+		return;
+	}
 
-		// 2. Within each block, sort based on the audio context
-		if (lhs.getContext() != rhs.getContext()) {
-			return lhs.getContext() < rhs.getContext();
-		}
+	m_partitionBuffer = receiverList;
 
-		// 3. Within each context, sort based on volume adjustments (but in descending order!)
-		return lhs.getVolumeAdjustment().factor > rhs.getVolumeAdjustment().factor;
-	});
+	if (countingSort< VOLUME_KEY_COUNT >(receiverList, m_partitionBuffer, volumeKey)) {
+		receiverList.swap(m_partitionBuffer);
+	}
+	if (countingSort< GROUP_KEY_COUNT >(receiverList, m_partitionBuffer, groupKey)) {
+		receiverList.swap(m_partitionBuffer);
+	}
 }
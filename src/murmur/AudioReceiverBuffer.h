@@ -10,8 +10,9 @@
 #include "ServerUser.h"
 #include "VolumeAdjustment.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
-#include <unordered_map>
 #include <vector>
 
 #include <tracy/Tracy.hpp>
@@ -89,7 +90,11 @@ public:
 
 		// Find a range, such that all receivers in [begin, end) are compatible in the sense that they will all receive
 		// the exact same audio packet (thus: no re-encoding required between sending the packet to them).
-		range.end = std::lower_bound(begin, end, *begin, [](const AudioReceiver &lhs, const AudioReceiver &rhs) {
+		// As the volume adjustments are only ordered by whole decibels, compatibility is checked for every receiver
+		// instead of bisecting the list.
+		range.end = std::find_if_not(begin, end, [&begin](const AudioReceiver &lhs) {
+			const AudioReceiver &rhs = *begin;
+
 			return lhs.getContext() == rhs.getContext()
 				   && Mumble::Protocol::protocolVersionsAreCompatible(lhs.getReceiver().m_version,
 																	  rhs.getReceiver().m_version)
@@ -107,10 +112,22 @@ public:
 	}
 
 protected:
+	/// The entries of a single user in the receiver lists. An entry only exists, if its epoch is the current one.
+	struct ReceiverSlot {
+		std::uint32_t regularEpoch    = 0;
+		std::uint32_t regularIndex    = 0;
+		std::uint32_t positionalEpoch = 0;
+		std::uint32_t positionalIndex = 0;
+	};
+
 	std::vector< AudioReceiver > m_regularReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > m_regularReceiverIndices;
 	std::vector< AudioReceiver > m_positionalReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > m_positionalReceiverIndices;
+	/// The slots of all users that have been added so far, indexed by session ID. Clearing the buffer only advances
+	/// the epoch, which invalidates all slots at once.
+	std::vector< ReceiverSlot > m_receiverSlots;
+	std::uint32_t m_epoch = 1;
+	/// Scratch space for ordering the receiver lists
+	std::vector< AudioReceiver > m_partitionBuffer;
 
 	void preprocessBuffer(std::vector< AudioReceiver > &receiverList);
 };
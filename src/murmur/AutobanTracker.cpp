@@ -0,0 +1,131 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AutobanTracker.h"
+
+#include <algorithm>
+
+constexpr std::uint32_t AutobanTracker::NONE;
+
+AutobanTracker::AutobanTracker(unsigned int attempts, std::uint64_t timeframe, std::uint64_t banTime,
+							   std::size_t capacity, unsigned int ipv6PrefixLength)
+	: m_attempts(attempts), m_timeframe(std::max< std::uint64_t >(timeframe, 1)), m_banTime(banTime),
+	  m_capacity(std::max< std::size_t >(capacity, 1)), m_ipv6PrefixLength(std::min(ipv6PrefixLength, 128U)),
+	  m_head(NONE), m_tail(NONE) {
+	m_entries.reserve(m_capacity);
+	m_indices.reserve(static_cast< int >(m_capacity));
+}
+
+bool AutobanTracker::attempt(const HostAddress &address, std::uint64_t now) {
+	Entry &entry = m_entries[use(keyOf(address), now)];
+
+	if (entry.bannedUntil > now) {
+		return true;
+	}
+	entry.bannedUntil = 0;
+
+	const double elapsed = static_cast< double >(now - std::min(entry.lastRefill, now));
+	entry.tokens         = std::min(m_attempts, entry.tokens + elapsed * m_attempts / static_cast< double >(m_timeframe));
+	entry.lastRefill     = now;
+
+	if (entry.tokens < 1) {
+		entry.bannedUntil = std::max< std::uint64_t >(now + m_banTime, 1);
+		return true;
+	}
+
+	entry.tokens -= 1;
+
+	return false;
+}
+
+void AutobanTracker::reset(const HostAddress &address) {
+	auto it = m_indices.constFind(keyOf(address));
+	if (it != m_indices.constEnd()) {
+		m_entries[*it].tokens = m_attempts;
+	}
+}
+
+std::size_t AutobanTracker::size() const {
+	return m_entries.size();
+}
+
+HostAddress AutobanTracker::keyOf(const HostAddress &address) const {
+	if (!address.isV6() || m_ipv6PrefixLength == 128) {
+		return address;
+	}
+
+	HostAddress key = address;
+	for (unsigned int i = m_ipv6PrefixLength / 8; i < 16; ++i) {
+		const unsigned int keptBits = i == m_ipv6PrefixLength / 8 ? m_ipv6PrefixLength % 8 : 0;
+
+		key.setByte(i, static_cast< std::uint8_t >(address.getByteRepresentation()[i] & ~(0xFF >> keptBits)));
+	}
+
+	return key;
+}
+
+std::uint32_t AutobanTracker::use(const HostAddress &key, std::uint64_t now) {
+	auto it = m_indices.constFind(key);
+	if (it != m_indices.constEnd()) {
+		const std::uint32_t index = *it;
+		if (index != m_head) {
+			unlink(index);
+			pushFront(index);
+		}
+
+		return index;
+	}
+
+	std::uint32_t index;
+	if (m_entries.size() < m_capacity) {
+		index = static_cast< std::uint32_t >(m_entries.size());
+		m_entries.emplace_back();
+	} else {
+		// Forget the address that has been quiet for the longest time
+		index = m_tail;
+		unlink(index);
+		m_indices.remove(m_entries[index].key);
+	}
+
+	Entry &entry      = m_entries[index];
+	entry.key         = key;
+	entry.tokens      = m_attempts;
+	entry.lastRefill  = now;
+	entry.bannedUntil = 0;
+
+	m_indices.insert(key, index);
+	pushFront(index);
+
+	return index;
+}
+
+void AutobanTracker::unlink(std::uint32_t index) {
+	Entry &entry = m_entries[index];
+
+	if (entry.previous != NONE) {
+		m_entries[entry.previous].next = entry.next;
+	} else {
+		m_head = entry.next;
+	}
+
+	if (entry.next != NONE) {
+		m_entries[entry.next].previous = entry.previous;
+	} else {
+		m_tail = entry.previous;
+	}
+}
+
+void AutobanTracker::pushFront(std::uint32_t index) {
+	Entry &entry   = m_entries[index];
+	entry.previous = NONE;
+	entry.next     = m_head;
+
+	if (m_head != NONE) {
+		m_entries[m_head].previous = index;
+	} else {
+		m_tail = index;
+	}
+	m_head = index;
+}
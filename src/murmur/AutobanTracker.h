@@ -0,0 +1,82 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_AUTOBANTRACKER_H_
+#define MUMBLE_MURMUR_AUTOBANTRACKER_H_
+
+#include "HostAddress.h"
+
+#include <QtCore/QHash>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Keeps track of the connection attempts of client addresses in order to ban the ones connecting too often.
+///
+/// Every address gets a token bucket that holds as many tokens as attempts are allowed and refills at the rate of
+/// that many tokens per timeframe. An attempt that finds the bucket empty bans the address. The buckets are kept in
+/// a least recently used list of a fixed size, so a flood of connections from (spoofed) addresses that never come
+/// back can't exhaust the memory. Instead, the addresses that have been quiet for the longest time are forgotten.
+///
+/// IPv6 clients can easily use many addresses from the same network, which is why these may be aggregated by
+/// prefix.
+class AutobanTracker {
+public:
+	/// @param attempts The number of attempts allowed within the timeframe
+	/// @param timeframe The timeframe in milliseconds
+	/// @param banTime How long an address is banned for in milliseconds
+	/// @param capacity The maximum number of addresses that are tracked at once
+	/// @param ipv6PrefixLength The number of leading bits IPv6 addresses are told apart by
+	AutobanTracker(unsigned int attempts, std::uint64_t timeframe, std::uint64_t banTime, std::size_t capacity,
+				   unsigned int ipv6PrefixLength);
+
+	/// Registers a connection attempt from the given address
+	///
+	/// @param now The current time in milliseconds, as measured by a monotonic clock
+	/// @returns Whether the address is banned
+	bool attempt(const HostAddress &address, std::uint64_t now);
+	/// Forgets the previous attempts of the given address
+	void reset(const HostAddress &address);
+
+	/// @returns The number of addresses that are currently tracked
+	std::size_t size() const;
+
+protected:
+	/// Terminates the least recently used list
+	static constexpr std::uint32_t NONE = UINT32_MAX;
+
+	struct Entry {
+		HostAddress key;
+		double tokens;
+		std::uint64_t lastRefill;
+		/// The end of the address' ban, 0 if it isn't banned
+		std::uint64_t bannedUntil;
+		std::uint32_t previous;
+		std::uint32_t next;
+	};
+
+	const double m_attempts;
+	const std::uint64_t m_timeframe;
+	const std::uint64_t m_banTime;
+	const std::size_t m_capacity;
+	const unsigned int m_ipv6PrefixLength;
+
+	std::vector< Entry > m_entries;
+	QHash< HostAddress, std::uint32_t > m_indices;
+	/// The most and least recently used entries
+	std::uint32_t m_head;
+	std::uint32_t m_tail;
+
+	/// @returns The address the given one is tracked as
+	HostAddress keyOf(const HostAddress &address) const;
+	/// @returns The index of the entry of the given key, which is created (by replacing the least recently used one,
+	/// 	if necessary) if there is none yet. The entry is moved to the front of the least recently used list.
+	std::uint32_t use(const HostAddress &key, std::uint64_t now);
+	void unlink(std::uint32_t index);
+	void pushFront(std::uint32_t index);
+};
+
+#endif
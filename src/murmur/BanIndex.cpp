@@ -0,0 +1,89 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BanIndex.h"
+
+/// @returns The bit with the given index of the address, counting from the most significant one
+static unsigned int bitOf(const HostAddress &address, unsigned int index) {
+	return (address.getByteRepresentation()[index / 8] >> (7 - index % 8)) & 1;
+}
+
+void BanIndex::rebuild(const QList< Ban > &bans) {
+	m_nodes.clear();
+	m_nodes.emplace_back();
+	m_bans.assign(bans.begin(), bans.end());
+	m_removed.assign(m_bans.size(), false);
+	m_expiries = decltype(m_expiries)();
+
+	for (std::size_t i = 0; i < m_bans.size(); ++i) {
+		insert(i);
+
+		if (m_bans[i].iDuration > 0) {
+			m_expiries.emplace(m_bans[i].qdtStart.addSecs(m_bans[i].iDuration), i);
+		}
+	}
+}
+
+void BanIndex::insert(std::size_t banIndex) {
+	const Ban &ban = m_bans[banIndex];
+
+	const unsigned int maskBits = static_cast< unsigned int >(qBound(0, ban.iMask, 128));
+
+	std::size_t node = 0;
+	for (unsigned int i = 0; i < maskBits; ++i) {
+		const unsigned int bit = bitOf(ban.haAddress, i);
+
+		if (m_nodes[node].children[bit] == 0) {
+			// The reference to the current node is invalidated when adding the child
+			m_nodes[node].children[bit] = static_cast< std::uint32_t >(m_nodes.size());
+			m_nodes.emplace_back();
+		}
+
+		node = m_nodes[node].children[bit];
+	}
+
+	m_nodes[node].bans.push_back(banIndex);
+}
+
+const Ban *BanIndex::match(const HostAddress &address) const {
+	if (m_nodes.empty()) {
+		return nullptr;
+	}
+
+	std::size_t node = 0;
+	for (unsigned int i = 0;; ++i) {
+		for (std::size_t banIndex : m_nodes[node].bans) {
+			// Bans that have just expired might not have been collected yet
+			if (!m_removed[banIndex] && !m_bans[banIndex].isExpired()) {
+				return &m_bans[banIndex];
+			}
+		}
+
+		if (i == 128 || m_nodes[node].children[bitOf(address, i)] == 0) {
+			return nullptr;
+		}
+
+		node = m_nodes[node].children[bitOf(address, i)];
+	}
+}
+
+QList< Ban > BanIndex::takeExpired() {
+	QList< Ban > expired;
+
+	while (!m_expiries.empty() && m_bans[m_expiries.top().second].isExpired()) {
+		const std::size_t banIndex = m_expiries.top().second;
+		m_expiries.pop();
+
+		// The trie isn't pruned, as the lookups skip removed bans anyway
+		m_removed[banIndex] = true;
+		expired << m_bans[banIndex];
+	}
+
+	return expired;
+}
+
+QDateTime BanIndex::nextExpiry() const {
+	return m_expiries.empty() ? QDateTime() : m_expiries.top().first;
+}
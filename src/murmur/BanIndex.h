@@ -0,0 +1,65 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BANINDEX_H_
+#define MUMBLE_MURMUR_BANINDEX_H_
+
+#include "Ban.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QList>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+/// Looks up the bans matching an address and keeps track of when they expire.
+///
+/// The banned address ranges are stored in a binary trie that branches on the bits of the (IPv6) addresses, so
+/// finding the bans of an address only takes as many steps as the longest mask, no matter how many bans there are.
+/// The temporary bans are furthermore ordered by the time they end, such that the expired ones can be collected
+/// without looking at all the others.
+class BanIndex {
+public:
+	/// Replaces the indexed bans by the given ones
+	void rebuild(const QList< Ban > &bans);
+
+	/// @returns The first indexed ban that matches the given address and hasn't expired yet, or nullptr if there
+	/// 	is none
+	const Ban *match(const HostAddress &address) const;
+
+	/// Removes the bans that have expired from the index
+	///
+	/// @returns The removed bans
+	QList< Ban > takeExpired();
+	/// @returns The time at which the next indexed ban expires. Invalid if there are no temporary bans.
+	QDateTime nextExpiry() const;
+
+protected:
+	struct Node {
+		/// The index of the node for the next bit being 0 or 1, or 0 if there is no such node (the root can't be
+		/// anybody's child)
+		std::uint32_t children[2] = { 0, 0 };
+		/// The indices of the bans whose mask ends at this node
+		std::vector< std::size_t > bans;
+	};
+
+	/// The nodes of the trie. The first one is the root.
+	std::vector< Node > m_nodes;
+	std::vector< Ban > m_bans;
+	/// Whether the ban with the same index has been removed because it expired
+	std::vector< bool > m_removed;
+
+	/// The end of every temporary ban along with its index, the one that ends first on top
+	using Expiry = std::pair< QDateTime, std::size_t >;
+	std::priority_queue< Expiry, std::vector< Expiry >, std::greater< Expiry > > m_expiries;
+
+	void insert(std::size_t banIndex);
+};
+
+#endif
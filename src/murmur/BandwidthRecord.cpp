@@ -0,0 +1,117 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BandwidthRecord.h"
+
+#include <algorithm>
+
+/// The amount of slots the statistics are computed over. Together with the partial current slot, these cover a second.
+static constexpr quint64 STATS_SLOTS = (1000000ULL >> BandwidthRecord::SLOT_SHIFT) + 1;
+
+/// @returns The first of the given amount of slots ending with the given one
+static quint64 firstSlot(quint64 lastSlot, quint64 count) {
+	return lastSlot + 1 > count ? lastSlot + 1 - count : 0;
+}
+
+BandwidthRecord::BandwidthRecord(quint64 now)
+	: m_start(now), m_lastFrame(now), m_idleControl(now), m_sequence(0), m_writing(false),
+	  m_currentSlot(now >> SLOT_SHIFT), m_windowSum(0) {
+	for (std::atomic< quint32 > &slot : m_slots) {
+		slot.store(0, std::memory_order_relaxed);
+	}
+}
+
+bool BandwidthRecord::addFrame(int size, int maxpersec, quint64 now) {
+	while (m_writing.exchange(true, std::memory_order_acquire)) {
+	}
+
+	const quint64 currentSlot = m_currentSlot.load(std::memory_order_relaxed);
+	// Another thread may have added a frame with a slightly later batch time
+	const quint64 slot = std::max(now >> SLOT_SHIFT, currentSlot);
+
+	const unsigned int sequence = m_sequence.load(std::memory_order_relaxed);
+	m_sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	// Clear the slots that have fallen out of the window since the last frame
+	const quint64 lastExpired = std::min(slot, currentSlot + SLOT_COUNT);
+	for (quint64 expired = currentSlot + 1; expired <= lastExpired; ++expired) {
+		std::atomic< quint32 > &expiredSlot = m_slots[expired % SLOT_COUNT];
+
+		m_windowSum -= expiredSlot.load(std::memory_order_relaxed);
+		expiredSlot.store(0, std::memory_order_relaxed);
+	}
+	m_currentSlot.store(slot, std::memory_order_relaxed);
+
+	// The window reaches back to the start of its first slot, unless the record is younger than that
+	const quint64 windowStart = std::max(m_start, firstSlot(slot, SLOT_COUNT) << SLOT_SHIFT);
+	const quint64 newSum      = m_windowSum + static_cast< quint64 >(size);
+
+	bool accepted = false;
+	if (now > windowStart) {
+		const quint64 bw = (newSum * 1000000ULL) / (now - windowStart);
+
+		accepted = bw <= static_cast< quint64 >(std::max(maxpersec, 0));
+	}
+
+	if (accepted) {
+		std::atomic< quint32 > &frameSlot = m_slots[slot % SLOT_COUNT];
+
+		frameSlot.store(frameSlot.load(std::memory_order_relaxed) + static_cast< quint32 >(size),
+						std::memory_order_relaxed);
+		m_windowSum = newSum;
+		m_lastFrame.store(std::max(now, m_lastFrame.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+	}
+
+	m_sequence.store(sequence + 2, std::memory_order_release);
+
+	m_writing.store(false, std::memory_order_release);
+
+	return accepted;
+}
+
+int BandwidthRecord::onlineSeconds(quint64 now) const {
+	return now > m_start ? static_cast< int >((now - m_start) / 1000000ULL) : 0;
+}
+
+int BandwidthRecord::idleSeconds(quint64 now) const {
+	const quint64 lastActivity =
+		std::max(m_lastFrame.load(std::memory_order_relaxed), m_idleControl.load(std::memory_order_relaxed));
+
+	return now > lastActivity ? static_cast< int >((now - lastActivity) / 1000000ULL) : 0;
+}
+
+void BandwidthRecord::resetIdleSeconds(quint64 now) {
+	m_idleControl.store(now, std::memory_order_relaxed);
+}
+
+int BandwidthRecord::bandwidth(quint64 now) const {
+	const quint64 slot = now >> SLOT_SHIFT;
+
+	quint64 sum = 0;
+	unsigned int sequence;
+	do {
+		sequence = m_sequence.load(std::memory_order_acquire);
+
+		// Slots after the last frame are empty and the ones before the window have been reused already
+		const quint64 currentSlot = m_currentSlot.load(std::memory_order_relaxed);
+		const quint64 first       = std::max(firstSlot(slot, STATS_SLOTS), firstSlot(currentSlot, SLOT_COUNT));
+		const quint64 last        = std::min(slot, currentSlot);
+
+		sum = 0;
+		for (quint64 i = first; i <= last; ++i) {
+			sum += m_slots[i % SLOT_COUNT].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((sequence & 1) || sequence != m_sequence.load(std::memory_order_relaxed));
+
+	const quint64 start = std::max(m_start, firstSlot(slot, STATS_SLOTS) << SLOT_SHIFT);
+	if (now < start + 250000ULL) {
+		return 0;
+	}
+
+	return static_cast< int >((sum * 1000000ULL) / (now - start));
+}
@@ -0,0 +1,62 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BANDWIDTHRECORD_H_
+#define MUMBLE_MURMUR_BANDWIDTHRECORD_H_
+
+#include "Timer.h"
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <atomic>
+
+/// Keeps track of the voice data a user sends, in order to enforce the bandwidth limit and for statistics.
+///
+/// The data is summed up in slots of 2^SLOT_SHIFT microseconds (~65ms), the last SLOT_COUNT of which make up the
+/// sliding window the bandwidth limit is checked against. Adding a frame thus only touches the slot it falls into,
+/// instead of a timestamp per frame.
+///
+/// Frames are added by the voice thread that receives the user's packets, using the time it has read once for the
+/// whole batch of packets. A client switching between UDP and TCP may briefly have its frames added by two threads,
+/// which are serialized by a spin flag that isn't contended otherwise. The statistics may be read from any thread
+/// without locking, as the slots are published by means of a sequence lock.
+class BandwidthRecord {
+public:
+	static constexpr unsigned int SLOT_SHIFT = 16;
+	static constexpr unsigned int SLOT_COUNT = 64;
+
+	/// @param now The time the record starts at, as returned by Timer::now()
+	explicit BandwidthRecord(quint64 now = Timer::now());
+
+	/// Accounts for a frame of the given size, unless that would exceed the given bandwidth (in bytes per second)
+	/// over the window.
+	///
+	/// @param now The time the frame has been received at, as returned by Timer::now()
+	/// @returns Whether the frame may pass
+	bool addFrame(int size, int maxpersec, quint64 now);
+	int onlineSeconds(quint64 now = Timer::now()) const;
+	/// @returns The seconds since the last frame or the last call to resetIdleSeconds(), whichever is more recent
+	int idleSeconds(quint64 now = Timer::now()) const;
+	void resetIdleSeconds(quint64 now = Timer::now());
+	/// @returns The bandwidth (in bytes per second) over the last second, or 0 if the record is younger than 250ms
+	int bandwidth(quint64 now = Timer::now()) const;
+
+protected:
+	const quint64 m_start;
+	std::atomic< quint64 > m_lastFrame;
+	std::atomic< quint64 > m_idleControl;
+
+	/// Odd while the slots are being written to
+	std::atomic< unsigned int > m_sequence;
+	std::atomic< bool > m_writing;
+	/// The slot (i.e. the time shifted by SLOT_SHIFT) the last frame has fallen into
+	std::atomic< quint64 > m_currentSlot;
+	/// The sum of all slots. Only accessed while adding frames.
+	quint64 m_windowSum;
+	std::array< std::atomic< quint32 >, SLOT_COUNT > m_slots;
+};
+
+#endif
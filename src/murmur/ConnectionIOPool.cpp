@@ -0,0 +1,47 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ConnectionIOPool.h"
+
+#include <QtCore/QThread>
+
+#include <tracy/Tracy.hpp>
+
+class ConnectionIOPool::Worker : public QThread {
+protected:
+	void run() Q_DECL_OVERRIDE {
+		tracy::SetThreadName("Connection");
+
+		exec();
+	}
+};
+
+ConnectionIOPool::ConnectionIOPool(std::size_t threadCount) {
+	for (std::size_t i = 0; i < threadCount; ++i) {
+		m_workers.push_back(std::make_unique< Worker >());
+		m_workers.back()->start();
+	}
+}
+
+ConnectionIOPool::~ConnectionIOPool() {
+	for (std::unique_ptr< Worker > &worker : m_workers) {
+		worker->quit();
+	}
+
+	for (std::unique_ptr< Worker > &worker : m_workers) {
+		worker->wait();
+	}
+}
+
+std::size_t ConnectionIOPool::threadCount() const {
+	return m_workers.size();
+}
+
+QThread *ConnectionIOPool::nextThread() {
+	QThread *thread = m_workers[m_nextWorker].get();
+	m_nextWorker    = (m_nextWorker + 1) % m_workers.size();
+
+	return thread;
+}
@@ -0,0 +1,39 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CONNECTIONIOPOOL_H_
+#define MUMBLE_MURMUR_CONNECTIONIOPOOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class QThread;
+
+/// A fixed set of threads that perform the socket I/O of client connections.
+///
+/// Every thread runs an event loop that the sockets of the connections assigned to it are moved into (see
+/// Connection::moveSocketToThread). The TLS handshake, encryption and decryption as well as splitting the incoming
+/// data into messages thus happen in these threads. The parsed messages are handed to the thread owning the server
+/// state through queued signals.
+class ConnectionIOPool {
+public:
+	explicit ConnectionIOPool(std::size_t threadCount);
+	/// Stops the threads. Sockets that have been scheduled for deletion before are deleted by their threads.
+	~ConnectionIOPool();
+
+	std::size_t threadCount() const;
+
+	/// @returns The thread the next connection is to be assigned to. Connections are spread evenly.
+	QThread *nextThread();
+
+protected:
+	class Worker;
+
+	std::vector< std::unique_ptr< Worker > > m_workers;
+	std::size_t m_nextWorker = 0;
+};
+
+#endif
@@ -0,0 +1,158 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CryptWorkerPool.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+#include <tracy/Tracy.hpp>
+
+#include <algorithm>
+
+void CryptFanout::clear() {
+	m_size = 0;
+}
+
+void CryptFanout::add(ServerUser &receiver) {
+	if (m_size == m_entries.size()) {
+		m_entries.resize(m_size + 1);
+	}
+
+	m_entries[m_size].receiver  = &receiver;
+	m_entries[m_size].encrypted = false;
+	++m_size;
+}
+
+std::size_t CryptFanout::size() const {
+	return m_size;
+}
+
+CryptFanout::Entry &CryptFanout::operator[](std::size_t index) {
+	return m_entries[index];
+}
+
+unsigned char *CryptFanout::buffer(std::size_t index) {
+#if defined(__LP64__)
+	return m_entries[index].data + 4;
+#else
+	return m_entries[index].data;
+#endif
+}
+
+
+class CryptWorkerPool::Worker : public QThread {
+public:
+	Worker(CryptWorkerPool &pool) : QThread(), m_pool(pool) {}
+
+protected:
+	CryptWorkerPool &m_pool;
+
+	void run() Q_DECL_OVERRIDE {
+		tracy::SetThreadName("Crypt");
+
+		m_pool.workerLoop();
+	}
+};
+
+CryptWorkerPool::CryptWorkerPool(std::size_t threadCount) : m_running(true) {
+	for (std::size_t i = 0; i < threadCount; ++i) {
+		m_workers.push_back(std::make_unique< Worker >(*this));
+		m_workers.back()->start(QThread::HighestPriority);
+	}
+}
+
+CryptWorkerPool::~CryptWorkerPool() {
+	{
+		QMutexLocker l(&m_mutex);
+		m_running = false;
+		m_jobAvailable.wakeAll();
+	}
+
+	for (std::unique_ptr< Worker > &worker : m_workers) {
+		worker->wait();
+	}
+}
+
+std::size_t CryptWorkerPool::threadCount() const {
+	return m_workers.size();
+}
+
+void CryptWorkerPool::run(std::size_t count, std::size_t sliceSize, const SliceFunction &function) {
+	if (count == 0) {
+		return;
+	}
+
+	Job job;
+	job.function      = &function;
+	job.count         = count;
+	job.sliceSize     = std::max(sliceSize, static_cast< std::size_t >(1));
+	job.sliceCount    = (count + job.sliceSize - 1) / job.sliceSize;
+	job.activeWorkers = 0;
+	job.nextSlice.store(0, std::memory_order_relaxed);
+
+	// The calling thread takes care of one slice itself
+	const std::size_t helpers = std::min(job.sliceCount - 1, m_workers.size());
+
+	if (helpers > 0) {
+		QMutexLocker l(&m_mutex);
+		m_queue.insert(m_queue.end(), helpers, &job);
+		m_jobAvailable.wakeAll();
+	}
+
+	processJob(job);
+
+	if (helpers > 0) {
+		QMutexLocker l(&m_mutex);
+
+		// All slices are done or in progress by now. Pool threads that did not pick up the job yet are not
+		// needed anymore, but the job must outlive those that did.
+		m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), &job), m_queue.end());
+
+		while (job.activeWorkers > 0) {
+			m_jobFinished.wait(&m_mutex);
+		}
+	}
+}
+
+void CryptWorkerPool::processJob(Job &job) {
+	ZoneScoped;
+
+	std::size_t slice;
+	while ((slice = job.nextSlice.fetch_add(1, std::memory_order_relaxed)) < job.sliceCount) {
+		const std::size_t begin = slice * job.sliceSize;
+		const std::size_t end   = std::min(begin + job.sliceSize, job.count);
+
+		(*job.function)(begin, end);
+	}
+}
+
+void CryptWorkerPool::workerLoop() {
+	QMutexLocker l(&m_mutex);
+
+	while (true) {
+		while (m_running && m_queue.empty()) {
+			m_jobAvailable.wait(&m_mutex);
+		}
+
+		if (!m_running) {
+			return;
+		}
+
+		Job *job = m_queue.front();
+		m_queue.pop_front();
+		++job->activeWorkers;
+
+		l.unlock();
+		processJob(*job);
+		l.relock();
+
+		// Taking the mutex here also makes all writes done while processing the job visible to the thread
+		// waiting for it
+		if (--job->activeWorkers == 0) {
+			m_jobFinished.wakeAll();
+		}
+	}
+}
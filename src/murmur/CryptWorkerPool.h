@@ -0,0 +1,99 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CRYPTWORKERPOOL_H_
+#define MUMBLE_MURMUR_CRYPTWORKERPOOL_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class ServerUser;
+
+/// Preallocated buffers the fan-out of a voice packet gets encrypted into. Every receiver owns one
+/// entry, so that the entries can be filled by different threads without any synchronization.
+class CryptFanout {
+public:
+	struct Entry {
+		alignas(8) unsigned char data[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+		ServerUser *receiver;
+		/// The length of the encrypted datagram
+		std::size_t length;
+		/// Whether the packet has been encrypted for the receiver successfully
+		bool encrypted;
+	};
+
+	void clear();
+	void add(ServerUser &receiver);
+
+	std::size_t size() const;
+	Entry &operator[](std::size_t index);
+
+	/// @returns The buffer the datagram for the entry with the given index is written to. On LP64 platforms
+	/// 	everything after the 4 byte crypt header is 8-byte aligned.
+	unsigned char *buffer(std::size_t index);
+
+protected:
+	/// The entries are never released, such that a fan-out only allocates if it is larger than all previous ones
+	std::vector< Entry > m_entries;
+	std::size_t m_size = 0;
+};
+
+/// A fixed set of threads that help a voice thread with the encryption of large fan-outs.
+///
+/// A call to run() splits the work into slices that are processed by the calling thread and by
+/// the pool's threads in parallel. The pool can be used by multiple voice threads at once.
+class CryptWorkerPool {
+public:
+	using SliceFunction = std::function< void(std::size_t begin, std::size_t end) >;
+
+	explicit CryptWorkerPool(std::size_t threadCount);
+	~CryptWorkerPool();
+
+	std::size_t threadCount() const;
+
+	/// Calls the given function for disjoint slices that together cover the range [0, count) and blocks
+	/// until all of them have been processed. The calling thread processes slices as well.
+	///
+	/// @param count The amount of items to process
+	/// @param sliceSize The (maximum) amount of items passed to a single call of the function
+	/// @param function The function processing a slice
+	void run(std::size_t count, std::size_t sliceSize, const SliceFunction &function);
+
+protected:
+	class Worker;
+
+	struct Job {
+		const SliceFunction *function;
+		std::size_t count;
+		std::size_t sliceSize;
+		std::size_t sliceCount;
+		/// The slice that is processed next by whichever thread gets to it first
+		std::atomic< std::size_t > nextSlice;
+		/// The amount of pool threads working on this job. Protected by m_mutex.
+		std::size_t activeWorkers;
+	};
+
+	QMutex m_mutex;
+	QWaitCondition m_jobAvailable;
+	QWaitCondition m_jobFinished;
+	/// Every job is queued once per pool thread that is supposed to help with it
+	std::deque< Job * > m_queue;
+	bool m_running;
+	std::vector< std::unique_ptr< Worker > > m_workers;
+
+	void processJob(Job &job);
+	void workerLoop();
+};
+
+#endif
@@ -0,0 +1,196 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "DBWriteQueue.h"
+#include "Meta.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutexLocker>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+#include <tracy/Tracy.hpp>
+
+#include <algorithm>
+
+DBWriteQueue::DBWriteQueue(const QSqlDatabase &database, int delay, std::size_t batchSize)
+	: QThread(), m_connectionName(QLatin1String("DBWriteQueue")), m_driver(database.driverName()),
+	  m_databaseName(database.databaseName()), m_hostName(database.hostName()), m_port(database.port()),
+	  m_userName(database.userName()), m_password(database.password()),
+	  m_connectOptions(database.connectOptions()), m_delay(delay), m_batchSize(batchSize), m_queued(0),
+	  m_committed(0), m_flushRequested(false), m_running(true) {
+	start();
+}
+
+DBWriteQueue::~DBWriteQueue() {
+	{
+		QMutexLocker l(&m_mutex);
+		m_running = false;
+		m_writeAvailable.wakeAll();
+	}
+
+	wait();
+}
+
+void DBWriteQueue::enqueue(const Write &write) {
+	QMutexLocker l(&m_mutex);
+
+	m_queue.push_back(write);
+	++m_queued;
+
+	// The thread only has to be woken up for the first write (to start waiting for further ones) and once the
+	// batch is full
+	if (m_queue.size() == 1 || m_queue.size() >= m_batchSize) {
+		m_writeAvailable.wakeAll();
+	}
+}
+
+void DBWriteQueue::flush() {
+	QMutexLocker l(&m_mutex);
+
+	const std::uint64_t target = m_queued;
+	if (m_committed >= target) {
+		return;
+	}
+
+	m_flushRequested = true;
+	m_writeAvailable.wakeAll();
+
+	while (m_committed < target) {
+		m_writesCommitted.wait(&m_mutex);
+	}
+}
+
+std::deque< DBWriteQueue::Write > DBWriteQueue::takePending() {
+	QMutexLocker l(&m_mutex);
+
+	std::deque< Write > pending;
+	pending.swap(m_queue);
+	// The queue's thread can't be committing, so everything else has been committed already
+	m_committed = m_queued;
+
+	return pending;
+}
+
+QMutex &DBWriteQueue::transactionMutex() {
+	return m_transactionMutex;
+}
+
+bool DBWriteQueue::beginTransaction(QSqlDatabase &database) {
+	if (database.driverName() == QLatin1String("QSQLITE")) {
+		QSqlQuery query(database);
+		return query.exec(QLatin1String("BEGIN IMMEDIATE"));
+	}
+
+	return database.transaction();
+}
+
+QSqlDatabase &DBWriteQueue::database() {
+	return m_database;
+}
+
+void DBWriteQueue::openDatabase() {
+	m_database = QSqlDatabase::addDatabase(m_driver, m_connectionName);
+	m_database.setDatabaseName(m_databaseName);
+	m_database.setHostName(m_hostName);
+	m_database.setPort(m_port);
+	m_database.setUserName(m_userName);
+	m_database.setPassword(m_password);
+	m_database.setConnectOptions(m_connectOptions);
+
+	if (!m_database.open()) {
+		qFatal("DBWriteQueue: Failed to connect to the database: %s", qPrintable(m_database.lastError().text()));
+	}
+
+	// The journal mode is stored in the database, but the synchronous mode has to be set for every connection
+	if (m_driver == QLatin1String("QSQLITE")) {
+		QSqlQuery query(m_database);
+		if (Meta::mp.iSQLiteWAL == 1) {
+			query.exec(QLatin1String("PRAGMA synchronous=NORMAL;"));
+		} else if (Meta::mp.iSQLiteWAL == 2) {
+			query.exec(QLatin1String("PRAGMA synchronous=FULL;"));
+		}
+	}
+}
+
+void DBWriteQueue::commit(const std::deque< Write > &batch) {
+	ZoneScoped;
+
+	const bool transaction = beginTransaction(m_database);
+	if (!transaction) {
+		qWarning("DBWriteQueue: Failed to start a transaction, performing %d writes one by one: %s",
+				 static_cast< int >(batch.size()), qPrintable(m_database.lastError().text()));
+	}
+
+	for (const Write &write : batch) {
+		QSqlQuery query(m_database);
+		write(query);
+	}
+
+	if (transaction && !m_database.commit()) {
+		qWarning("DBWriteQueue: Failed to commit %d writes: %s", static_cast< int >(batch.size()),
+				 qPrintable(m_database.lastError().text()));
+		m_database.rollback();
+	}
+}
+
+void DBWriteQueue::run() {
+	tracy::SetThreadName("Database");
+
+	openDatabase();
+
+	QMutexLocker l(&m_mutex);
+
+	while (true) {
+		while (m_running && m_queue.empty()) {
+			m_writeAvailable.wait(&m_mutex);
+		}
+
+		if (m_queue.empty()) {
+			break;
+		}
+
+		// Give further writes the chance to join the transaction
+		QElapsedTimer timer;
+		timer.start();
+		while (m_running && !m_flushRequested && m_queue.size() < m_batchSize) {
+			const qint64 remaining = m_delay - timer.elapsed();
+			if (remaining <= 0) {
+				break;
+			}
+
+			m_writeAvailable.wait(&m_mutex, static_cast< unsigned long >(remaining));
+		}
+
+		// The batch is taken only once no transaction runs on the main connection. Until then, the main connection may
+		// take the writes itself (see takePending()).
+		l.unlock();
+		QMutexLocker transactionLocker(&m_transactionMutex);
+		l.relock();
+
+		std::deque< Write > batch;
+		batch.swap(m_queue);
+		const std::uint64_t committed = m_queued;
+		m_flushRequested              = false;
+
+		l.unlock();
+
+		if (!batch.empty()) {
+			commit(batch);
+		}
+		transactionLocker.unlock();
+
+		l.relock();
+
+		m_committed = std::max(m_committed, committed);
+		m_writesCommitted.wakeAll();
+	}
+
+	l.unlock();
+
+	m_database.close();
+	m_database = QSqlDatabase();
+	QSqlDatabase::removeDatabase(m_connectionName);
+}
@@ -0,0 +1,96 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_DBWRITEQUEUE_H_
+#define MUMBLE_MURMUR_DBWRITEQUEUE_H_
+
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtSql/QSqlDatabase>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+class QSqlQuery;
+
+/// Performs database writes on a dedicated thread with its own connection to the database.
+///
+/// Writes are kept back for a short while and then committed together in a single transaction. Thus bursts of
+/// writes (e.g. the log messages caused by many users joining and leaving) cost a single commit instead of one each,
+/// and the thread that issued them doesn't wait for any of these.
+///
+/// The queue's connection and the main connection never run transactions at the same time (see transactionMutex()).
+/// Otherwise a transaction that reads and then writes could fail to get the write lock of the database.
+class DBWriteQueue : public QThread {
+	Q_DISABLE_COPY(DBWriteQueue)
+public:
+	using Write = std::function< void(QSqlQuery &) >;
+
+	/// @param database The connection whose parameters are used for the connection of the queue's thread
+	/// @param delay The time in milliseconds a write is kept back at most, waiting for further writes
+	/// @param batchSize The amount of pending writes that are committed right away
+	DBWriteQueue(const QSqlDatabase &database, int delay, std::size_t batchSize);
+	/// Commits all pending writes before the thread stops
+	~DBWriteQueue() Q_DECL_OVERRIDE;
+
+	/// Queues the given write. It is performed in the queue's thread and must not access anything that might be gone
+	/// by then.
+	void enqueue(const Write &write);
+	/// Blocks until all writes that have been queued so far have been committed. Must not be called while holding
+	/// transactionMutex().
+	void flush();
+	/// Removes the writes that haven't been committed yet, so that they can be performed by the transaction of the
+	/// caller instead. Must only be called while holding transactionMutex().
+	std::deque< Write > takePending();
+
+	/// @returns The mutex that is held by whoever runs a transaction, be it the queue's thread or the main connection
+	QMutex &transactionMutex();
+	/// Starts a transaction on the given connection. On SQLite the transaction takes the write lock right away. A
+	/// transaction that has already read can't wait for it, so it would fail if another connection held it.
+	///
+	/// @returns Whether the transaction has been started
+	static bool beginTransaction(QSqlDatabase &database);
+
+	/// @returns The connection of the queue's thread. Must only be used in that thread.
+	QSqlDatabase &database();
+
+protected:
+	QString m_connectionName;
+	QString m_driver;
+	QString m_databaseName;
+	QString m_hostName;
+	int m_port;
+	QString m_userName;
+	QString m_password;
+	QString m_connectOptions;
+	QSqlDatabase m_database;
+
+	const int m_delay;
+	const std::size_t m_batchSize;
+
+	QMutex m_transactionMutex;
+
+	QMutex m_mutex;
+	QWaitCondition m_writeAvailable;
+	QWaitCondition m_writesCommitted;
+	std::deque< Write > m_queue;
+	/// The amount of writes that have been queued and committed since the queue has been created
+	std::uint64_t m_queued;
+	std::uint64_t m_committed;
+	/// Whether somebody waits for the pending writes, so that there is no point in waiting for further ones
+	bool m_flushRequested;
+	bool m_running;
+
+	void run() Q_DECL_OVERRIDE;
+	void openDatabase();
+	/// Performs the given writes in a single transaction
+	void commit(const std::deque< Write > &batch);
+};
+
+#endif
@@ -405,7 +405,7 @@ void MurmurDBus::addChannel(const QString &name, int chanparent, const QDBusMess
 	Channel *nc;
 
 	{
-		QWriteLocker wl(&server->qrwlVoiceThread);
+		VoiceWriteLocker wl(&server->qrwlVoiceThread);
 		nc = server->addChannel(cChannel, name);
 	}
 
@@ -426,7 +426,7 @@ void MurmurDBus::removeChannel(int id, const QDBusMessage &msg) {
 		return;
 	}
 
-	QWriteLocker wl(&server->qrwlVoiceThread);
+	VoiceWriteLocker wl(&server->qrwlVoiceThread);
 	server->removeChannel(cChannel);
 }
 
@@ -555,7 +555,7 @@ void MurmurDBus::setACL(int id, const QList< ACLInfo > &acls, const QList< Group
 		a->pAllow     = static_cast< ChanACL::Permissions >(ai.allow) & ChanACL::All;
 	}
 
-	server->clearACLCache();
+	server->clearChannelACLCache(cChannel);
 	server->updateChannel(cChannel);
 }
 
@@ -0,0 +1,135 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LinkClosure.h"
+
+#include <QtCore/QStack>
+
+#include <utility>
+
+void LinkClosure::addLink(unsigned int channelID, unsigned int linkedChannelID) {
+	if (channelID == linkedChannelID || m_links.value(channelID).contains(linkedChannelID)) {
+		return;
+	}
+
+	m_links[channelID].insert(linkedChannelID);
+	m_links[linkedChannelID].insert(channelID);
+
+	auto groupIt       = m_groupIDs.constFind(channelID);
+	auto linkedGroupIt = m_groupIDs.constFind(linkedChannelID);
+
+	if (groupIt == m_groupIDs.constEnd() && linkedGroupIt == m_groupIDs.constEnd()) {
+		createGroup({ channelID, linkedChannelID });
+	} else if (linkedGroupIt == m_groupIDs.constEnd()) {
+		m_groups[*groupIt].append(linkedChannelID);
+		m_groupIDs.insert(linkedChannelID, *groupIt);
+	} else if (groupIt == m_groupIDs.constEnd()) {
+		m_groups[*linkedGroupIt].append(channelID);
+		m_groupIDs.insert(channelID, *linkedGroupIt);
+	} else if (*groupIt != *linkedGroupIt) {
+		// Merge the smaller group into the larger one
+		unsigned int target = *groupIt;
+		unsigned int source = *linkedGroupIt;
+		if (m_groups.value(target).size() < m_groups.value(source).size()) {
+			std::swap(target, source);
+		}
+
+		const QVector< unsigned int > sourceMembers = m_groups.take(source);
+		for (unsigned int member : sourceMembers) {
+			m_groupIDs.insert(member, target);
+		}
+		m_groups[target] += sourceMembers;
+	}
+}
+
+void LinkClosure::removeLink(unsigned int channelID, unsigned int linkedChannelID) {
+	auto linksIt = m_links.find(channelID);
+	if (linksIt == m_links.end() || !linksIt->remove(linkedChannelID)) {
+		return;
+	}
+	if (linksIt->isEmpty()) {
+		m_links.erase(linksIt);
+	}
+
+	auto linkedLinksIt = m_links.find(linkedChannelID);
+	linkedLinksIt->remove(channelID);
+	if (linkedLinksIt->isEmpty()) {
+		m_links.erase(linkedLinksIt);
+	}
+
+	// The group only falls apart, if there is no other path between the two channels
+	const QSet< unsigned int > reachable = collectLinked(channelID);
+	if (reachable.contains(linkedChannelID)) {
+		return;
+	}
+
+	const QVector< unsigned int > members = m_groups.take(m_groupIDs.value(channelID));
+
+	QVector< unsigned int > channelMembers;
+	QVector< unsigned int > linkedMembers;
+	for (unsigned int member : members) {
+		m_groupIDs.remove(member);
+
+		if (reachable.contains(member)) {
+			channelMembers.append(member);
+		} else {
+			linkedMembers.append(member);
+		}
+	}
+
+	createGroup(channelMembers);
+	createGroup(linkedMembers);
+}
+
+void LinkClosure::removeChannel(unsigned int channelID) {
+	for (unsigned int linkedChannelID : m_links.value(channelID)) {
+		removeLink(channelID, linkedChannelID);
+	}
+}
+
+QVector< unsigned int > LinkClosure::getLinkGroup(unsigned int channelID) const {
+	auto it = m_groupIDs.constFind(channelID);
+
+	return it != m_groupIDs.constEnd() ? m_groups.value(*it) : QVector< unsigned int >();
+}
+
+bool LinkClosure::isLinked(unsigned int channelID, unsigned int otherChannelID) const {
+	auto it      = m_groupIDs.constFind(channelID);
+	auto otherIt = m_groupIDs.constFind(otherChannelID);
+
+	return it != m_groupIDs.constEnd() && otherIt != m_groupIDs.constEnd() && *it == *otherIt;
+}
+
+QSet< unsigned int > LinkClosure::collectLinked(unsigned int channelID) const {
+	QSet< unsigned int > seen;
+	seen.insert(channelID);
+
+	QStack< unsigned int > stack;
+	stack.push(channelID);
+
+	while (!stack.isEmpty()) {
+		for (unsigned int linkedChannelID : m_links.value(stack.pop())) {
+			if (!seen.contains(linkedChannelID)) {
+				seen.insert(linkedChannelID);
+				stack.push(linkedChannelID);
+			}
+		}
+	}
+
+	return seen;
+}
+
+void LinkClosure::createGroup(const QVector< unsigned int > &members) {
+	if (members.size() < 2) {
+		return;
+	}
+
+	const unsigned int groupID = m_nextGroupID++;
+
+	for (unsigned int member : members) {
+		m_groupIDs.insert(member, groupID);
+	}
+	m_groups.insert(groupID, members);
+}
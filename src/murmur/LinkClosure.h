@@ -0,0 +1,49 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_LINKCLOSURE_H_
+#define MUMBLE_MURMUR_LINKCLOSURE_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
+/// Keeps track of which channels are linked to each other, directly or through other channels.
+///
+/// Channel::allLinks() has to walk the link graph on every call. This class instead maintains the groups of
+/// linked channels (the connected components of the link graph) and updates them whenever a single link is
+/// added or removed. Adding a link merges two groups, removing one only has to walk the group it was part of.
+class LinkClosure {
+public:
+	/// Links the two given channels. Linking channels that are linked already is a no-op.
+	void addLink(unsigned int channelID, unsigned int linkedChannelID);
+	/// Removes the (direct) link between the two given channels
+	void removeLink(unsigned int channelID, unsigned int linkedChannelID);
+	/// Removes all links of the given channel
+	void removeChannel(unsigned int channelID);
+
+	/// @returns The IDs of all channels that are linked to the given channel, including the channel itself. If
+	/// 	the channel is not linked at all, the returned list is empty. Returning the list does not copy it.
+	QVector< unsigned int > getLinkGroup(unsigned int channelID) const;
+
+	/// @returns Whether the two given channels are linked to each other, directly or indirectly
+	bool isLinked(unsigned int channelID, unsigned int otherChannelID) const;
+
+protected:
+	/// The direct links of every channel that has any
+	QHash< unsigned int, QSet< unsigned int > > m_links;
+	/// The ID of the group every linked channel belongs to
+	QHash< unsigned int, unsigned int > m_groupIDs;
+	/// The members of every group
+	QHash< unsigned int, QVector< unsigned int > > m_groups;
+	unsigned int m_nextGroupID = 0;
+
+	/// @returns The IDs of all channels reachable from the given one by following direct links
+	QSet< unsigned int > collectLinked(unsigned int channelID) const;
+	/// Puts the given channels into a new group, unless they are only a single channel
+	void createGroup(const QVector< unsigned int > &members);
+};
+
+#endif
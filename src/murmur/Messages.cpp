@@ -193,15 +193,28 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	}
 	MSG_SETUP(ServerUser::Connected);
 
+	if (uSource->m_passwordHashPending) {
+		// The client has to wait for its previous attempt to be verified
+		return;
+	}
+
 	// As the first thing, assign a session ID to this client. Given that the client initiated
 	// the authentication procedure we can be sure that this is not just a random TCP connection.
 	// Thus it is about time we assign the ID to this client in order to be able to reference it
-	// in the following.
-	{
-		QWriteLocker wl(&qrwlVoiceThread);
-		uSource->uiSession = qqIds.dequeue();
-		qhUsers.insert(uSource->uiSession, uSource);
-		qhHostUsers[uSource->haAddress].insert(uSource);
+	// in the following. Clients resuming their authentication after their password hash has been
+	// computed already have one.
+	if (uSource->uiSession == 0) {
+		{
+			VoiceWriteLocker wl(&qrwlVoiceThread);
+			uSource->uiSession = qqIds.dequeue();
+			qhUsers.insert(uSource->uiSession, uSource);
+			qhHostUsers[uSource->haAddress].insert(uSource);
+		}
+		{
+			// Permissions are cached per session, which might have been used by a previous user
+			QMutexLocker qml(&qmCache);
+			acCache.clearUser(*uSource);
+		}
 	}
 
 	Channel *root = qhChannels.value(0);
@@ -219,6 +232,15 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	int id = authenticate(uSource->qsName, pw, static_cast< int >(uSource->uiSession), uSource->qslEmail,
 						  uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain());
 
+	if (id == -4) {
+		// The password is verified in the background, after which the authentication is resumed
+		if (startPasswordHash(uSource, msg)) {
+			return;
+		}
+
+		id = -3;
+	}
+
 	uSource->iId = id >= 0 ? id : -1;
 
 	QString reason;
@@ -374,40 +396,70 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 						  "talk to or hear most clients. Please make sure your client was built with CELT support."));
 	}
 
+	// Clients of version 1.2.2 and newer all receive the same channel and user states, except for a few fields that
+	// depend on the receiving client. These are sent from the pre-serialised messages of m_stateSyncCache, all at once.
+	const bool cachedSync = uSource->m_version >= Version::fromComponents(1, 2, 2);
+	QByteArray sync;
+
+	auto fillChannelState = [this, uSource](Channel *channel, MumbleProto::ChannelState &mpcs) {
+		mpcs.set_channel_id(channel->iId);
+		if (channel->cParent)
+			mpcs.set_parent(channel->cParent->iId);
+		if (channel->iId == 0)
+			mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
+		else
+			mpcs.set_name(u8(channel->qsName));
+
+		mpcs.set_position(channel->iPosition);
+
+		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !channel->qbaDescHash.isEmpty())
+			mpcs.set_description_hash(blob(channel->qbaDescHash));
+		else if (!channel->qsDesc.isEmpty())
+			mpcs.set_description(u8(channel->qsDesc));
+
+		mpcs.set_max_users(channel->uiMaxUsers);
+
+		// Include info about enter restrictions of this channel
+		mpcs.set_is_enter_restricted(isChannelEnterRestricted(channel));
+	};
+	auto fillChannelLinks = [](const Channel *channel, MumbleProto::ChannelState &mpcs) {
+		mpcs.set_channel_id(channel->iId);
+
+		foreach (Channel *l, channel->qhLinks.keys())
+			mpcs.add_links(l->iId);
+	};
+
+	// The permission to enter a channel is the only field that differs between users
+	MumbleProto::ChannelState mpcs;
+	mpcs.set_can_enter(true);
+	const QByteArray canEnterField = StateSyncCache::serialize(mpcs);
+	mpcs.set_can_enter(false);
+	const QByteArray cannotEnterField = StateSyncCache::serialize(mpcs);
+
 	// Transmit channel tree
 	QQueue< Channel * > q;
-	QSet< Channel * > chans;
+	QList< Channel * > chans;
 	q << root;
-	MumbleProto::ChannelState mpcs;
 
 	while (!q.isEmpty()) {
 		c = q.dequeue();
-		chans.insert(c);
-
-		mpcs.Clear();
-
-		mpcs.set_channel_id(c->iId);
-		if (c->cParent)
-			mpcs.set_parent(c->cParent->iId);
-		if (c->iId == 0)
-			mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
-		else
-			mpcs.set_name(u8(c->qsName));
+		chans << c;
 
-		mpcs.set_position(c->iPosition);
+		const bool canEnter = hasPermission(uSource, c, ChanACL::Enter);
 
-		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !c->qbaDescHash.isEmpty())
-			mpcs.set_description_hash(blob(c->qbaDescHash));
-		else if (!c->qsDesc.isEmpty())
-			mpcs.set_description(u8(c->qsDesc));
+		if (cachedSync) {
+			const QByteArray &state = m_stateSyncCache.channelState(
+				c->iId, [&fillChannelState, c](MumbleProto::ChannelState &built) { fillChannelState(c, built); });
 
-		mpcs.set_max_users(c->uiMaxUsers);
-
-		// Include info about enter restrictions of this channel
-		mpcs.set_is_enter_restricted(isChannelEnterRestricted(c));
-		mpcs.set_can_enter(hasPermission(uSource, c, ChanACL::Enter));
+			StateSyncCache::appendMessage(sync, Mumble::Protocol::TCPMessageType::ChannelState, state,
+										  canEnter ? canEnterField : cannotEnterField);
+		} else {
+			mpcs.Clear();
+			fillChannelState(c, mpcs);
+			mpcs.set_can_enter(canEnter);
 
-		sendMessage(uSource, mpcs);
+			sendMessage(uSource, mpcs);
+		}
 
 		foreach (c, c->qlChannels)
 			q.enqueue(c);
@@ -415,16 +467,24 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 
 	// Transmit links
 	foreach (c, chans) {
-		if (c->qhLinks.count() > 0) {
+		if (cachedSync) {
+			const QByteArray &links = m_stateSyncCache.channelLinks(
+				c->iId, [&fillChannelLinks, c](MumbleProto::ChannelState &built) { fillChannelLinks(c, built); });
+
+			if (!links.isEmpty()) {
+				StateSyncCache::appendMessage(sync, Mumble::Protocol::TCPMessageType::ChannelState, links);
+			}
+		} else if (c->qhLinks.count() > 0) {
 			mpcs.Clear();
-			mpcs.set_channel_id(c->iId);
+			fillChannelLinks(c, mpcs);
 
-			foreach (Channel *l, c->qhLinks.keys())
-				mpcs.add_links(l->iId);
 			sendMessage(uSource, mpcs);
 		}
 	}
 
+	uSource->sendMessage(sync);
+	sync.clear();
+
 	loadChannelListenersOf(*uSource);
 
 	// Transmit user profile
@@ -433,9 +493,12 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	userEnterChannel(uSource, lc, mpus);
 
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 		uSource->sState = ServerUser::Authenticated;
 	}
+	// Only authenticated users may speak
+	updateRouting({}, { uSource->uiSession });
+	addBroadcastReceiver(uSource);
 
 	mpus.set_session(uSource->uiSession);
 	mpus.set_name(u8(uSource->qsName));
@@ -474,67 +537,80 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 
 	// Transmit other users profiles
-	foreach (ServerUser *u, qhUsers) {
-		if (u->sState != ServerUser::Authenticated)
-			continue;
-
-		if (u == uSource)
-			continue;
-
-		mpus.Clear();
-		mpus.set_session(u->uiSession);
-		mpus.set_name(u8(u->qsName));
+	auto fillUserState = [this, uSource](const ServerUser *u, MumbleProto::UserState &state) {
+		state.set_session(u->uiSession);
+		state.set_name(u8(u->qsName));
 		if (u->iId >= 0)
-			mpus.set_user_id(static_cast< unsigned int >(u->iId));
+			state.set_user_id(static_cast< unsigned int >(u->iId));
 		if (uSource->m_version >= Version::fromComponents(1, 2, 2)) {
 			if (!u->qbaTextureHash.isEmpty())
-				mpus.set_texture_hash(blob(u->qbaTextureHash));
+				state.set_texture_hash(blob(u->qbaTextureHash));
 			else if (!u->qbaTexture.isEmpty())
-				mpus.set_texture(blob(u->qbaTexture));
+				state.set_texture(blob(u->qbaTexture));
 		} else if ((uSource->qbaTexture.length() >= 4)
 				   && (qFromBigEndian< unsigned int >(
 						   reinterpret_cast< const unsigned char * >(uSource->qbaTexture.constData()))
 					   == 600 * 60 * 4)) {
-			mpus.set_texture(blob(u->qbaTexture));
+			state.set_texture(blob(u->qbaTexture));
 		}
 		if (u->cChannel->iId != 0)
-			mpus.set_channel_id(u->cChannel->iId);
+			state.set_channel_id(u->cChannel->iId);
 		if (u->bDeaf)
-			mpus.set_deaf(true);
+			state.set_deaf(true);
 		else if (u->bMute)
-			mpus.set_mute(true);
+			state.set_mute(true);
 		if (u->bSuppress)
-			mpus.set_suppress(true);
+			state.set_suppress(true);
 		if (u->bPrioritySpeaker)
-			mpus.set_priority_speaker(true);
+			state.set_priority_speaker(true);
 		if (u->bRecording)
-			mpus.set_recording(true);
+			state.set_recording(true);
 		if (u->bSelfDeaf)
-			mpus.set_self_deaf(true);
+			state.set_self_deaf(true);
 		else if (u->bSelfMute)
-			mpus.set_self_mute(true);
+			state.set_self_mute(true);
 		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !u->qbaCommentHash.isEmpty())
-			mpus.set_comment_hash(blob(u->qbaCommentHash));
+			state.set_comment_hash(blob(u->qbaCommentHash));
 		else if (!u->qsComment.isEmpty())
-			mpus.set_comment(u8(u->qsComment));
+			state.set_comment(u8(u->qsComment));
 		if (!u->qsHash.isEmpty())
-			mpus.set_hash(u8(u->qsHash));
+			state.set_hash(u8(u->qsHash));
 
 
 		for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
-			mpus.add_listening_channel_add(channelID);
+			state.add_listening_channel_add(channelID);
 
 			if (broadcastListenerVolumeAdjustments) {
 				VolumeAdjustment volume = m_channelListenerManager.getListenerVolumeAdjustment(u->uiSession, channelID);
-				MumbleProto::UserState::VolumeAdjustment *adjustment = mpus.add_listening_volume_adjustment();
+				MumbleProto::UserState::VolumeAdjustment *adjustment = state.add_listening_volume_adjustment();
 				adjustment->set_listening_channel(channelID);
 				adjustment->set_volume_adjustment(volume.factor);
 			}
 		}
+	};
 
-		sendMessage(uSource, mpus);
+	foreach (ServerUser *u, qhUsers) {
+		if (u->sState != ServerUser::Authenticated)
+			continue;
+
+		if (u == uSource)
+			continue;
+
+		if (cachedSync) {
+			const QByteArray &state = m_stateSyncCache.userState(
+				u->uiSession, [&fillUserState, u](MumbleProto::UserState &built) { fillUserState(u, built); });
+
+			StateSyncCache::appendMessage(sync, Mumble::Protocol::TCPMessageType::UserState, state);
+		} else {
+			mpus.Clear();
+			fillUserState(u, mpus);
+
+			sendMessage(uSource, mpus);
+		}
 	}
 
+	uSource->sendMessage(sync);
+
 	// Send synchronisation packet
 	MumbleProto::ServerSync mpss;
 	mpss.set_session(uSource->uiSession);
@@ -547,7 +623,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	} else {
 		QMutexLocker qml(&qmCache);
 		ChanACL::hasPermission(uSource, root, ChanACL::Enter, &acCache);
-		mpss.set_permissions(acCache.value(uSource)->value(root));
+		mpss.set_permissions(acCache.get(*uSource, root->iId));
 	}
 
 	sendMessage(uSource, mpss);
@@ -944,7 +1020,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 	// Writing to bSelfMute, bSelfDeaf and ssContext
 	// requires holding a write lock on qrwlVoiceThread.
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 
 		if (msg.has_self_deaf()) {
 			pDstServerUser->bSelfDeaf = msg.self_deaf();
@@ -992,7 +1068,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 	if (msg.has_mute() || msg.has_deaf() || msg.has_suppress() || msg.has_priority_speaker()) {
 		// Writing to bDeaf, bMute and bSuppress requires
 		// holding a write lock on qrwlVoiceThread.
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 
 		if (msg.has_deaf()) {
 			pDstServerUser->bDeaf = msg.deaf();
@@ -1111,12 +1187,6 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 	bool broadcastingBecauseOfVolumeChange = !bBroadcast && listenerVolumeChanged;
 	bBroadcast                             = bBroadcast || listenerChanged || listenerVolumeChanged;
 
-	if (listenerChanged || listenerVolumeChanged) {
-		// As whisper targets also contain information about ChannelListeners and
-		// their associated volume adjustment, we have to clear the target cache
-		clearWhisperTargetCache();
-	}
-
 
 	bool bDstAclChanged = false;
 	if (msg.has_user_id()) {
@@ -1182,10 +1252,6 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 
 		if (bDstAclChanged) {
 			clearACLCache(pDstServerUser);
-		} else if (listenerChanged || listenerVolumeChanged) {
-			// We only have to do this if the ACLs didn't change as
-			// clearACLCache calls clearWhisperTargetChache anyways
-			clearWhisperTargetCache();
 		}
 	}
 
@@ -1354,7 +1420,7 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 			a->pDeny  = ChanACL::None;
 			a->pAllow = ChanACL::Write | ChanACL::Traverse;
 
-			clearACLCache();
+			clearChannelACLCache(c);
 		}
 		updateChannel(c);
 
@@ -1484,10 +1550,13 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 			log(uSource, QString("Moved channel %1 from %2 to %3").arg(QString(*c), QString(*c->cParent), QString(*p)));
 
 			{
-				QWriteLocker wl(&qrwlVoiceThread);
+				VoiceWriteLocker wl(&qrwlVoiceThread);
 				c->cParent->removeChannel(c);
 				p->addChannel(c);
 			}
+
+			// The channel now inherits its ACLs and groups from elsewhere
+			clearChannelACLCache(c);
 		}
 		if (!qsName.isNull()) {
 			log(uSource, QString("Renamed channel %1 to %2").arg(QString(*c), QString(qsName)));
@@ -1851,7 +1920,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 		ChanACL *a;
 
 		{
-			QWriteLocker wl(&qrwlVoiceThread);
+			VoiceWriteLocker wl(&qrwlVoiceThread);
 
 			QHash< QString, QSet< int > > hOldTemp;
 
@@ -1922,11 +1991,11 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 			}
 		}
 
-		clearACLCache();
+		clearChannelACLCache(c);
 
 		if (!hasPermission(uSource, c, ChanACL::Write) && ((uSource->iId >= 0) || !uSource->qsHash.isEmpty())) {
 			{
-				QWriteLocker wl(&qrwlVoiceThread);
+				VoiceWriteLocker wl(&qrwlVoiceThread);
 
 				a             = new ChanACL(c);
 				a->bApplyHere = true;
@@ -1940,7 +2009,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 				a->pAllow  = ChanACL::Write | ChanACL::Traverse;
 			}
 
-			clearACLCache();
+			clearChannelACLCache(c);
 		}
 
 
@@ -2076,7 +2145,17 @@ void Server::msgVersion(ServerUser *uSource, MumbleProto::Version &msg) {
 
 	RATELIMIT(uSource);
 
+	// Broadcasts are sent by version, so a user that has already authenticated has to be moved to its new version
+	const bool authenticated = uSource->sState == ServerUser::Authenticated;
+	if (authenticated) {
+		removeBroadcastReceiver(uSource);
+	}
+
 	uSource->m_version = MumbleProto::getVersion(msg);
+
+	if (authenticated) {
+		addBroadcastReceiver(uSource);
+	}
 	if (msg.has_release()) {
 		uSource->qsRelease = convertWithSizeRestriction(msg.release(), 100);
 	}
@@ -2181,7 +2260,7 @@ void Server::msgVoiceTarget(ServerUser *uSource, MumbleProto::VoiceTarget &msg)
 	if ((target < 1) || (target >= 0x1f))
 		return;
 
-	QWriteLocker lock(&qrwlVoiceThread);
+	VoiceWriteLocker lock(&qrwlVoiceThread);
 
 	uSource->qmTargetCache.remove(target);
 
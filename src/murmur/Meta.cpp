@@ -55,12 +55,18 @@ MetaParams::MetaParams() {
 	iMaxBandwidth              = 558000;
 	iMaxUsers                  = 1000;
 	iMaxUsersPerChannel        = 0;
+	iMaxActiveSpeakers         = 0;
+	iActiveSpeakersChannelSize = 50;
+	iMixingBitrate             = 40000;
 	iMaxListenersPerChannel    = -1;
 	iMaxListenerProxiesPerUser = -1;
 	iMaxTextMessageLength      = 5000;
 	iMaxImageMessageLength     = 131072;
 	legacyPasswordHash         = false;
 	kdfIterations              = -1;
+	kdfThreads                 = 1;
+	kdfMaxPending              = 32;
+	kdfMaxPendingPerAddress    = 4;
 	bAllowHTML                 = true;
 	iDefaultChan               = 0;
 	bRememberChan              = true;
@@ -69,6 +75,8 @@ MetaParams::MetaParams() {
 	qsWelcomeTextFile          = QString();
 	qsDatabase                 = QString();
 	iSQLiteWAL                 = 0;
+	iDBWriteDelay              = 0;
+	iDBWriteBatch              = 100;
 	iDBPort                    = 0;
 	qsDBusService              = "net.sourceforge.mumble.murmur";
 	qsDBDriver                 = "QSQLITE";
@@ -88,12 +96,21 @@ MetaParams::MetaParams() {
 	iBanTime       = 300;
 	bBanSuccessful = true;
 
+	iBanTrackedAddresses = 65536;
+	iBanIPv6Prefix       = 128;
+
 #ifdef Q_OS_UNIX
 	uiUid = uiGid = 0;
 #endif
 
 	iOpusThreshold = 0;
 
+	iUDPBatchSize      = 32;
+	iVoiceThreads      = 1;
+	iVoicePoolThreads  = 0;
+	iCryptThreads      = 0;
+	iConnectionThreads = 0;
+
 	iChannelNestingLimit = 10;
 	iChannelCountLimit   = 1000;
 
@@ -106,6 +123,9 @@ MetaParams::MetaParams() {
 	iPluginMessageLimit = 4;
 	iPluginMessageBurst = 15;
 
+	iTCPVoiceDropThreshold = 64 * 1024;
+	iTCPOutputLimit        = 16 * 1024 * 1024;
+
 	broadcastListenerVolumeAdjustments = false;
 
 	qsCiphers = MumbleSSL::defaultOpenSSLCipherString();
@@ -276,6 +296,9 @@ void MetaParams::read(QString fname) {
 	iMaxImageMessageLength     = typeCheckedFromSettings("imagemessagelength", iMaxImageMessageLength);
 	legacyPasswordHash         = typeCheckedFromSettings("legacypasswordhash", legacyPasswordHash);
 	kdfIterations              = typeCheckedFromSettings("kdfiterations", -1);
+	kdfThreads                 = qMax(typeCheckedFromSettings("kdfthreads", kdfThreads), 0);
+	kdfMaxPending              = qMax(typeCheckedFromSettings("kdfmaxpending", kdfMaxPending), 1);
+	kdfMaxPendingPerAddress    = qMax(typeCheckedFromSettings("kdfmaxpendingperaddress", kdfMaxPendingPerAddress), 1);
 	bAllowHTML                 = typeCheckedFromSettings("allowhtml", bAllowHTML);
 	iMaxBandwidth              = typeCheckedFromSettings("bandwidth", iMaxBandwidth);
 	iDefaultChan               = typeCheckedFromSettings("defaultchannel", iDefaultChan);
@@ -283,6 +306,10 @@ void MetaParams::read(QString fname) {
 	iRememberChanDuration      = typeCheckedFromSettings("rememberchannelduration", iRememberChanDuration);
 	iMaxUsers                  = typeCheckedFromSettings("users", iMaxUsers);
 	iMaxUsersPerChannel        = typeCheckedFromSettings("usersperchannel", iMaxUsersPerChannel);
+	iMaxActiveSpeakers         = typeCheckedFromSettings("activespeakers", iMaxActiveSpeakers);
+	iActiveSpeakersChannelSize = typeCheckedFromSettings("activespeakerschannelsize", iActiveSpeakersChannelSize);
+	qsMixedChannels            = typeCheckedFromSettings("mixedchannels", qsMixedChannels);
+	iMixingBitrate             = typeCheckedFromSettings("mixingbitrate", iMixingBitrate);
 	iMaxListenersPerChannel    = typeCheckedFromSettings("listenersperchannel", iMaxListenersPerChannel);
 	iMaxListenerProxiesPerUser = typeCheckedFromSettings("listenersperuser", iMaxListenerProxiesPerUser);
 	qsWelcomeText              = typeCheckedFromSettings("welcometext", qsWelcomeText);
@@ -293,6 +320,9 @@ void MetaParams::read(QString fname) {
 	qsDatabase = typeCheckedFromSettings("database", qsDatabase);
 	iSQLiteWAL = typeCheckedFromSettings("sqlite_wal", iSQLiteWAL);
 
+	iDBWriteDelay = qMax(typeCheckedFromSettings("dbwritedelay", iDBWriteDelay), 0);
+	iDBWriteBatch = qMax(typeCheckedFromSettings("dbwritebatch", iDBWriteBatch), 1);
+
 	qsDBDriver   = typeCheckedFromSettings("dbDriver", qsDBDriver);
 	qsDBUserName = typeCheckedFromSettings("dbUsername", qsDBUserName);
 	qsDBPassword = typeCheckedFromSettings("dbPassword", qsDBPassword);
@@ -325,6 +355,9 @@ void MetaParams::read(QString fname) {
 	iBanTime       = typeCheckedFromSettings("autobanTime", iBanTime);
 	bBanSuccessful = typeCheckedFromSettings("autobanSuccessfulConnections", bBanSuccessful);
 
+	iBanTrackedAddresses = qMax(typeCheckedFromSettings("autobanTrackedAddresses", iBanTrackedAddresses), 1);
+	iBanIPv6Prefix       = qBound(1, typeCheckedFromSettings("autobanIPv6Prefix", iBanIPv6Prefix), 128);
+
 	m_suggestVersion = Version::fromConfig(qsSettings->value("suggestVersion"));
 
 	qvSuggestPositional = qsSettings->value("suggestPositional");
@@ -342,6 +375,36 @@ void MetaParams::read(QString fname) {
 
 	iOpusThreshold = typeCheckedFromSettings("opusthreshold", iOpusThreshold);
 
+	iUDPBatchSize = qBound(1, typeCheckedFromSettings("udpbatchsize", iUDPBatchSize),
+						   static_cast< int >(UDPSendBatch::MAX_CAPACITY));
+
+	iVoiceThreads = typeCheckedFromSettings("voicethreads", iVoiceThreads);
+	if (iVoiceThreads <= 0) {
+		iVoiceThreads = QThread::idealThreadCount();
+	}
+#ifndef Q_OS_LINUX
+	if (iVoiceThreads != 1) {
+		qWarning("Multiple voice threads are only supported on Linux. Using a single one.");
+		iVoiceThreads = 1;
+	}
+#endif
+	iVoiceThreads = qMax(iVoiceThreads, 1);
+
+	iVoicePoolThreads = typeCheckedFromSettings("voicepoolthreads", iVoicePoolThreads);
+	if (iVoicePoolThreads < 0) {
+		iVoicePoolThreads = QThread::idealThreadCount();
+	}
+#ifndef Q_OS_LINUX
+	if (iVoicePoolThreads != 0) {
+		qWarning("Shared voice threads are only supported on Linux. Every virtual server uses its own.");
+		iVoicePoolThreads = 0;
+	}
+#endif
+
+	iCryptThreads = qMax(typeCheckedFromSettings("cryptthreads", iCryptThreads), 0);
+
+	iConnectionThreads = qMax(typeCheckedFromSettings("connectionthreads", iConnectionThreads), 0);
+
 	iChannelNestingLimit = typeCheckedFromSettings("channelnestinglimit", iChannelNestingLimit);
 	iChannelCountLimit   = typeCheckedFromSettings("channelcountlimit", iChannelCountLimit);
 
@@ -376,6 +439,9 @@ void MetaParams::read(QString fname) {
 	iPluginMessageLimit = typeCheckedFromSettings< unsigned int >("pluginmessagelimit", 4);
 	iPluginMessageBurst = typeCheckedFromSettings< unsigned int >("pluginmessageburst", 15);
 
+	iTCPVoiceDropThreshold = qMax(typeCheckedFromSettings("tcpvoicedropthreshold", iTCPVoiceDropThreshold), 0);
+	iTCPOutputLimit        = qMax(typeCheckedFromSettings("tcpoutputlimit", iTCPOutputLimit), 0);
+
 	broadcastListenerVolumeAdjustments = typeCheckedFromSettings("broadcastlistenervolumeadjustments", false);
 
 	bool bObfuscate = typeCheckedFromSettings("obfuscate", false);
@@ -635,7 +701,35 @@ bool MetaParams::loadSSLSettings() {
 	return true;
 }
 
-Meta::Meta() {
+Meta::Meta()
+	: m_autobanTracker(static_cast< unsigned int >(qMax(mp.iBanTries, 0)),
+					   1000ULL * static_cast< unsigned long long >(qMax(mp.iBanTimeframe, 0)),
+					   1000ULL * static_cast< unsigned long long >(qMax(mp.iBanTime, 0)),
+					   static_cast< std::size_t >(mp.iBanTrackedAddresses),
+					   static_cast< unsigned int >(mp.iBanIPv6Prefix)) {
+	m_autobanClock.start();
+
+	if (mp.iCryptThreads > 0) {
+		m_cryptPool = std::make_unique< CryptWorkerPool >(static_cast< std::size_t >(mp.iCryptThreads));
+	}
+
+	if (mp.iConnectionThreads > 0) {
+		m_connectionPool = std::make_unique< ConnectionIOPool >(static_cast< std::size_t >(mp.iConnectionThreads));
+	}
+
+	if (mp.kdfThreads > 0) {
+		m_passwordHasher = std::make_unique< PasswordHasher >(static_cast< std::size_t >(mp.kdfThreads),
+															  static_cast< std::size_t >(mp.kdfMaxPending),
+															  static_cast< std::size_t >(mp.kdfMaxPendingPerAddress));
+	}
+
+#ifdef Q_OS_LINUX
+	if (mp.iVoicePoolThreads > 0) {
+		m_voicePool = std::make_unique< VoiceThreadPool >(static_cast< std::size_t >(mp.iVoicePoolThreads),
+														  static_cast< std::size_t >(mp.iUDPBatchSize));
+	}
+#endif
+
 #ifdef Q_OS_WIN
 	QOS_VERSION qvVer;
 	qvVer.MajorVersion = 1;
@@ -761,14 +855,7 @@ void Meta::killAll() {
 
 void Meta::successfulConnectionFrom(const QHostAddress &addr) {
 	if (!mp.bBanSuccessful) {
-		QList< Timer > &ql = qhAttempts[addr];
-		// Seems like this is the most efficient way to clear the list, given:
-		// 1. ql.clear() allocates a new array
-		// 2. ql has less than iBanAttempts members
-		// 3. seems like ql.removeFirst() might actually copy elements to shift to the front
-		while (!ql.empty()) {
-			ql.removeLast();
-		}
+		m_autobanTracker.reset(addr);
 	}
 }
 
@@ -776,22 +863,5 @@ bool Meta::banCheck(const QHostAddress &addr) {
 	if ((mp.iBanTries <= 0) || (mp.iBanTimeframe <= 0))
 		return false;
 
-	if (qhBans.contains(addr)) {
-		Timer t = qhBans.value(addr);
-		if (t.elapsed() < (1000000ULL * static_cast< unsigned long long >(mp.iBanTime)))
-			return true;
-		qhBans.remove(addr);
-	}
-
-	QList< Timer > &ql = qhAttempts[addr];
-
-	ql.append(Timer());
-	while (!ql.isEmpty() && (ql.at(0).elapsed() > (1000000ULL * static_cast< unsigned long long >(mp.iBanTimeframe))))
-		ql.removeFirst();
-
-	if (ql.count() > mp.iBanTries) {
-		qhBans.insert(addr, Timer());
-		return true;
-	}
-	return false;
+	return m_autobanTracker.attempt(addr, static_cast< std::uint64_t >(m_autobanClock.elapsed()));
 }
@@ -6,7 +6,12 @@
 #ifndef MUMBLE_MURMUR_META_H_
 #define MUMBLE_MURMUR_META_H_
 
+#include "AutobanTracker.h"
+#include "ConnectionIOPool.h"
+#include "CryptWorkerPool.h"
+#include "PasswordHasher.h"
 #include "Timer.h"
+#include "VoiceThreadPool.h"
 
 #include "Version.h"
 
@@ -15,6 +20,7 @@
 #endif
 
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QList>
 #include <QtCore/QUrl>
 #include <QtCore/QVariant>
@@ -23,6 +29,8 @@
 #include <QtNetwork/QSslCipher>
 #include <QtNetwork/QSslKey>
 
+#include <memory>
+
 class Server;
 class QSettings;
 
@@ -36,6 +44,14 @@ public:
 	int iMaxBandwidth;
 	unsigned int iMaxUsers;
 	unsigned int iMaxUsersPerChannel;
+	/// How many users may speak at the same time in large channels (0 for no limit), see ActiveSpeakerLimiter
+	unsigned int iMaxActiveSpeakers;
+	/// The number of users and listeners from which on a channel is considered large
+	unsigned int iActiveSpeakersChannelSize;
+	/// The comma-separated IDs of the channels whose speakers are mixed on the server, see AudioMixer
+	QString qsMixedChannels;
+	/// The bitrate (in bits per second) the mixed audio is encoded with
+	int iMixingBitrate;
 	int iMaxListenersPerChannel;
 	int iMaxListenerProxiesPerUser;
 	unsigned int iDefaultChan;
@@ -44,6 +60,23 @@ public:
 	int iMaxTextMessageLength;
 	int iMaxImageMessageLength;
 	int iOpusThreshold;
+	/// The maximum amount of voice datagrams that are received or sent
+	/// with a single system call (recvmmsg/sendmmsg, Linux only)
+	int iUDPBatchSize;
+	/// The amount of threads routing voice packets for each
+	/// virtual server (Linux only)
+	int iVoiceThreads;
+	/// The amount of threads routing the voice packets of all
+	/// virtual servers together (0 to let every virtual server
+	/// run voice threads of its own, Linux only)
+	int iVoicePoolThreads;
+	/// The amount of threads helping the voice threads of all virtual
+	/// servers with encrypting large fan-outs (0 to disable)
+	int iCryptThreads;
+	/// The amount of threads performing the TLS handshakes and the socket
+	/// I/O of the client connections of all virtual servers (0 to use the
+	/// main thread)
+	int iConnectionThreads;
 	int iChannelNestingLimit;
 	int iChannelCountLimit;
 	/// If true the old SHA1 password hashing is used instead of PBKDF2
@@ -53,6 +86,13 @@ public:
 	/// is <= 0 the value is loaded from the database and if not
 	/// available there yet found by a benchmark.
 	int kdfIterations;
+	/// The amount of threads verifying passwords for all virtual servers
+	/// (0 to verify them on the main thread)
+	int kdfThreads;
+	/// The maximum amount of passwords that may wait for being verified
+	/// on all virtual servers at once, in total and per client address
+	int kdfMaxPending;
+	int kdfMaxPendingPerAddress;
 	bool bAllowHTML;
 	QString qsPassword;
 	QString qsWelcomeText;
@@ -64,9 +104,19 @@ public:
 	int iBanTimeframe;
 	int iBanTime;
 	bool bBanSuccessful;
+	/// The maximum number of addresses the autoban keeps track of
+	int iBanTrackedAddresses;
+	/// The number of leading bits by which the autoban tells IPv6 addresses apart
+	int iBanIPv6Prefix;
 
 	QString qsDatabase;
 	int iSQLiteWAL;
+	/// The time in milliseconds frequent writes (e.g. log messages) are kept
+	/// back at most to be committed together with further ones by the
+	/// database thread (0 to write synchronously)
+	int iDBWriteDelay;
+	/// The amount of pending writes that are committed without any further delay
+	int iDBWriteBatch;
 	QString qsDBDriver;
 	QString qsDBUserName;
 	QString qsDBPassword;
@@ -104,6 +154,12 @@ public:
 	unsigned int iPluginMessageLimit;
 	unsigned int iPluginMessageBurst;
 
+	/// The amount of data that may wait for being sent to a client over TCP before voice packets tunnelled to it are
+	/// dropped (0 to never drop them)
+	int iTCPVoiceDropThreshold;
+	/// The amount of data that may wait for being sent to a client over TCP before it is disconnected (0 for no limit)
+	int iTCPOutputLimit;
+
 	bool broadcastListenerVolumeAdjustments;
 
 	QSslCertificate qscCert;
@@ -180,10 +236,25 @@ private:
 public:
 	static MetaParams mp;
 	QHash< int, Server * > qhServers;
-	QHash< QHostAddress, QList< Timer > > qhAttempts;
-	QHash< QHostAddress, Timer > qhBans;
+	/// The connection attempts of all clients for the autoban
+	AutobanTracker m_autobanTracker;
+	/// The clock the autoban is measured by
+	QElapsedTimer m_autobanClock;
 	QString qsOS, qsOSVersion;
 	Timer tUptime;
+	/// The threads helping the voice threads of all virtual servers with encrypting large fan-outs. Null unless
+	/// cryptthreads is set.
+	std::unique_ptr< CryptWorkerPool > m_cryptPool;
+	/// The threads performing the socket I/O of the client connections of all virtual servers. Null unless
+	/// connectionthreads is set.
+	std::unique_ptr< ConnectionIOPool > m_connectionPool;
+	/// The threads verifying the passwords of the users authenticating with any virtual server. Null unless kdfthreads
+	/// is set.
+	std::unique_ptr< PasswordHasher > m_passwordHasher;
+#ifdef Q_OS_LINUX
+	/// The voice threads shared by all virtual servers. Null unless voicepoolthreads is set.
+	std::unique_ptr< VoiceThreadPool > m_voicePool;
+#endif
 
 #ifdef Q_OS_WIN
 	static HANDLE hQoS;
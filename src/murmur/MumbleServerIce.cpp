@@ -1012,7 +1012,7 @@ static void impl_Server_setConf(const ::MumbleServer::AMD_Server_setConfPtr cb,
 	QString v = u8(value);
 	ServerDB::setConf(server_id, k, v);
 	if (server) {
-		QWriteLocker wl(&server->qrwlVoiceThread);
+		VoiceWriteLocker wl(&server->qrwlVoiceThread);
 		server->setLiveConf(k, v);
 	}
 	cb->ice_response();
@@ -1149,7 +1149,7 @@ static void impl_Server_setBans(const ::MumbleServer::AMD_Server_setBansPtr cb,
 								const ::MumbleServer::BanList &bans) {
 	NEED_SERVER;
 	{
-		QWriteLocker wl(&server->qrwlVoiceThread);
+		VoiceWriteLocker wl(&server->qrwlVoiceThread);
 		server->qlBans.clear();
 		foreach (const ::MumbleServer::Ban &mb, bans) {
 			::Ban ban;
@@ -1465,7 +1465,7 @@ static void impl_Server_setACL(const ::MumbleServer::AMD_Server_setACLPtr cb, in
 	NEED_CHANNEL;
 
 	{
-		QWriteLocker locker(&server->qrwlVoiceThread);
+		VoiceWriteLocker locker(&server->qrwlVoiceThread);
 
 		::Group *g;
 		ChanACL *acl;
@@ -1511,7 +1511,7 @@ static void impl_Server_setACL(const ::MumbleServer::AMD_Server_setACLPtr cb, in
 		}
 	}
 
-	server->clearACLCache();
+	server->clearChannelACLCache(channel);
 	server->updateChannel(channel);
 	cb->ice_response();
 }
@@ -1735,7 +1735,7 @@ static void impl_Server_updateCertificate(const ::MumbleServer::AMD_Server_updat
 	server->setConf("key", u8(privateKey));
 	server->setConf("passphrase", u8(passphrase));
 	{
-		QWriteLocker wl(&server->qrwlVoiceThread);
+		VoiceWriteLocker wl(&server->qrwlVoiceThread);
 		server->initializeCert();
 	}
 
@@ -1846,7 +1846,7 @@ static void impl_Server_addUserToGroup(const ::MumbleServer::AMD_Server_addUserT
 	}
 
 	{
-		QWriteLocker wl(&server->qrwlVoiceThread);
+		VoiceWriteLocker wl(&server->qrwlVoiceThread);
 
 		::Group *g = channel->qhGroups.value(qsgroup);
 		if (!g)
@@ -1873,7 +1873,7 @@ static void impl_Server_removeUserFromGroup(const ::MumbleServer::AMD_Server_rem
 	}
 
 	{
-		QWriteLocker qrwl(&server->qrwlVoiceThread);
+		VoiceWriteLocker qrwl(&server->qrwlVoiceThread);
 
 		::Group *g = channel->qhGroups.value(qsgroup);
 		if (!g)
@@ -1897,7 +1897,7 @@ static void impl_Server_redirectWhisperGroup(const ::MumbleServer::AMD_Server_re
 	QString qstarget = u8(target);
 
 	{
-		QWriteLocker wl(&server->qrwlVoiceThread);
+		VoiceWriteLocker wl(&server->qrwlVoiceThread);
 
 		if (qstarget.isEmpty())
 			user->qmWhisperRedirect.remove(qssource);
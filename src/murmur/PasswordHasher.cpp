@@ -0,0 +1,104 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PasswordHasher.h"
+#include "PBKDF2.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+
+class PasswordHasher::Task : public QRunnable {
+public:
+	Task(PasswordHasher &hasher, const void *owner, const HostAddress &address, const QString &salt,
+		 const QString &password, int iterations, const Callback &callback)
+		: m_hasher(hasher), m_owner(owner), m_address(address), m_salt(salt), m_password(password),
+		  m_iterations(iterations), m_callback(callback) {}
+
+	void run() Q_DECL_OVERRIDE {
+		if (!m_hasher.isCancelled(m_owner)) {
+			m_callback(PBKDF2::getHash(m_salt, m_password, m_iterations));
+		}
+
+		m_hasher.finished(m_owner, m_address);
+	}
+
+protected:
+	PasswordHasher &m_hasher;
+	const void *const m_owner;
+	const HostAddress m_address;
+	const QString m_salt;
+	const QString m_password;
+	const int m_iterations;
+	const Callback m_callback;
+};
+
+PasswordHasher::PasswordHasher(std::size_t threadCount, std::size_t maxPending, std::size_t maxPendingPerAddress)
+	: m_maxPending(maxPending), m_maxPendingPerAddress(maxPendingPerAddress), m_pending(0) {
+	m_pool.setMaxThreadCount(static_cast< int >(threadCount));
+	// The threads are kept around, so that bursts of logins don't keep creating new ones
+	m_pool.setExpiryTimeout(-1);
+}
+
+PasswordHasher::~PasswordHasher() {
+	m_pool.waitForDone();
+}
+
+bool PasswordHasher::start(const void *owner, const HostAddress &address, const QString &salt,
+						   const QString &password, int iterations, const Callback &callback) {
+	{
+		QMutexLocker l(&m_mutex);
+
+		std::size_t &pendingOfAddress = m_pendingPerAddress[address];
+		if (m_pending >= m_maxPending || pendingOfAddress >= m_maxPendingPerAddress) {
+			if (pendingOfAddress == 0) {
+				m_pendingPerAddress.remove(address);
+			}
+
+			return false;
+		}
+
+		++m_pending;
+		++pendingOfAddress;
+		++m_pendingPerOwner[owner];
+	}
+
+	m_pool.start(new Task(*this, owner, address, salt, password, iterations, callback));
+
+	return true;
+}
+
+void PasswordHasher::cancel(const void *owner) {
+	QMutexLocker l(&m_mutex);
+
+	m_cancelled.insert(owner);
+	while (m_pendingPerOwner.contains(owner)) {
+		m_finished.wait(&m_mutex);
+	}
+	m_cancelled.remove(owner);
+}
+
+bool PasswordHasher::isCancelled(const void *owner) {
+	QMutexLocker l(&m_mutex);
+
+	return m_cancelled.contains(owner);
+}
+
+void PasswordHasher::finished(const void *owner, const HostAddress &address) {
+	QMutexLocker l(&m_mutex);
+
+	--m_pending;
+
+	auto it = m_pendingPerAddress.find(address);
+	if (--it.value() == 0) {
+		m_pendingPerAddress.erase(it);
+	}
+
+	auto ownerIt = m_pendingPerOwner.find(owner);
+	if (--ownerIt.value() == 0) {
+		m_pendingPerOwner.erase(ownerIt);
+	}
+
+	m_finished.wakeAll();
+}
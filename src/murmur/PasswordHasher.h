@@ -0,0 +1,68 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PASSWORDHASHER_H_
+#define MUMBLE_MURMUR_PASSWORDHASHER_H_
+
+#include "HostAddress.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include <cstddef>
+#include <functional>
+
+/// Computes PBKDF2 password hashes on a fixed set of threads, such that verifying passwords doesn't block the thread
+/// handling the control channel.
+///
+/// A single hasher is shared by all virtual servers. The amount of hashes that may be pending at once is limited in
+/// total and per client address. Bursts of login attempts are thus turned away before they cause any expensive work.
+class PasswordHasher {
+public:
+	/// Receives the computed hash. It is called in one of the hasher's threads.
+	using Callback = std::function< void(const QString &hash) >;
+
+	PasswordHasher(std::size_t threadCount, std::size_t maxPending, std::size_t maxPendingPerAddress);
+	/// Waits for the pending computations to finish
+	~PasswordHasher();
+
+	/// Starts computing the hash of the given password, unless the limits of pending computations have been reached
+	///
+	/// @param owner The object the computation is done for (usually the virtual server), see cancel()
+	/// @param address The address of the client the password has been sent by
+	/// @param callback The function the hash is passed to once it is known
+	/// @returns Whether the computation has been started
+	bool start(const void *owner, const HostAddress &address, const QString &salt, const QString &password,
+			   int iterations, const Callback &callback);
+	/// Drops the computations of the given owner. Those that haven't started yet are skipped, the running ones are
+	/// waited for. Once this returns, no callback of the owner is called anymore.
+	void cancel(const void *owner);
+
+protected:
+	class Task;
+
+	QThreadPool m_pool;
+	const std::size_t m_maxPending;
+	const std::size_t m_maxPendingPerAddress;
+
+	/// Protects the counts of pending computations, which are decreased in the hasher's threads
+	QMutex m_mutex;
+	/// Signalled whenever a computation has finished
+	QWaitCondition m_finished;
+	std::size_t m_pending;
+	QHash< HostAddress, std::size_t > m_pendingPerAddress;
+	QHash< const void *, std::size_t > m_pendingPerOwner;
+	/// The owners whose computations are being cancelled
+	QSet< const void * > m_cancelled;
+
+	bool isCancelled(const void *owner);
+	void finished(const void *owner, const HostAddress &address);
+};
+
+#endif
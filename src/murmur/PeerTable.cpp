@@ -0,0 +1,240 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PeerTable.h"
+
+#ifdef Q_OS_WIN
+#	include <ws2tcpip.h>
+#else
+#	include <netinet/in.h>
+#endif
+
+#include <QtCore/QMutexLocker>
+
+#include <cstring>
+
+/// The initial amount of slots. The table grows whenever more than half of its slots are in use.
+static constexpr std::size_t INITIAL_CAPACITY = 64;
+
+bool PeerTable::Key::operator==(const Key &other) const {
+	return addressHigh == other.addressHigh && addressLow == other.addressLow && port == other.port;
+}
+
+PeerTable::Slots::Slots(std::size_t capacity) : slots(new Slot[capacity]), mask(capacity - 1) {
+	for (std::size_t i = 0; i < capacity; ++i) {
+		slots[i].addressHigh.store(0, std::memory_order_relaxed);
+		slots[i].addressLow.store(0, std::memory_order_relaxed);
+		slots[i].port.store(0, std::memory_order_relaxed);
+		slots[i].user.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+PeerTable::PeerTable() : m_version(0), m_size(0) {
+	m_slotArrays.push_back(std::make_unique< Slots >(INITIAL_CAPACITY));
+	m_slots.store(m_slotArrays.back().get(), std::memory_order_release);
+}
+
+PeerTable::~PeerTable() = default;
+
+PeerTable::Key PeerTable::makeKey(const sockaddr_storage &address) {
+	unsigned char bytes[16] = {};
+	Key key;
+
+	if (address.ss_family == AF_INET) {
+		const sockaddr_in *in = reinterpret_cast< const sockaddr_in * >(&address);
+
+		bytes[10] = 0xFF;
+		bytes[11] = 0xFF;
+		memcpy(&bytes[12], &in->sin_addr.s_addr, sizeof(in->sin_addr.s_addr));
+		key.port = in->sin_port;
+	} else if (address.ss_family == AF_INET6) {
+		const sockaddr_in6 *in6 = reinterpret_cast< const sockaddr_in6 * >(&address);
+
+		memcpy(bytes, in6->sin6_addr.s6_addr, sizeof(bytes));
+		key.port = in6->sin6_port;
+	} else {
+		key.port = 0;
+	}
+
+	memcpy(&key.addressHigh, &bytes[0], sizeof(key.addressHigh));
+	memcpy(&key.addressLow, &bytes[8], sizeof(key.addressLow));
+
+	return key;
+}
+
+std::size_t PeerTable::hash(const Key &key) {
+	// Only addresses of authenticated users end up in the table, so there is no need for a hash that is
+	// resistant against deliberate collisions.
+	std::uint64_t h = key.addressHigh * 0x9E3779B97F4A7C15ULL;
+	h ^= key.addressLow + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+	h ^= key.port * 0xC2B2AE3D27D4EB4FULL;
+	h ^= h >> 29;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 32;
+
+	return static_cast< std::size_t >(h);
+}
+
+PeerTable::Key PeerTable::loadKey(const Slot &slot) {
+	Key key;
+	key.addressHigh = slot.addressHigh.load(std::memory_order_relaxed);
+	key.addressLow  = slot.addressLow.load(std::memory_order_relaxed);
+	key.port        = slot.port.load(std::memory_order_relaxed);
+
+	return key;
+}
+
+void PeerTable::storeKey(Slot &slot, const Key &key) {
+	slot.addressHigh.store(key.addressHigh, std::memory_order_relaxed);
+	slot.addressLow.store(key.addressLow, std::memory_order_relaxed);
+	slot.port.store(key.port, std::memory_order_relaxed);
+}
+
+std::size_t PeerTable::probe(const Slots &slots, const Key &key) {
+	std::size_t index = hash(key) & slots.mask;
+
+	// The table is never more than half full, so the loop will always end at an empty slot. The bound only
+	// matters for readers that race with a writer and that are going to retry anyway.
+	for (std::size_t i = 0; i <= slots.mask; ++i) {
+		const Slot &slot = slots.slots[index];
+
+		if (!slot.user.load(std::memory_order_relaxed) || loadKey(slot) == key) {
+			break;
+		}
+
+		index = (index + 1) & slots.mask;
+	}
+
+	return index;
+}
+
+ServerUser *PeerTable::find(const sockaddr_storage &address) const {
+	const Key key = makeKey(address);
+
+	while (true) {
+		const std::uint32_t version = m_version.load(std::memory_order_acquire);
+		if (version & 1) {
+			// A modification is in progress
+			continue;
+		}
+
+		const Slots &slots = *m_slots.load(std::memory_order_acquire);
+		const Slot &slot   = slots.slots[probe(slots, key)];
+
+		ServerUser *user = slot.user.load(std::memory_order_relaxed);
+		if (user && !(loadKey(slot) == key)) {
+			user = nullptr;
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_version.load(std::memory_order_relaxed) == version) {
+			return user;
+		}
+	}
+}
+
+void PeerTable::insert(const sockaddr_storage &address, ServerUser *user) {
+	const Key key = makeKey(address);
+
+	QMutexLocker l(&m_writeMutex);
+
+	if ((m_size + 1) * 2 > m_slots.load(std::memory_order_relaxed)->mask + 1) {
+		grow();
+	}
+
+	Slots &slots = *m_slots.load(std::memory_order_relaxed);
+	Slot &slot   = slots.slots[probe(slots, key)];
+
+	beginWrite();
+
+	if (!slot.user.load(std::memory_order_relaxed)) {
+		storeKey(slot, key);
+		++m_size;
+	}
+	slot.user.store(user, std::memory_order_relaxed);
+
+	endWrite();
+}
+
+void PeerTable::remove(const sockaddr_storage &address, const ServerUser *user) {
+	const Key key = makeKey(address);
+
+	QMutexLocker l(&m_writeMutex);
+
+	Slots &slots      = *m_slots.load(std::memory_order_relaxed);
+	std::size_t index = probe(slots, key);
+
+	if (slots.slots[index].user.load(std::memory_order_relaxed) != user || !user) {
+		return;
+	}
+
+	beginWrite();
+
+	// Backward shift deletion: Move every entry of the probe sequence following the removed one into the gap,
+	// unless that would move it in front of the slot it hashes to. This keeps all probe sequences intact
+	// without the need for tombstones.
+	std::size_t next = index;
+	while (true) {
+		next = (next + 1) & slots.mask;
+
+		Slot &nextSlot = slots.slots[next];
+		if (!nextSlot.user.load(std::memory_order_relaxed)) {
+			break;
+		}
+
+		const Key nextKey      = loadKey(nextSlot);
+		const std::size_t home = hash(nextKey) & slots.mask;
+
+		// Whether home lies cyclically within (index, next], in which case the entry has to stay where it is
+		const bool stays = (index <= next) ? (index < home && home <= next) : (index < home || home <= next);
+		if (!stays) {
+			storeKey(slots.slots[index], nextKey);
+			slots.slots[index].user.store(nextSlot.user.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			index = next;
+		}
+	}
+
+	slots.slots[index].user.store(nullptr, std::memory_order_relaxed);
+	storeKey(slots.slots[index], Key{ 0, 0, 0 });
+	--m_size;
+
+	endWrite();
+}
+
+std::size_t PeerTable::size() const {
+	QMutexLocker l(&m_writeMutex);
+
+	return m_size;
+}
+
+void PeerTable::beginWrite() {
+	m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void PeerTable::endWrite() {
+	m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void PeerTable::grow() {
+	const Slots &oldSlots = *m_slots.load(std::memory_order_relaxed);
+	std::unique_ptr< Slots > newSlots = std::make_unique< Slots >((oldSlots.mask + 1) * 2);
+
+	// The new array is not visible to readers yet, so it can be filled without further ado
+	for (std::size_t i = 0; i <= oldSlots.mask; ++i) {
+		const Slot &slot = oldSlots.slots[i];
+
+		if (ServerUser *user = slot.user.load(std::memory_order_relaxed)) {
+			const Key key = loadKey(slot);
+			Slot &target  = newSlots->slots[probe(*newSlots, key)];
+
+			storeKey(target, key);
+			target.user.store(user, std::memory_order_relaxed);
+		}
+	}
+
+	m_slots.store(newSlots.get(), std::memory_order_release);
+	m_slotArrays.push_back(std::move(newSlots));
+}
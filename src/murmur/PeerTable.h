@@ -0,0 +1,106 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PEERTABLE_H_
+#define MUMBLE_MURMUR_PEERTABLE_H_
+
+#include <QtCore/QtGlobal>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#else
+#	include <sys/socket.h>
+#endif
+
+#include <QtCore/QMutex>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ServerUser;
+
+/// Maps the UDP address (IP and port) voice packets are received from to the user that sends them.
+///
+/// The table is a flat open-addressed hash table that is keyed by the raw socket address, such that looking
+/// up the sender of a datagram neither allocates nor has to build any intermediate objects. Lookups are
+/// lock-free and may happen concurrently to modifications, which in turn are serialized by the table itself.
+///
+/// Note that the table does not manage the lifetime of the users it points to. A pointer obtained from find()
+/// may only be dereferenced while the user is guaranteed to not be deleted, which the Server ensures by
+/// removing users from the table while holding the write lock of qrwlVoiceThread.
+class PeerTable {
+public:
+	PeerTable();
+	~PeerTable();
+
+	/// @returns The user sending from the given address or nullptr if there is none
+	ServerUser *find(const sockaddr_storage &address) const;
+
+	/// Associates the given address with the given user. An existing association of the address is replaced.
+	void insert(const sockaddr_storage &address, ServerUser *user);
+
+	/// Removes the association of the given address, if it points to the given user
+	void remove(const sockaddr_storage &address, const ServerUser *user);
+
+	/// @returns The amount of addresses in the table
+	std::size_t size() const;
+
+protected:
+	/// The normalized form of a socket address. IPv4 addresses are stored as IPv4-mapped IPv6 addresses, such
+	/// that datagrams received on dual-stack sockets map to the same key as those received on IPv4 sockets.
+	struct Key {
+		std::uint64_t addressHigh;
+		std::uint64_t addressLow;
+		std::uint64_t port;
+
+		bool operator==(const Key &other) const;
+	};
+
+	/// All fields are atomic, as they are read by find() without synchronizing with writers. A reader that
+	/// raced with a writer notices by means of m_version and retries.
+	struct Slot {
+		std::atomic< std::uint64_t > addressHigh;
+		std::atomic< std::uint64_t > addressLow;
+		std::atomic< std::uint64_t > port;
+		/// nullptr if the slot is empty
+		std::atomic< ServerUser * > user;
+	};
+
+	struct Slots {
+		explicit Slots(std::size_t capacity);
+
+		std::unique_ptr< Slot[] > slots;
+		std::size_t mask;
+	};
+
+	/// Odd while a modification is in progress
+	std::atomic< std::uint32_t > m_version;
+	std::atomic< Slots * > m_slots;
+	std::size_t m_size;
+
+	/// Serializes all modifications
+	mutable QMutex m_writeMutex;
+	/// Slot arrays that have been replaced by a larger one. They are kept around (they add up to less than the
+	/// current array) as concurrent readers might still access them.
+	std::vector< std::unique_ptr< Slots > > m_slotArrays;
+
+	static Key makeKey(const sockaddr_storage &address);
+	static std::size_t hash(const Key &key);
+	static Key loadKey(const Slot &slot);
+	static void storeKey(Slot &slot, const Key &key);
+
+	/// @returns The index of the slot holding the given key or of the empty slot it would have to be put into
+	static std::size_t probe(const Slots &slots, const Key &key);
+
+	void beginWrite();
+	void endWrite();
+	void grow();
+};
+
+#endif
@@ -0,0 +1,204 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PermissionCache.h"
+#include "Channel.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+/// The minimum amount of sessions and channels rows are allocated for
+static constexpr std::size_t MIN_CAPACITY = 64;
+
+static std::size_t capacityFor(std::size_t index) {
+	std::size_t capacity = MIN_CAPACITY;
+	while (capacity <= index) {
+		capacity *= 2;
+	}
+
+	return capacity;
+}
+
+PermissionCache::Row::Row(std::size_t capacity)
+	: permissions(new std::atomic< std::uint32_t >[capacity]), capacity(capacity) {
+	for (std::size_t i = 0; i < capacity; ++i) {
+		permissions[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+PermissionCache::Rows::Rows(std::size_t capacity) : rows(new std::atomic< Row * >[capacity]), capacity(capacity) {
+	for (std::size_t i = 0; i < capacity; ++i) {
+		rows[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+PermissionCache::PermissionCache() {
+	m_allocatedRowArrays.push_back(std::make_unique< Rows >(MIN_CAPACITY));
+	m_rows.store(m_allocatedRowArrays.back().get(), std::memory_order_release);
+}
+
+PermissionCache::~PermissionCache() = default;
+
+ChanACL::Permissions PermissionCache::get(const ServerUser &user, unsigned int channelID) const {
+	const Rows &rows = *m_rows.load(std::memory_order_acquire);
+	if (user.uiSession >= rows.capacity) {
+		return ChanACL::None;
+	}
+
+	const Row *row = rows.rows[user.uiSession].load(std::memory_order_acquire);
+	if (!row || channelID >= row->capacity) {
+		return ChanACL::None;
+	}
+
+	return static_cast< ChanACL::Permissions >(row->permissions[channelID].load(std::memory_order_acquire));
+}
+
+void PermissionCache::set(const ServerUser &user, unsigned int channelID, ChanACL::Permissions permissions) {
+	getRow(user.uiSession, channelID)
+		.permissions[channelID]
+		.store(static_cast< std::uint32_t >(permissions), std::memory_order_release);
+}
+
+void PermissionCache::clearUser(const ServerUser &user) {
+	const Rows &rows = *m_rows.load(std::memory_order_relaxed);
+	if (user.uiSession >= rows.capacity) {
+		return;
+	}
+
+	m_inheritedMemberships.remove(user.uiSession);
+
+	// The row is kept around for the next user that gets the same session
+	Row *row = rows.rows[user.uiSession].load(std::memory_order_relaxed);
+	if (row) {
+		for (std::size_t i = 0; i < row->capacity; ++i) {
+			row->permissions[i].store(0, std::memory_order_release);
+		}
+	}
+}
+
+void PermissionCache::clearChannels(const std::vector< unsigned int > &channelIDs) {
+	for (QHash< unsigned int, QBitArray > &memberships : m_inheritedMemberships) {
+		for (unsigned int channelID : channelIDs) {
+			memberships.remove(channelID);
+		}
+	}
+
+	const Rows &rows = *m_rows.load(std::memory_order_relaxed);
+
+	for (std::size_t session = 0; session < rows.capacity; ++session) {
+		Row *row = rows.rows[session].load(std::memory_order_relaxed);
+		if (!row) {
+			continue;
+		}
+
+		for (unsigned int channelID : channelIDs) {
+			if (channelID < row->capacity) {
+				row->permissions[channelID].store(0, std::memory_order_release);
+			}
+		}
+	}
+}
+
+void PermissionCache::clear() {
+	m_inheritedMemberships.clear();
+
+	const Rows &rows = *m_rows.load(std::memory_order_relaxed);
+
+	for (std::size_t session = 0; session < rows.capacity; ++session) {
+		Row *row = rows.rows[session].load(std::memory_order_relaxed);
+		if (row) {
+			for (std::size_t i = 0; i < row->capacity; ++i) {
+				row->permissions[i].store(0, std::memory_order_release);
+			}
+		}
+	}
+}
+
+PermissionCache::Row &PermissionCache::getRow(unsigned int session, unsigned int channelID) {
+	Rows *rows = m_rows.load(std::memory_order_relaxed);
+
+	if (session >= rows->capacity) {
+		// The new array is not visible to readers yet, so it can be filled without further ado
+		std::unique_ptr< Rows > newRows = std::make_unique< Rows >(capacityFor(session));
+		for (std::size_t i = 0; i < rows->capacity; ++i) {
+			newRows->rows[i].store(rows->rows[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+
+		rows = newRows.get();
+		m_rows.store(rows, std::memory_order_release);
+		m_allocatedRowArrays.push_back(std::move(newRows));
+	}
+
+	Row *row = rows->rows[session].load(std::memory_order_relaxed);
+
+	if (!row || channelID >= row->capacity) {
+		std::unique_ptr< Row > newRow = std::make_unique< Row >(capacityFor(channelID));
+		if (row) {
+			for (std::size_t i = 0; i < row->capacity; ++i) {
+				newRow->permissions[i].store(row->permissions[i].load(std::memory_order_relaxed),
+											 std::memory_order_relaxed);
+			}
+		}
+
+		row = newRow.get();
+		rows->rows[session].store(row, std::memory_order_release);
+		m_allocatedRows.push_back(std::move(newRow));
+	}
+
+	return *row;
+}
+
+bool PermissionCache::isGroupMember(const ServerUser &user, const Channel &channel, const QString &groupName) {
+	const Group *group = channel.qhGroups.value(groupName);
+
+	if (!group || group->bInheritable) {
+		return isInheritedMember(user, channel, groupName);
+	}
+
+	// A group that isn't inheritable only exists as seen from its own channel
+	return group->contains(user, group->bInherit && channel.cParent
+									 && isInheritedMember(user, *channel.cParent, groupName));
+}
+
+bool PermissionCache::isInheritedMember(const ServerUser &user, const Channel &channel, const QString &groupName) {
+	const QBitArray &memberships = getInheritedMemberships(user, channel);
+
+	// A name that is unknown even after determining the memberships in the channel isn't used by any group in the
+	// channel or its parents
+	const int index = m_groupIndices.value(groupName, -1);
+
+	return index >= 0 && memberships.testBit(index);
+}
+
+const QBitArray &PermissionCache::getInheritedMemberships(const ServerUser &user, const Channel &channel) {
+	{
+		auto it = m_inheritedMemberships[user.uiSession].constFind(channel.iId);
+		if (it != m_inheritedMemberships[user.uiSession].constEnd() && it->size() == m_groupIndices.size()) {
+			return *it;
+		}
+	}
+
+	QBitArray inherited = channel.cParent ? getInheritedMemberships(user, *channel.cParent) : QBitArray();
+
+	// Names that are only known from now on are not used by any group in the parents, so the user isn't a member
+	for (const Group *group : channel.qhGroups) {
+		if (!m_groupIndices.contains(group->qsName)) {
+			m_groupIndices.insert(group->qsName, m_groupIndices.size());
+		}
+	}
+	inherited.resize(m_groupIndices.size());
+
+	QBitArray memberships = inherited;
+	for (const Group *group : channel.qhGroups) {
+		const int index = m_groupIndices.value(group->qsName);
+
+		memberships.setBit(index,
+						   group->bInheritable && group->contains(user, group->bInherit && inherited.testBit(index)));
+	}
+
+	QHash< unsigned int, QBitArray > &userMemberships = m_inheritedMemberships[user.uiSession];
+	userMemberships.insert(channel.iId, memberships);
+
+	return *userMemberships.constFind(channel.iId);
+}
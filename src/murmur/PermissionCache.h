@@ -0,0 +1,92 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PERMISSIONCACHE_H_
+#define MUMBLE_MURMUR_PERMISSIONCACHE_H_
+
+#include "ACL.h"
+
+#include <QtCore/QBitArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Channel;
+class ServerUser;
+
+/// Caches the effective permissions of users in channels.
+///
+/// The cache is a dense table with one row per user session, which in turn holds one entry per channel ID. Both
+/// session IDs and channel IDs are handed out from the bottom up, so neither dimension is sparse in practice.
+///
+/// Lookups are lock-free and may happen concurrently to modifications. Modifications (including storing newly
+/// computed permissions) have to be serialized by the caller, which the Server does by means of qmCache.
+///
+/// In order to speed up computing permissions that aren't cached yet, the cache furthermore remembers which (named)
+/// groups a user is a member of as a bitset per channel. Looking these up is not lock-free.
+class PermissionCache {
+public:
+	PermissionCache();
+	~PermissionCache();
+
+	/// @returns The cached permissions of the given user in the channel with the given ID. If there are none, the
+	/// 	returned permissions don't have the ChanACL::Cached flag set.
+	ChanACL::Permissions get(const ServerUser &user, unsigned int channelID) const;
+	/// Stores the permissions of the given user in the channel with the given ID
+	void set(const ServerUser &user, unsigned int channelID, ChanACL::Permissions permissions);
+
+	/// Drops all cached permissions of the given user
+	void clearUser(const ServerUser &user);
+	/// Drops the cached permissions of all users in the channels with the given IDs
+	void clearChannels(const std::vector< unsigned int > &channelIDs);
+	/// Drops all cached permissions
+	void clear();
+
+	/// Equivalent to Group::isMember, except that the memberships of the user in all groups of a channel are
+	/// determined at once and remembered until the permissions of the user or the channel are dropped.
+	bool isGroupMember(const ServerUser &user, const Channel &channel, const QString &groupName);
+
+protected:
+	struct Row {
+		explicit Row(std::size_t capacity);
+
+		std::unique_ptr< std::atomic< std::uint32_t >[] > permissions;
+		std::size_t capacity;
+	};
+
+	struct Rows {
+		explicit Rows(std::size_t capacity);
+
+		std::unique_ptr< std::atomic< Row * >[] > rows;
+		std::size_t capacity;
+	};
+
+	std::atomic< Rows * > m_rows;
+
+	/// All rows and row arrays that have ever been allocated. Readers might still access the ones that have been
+	/// replaced by larger ones, so these are only released together with the cache. As the capacity is doubled
+	/// every time, they add up to less than the ones in use.
+	std::vector< std::unique_ptr< Row > > m_allocatedRows;
+	std::vector< std::unique_ptr< Rows > > m_allocatedRowArrays;
+
+	/// The bit index of every group name that has been encountered so far
+	QHash< QString, int > m_groupIndices;
+	/// The groups a user is a member of as seen from the subchannels of a channel, by session and channel ID. This
+	/// differs from the membership as seen from the channel itself only for groups that aren't inheritable. Bitsets
+	/// that are smaller than the number of known group names are outdated.
+	QHash< unsigned int, QHash< unsigned int, QBitArray > > m_inheritedMemberships;
+
+	/// @returns The row of the given session, making sure it exists and has room for the given channel ID
+	Row &getRow(unsigned int session, unsigned int channelID);
+	const QBitArray &getInheritedMemberships(const ServerUser &user, const Channel &channel);
+	bool isInheritedMember(const ServerUser &user, const Channel &channel, const QString &groupName);
+};
+
+#endif
@@ -65,7 +65,7 @@ void Server::setUserState(User *pUser, Channel *cChannel, bool mute, bool deaf,
 	}
 
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 		pUser->bDeaf     = deaf;
 		pUser->bMute     = mute;
 		pUser->bSuppress = suppressed;
@@ -121,10 +121,12 @@ bool Server::setChannelState(Channel *cChannel, Channel *cParent, const QString
 		}
 
 		{
-			QWriteLocker wl(&qrwlVoiceThread);
+			VoiceWriteLocker wl(&qrwlVoiceThread);
 			cChannel->cParent->removeChannel(cChannel);
 			cParent->addChannel(cChannel);
 		}
+		// Targets including the children of the old or the new parents have to be recomputed
+		clearWhisperTargetCache({ cChannel->iId, cParent->iId }, {});
 
 		mpcs.set_parent(cParent->iId);
 
@@ -228,7 +230,7 @@ void Server::setTempGroups(int userid, int sessionId, Channel *cChannel, const Q
 		cChannel = qhChannels.value(0);
 
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 
 		Group *g;
 		foreach (g, cChannel->qhGroups) {
@@ -268,7 +270,7 @@ void Server::clearTempGroups(User *user, Channel *cChannel, bool recurse) {
 	qlChans.append(cChannel);
 
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 
 		while (!qlChans.isEmpty()) {
 			Channel *chan = qlChans.takeLast();
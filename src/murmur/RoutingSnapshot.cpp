@@ -0,0 +1,53 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "RoutingSnapshot.h"
+
+#include <utility>
+
+std::size_t RoutingSnapshot::setChannel(unsigned int channelID, std::vector< Receiver > receivers) {
+	std::shared_ptr< const std::vector< Receiver > > shared =
+		std::make_shared< const std::vector< Receiver > >(std::move(receivers));
+
+	std::size_t index;
+	if (findChannel(channelID, index)) {
+		m_channels[index] = std::move(shared);
+	} else {
+		index = m_channels.size();
+		m_channels.push_back(std::move(shared));
+		m_channelIndices.emplace(channelID, index);
+	}
+
+	return index;
+}
+
+bool RoutingSnapshot::findChannel(unsigned int channelID, std::size_t &index) const {
+	auto it = m_channelIndices.find(channelID);
+	if (it == m_channelIndices.end()) {
+		return false;
+	}
+
+	index = it->second;
+
+	return true;
+}
+
+void RoutingSnapshot::setSpeaker(unsigned int session, Speaker speaker) {
+	m_speakers[session] = std::move(speaker);
+}
+
+void RoutingSnapshot::removeSpeaker(unsigned int session) {
+	m_speakers.erase(session);
+}
+
+const std::vector< RoutingSnapshot::Receiver > &RoutingSnapshot::getReceivers(std::size_t channel) const {
+	return *m_channels[channel];
+}
+
+const RoutingSnapshot::Speaker *RoutingSnapshot::findSpeaker(unsigned int session) const {
+	auto it = m_speakers.find(session);
+
+	return it != m_speakers.end() ? &it->second : nullptr;
+}
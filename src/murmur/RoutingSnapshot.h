@@ -0,0 +1,73 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_ROUTINGSNAPSHOT_H_
+#define MUMBLE_MURMUR_ROUTINGSNAPSHOT_H_
+
+#include "MumbleProtocol.h"
+#include "VolumeAdjustment.h"
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class ServerUser;
+
+/// An immutable, flattened view of whom the regular speech of every user is routed to.
+///
+/// Snapshots are built by the main thread whenever the channel membership, links, listeners or permissions
+/// change and are then handed to the voice threads as a whole. This way the voice threads can route regular
+/// speech without looking at (and thus synchronizing with) the channel tree at all.
+///
+/// Most changes only affect a few channels and speakers, so a new snapshot is usually a copy of the previous one
+/// with only those entries replaced. The receivers of the channels are shared between such copies.
+class RoutingSnapshot {
+public:
+	struct Receiver {
+		ServerUser *user;
+		Mumble::Protocol::audio_context_t context;
+		VolumeAdjustment volumeAdjustment;
+	};
+
+	struct Speaker {
+		/// The channel the speaker is in
+		std::size_t channel;
+		/// The ID of that channel
+		unsigned int channelID;
+		/// Whether the speakers of that channel are mixed on the server (see AudioMixer)
+		bool mixed;
+		/// The linked channels the speaker has permission to speak in
+		std::vector< std::size_t > linkedChannels;
+	};
+
+	/// Sets the receivers of a channel, that is its users and its listeners. Channels that are not part of the
+	/// snapshot yet are added.
+	///
+	/// @returns The index of the channel
+	std::size_t setChannel(unsigned int channelID, std::vector< Receiver > receivers);
+	/// @param[out] index The index of the channel with the given ID, if it is part of the snapshot
+	/// @returns Whether the channel is part of the snapshot
+	bool findChannel(unsigned int channelID, std::size_t &index) const;
+
+	void setSpeaker(unsigned int session, Speaker speaker);
+	void removeSpeaker(unsigned int session);
+
+	/// @returns The receivers of the channel with the given index
+	const std::vector< Receiver > &getReceivers(std::size_t channel) const;
+
+	/// @returns The routing information of the user with the given session or nullptr if the user is not
+	/// 	part of this snapshot (yet)
+	const Speaker *findSpeaker(unsigned int session) const;
+
+protected:
+	std::vector< std::shared_ptr< const std::vector< Receiver > > > m_channels;
+	/// The index of every channel in m_channels by channel ID. Indices of removed channels are not reused, their
+	/// receivers are merely cleared.
+	std::unordered_map< unsigned int, std::size_t > m_channelIndices;
+	std::unordered_map< unsigned int, Speaker > m_speakers;
+};
+
+#endif
@@ -0,0 +1,72 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SPSCQUEUE_H_
+#define MUMBLE_MURMUR_SPSCQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/// A bounded, lock-free queue for handing items from exactly one producer thread to
+/// exactly one consumer thread. All memory is allocated up front.
+template< typename T > class SPSCQueue {
+public:
+	/// @param capacity The maximum amount of items in the queue. It is rounded up to the next power of two.
+	explicit SPSCQueue(std::size_t capacity) {
+		std::size_t size = 2;
+		while (size < capacity) {
+			size *= 2;
+		}
+
+		m_items.resize(size);
+		m_mask = size - 1;
+	}
+
+	/// Adds an item to the queue. Must only be called by the producer.
+	///
+	/// @returns Whether the item has been added. This fails if the queue is full.
+	bool push(T item) {
+		const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+
+		if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+			return false;
+		}
+
+		m_items[tail & m_mask] = std::move(item);
+		m_tail.store(tail + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/// Takes the oldest item out of the queue. Must only be called by the consumer.
+	///
+	/// @returns Whether there was an item to take
+	bool pop(T &item) {
+		const std::size_t head = m_head.load(std::memory_order_relaxed);
+
+		if (head == m_tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		// Moving the item out of its slot releases whatever resources it holds right away
+		item = std::move(m_items[head & m_mask]);
+		m_head.store(head + 1, std::memory_order_release);
+
+		return true;
+	}
+
+protected:
+	std::vector< T > m_items;
+	std::size_t m_mask;
+
+	// The indices are only ever incremented and only wrapped when accessing an item. They live on separate
+	// cache lines as each of them is written by a different thread.
+	alignas(64) std::atomic< std::size_t > m_head{ 0 };
+	alignas(64) std::atomic< std::size_t > m_tail{ 0 };
+};
+
+#endif
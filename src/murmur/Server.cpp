@@ -21,7 +21,11 @@
 #include "ServerUser.h"
 #include "User.h"
 #include "Version.h"
+#include "VoiceThreadPool.h"
 
+#ifdef USE_SERVER_MIXING
+#	include "AudioMixer.h"
+#endif
 #ifdef USE_ZEROCONF
 #	include "Zeroconf.h"
 #endif
@@ -81,6 +85,7 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 	tracy::SetThreadName("Main");
 
 	bValid     = true;
+	bRunning   = false;
 	iServerNum = snum;
 #ifdef USE_ZEROCONF
 	zeroconf = nullptr;
@@ -94,12 +99,45 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 	qtTimeout = new QTimer(this);
 
+	m_banExpiryTimer = new QTimer(this);
+	m_banExpiryTimer->setSingleShot(true);
+
 	iCodecAlpha = iCodecBeta = 0;
 	bPreferAlpha             = false;
 	bOpus                    = true;
 
 	qnamNetwork = nullptr;
 
+	m_cryptPool      = meta->m_cryptPool.get();
+	m_connectionPool = meta->m_connectionPool.get();
+
+#ifdef Q_OS_LINUX
+	m_voicePool = meta->m_voicePool.get();
+#else
+	m_voicePool = nullptr;
+#endif
+
+	// The Server thread itself is the first voice thread, any further one is handled by a VoiceWorker. With the
+	// shared voice threads, the contexts are used by whichever of those picks up the respective sockets.
+	const std::size_t voiceThreads = static_cast< std::size_t >(Meta::mp.iVoiceThreads);
+	for (std::size_t i = 0; i < voiceThreads; ++i) {
+		m_voiceContexts.push_back(std::make_unique< VoiceThreadContext >());
+		m_voiceContexts.back()->sendBatch.setCapacity(static_cast< std::size_t >(Meta::mp.iUDPBatchSize));
+
+		if (i > 0 && !m_voicePool) {
+			m_voiceWorkers.push_back(std::make_unique< VoiceWorker >(*this, i));
+		}
+	}
+	qrwlVoiceThread.setSlotCount(voiceThreads);
+
+	m_tcpContext.sendBatch.setCapacity(static_cast< std::size_t >(Meta::mp.iUDPBatchSize));
+	m_tcpTransmitPending = false;
+
+	m_routingVersion = 0;
+	publishRoutingSnapshot(std::make_shared< RoutingSnapshot >());
+
+	m_passwordHasher = meta->m_passwordHasher.get();
+
 	readParams();
 	initialize();
 
@@ -131,86 +169,102 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 		memset(&addr, 0, sizeof(addr));
 		getsockname(tcpsock, reinterpret_cast< struct sockaddr * >(&addr), &len);
+		for (std::size_t i = 0; i < m_voiceContexts.size(); ++i) {
 #ifdef Q_OS_UNIX
-		int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
+			int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
 #	ifdef Q_OS_LINUX
-		int sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
-		sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			int sockopt = 1;
+			if (m_voiceContexts.size() > 1) {
+				// Let every voice thread have its own socket on the same address. The kernel will then distribute
+				// the clients among them by hashing the flows.
+				if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &sockopt, sizeof(sockopt)))
+					log(QString("Failed to set SO_REUSEPORT for %1")
+							.arg(addressToString(ss->serverAddress(), usPort)));
+			}
+			sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IPV6_RECVPKTINFO for %1")
+						.arg(addressToString(ss->serverAddress(), usPort)));
 #	endif
 #else
 #	ifndef SIO_UDP_CONNRESET
 #		define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
 #	endif
-		SOCKET sock           = ::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED);
-		DWORD dwBytesReturned = 0;
-		BOOL bNewBehaviour    = FALSE;
-		if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
-					 nullptr, nullptr)
-			== SOCKET_ERROR) {
-			log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
-		}
+			SOCKET sock =
+				::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED);
+			DWORD dwBytesReturned = 0;
+			BOOL bNewBehaviour    = FALSE;
+			if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
+						 nullptr, nullptr)
+				== SOCKET_ERROR) {
+				log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
+			}
 #endif
-		if (sock == INVALID_SOCKET) {
-			log("Failed to create UDP Socket");
-			bValid = false;
-			return;
-		} else {
-			if (addr.ss_family == AF_INET6) {
-				// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
-				// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
-				// This will fail for WindowsXP which is ok. Our TCP code will have split that up
-				// into two sockets.
-				int ipv6only     = 0;
-				socklen_t optlen = sizeof(ipv6only);
-				if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
-					== 0) {
-					if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
-									 optlen)
-						== SOCKET_ERROR) {
-						log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+			if (sock == INVALID_SOCKET) {
+				log("Failed to create UDP Socket");
+				bValid = false;
+				return;
+			} else {
+				if (addr.ss_family == AF_INET6) {
+					// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
+					// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
+					// This will fail for WindowsXP which is ok. Our TCP code will have split that up
+					// into two sockets.
+					int ipv6only     = 0;
+					socklen_t optlen = sizeof(ipv6only);
+					if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only),
+									 &optlen)
+						== 0) {
+						if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
+										 optlen)
+							== SOCKET_ERROR) {
+							log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+						}
 					}
 				}
-			}
 
-			if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
+				if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
 #ifdef Q_OS_WIN
-				log(QString("Failed to bind UDP Socket to %1: %2")
-						.arg(addressToString(ss->serverAddress(), usPort), WSAGetLastError()));
+					log(QString("Failed to bind UDP Socket to %1: %2")
+							.arg(addressToString(ss->serverAddress(), usPort), WSAGetLastError()));
 #else
-				log(QString("Failed to bind UDP Socket to %1: %2")
-						.arg(addressToString(ss->serverAddress(), usPort), errno));
+					log(QString("Failed to bind UDP Socket to %1: %2")
+							.arg(addressToString(ss->serverAddress(), usPort), errno));
 #endif
-			} else {
+				} else {
 #ifdef Q_OS_UNIX
-				int val = 0xe0;
-				if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
-					val = 0x80;
-					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
-						log("Server: Failed to set TOS for UDP Socket");
-				}
+					int val = 0xe0;
+					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
+						val = 0x80;
+						if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
+							log("Server: Failed to set TOS for UDP Socket");
+					}
 #	if defined(SO_PRIORITY)
-				socklen_t optlen = sizeof(val);
-				if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
-					if (val == 0) {
-						val = 6;
-						setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+					socklen_t optlen = sizeof(val);
+					if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
+						if (val == 0) {
+							val = 6;
+							setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+						}
 					}
-				}
 #	endif
 #endif
+				}
+				QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
+				connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
+				qlUdpSocket << sock;
+				qlUdpNotifier << qsn;
+				m_voiceContexts[i]->sockets << sock;
 			}
-			QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
-			connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
-			qlUdpSocket << sock;
-			qlUdpNotifier << qsn;
 		}
 	}
 
-	bValid = bValid && (qlServer.count() == qlBind.count()) && (qlUdpSocket.count() == qlBind.count());
+	bValid = bValid && (qlServer.count() == qlBind.count())
+			 && (static_cast< std::size_t >(qlUdpSocket.count())
+				 == static_cast< std::size_t >(qlBind.count()) * m_voiceContexts.size());
 	if (!bValid)
 		return;
 
@@ -224,14 +278,14 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 	hNotify = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 #endif
 
-	connect(this, SIGNAL(tcpTransmit(QByteArray, unsigned int)), this, SLOT(tcpTransmitData(QByteArray, unsigned int)),
-			Qt::QueuedConnection);
+	connect(this, SIGNAL(tcpTransmit()), this, SLOT(tcpTransmitData()), Qt::QueuedConnection);
 	connect(this, SIGNAL(reqSync(unsigned int)), this, SLOT(doSync(unsigned int)));
 
 	for (unsigned int i = 1; i < iMaxUsers * 2; ++i)
 		qqIds.enqueue(i);
 
 	connect(qtTimeout, SIGNAL(timeout()), this, SLOT(checkTimeout()));
+	connect(m_banExpiryTimer, SIGNAL(timeout()), this, SLOT(expireBans()));
 
 	getBans();
 	readChannels();
@@ -248,13 +302,28 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 }
 
 void Server::startThread() {
-	if (!isRunning()) {
+#ifdef Q_OS_LINUX
+	if (m_voicePool && !bRunning) {
+		log("Starting voice processing on the shared voice threads");
+		bRunning = true;
+
+		foreach (QSocketNotifier *qsn, qlUdpNotifier)
+			qsn->setEnabled(false);
+		for (std::size_t i = 0; i < m_voiceContexts.size(); ++i) {
+			m_voicePool->addSockets(*this, i, m_voiceContexts[i]->sockets);
+		}
+	}
+#endif
+	if (!m_voicePool && !isRunning()) {
 		log("Starting voice thread");
 		bRunning = true;
 
 		foreach (QSocketNotifier *qsn, qlUdpNotifier)
 			qsn->setEnabled(false);
 		start(QThread::HighestPriority);
+		for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
+			worker->start(QThread::HighestPriority);
+		}
 #ifdef Q_OS_LINUX
 		// QThread::HighestPriority == Same as everything else...
 		int policy;
@@ -273,6 +342,15 @@ void Server::startThread() {
 }
 
 void Server::stopThread() {
+#ifdef Q_OS_LINUX
+	if (m_voicePool && bRunning) {
+		log("Ending voice processing on the shared voice threads");
+		m_voicePool->removeServer(*this);
+
+		foreach (QSocketNotifier *qsn, qlUdpNotifier)
+			qsn->setEnabled(true);
+	}
+#endif
 	bRunning = false;
 	if (isRunning()) {
 		log("Ending voice thread");
@@ -285,6 +363,15 @@ void Server::stopThread() {
 		SetEvent(hNotify);
 #endif
 		wait();
+		for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
+			worker->wait();
+		}
+
+#ifdef Q_OS_UNIX
+		// The voice threads leave the notification in the pipe so that all of them get to see it
+		while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
+		};
+#endif
 
 		foreach (QSocketNotifier *qsn, qlUdpNotifier)
 			qsn->setEnabled(true);
@@ -299,6 +386,11 @@ Server::~Server() {
 
 	stopThread();
 
+	if (m_passwordHasher) {
+		// The hasher outlives the server and mustn't post the hashes to it anymore
+		m_passwordHasher->cancel(this);
+	}
+
 	foreach (QSocketNotifier *qsn, qlUdpNotifier)
 		delete qsn;
 
@@ -321,6 +413,21 @@ Server::~Server() {
 	log("Stopped");
 }
 
+/// @returns The IDs in the given comma-separated list. Entries that aren't valid IDs are ignored.
+static QSet< unsigned int > parseChannelIDs(const QString &list) {
+	QSet< unsigned int > channelIDs;
+
+	for (const QString &entry : list.split(QLatin1Char(','))) {
+		bool ok               = false;
+		const unsigned int id = entry.trimmed().toUInt(&ok);
+		if (ok) {
+			channelIDs.insert(id);
+		}
+	}
+
+	return channelIDs;
+}
+
 void Server::readParams() {
 	qsPassword                         = Meta::mp.qsPassword;
 	usPort                             = static_cast< unsigned short >(Meta::mp.usPort + iServerNum - 1);
@@ -328,6 +435,10 @@ void Server::readParams() {
 	iMaxBandwidth                      = Meta::mp.iMaxBandwidth;
 	iMaxUsers                          = Meta::mp.iMaxUsers;
 	iMaxUsersPerChannel                = Meta::mp.iMaxUsersPerChannel;
+	iMaxActiveSpeakers                 = Meta::mp.iMaxActiveSpeakers;
+	iActiveSpeakersChannelSize         = Meta::mp.iActiveSpeakersChannelSize;
+	qsMixedChannels                    = Meta::mp.qsMixedChannels;
+	iMixingBitrate                     = Meta::mp.iMixingBitrate;
 	iMaxTextMessageLength              = Meta::mp.iMaxTextMessageLength;
 	iMaxImageMessageLength             = Meta::mp.iMaxImageMessageLength;
 	bAllowHTML                         = Meta::mp.bAllowHTML;
@@ -409,6 +520,13 @@ void Server::readParams() {
 	qsWelcomeText          = getConf("welcometext", qsWelcomeText).toString();
 	qsWelcomeTextFile      = getConf("welcometextfile", qsWelcomeTextFile).toString();
 
+	iMaxActiveSpeakers         = getConf("activespeakers", iMaxActiveSpeakers).toUInt();
+	iActiveSpeakersChannelSize = getConf("activespeakerschannelsize", iActiveSpeakersChannelSize).toUInt();
+
+	qsMixedChannels = getConf("mixedchannels", qsMixedChannels).toString();
+	iMixingBitrate  = getConf("mixingbitrate", iMixingBitrate).toInt();
+	m_mixedChannels = parseChannelIDs(qsMixedChannels);
+
 	if (!qsWelcomeTextFile.isEmpty()) {
 		if (qsWelcomeText.isEmpty()) {
 			QFile f(qsWelcomeTextFile);
@@ -505,7 +623,23 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 		sendAll(mpsc);
 	} else if (key == "usersperchannel")
 		iMaxUsersPerChannel = i ? static_cast< unsigned int >(i) : Meta::mp.iMaxUsersPerChannel;
-	else if (key == "textmessagelength") {
+	else if (key == "activespeakers")
+		iMaxActiveSpeakers = i ? static_cast< unsigned int >(i) : Meta::mp.iMaxActiveSpeakers;
+	else if (key == "activespeakerschannelsize")
+		iActiveSpeakersChannelSize = i ? static_cast< unsigned int >(i) : Meta::mp.iActiveSpeakersChannelSize;
+	else if (key == "mixedchannels") {
+		qsMixedChannels = !v.isNull() ? v : Meta::mp.qsMixedChannels;
+		m_mixedChannels = parseChannelIDs(qsMixedChannels);
+#ifdef USE_SERVER_MIXING
+		clearMixers();
+#endif
+		updateRouting();
+	} else if (key == "mixingbitrate") {
+		iMixingBitrate = i ? i : Meta::mp.iMixingBitrate;
+#ifdef USE_SERVER_MIXING
+		clearMixers();
+#endif
+	} else if (key == "textmessagelength") {
 		int length = i ? i : Meta::mp.iMaxTextMessageLength;
 		if (length != iMaxTextMessageLength) {
 			iMaxTextMessageLength = length;
@@ -547,6 +681,8 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 		QString text = !v.isNull() ? v : Meta::mp.qsRegName;
 		if (text != qsRegName) {
 			qsRegName = text;
+			// The root channel is named after the server, which isn't broadcast if the name is reset
+			m_stateSyncCache.invalidateChannel(0);
 			if (!qsRegName.isEmpty()) {
 				MumbleProto::ChannelState mpcs;
 				mpcs.set_channel_id(0);
@@ -608,6 +744,8 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 	} else if (key == "broadcastlistenervolumeadjustments") {
 		broadcastListenerVolumeAdjustments =
 			(!v.isNull() ? QVariant(v).toBool() : Meta::mp.broadcastListenerVolumeAdjustments);
+		// The volume adjustments are only part of the user states if they are broadcast
+		m_stateSyncCache.clear();
 	}
 }
 
@@ -742,17 +880,28 @@ void Server::udpActivated(int socket) {
 void Server::run() {
 	tracy::SetThreadName("Audio");
 
+	voiceLoop(0);
+}
+
+void Server::voiceLoop(std::size_t index) {
+	VoiceThreadContext &context = *m_voiceContexts[index];
+
+#ifdef Q_OS_LINUX
+	UDPReceiveBatch receiveBatch(static_cast< std::size_t >(Meta::mp.iUDPBatchSize));
+#else
 	qint32 len;
-#if defined(__LP64__)
+#	if defined(__LP64__)
 	unsigned char encbuff[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
 	unsigned char *encrypt = encbuff + 4;
-#else
+#	else
 	unsigned char encrypt[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
-#endif
-	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+#	endif
 
 	sockaddr_storage from;
-	unsigned int nfds = static_cast< unsigned int >(qlUdpSocket.count());
+	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+#endif
+
+	unsigned int nfds = static_cast< unsigned int >(context.sockets.count());
 
 #ifdef Q_OS_UNIX
 	socklen_t fromlen;
@@ -760,7 +909,7 @@ void Server::run() {
 	fds.resize(static_cast< std::size_t >(nfds + 1));
 
 	for (unsigned int i = 0; i < nfds; ++i) {
-		fds[i].fd      = qlUdpSocket.at(static_cast< int >(i));
+		fds[i].fd      = context.sockets.at(static_cast< int >(i));
 		fds[i].events  = POLLIN;
 		fds[i].revents = 0;
 	}
@@ -775,7 +924,7 @@ void Server::run() {
 	std::vector< HANDLE > events;
 	events.resize(nfds + 1);
 	for (unsigned int i = 0; i < nfds; ++i) {
-		fds[i]    = qlUdpSocket.at(i);
+		fds[i]    = context.sockets.at(i);
 		events[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 		::WSAEventSelect(fds[i], events[i], FD_READ);
 	}
@@ -798,10 +947,7 @@ void Server::run() {
 		}
 
 		if (fds[nfds - 1].revents) {
-			// Drain pipe
-			unsigned char val;
-			while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
-			};
+			// We are asked to stop. The pipe is drained by stopThread() once all voice threads are done.
 			break;
 		}
 
@@ -829,188 +975,186 @@ void Server::run() {
 				SOCKET sock = fds[ret - WAIT_OBJECT_0];
 #endif
 
+#ifdef Q_OS_LINUX
+				// Anything that didn't fit into the batch will wake up the next poll() right away
+				receiveVoice(index, sock, receiveBatch);
+				Q_UNUSED(fromlen);
+#else
 				fromlen = sizeof(from);
-#ifdef Q_OS_WIN
+#	ifdef Q_OS_WIN
 				len = ::recvfrom(sock, reinterpret_cast< char * >(encrypt), Mumble::Protocol::MAX_UDP_PACKET_SIZE, 0,
 								 reinterpret_cast< struct sockaddr * >(&from), &fromlen);
-#else
-#	ifdef Q_OS_LINUX
-				struct msghdr msg;
-				struct iovec iov[1];
-
-				iov[0].iov_base = encrypt;
-				iov[0].iov_len  = Mumble::Protocol::MAX_UDP_PACKET_SIZE;
-
-				uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
-
-				memset(&msg, 0, sizeof(msg));
-				msg.msg_name       = reinterpret_cast< struct sockaddr * >(&from);
-				msg.msg_namelen    = sizeof(from);
-				msg.msg_iov        = iov;
-				msg.msg_iovlen     = 1;
-				msg.msg_control    = controldata;
-				msg.msg_controllen = sizeof(controldata);
-
-				len = static_cast< qint32 >(::recvmsg(sock, &msg, MSG_TRUNC));
-				Q_UNUSED(fromlen);
 #	else
 				len = static_cast< qint32 >(::recvfrom(sock, encrypt, Mumble::Protocol::MAX_UDP_PACKET_SIZE, MSG_TRUNC,
 													   reinterpret_cast< struct sockaddr * >(&from), &fromlen));
 #	endif
-#endif
-
-				// Capture only the processing without the polling
-				ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
 
 				if (len == 0) {
 					break;
 				} else if (len == SOCKET_ERROR) {
 					break;
-				} else if (len < 5) {
-					// 4 bytes crypt header + type + session
-					continue;
-				} else if (static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
-					// This will also catch the len == -1 case (indicating error)
-					static_assert(static_cast< unsigned int >(-1) > Mumble::Protocol::MAX_UDP_PACKET_SIZE,
-								  "Invalid assumption");
-					continue;
 				}
 
-				QReadLocker rl(&qrwlVoiceThread);
+				UDPDatagram datagram;
+				datagram.socket     = sock;
+				datagram.data       = encrypt;
+				datagram.length     = len;
+				datagram.from       = &from;
+				datagram.fromLength = fromlen;
 
-				quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast< sockaddr_in6 * >(&from)->sin6_port)
-															: (reinterpret_cast< sockaddr_in * >(&from)->sin_port);
-				const HostAddress &ha = HostAddress(from);
+				context.receiveTime = Timer::now();
 
-				const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(ha, port);
+				processDatagram(context, datagram, buffer);
+#endif
+#ifdef Q_OS_UNIX
+				fds[i].revents = 0;
+#endif
+			}
+		}
+	}
+#ifdef Q_OS_WIN
+	for (unsigned int i = 0; i < nfds - 1; ++i) {
+		::WSAEventSelect(fds[i], nullptr, 0);
+		CloseHandle(events[i]);
+	}
+#endif
+}
 
-				ServerUser *u = qhPeerUsers.value(key);
+#ifdef Q_OS_LINUX
+void Server::receiveVoice(std::size_t index, int socket, UDPReceiveBatch &receiveBatch) {
+	VoiceThreadContext &context = *m_voiceContexts[index];
+	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
 
-				if (u) {
-					m_udpDecoder.setProtocolVersion(u->m_version);
-				} else {
-					m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
-				}
-				// This may be a general ping requesting server details, unencrypted.
-				if (bAllowPing
-					&& m_udpDecoder.decodePing(
-						gsl::span< Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)))
-					&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
-					ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
+	// Fetch everything that is currently queued on the socket (up to the batch size) with a single system call
+	const int received = receiveBatch.receive(socket);
 
-					gsl::span< const Mumble::Protocol::byte > encodedPing =
-						handlePing(m_udpDecoder, m_udpPingEncoder, true);
+	context.receiveTime = Timer::now();
 
-					if (!encodedPing.empty()) {
-#ifdef Q_OS_LINUX
-						// We are only reading from the buffer and thus the const_cast should be fine
-						iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
-						iov[0].iov_len  = encodedPing.size();
-						::sendmsg(sock, &msg, 0);
-#else
-#	ifdef Q_OS_WIN
-						using size_type = int;
-#	else
-						using size_type = std::size_t;
-#	endif
-						::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
-								 static_cast< size_type >(encodedPing.size()), 0,
-								 reinterpret_cast< struct sockaddr * >(&from), fromlen);
+	for (int i = 0; i < received; ++i) {
+		processDatagram(context, receiveBatch.datagram(static_cast< std::size_t >(i)), buffer);
+	}
+}
 #endif
-					}
 
-					continue;
+void Server::processDatagram(VoiceThreadContext &context, const UDPDatagram &datagram, unsigned char *buffer) {
+	// Capture only the processing without the polling
+	ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
+
+	qint32 len             = datagram.length;
+	unsigned char *encrypt = datagram.data;
+	sockaddr_storage &from = *datagram.from;
+
+	if (len < 5) {
+		// 4 bytes crypt header + type + session
+		// This will also catch the len == -1 case (indicating error)
+		return;
+	} else if (static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+		return;
+	}
+
+	// The lookup itself is lock-free, but the user must not be deleted while its packet is being processed
+	VoiceReadLocker rl(&qrwlVoiceThread);
+
+	ServerUser *u = m_udpPeers.find(from);
+
+	if (u) {
+		context.decoder.setProtocolVersion(u->m_version);
+	} else {
+		context.decoder.setProtocolVersion(Version::UNKNOWN);
+	}
+	// This may be a general ping requesting server details, unencrypted.
+	if (bAllowPing
+		&& context.decoder.decodePing(gsl::span< Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)))
+		&& context.decoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
+		ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
+
+		gsl::span< const Mumble::Protocol::byte > encodedPing = handlePing(context.decoder, context.pingEncoder, true);
+
+		if (!encodedPing.empty()) {
+			datagram.reply(encodedPing.data(), encodedPing.size());
+		}
+
+		return;
+	}
+
+
+	if (u) {
+		if (!checkDecrypt(u, encrypt, buffer, static_cast< unsigned int >(len))) {
+			return;
+		}
+	} else {
+		ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
+
+		// Unknown peer
+		const HostAddress ha(from);
+		foreach (ServerUser *usr, qhHostUsers.value(ha)) {
+			if (checkDecrypt(usr, encrypt, buffer,
+							 static_cast< unsigned int >(len))) { // checkDecrypt takes the User's qrwlCrypt lock.
+				// Every time we relock, reverify users' existence.
+				// The main thread might delete the user while the lock isn't held.
+				unsigned int uiSession = usr->uiSession;
+				rl.unlock();
+				qrwlVoiceThread.lockForWrite();
+				if (qhUsers.contains(uiSession)) {
+					u             = usr;
+					u->sUdpSocket = datagram.socket;
+					memcpy(&u->saiUdpAddress, &from, sizeof(from));
+					qhHostUsers[ha].remove(u);
+					m_udpPeers.insert(from, u);
 				}
+				qrwlVoiceThread.unlock();
+				rl.relock();
+				if (u && !qhUsers.contains(uiSession))
+					u = nullptr;
+				break;
+			}
+		}
+		if (!u) {
+			return;
+		}
+	}
+	len -= 4;
 
+	if (context.decoder.decode(gsl::span< Mumble::Protocol::byte >(buffer, static_cast< std::size_t >(len)))) {
+		switch (context.decoder.getMessageType()) {
+			case Mumble::Protocol::UDPMessageType::Audio: {
+				Mumble::Protocol::AudioData audioData = context.decoder.getAudioData();
 
-				if (u) {
-					if (!checkDecrypt(u, encrypt, buffer, static_cast< unsigned int >(len))) {
-						continue;
-					}
-				} else {
-					ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
-
-					// Unknown peer
-					foreach (ServerUser *usr, qhHostUsers.value(ha)) {
-						if (checkDecrypt(
-								usr, encrypt, buffer,
-								static_cast< unsigned int >(len))) { // checkDecrypt takes the User's qrwlCrypt lock.
-							// Every time we relock, reverify users' existence.
-							// The main thread might delete the user while the lock isn't held.
-							unsigned int uiSession = usr->uiSession;
-							rl.unlock();
-							qrwlVoiceThread.lockForWrite();
-							if (qhUsers.contains(uiSession)) {
-								u             = usr;
-								u->sUdpSocket = sock;
-								memcpy(&u->saiUdpAddress, &from, sizeof(from));
-								qhHostUsers[from].remove(u);
-								qhPeerUsers.insert(key, u);
-							}
-							qrwlVoiceThread.unlock();
-							rl.relock();
-							if (u && !qhUsers.contains(uiSession))
-								u = nullptr;
-							break;
-						}
-					}
-					if (!u) {
-						continue;
-					}
+				// Allow all voice packets through by default.
+				bool ok = true;
+				// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
+				if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
+					ok = false;
 				}
-				len -= 4;
-
-				if (m_udpDecoder.decode(gsl::span< Mumble::Protocol::byte >(buffer, static_cast< std::size_t >(len)))) {
-					switch (m_udpDecoder.getMessageType()) {
-						case Mumble::Protocol::UDPMessageType::Audio: {
-							Mumble::Protocol::AudioData audioData = m_udpDecoder.getAudioData();
-
-							// Allow all voice packets through by default.
-							bool ok = true;
-							// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
-							if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
-								ok = false;
-							}
 
-							if (ok) {
-								u->aiUdpFlag = 1;
+				if (ok) {
+					u->aiUdpFlag = 1;
+
+					// Add session id
+					audioData.senderSession = u->uiSession;
 
-								// Add session id
-								audioData.senderSession = u->uiSession;
+					processMsg(u, audioData, context);
+				}
+				break;
+			}
+			case Mumble::Protocol::UDPMessageType::Ping: {
+				ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
 
-								processMsg(u, audioData, m_udpAudioReceivers, m_udpAudioEncoder);
-							}
-							break;
-						}
-						case Mumble::Protocol::UDPMessageType::Ping: {
-							ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
-
-							Mumble::Protocol::PingData pingData = m_udpDecoder.getPingData();
-							if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
-								// At this point here, we only want to handle connectivity pings
-								gsl::span< const Mumble::Protocol::byte > encodedPing =
-									handlePing(m_udpDecoder, m_udpPingEncoder, false);
-
-								QByteArray cache;
-								sendMessage(*u, encodedPing.data(), static_cast< int >(encodedPing.size()), cache,
-											true);
-							}
-							break;
-						}
-					}
+				Mumble::Protocol::PingData pingData = context.decoder.getPingData();
+				if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
+					// At this point here, we only want to handle connectivity pings
+					gsl::span< const Mumble::Protocol::byte > encodedPing =
+						handlePing(context.decoder, context.pingEncoder, false);
+
+					QByteArray cache;
+					sendMessage(*u, encodedPing.data(), static_cast< int >(encodedPing.size()), cache, context,
+								true);
+					context.sendBatch.flush();
 				}
-#ifdef Q_OS_UNIX
-				fds[i].revents = 0;
-#endif
+				break;
 			}
 		}
 	}
-#ifdef Q_OS_WIN
-	for (unsigned int i = 0; i < nfds - 1; ++i) {
-		::WSAEventSelect(fds[i], nullptr, 0);
-		CloseHandle(events[i]);
-	}
-#endif
 }
 
 bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned char *plain, unsigned int len) {
@@ -1031,25 +1175,22 @@ bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned
 	return false;
 }
 
-void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force) {
-	ZoneScoped;
-
+/// @returns Whether packets can be sent to the given user via UDP
+static bool canSendViaUDP(const ServerUser &u, bool force) {
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-	if ((u.aiUdpFlag.loadRelaxed() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET)) {
+	return (u.aiUdpFlag.loadRelaxed() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET);
 #else
 	// Qt 5.14 introduced QAtomicInteger::loadRelaxed() which deprecates QAtomicInteger::load()
-	if ((u.aiUdpFlag.load() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET)) {
-#endif
-#if defined(__LP64__)
-		static std::vector< char > ebuffer;
-		ebuffer.resize(static_cast< std::size_t >(len + 4 + 16));
-		char *buffer = reinterpret_cast< char * >(
-			((reinterpret_cast< quint64 >(ebuffer.data()) + 8) & static_cast< quint64 >(~7)) + 4);
-#else
-		std::vector< char > bufVec;
-		bufVec.resize(static_cast< std::size_t >(len + 4));
-		char *buffer    = bufVec.data();
+	return (u.aiUdpFlag.load() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET);
 #endif
+}
+
+void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache,
+						 VoiceThreadContext &context, bool force) {
+	ZoneScoped;
+
+	if (canSendViaUDP(u, force)) {
+		unsigned char *buffer = context.sendBatch.nextBuffer();
 		{
 			QMutexLocker wl(&u.qmCrypt);
 
@@ -1057,97 +1198,79 @@ void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByt
 				return;
 			}
 
-			if (!u.csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data),
-									reinterpret_cast< unsigned char * >(buffer), static_cast< unsigned int >(len))) {
+			if (!u.csCrypt->encrypt(data, buffer, static_cast< unsigned int >(len))) {
 				return;
 			}
 		}
-#ifdef Q_OS_WIN
-		DWORD dwFlow = 0;
-		if (Meta::hQoS)
-			QOSAddSocketToFlow(Meta::hQoS, u.sUdpSocket, reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress),
-							   QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&dwFlow));
-#endif
-#ifdef Q_OS_LINUX
-		struct msghdr msg;
-		struct iovec iov[1];
-
-		iov[0].iov_base = buffer;
-		iov[0].iov_len  = static_cast< unsigned int >(len + 4);
-
-		uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
-		memset(controldata, 0, sizeof(controldata));
-
-		memset(&msg, 0, sizeof(msg));
-		msg.msg_name    = reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress);
-		msg.msg_namelen = static_cast< socklen_t >(
-			(u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
-		msg.msg_iov        = iov;
-		msg.msg_iovlen     = 1;
-		msg.msg_control    = controldata;
-		msg.msg_controllen = CMSG_SPACE((u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo)
-																				: sizeof(struct in_pktinfo));
-
-		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-		HostAddress tcpha(u.saiTcpLocalAddress);
-		if (u.saiUdpAddress.ss_family == AF_INET6) {
-			cmsg->cmsg_level            = IPPROTO_IPV6;
-			cmsg->cmsg_type             = IPV6_PKTINFO;
-			cmsg->cmsg_len              = CMSG_LEN(sizeof(struct in6_pktinfo));
-			struct in6_pktinfo *pktinfo = reinterpret_cast< struct in6_pktinfo * >(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			memcpy(&pktinfo->ipi6_addr.s6_addr[0], tcpha.getByteRepresentation().data(),
-				   sizeof(pktinfo->ipi6_addr.s6_addr));
-		} else {
-			cmsg->cmsg_level           = IPPROTO_IP;
-			cmsg->cmsg_type            = IP_PKTINFO;
-			cmsg->cmsg_len             = CMSG_LEN(sizeof(struct in_pktinfo));
-			struct in_pktinfo *pktinfo = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			if (tcpha.isV6())
-				return;
-			pktinfo->ipi_spec_dst.s_addr = tcpha.toIPv4();
-		}
-
 
-		::sendmsg(u.sUdpSocket, &msg, 0);
-#else
-#	ifdef Q_OS_WIN
-		using size_type = int;
-#	else
-		using size_type = std::size_t;
-#	endif
-		::sendto(u.sUdpSocket, buffer, static_cast< size_type >(len + 4), 0,
-				 reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress),
-				 (u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
-#endif
-#ifdef Q_OS_WIN
-		if (Meta::hQoS && dwFlow)
-			QOSRemoveSocketFromFlow(Meta::hQoS, 0, dwFlow, 0);
-#else
-#endif
+		// The datagram is sent once the batch is full or gets flushed
+		context.sendBatch.commit(u.sUdpSocket, u.saiUdpAddress, u.saiTcpLocalAddress,
+								 static_cast< std::size_t >(len + 4));
 	} else {
-		if (cache.isEmpty())
-			cache = QByteArray(reinterpret_cast< const char * >(data), len);
-		emit tcpTransmit(cache, u.uiSession);
+		// The UDPTunnel message is built only once and then shared among all receivers of the packet
+		if (cache.isEmpty()) {
+			cache.resize(len + 6);
+			unsigned char *uc = reinterpret_cast< unsigned char * >(cache.data());
+			*reinterpret_cast< quint16 * >(&uc[0]) =
+				qToBigEndian(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel));
+			*reinterpret_cast< quint32 * >(&uc[2]) = qToBigEndian(static_cast< quint32 >(len));
+			memcpy(uc + 6, data, static_cast< std::size_t >(len));
+		}
+
+		if (!context.tunnelQueue.push({ cache, u.uiSession })) {
+			// The main thread is lagging behind that much that the packet would arrive way too late anyway
+			return;
+		}
+
+		// Only wake up the main thread if it isn't going to drain the queues anyway
+		if (!m_tcpTransmitPending.exchange(true)) {
+			emit tcpTransmit();
+		}
 	}
 }
 
-void Server::addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user, const Channel &channel) {
-	const VolumeAdjustment &volumeAdjustment =
-		m_channelListenerManager.getListenerVolumeAdjustment(user.uiSession, channel.iId);
+void Server::encryptFanout(CryptFanout &fanout, std::size_t begin, const unsigned char *data, int len) {
+	ZoneScoped;
+
+	// The amount of receivers a single thread encrypts for at once. Smaller fan-outs are not worth being
+	// distributed among multiple threads.
+	constexpr std::size_t sliceSize = 16;
 
-	auto it = listeners.find(&user);
+	auto encryptSlice = [&fanout, begin, data, len](std::size_t sliceBegin, std::size_t sliceEnd) {
+		for (std::size_t i = begin + sliceBegin; i < begin + sliceEnd; ++i) {
+			CryptFanout::Entry &entry = fanout[i];
+			ServerUser &receiver      = *entry.receiver;
 
-	if (it == listeners.end() || it->factor < volumeAdjustment.factor) {
-		listeners[&user] = volumeAdjustment;
+			QMutexLocker wl(&receiver.qmCrypt);
+
+			entry.length    = static_cast< std::size_t >(len + 4);
+			entry.encrypted = receiver.csCrypt->isValid()
+							  && receiver.csCrypt->encrypt(data, fanout.buffer(i), static_cast< unsigned int >(len));
+		}
+	};
+
+	// A receiver is part of a fan-out at most once and the voice thread waits for the whole fan-out to be
+	// encrypted before it moves on. Thus the nonces of every receiver are still used in the order in which
+	// its packets are sent.
+	const std::size_t count = fanout.size() - begin;
+	if (m_cryptPool && count > sliceSize) {
+		m_cryptPool->run(count, sliceSize, encryptSlice);
+	} else {
+		encryptSlice(0, count);
 	}
 }
 
-void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-						Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder) {
+void Server::addListener(std::vector< WhisperTargetCache::Listener > &listeners, ServerUser &user,
+						 const Channel &channel) {
+	// Duplicates are resolved once all listeners have been collected
+	listeners.push_back({ &user, m_channelListenerManager.getListenerVolumeAdjustment(user.uiSession, channel.iId) });
+}
+
+void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, VoiceThreadContext &context) {
 	ZoneScoped;
 
+	AudioReceiverBuffer &buffer = context.receivers;
+
 	// Note that in this function we never have to acquire a read-lock on qrwlVoiceThread
 	// as all places that call this function will hold that lock at the point of calling
 	// this function.
@@ -1163,7 +1286,7 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 		// IP + UDP + Crypt + Data
 		const std::size_t packetsize = 20 + 8 + 4 + audioData.payload.size();
 
-		if (!bw->addFrame(static_cast< int >(packetsize), iMaxBandwidth / 8)) {
+		if (!bw->addFrame(static_cast< int >(packetsize), iMaxBandwidth / 8, context.receiveTime)) {
 			// Suppress packet.
 			return;
 		}
@@ -1171,69 +1294,57 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 
 	buffer.clear();
 
+	// Pick up the latest routing snapshot, if the main thread has published a new one since the last packet
+	const unsigned int routingVersion = m_routingVersion.load(std::memory_order_acquire);
+	if (context.routingVersion != routingVersion) {
+		context.routing        = std::atomic_load(&m_routingSnapshot);
+		context.routingVersion = routingVersion;
+	}
+
 	if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::SERVER_LOOPBACK) {
 		buffer.forceAddReceiver(*u, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
 	} else if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) {
-		Channel *c = u->cChannel;
-
-		// Send audio to all users that are listening to the channel
-		foreach (unsigned int currentSession, m_channelListenerManager.getListenersForChannel(c->iId)) {
-			ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-			if (pDst) {
-				buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								   m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, c->iId));
-			}
-		}
-
-		// Send audio to all users in the same channel
-		for (User *p : c->qlUsers) {
-			ServerUser *pDst = static_cast< ServerUser * >(p);
+		// The main thread has already figured out who is in (or listening to) the speaker's channel and which of the
+		// linked channels the speaker may speak in (see buildRoutingSnapshot)
+		const RoutingSnapshot::Speaker *speaker = context.routing->findSpeaker(u->uiSession);
 
-			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
-		}
-
-		// Send audio to all linked channels the user has speak-permission
-		if (!c->qhLinks.isEmpty()) {
-			QSet< Channel * > chans = c->allLinks();
-			chans.remove(c);
+		if (speaker) {
+			const std::vector< RoutingSnapshot::Receiver > &receivers = context.routing->getReceivers(speaker->channel);
 
-			QMutexLocker qml(&qmCache);
+			// In large channels, only a limited number of users may speak at the same time (see ActiveSpeakerLimiter)
+			if (iMaxActiveSpeakers > 0 && receivers.size() >= iActiveSpeakersChannelSize && !u->bPrioritySpeaker
+				&& !m_activeSpeakers.admit(speaker->channelID, u->uiSession, iMaxActiveSpeakers, audioData.isLastFrame,
+										   context.receiveTime)) {
+				return;
+			}
 
-			for (Channel *l : chans) {
-				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache)) {
-					// Send the audio stream to all users that are listening to the linked channel
-					for (unsigned int currentSession : m_channelListenerManager.getListenersForChannel(l->iId)) {
-						ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-						if (pDst) {
-							buffer.addReceiver(
-								*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, l->iId));
-						}
-					}
+#ifdef USE_SERVER_MIXING
+			// The speakers of mixed channels are heard through the channel's mix only
+			if (speaker->mixed) {
+				mixAudio(*u, *speaker, audioData, context);
+				return;
+			}
+#endif
 
-					// Send audio to users in the linked channel
-					for (User *p : l->qlUsers) {
-						ServerUser *pDst = static_cast< ServerUser * >(p);
+			for (const RoutingSnapshot::Receiver &receiver : receivers) {
+				buffer.addReceiver(*u, *receiver.user, receiver.context, audioData.containsPositionalData,
+								   receiver.volumeAdjustment);
+			}
 
-						buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL,
-										   audioData.containsPositionalData);
-					}
+			for (std::size_t linkedChannel : speaker->linkedChannels) {
+				for (const RoutingSnapshot::Receiver &receiver : context.routing->getReceivers(linkedChannel)) {
+					buffer.addReceiver(*u, *receiver.user, receiver.context, audioData.containsPositionalData,
+									   receiver.volumeAdjustment);
 				}
 			}
 		}
 	} else if (u->qmTargets.contains(static_cast< int >(audioData.targetOrContext))) { // Whisper/Shout
-		QSet< ServerUser * > channel;
-		QSet< ServerUser * > direct;
-		QHash< ServerUser *, VolumeAdjustment > cachedListeners;
+		const int target = static_cast< int >(audioData.targetOrContext);
 
-		if (u->qmTargetCache.contains(static_cast< int >(audioData.targetOrContext))) {
-			ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_STORE);
+		// The cache entries are only modified while holding the write lock, so they can be used in place
+		auto cacheIt = u->qmTargetCache.constFind(target);
 
-			const WhisperTargetCache &cache = u->qmTargetCache.value(static_cast< int >(audioData.targetOrContext));
-			channel                         = cache.channelTargets;
-			direct                          = cache.directTargets;
-			cachedListeners                 = cache.listeningTargets;
-		} else {
+		if (cacheIt == u->qmTargetCache.constEnd()) {
 			ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_CREATE);
 
 			const unsigned int uiSession = u->uiSession;
@@ -1249,42 +1360,59 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 			// transaction (ensured by the lock) to avoid running into situations in which a user from the cache
 			// gets deleted without this particular cache entry being purged (which happens, if the cache entry is
 			// in the store at the point of deleting the user).
-			const WhisperTarget &wt  = u->qmTargets.value(static_cast< int >(audioData.targetOrContext));
+			const WhisperTarget &wt  = u->qmTargets.value(target);
 			WhisperTargetCache cache = createWhisperTargetCacheFor(*u, wt);
 
-			u->qmTargetCache.insert(static_cast< int >(audioData.targetOrContext), std::move(cache));
+			u->qmTargetCache.insert(target, std::move(cache));
 
 
 			qrwlVoiceThread.unlock();
 			qrwlVoiceThread.lockForRead();
 			if (!qhUsers.contains(uiSession))
 				return;
+
+			cacheIt = u->qmTargetCache.constFind(target);
+			if (cacheIt == u->qmTargetCache.constEnd()) {
+				// The entry has been invalidated again while the lock was released. Its replacement is created along
+				// with the next packet.
+				return;
+			}
 		}
 
+		ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_STORE);
+
+		const WhisperTargetCache &cache = cacheIt.value();
+
 		// These users receive the audio because someone is shouting to their channel
-		for (ServerUser *pDst : channel) {
+		for (ServerUser *pDst : cache.channelTargets) {
 			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::SHOUT, audioData.containsPositionalData);
 		}
 		// These users receive audio because someone is whispering to them
-		for (ServerUser *pDst : direct) {
+		for (ServerUser *pDst : cache.directTargets) {
 			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::WHISPER, audioData.containsPositionalData);
 		}
 		// These users receive audio because someone is sending audio to one of their listeners
-		QHashIterator< ServerUser *, VolumeAdjustment > it(cachedListeners);
-		while (it.hasNext()) {
-			it.next();
-			ServerUser *user                         = it.key();
-			const VolumeAdjustment &volumeAdjustment = it.value();
-
-			buffer.addReceiver(*u, *user, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-							   volumeAdjustment);
+		for (const WhisperTargetCache::Listener &listener : cache.listeningTargets) {
+			buffer.addReceiver(*u, *listener.user, Mumble::Protocol::AudioContext::LISTEN,
+							   audioData.containsPositionalData, listener.volumeAdjustment);
 		}
 	}
 
-	ZoneNamedN(__tracy_scoped_zone2, TracyConstants::AUDIO_SENDOUT_ZONE, true);
+	sendAudio(audioData, context);
+}
+
+void Server::sendAudio(Mumble::Protocol::AudioData &audioData, VoiceThreadContext &context) {
+	ZoneScopedN(TracyConstants::AUDIO_SENDOUT_ZONE);
+
+	AudioReceiverBuffer &buffer = context.receivers;
+	auto &encoder               = context.audioEncoder;
+	UDPSendBatch &batch         = context.sendBatch;
+	CryptFanout &fanout         = context.fanout;
 
 	buffer.preprocessBuffer();
 
+	fanout.clear();
+
 	bool isFirstIteration = true;
 	QByteArray tcpCache;
 	for (bool includePositionalData : { true, false }) {
@@ -1331,24 +1459,127 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 			// Clear TCP cache
 			tcpCache.clear();
 
-			// Send encoded packet to all receivers of this range
+			// Send encoded packet to all receivers of this range. The ones reachable via UDP are collected, such
+			// that the packet can be encrypted for all of them at once.
+			const std::size_t fanoutBegin = fanout.size();
 			for (auto it = currentRange.begin; it != currentRange.end; ++it) {
-				sendMessage(it->getReceiver(), encodedPacket.data(), static_cast< int >(encodedPacket.size()),
-							tcpCache);
+				if (canSendViaUDP(it->getReceiver(), false)) {
+					fanout.add(it->getReceiver());
+				} else {
+					sendMessage(it->getReceiver(), encodedPacket.data(), static_cast< int >(encodedPacket.size()),
+								tcpCache, context);
+				}
 			}
 
+			encryptFanout(fanout, fanoutBegin, encodedPacket.data(), static_cast< int >(encodedPacket.size()));
+
 			// Find next range
 			currentRange = AudioReceiverBuffer::getReceiverRange(currentRange.end, receiverList.end());
 		}
 	}
-}
 
-void Server::log(ServerUser *u, const QString &str) const {
-	QString msg = QString("<%1:%2(%3)> %4").arg(QString::number(u->uiSession), u->qsName, QString::number(u->iId), str);
-	log(msg);
-}
+	// Every receiver is sent to on the socket it has last sent on, which with multiple voice threads is any of the
+	// SO_REUSEPORT sockets. As sendmmsg() sends on a single socket only, the datagrams are grouped by socket, such
+	// that the batch doesn't have to be flushed for every change of the socket.
+	std::vector< std::size_t > &order = context.fanoutOrder;
+	order.resize(fanout.size());
+	for (std::size_t i = 0; i < order.size(); ++i) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&fanout](std::size_t lhs, std::size_t rhs) {
+		return fanout[lhs].receiver->sUdpSocket < fanout[rhs].receiver->sUdpSocket;
+	});
 
-void Server::log(const QString &msg) const {
+	// The encrypted datagrams are sent straight from the fan-out's buffers
+	for (std::size_t i : order) {
+		const CryptFanout::Entry &entry = fanout[i];
+
+		if (entry.encrypted) {
+			batch.commit(entry.receiver->sUdpSocket, entry.receiver->saiUdpAddress,
+						 entry.receiver->saiTcpLocalAddress, fanout.buffer(i), entry.length);
+		}
+	}
+
+	// Hand all datagrams that are still queued to the kernel at once
+	batch.flush();
+}
+
+#ifdef USE_SERVER_MIXING
+void Server::mixAudio(const ServerUser &u, const RoutingSnapshot::Speaker &speaker,
+					  const Mumble::Protocol::AudioData &audioData, VoiceThreadContext &context) {
+	// The legacy codecs can't be decoded on the server
+	if (audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
+		return;
+	}
+
+	std::shared_ptr< AudioMixer > mixer;
+	{
+		QMutexLocker lock(&m_mixerMutex);
+
+		std::shared_ptr< AudioMixer > &entry = m_mixers[speaker.channelID];
+		if (!entry) {
+			entry = std::make_shared< AudioMixer >(iMixingBitrate);
+		}
+
+		mixer = entry;
+	}
+
+	std::vector< AudioMixer::Frame > &frames = context.mixedFrames;
+	frames.clear();
+
+	mixer->addFrame(u.uiSession, audioData.payload.data(), audioData.payload.size(), audioData.isLastFrame,
+					context.receiveTime, frames);
+
+	for (const AudioMixer::Frame &frame : frames) {
+		// The speaker the frame is attributed to might have left in the meantime
+		ServerUser *sender = qhUsers.value(frame.sender);
+		if (!sender) {
+			continue;
+		}
+
+		context.receivers.clear();
+
+		if (frame.forListeners) {
+			for (const RoutingSnapshot::Receiver &receiver : context.routing->getReceivers(speaker.channel)) {
+				// Whoever has been speaking when the frame has been mixed would hear their own voice in it
+				if (!std::binary_search(frame.speakers.begin(), frame.speakers.end(), receiver.user->uiSession)) {
+					context.receivers.addReceiver(*sender, *receiver.user, receiver.context, false,
+												  receiver.volumeAdjustment);
+				}
+			}
+		} else {
+			ServerUser *receiver = qhUsers.value(frame.receiver);
+			if (!receiver) {
+				continue;
+			}
+
+			context.receivers.addReceiver(*sender, *receiver, Mumble::Protocol::AudioContext::NORMAL, false);
+		}
+
+		Mumble::Protocol::AudioData mixed;
+		mixed.senderSession = frame.sender;
+		mixed.frameNumber   = frame.frameNumber;
+		mixed.payload       = gsl::span< const Mumble::Protocol::byte >(frame.opusData.data(), frame.opusData.size());
+		mixed.isLastFrame   = frame.isLastFrame;
+
+		sendAudio(mixed, context);
+	}
+}
+
+void Server::clearMixers() {
+	QMutexLocker lock(&m_mixerMutex);
+
+	// Voice threads that are using one of the mixers right now keep it alive until they are done
+	m_mixers.clear();
+}
+#endif
+
+void Server::log(ServerUser *u, const QString &str) const {
+	QString msg = QString("<%1:%2(%3)> %4").arg(QString::number(u->uiSession), u->qsName, QString::number(u->iId), str);
+	log(msg);
+}
+
+void Server::log(const QString &msg) const {
 	dblog(msg);
 	qWarning("%d => %s", iServerNum, msg.toUtf8().constData());
 }
@@ -1374,25 +1605,13 @@ void Server::newClient() {
 
 		HostAddress ha(adr);
 
-		QList< Ban > tmpBans = qlBans;
-		foreach (const Ban &ban, qlBans) {
-			if (ban.isExpired())
-				tmpBans.removeOne(ban);
-		}
-		if (qlBans.count() != tmpBans.count()) {
-			qlBans = tmpBans;
-			saveBans();
-		}
-
-		foreach (const Ban &ban, qlBans) {
-			if (ban.haAddress.match(ha, static_cast< unsigned int >(ban.iMask))) {
-				log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
-						.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban.qsReason, ban.qsUsername,
-							 ban.qsHash));
-				sock->disconnectFromHost();
-				sock->deleteLater();
-				return;
-			}
+		if (const Ban *ban = m_banIndex.match(ha)) {
+			log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
+					.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban->qsReason, ban->qsUsername,
+						 ban->qsHash));
+			sock->disconnectFromHost();
+			sock->deleteLater();
+			return;
 		}
 
 #ifdef Q_OS_MAC
@@ -1469,8 +1688,11 @@ void Server::newClient() {
 		connect(u, &ServerUser::connectionClosed, this, &Server::connectionClosed);
 		connect(u, SIGNAL(message(Mumble::Protocol::TCPMessageType, const QByteArray &)), this,
 				SLOT(message(Mumble::Protocol::TCPMessageType, const QByteArray &)));
+		connect(u, &ServerUser::parsedMessage, this, &Server::parsedMessage);
 		connect(u, &ServerUser::handleSslErrors, this, &Server::sslError);
 		connect(u, &ServerUser::encrypted, this, &Server::encrypted);
+		u->setSslErrorFilter(&Server::acceptsSslErrors);
+		u->setMessageParser(&Server::parseMessage);
 
 		log(u, QString("New connection: %1").arg(addressToString(sock->peerAddress(), sock->peerPort())));
 
@@ -1485,7 +1707,11 @@ void Server::newClient() {
 #else
 		sock->setProtocol(QSsl::TlsV1_0);
 #endif
-		sock->startServerEncryption();
+
+		if (m_connectionPool) {
+			u->moveSocketToThread(m_connectionPool->nextThread());
+		}
+		u->startServerEncryption();
 
 		meta->successfulConnectionFrom(adr);
 	}
@@ -1539,6 +1765,40 @@ void Server::encrypted() {
 	}
 }
 
+/// How an SSL error during the handshake with a client is dealt with
+enum class SslErrorSeverity {
+	/// The error is ignored
+	Allowed,
+	/// The handshake proceeds, but the client's certificate doesn't count as verified
+	Unverified,
+	/// The connection is dropped
+	Fatal
+};
+
+static SslErrorSeverity severityOf(const QSslError &error) {
+	switch (error.error()) {
+		case QSslError::InvalidPurpose:
+			// Allow email certificates.
+			return SslErrorSeverity::Allowed;
+		case QSslError::NoPeerCertificate:
+		case QSslError::SelfSignedCertificate:
+		case QSslError::SelfSignedCertificateInChain:
+		case QSslError::UnableToGetLocalIssuerCertificate:
+		case QSslError::UnableToVerifyFirstCertificate:
+		case QSslError::HostNameMismatch:
+		case QSslError::CertificateNotYetValid:
+		case QSslError::CertificateExpired:
+			return SslErrorSeverity::Unverified;
+		default:
+			return SslErrorSeverity::Fatal;
+	}
+}
+
+bool Server::acceptsSslErrors(const QList< QSslError > &errors) {
+	return std::none_of(errors.begin(), errors.end(),
+						[](const QSslError &e) { return severityOf(e) == SslErrorSeverity::Fatal; });
+}
+
 void Server::sslError(const QList< QSslError > &errors) {
 	ServerUser *u = qobject_cast< ServerUser * >(sender());
 	if (!u)
@@ -1546,29 +1806,20 @@ void Server::sslError(const QList< QSslError > &errors) {
 
 	bool ok = true;
 	foreach (QSslError e, errors) {
-		switch (e.error()) {
-			case QSslError::InvalidPurpose:
-				// Allow email certificates.
+		switch (severityOf(e)) {
+			case SslErrorSeverity::Allowed:
 				break;
-			case QSslError::NoPeerCertificate:
-			case QSslError::SelfSignedCertificate:
-			case QSslError::SelfSignedCertificateInChain:
-			case QSslError::UnableToGetLocalIssuerCertificate:
-			case QSslError::UnableToVerifyFirstCertificate:
-			case QSslError::HostNameMismatch:
-			case QSslError::CertificateNotYetValid:
-			case QSslError::CertificateExpired:
+			case SslErrorSeverity::Unverified:
 				u->bVerified = false;
 				break;
-			default:
+			case SslErrorSeverity::Fatal:
 				log(u, QString("SSL Error: %1").arg(e.errorString()));
 				ok = false;
 		}
 	}
 
-	if (ok) {
-		u->proceedAnyway();
-	} else {
+	// Acceptable errors have already been ignored by the socket (see acceptsSslErrors)
+	if (!ok) {
 		// Due to a regression in Qt 5 (QTBUG-53906),
 		// we can't 'force' disconnect (which calls
 		// QAbstractSocket->abort()) when built against Qt 5.
@@ -1633,11 +1884,17 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 
 	setLastDisconnect(u);
 
+	// The channels whose receivers include the user
+	std::vector< unsigned int > routedChannelIDs;
+
 	if (u->sState == ServerUser::Authenticated) {
+		removeBroadcastReceiver(u);
+
 		if (m_channelListenerManager.isListeningToAny(u->uiSession)) {
 			for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
 				// Remove the client from the list on the server
 				m_channelListenerManager.removeListener(u->uiSession, channelID);
+				routedChannelIDs.push_back(channelID);
 			}
 		}
 
@@ -1653,18 +1910,22 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 	}
 
 	Channel *old = u->cChannel;
+	if (old) {
+		routedChannelIDs.push_back(old->iId);
+	}
+
+	// The voice threads must not get to see the user anymore once it is deleted
+	std::shared_ptr< const RoutingSnapshot > routing = patchRoutingSnapshot(routedChannelIDs, { u->uiSession }, u);
 
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
+
+		publishRoutingSnapshot(std::move(routing));
 
 		qhUsers.remove(u->uiSession);
+		m_speakableLinks.remove(u->uiSession);
 		qhHostUsers[u->haAddress].remove(u);
-
-		quint16 port = (u->saiUdpAddress.ss_family == AF_INET6)
-						   ? (reinterpret_cast< sockaddr_in6 * >(&u->saiUdpAddress)->sin6_port)
-						   : (reinterpret_cast< sockaddr_in * >(&u->saiUdpAddress)->sin_port);
-		const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(u->haAddress, port);
-		qhPeerUsers.remove(key);
+		m_udpPeers.remove(u->saiUdpAddress, u);
 
 		if (old)
 			old->removeUser(u);
@@ -1706,7 +1967,7 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 			return;
 		}
 
-		QReadLocker rl(&qrwlVoiceThread);
+		VoiceReadLocker rl(&qrwlVoiceThread);
 
 		u->aiUdpFlag = 0;
 
@@ -1728,7 +1989,8 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 					// Add session id
 					audioData.senderSession = u->uiSession;
 
-					processMsg(u, std::move(audioData), m_tcpAudioReceivers, m_tcpAudioEncoder);
+					m_tcpContext.receiveTime = Timer::now();
+					processMsg(u, std::move(audioData), m_tcpContext);
 				}
 			}
 		}
@@ -1736,37 +1998,108 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 		return;
 	}
 
-#ifdef QT_NO_DEBUG
-#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                      \
-		case Mumble::Protocol::TCPMessageType::name: {                   \
-			MumbleProto::name msg;                                       \
-			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-				msg.DiscardUnknownFields();                              \
-				msg##name(u, msg);                                       \
-			}                                                            \
-			break;                                                       \
-		}
-#else
-#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                      \
-		case Mumble::Protocol::TCPMessageType::name: {                   \
-			MumbleProto::name msg;                                       \
-			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-				if (type != Mumble::Protocol::TCPMessageType::Ping) {    \
-					printf("== %s:\n", #name);                           \
-					msg.PrintDebugString();                              \
-				}                                                        \
-				msg.DiscardUnknownFields();                              \
-				msg##name(u, msg);                                       \
-			}                                                            \
-			break;                                                       \
-		}
+	std::shared_ptr< ::google::protobuf::Message > msg;
+	if (parseMessage(type, qbaMsg, msg) && msg) {
+		handleMessage(type, *msg, u);
+	}
+}
+
+void Server::parsedMessage(Mumble::Protocol::TCPMessageType type, std::shared_ptr< ::google::protobuf::Message > msg) {
+	ZoneScopedN(TracyConstants::TCP_PACKET_PROCESSING_ZONE);
+
+	ServerUser *u = static_cast< ServerUser * >(sender());
+
+	if (u->sState == ServerUser::Authenticated) {
+		u->resetActivityTime();
+	}
+
+	handleMessage(type, *msg, u);
+}
+
+bool Server::parseMessage(Mumble::Protocol::TCPMessageType type, const QByteArray &data,
+						  std::shared_ptr< ::google::protobuf::Message > &msg) {
+	if (type == Mumble::Protocol::TCPMessageType::UDPTunnel) {
+		// Decoded by the voice path on the main thread
+		return true;
+	}
+
+#define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                                                \
+	case Mumble::Protocol::TCPMessageType::name: {                                             \
+		std::shared_ptr< MumbleProto::name > parsed = std::make_shared< MumbleProto::name >(); \
+		if (!parsed->ParseFromArray(data.constData(), data.size())) {                          \
+			return false;                                                                      \
+		}                                                                                      \
+		parsed->DiscardUnknownFields();                                                        \
+		msg = std::move(parsed);                                                               \
+		return true;                                                                           \
+	}
+
+	switch (type) { MUMBLE_ALL_TCP_MESSAGES }
+
+#undef PROCESS_MUMBLE_TCP_MESSAGE
+
+	// Messages of unknown types are ignored
+	return false;
+}
+
+void Server::handleMessage(Mumble::Protocol::TCPMessageType type, ::google::protobuf::Message &msg, ServerUser *u) {
+#ifndef QT_NO_DEBUG
+	if (type != Mumble::Protocol::TCPMessageType::Ping) {
+		printf("== %s:\n", msg.GetDescriptor()->name().c_str());
+		msg.PrintDebugString();
+	}
 #endif
 
+#define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                \
+	case Mumble::Protocol::TCPMessageType::name:               \
+		msg##name(u, static_cast< MumbleProto::name & >(msg)); \
+		break;
+
 	switch (type) { MUMBLE_ALL_TCP_MESSAGES }
 
 #undef PROCESS_MUMBLE_TCP_MESSAGE
 }
 
+void Server::updateBanIndex() {
+	m_banIndex.rebuild(qlBans);
+
+	scheduleBanExpiry();
+}
+
+void Server::scheduleBanExpiry() {
+	const QDateTime nextExpiry = m_banIndex.nextExpiry();
+	if (!nextExpiry.isValid()) {
+		m_banExpiryTimer->stop();
+		return;
+	}
+
+	// Ban::isExpired() works with whole seconds, so wait for an extra one. Expiries that are too far away for a
+	// QTimer are scheduled again once the maximum interval has passed.
+	const qint64 maxInterval = 24 * 60 * 60 * 1000;
+	const qint64 interval    = QDateTime::currentDateTimeUtc().msecsTo(nextExpiry) + 1000;
+
+	m_banExpiryTimer->start(static_cast< int >(qBound< qint64 >(0, interval, maxInterval)));
+}
+
+void Server::expireBans() {
+	const QList< Ban > expired = m_banIndex.takeExpired();
+
+	if (!expired.isEmpty()) {
+		QSet< Ban > expiredSet;
+		for (const Ban &ban : expired) {
+			expiredSet.insert(ban);
+		}
+
+		qlBans.erase(std::remove_if(qlBans.begin(), qlBans.end(),
+									[&expiredSet](const Ban &ban) { return expiredSet.contains(ban); }),
+					 qlBans.end());
+
+		deleteBans(expired);
+	}
+
+	scheduleBanExpiry();
+}
+
 void Server::checkTimeout() {
 	QList< ServerUser * > qlClose;
 
@@ -1782,21 +2115,31 @@ void Server::checkTimeout() {
 		u->disconnectSocket(true);
 }
 
-void Server::tcpTransmitData(QByteArray a, unsigned int id) {
-	Connection *c = qhUsers.value(id);
-	if (c) {
-		QByteArray qba;
-		int len = a.size();
+void Server::tcpTransmitData() {
+	// Reset the flag before draining, such that packets queued from now on will trigger another call
+	m_tcpTransmitPending = false;
+
+	TunnelledVoice voice;
+	QSet< ServerUser * > receivers;
+	auto drain = [this, &voice, &receivers](VoiceThreadContext &context) {
+		while (context.tunnelQueue.pop(voice)) {
+			ServerUser *user = qhUsers.value(voice.session);
+			if (user) {
+				queueMessage(user, voice.message, true);
+				receivers.insert(user);
+			}
+		}
+	};
 
-		qba.resize(len + 6);
-		unsigned char *uc = reinterpret_cast< unsigned char * >(qba.data());
-		*reinterpret_cast< quint16 * >(&uc[0]) =
-			qToBigEndian(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel));
-		*reinterpret_cast< quint32 * >(&uc[2]) = qToBigEndian(static_cast< quint32 >(len));
-		memcpy(uc + 6, a.constData(), static_cast< std::size_t >(len));
+	for (std::unique_ptr< VoiceThreadContext > &context : m_voiceContexts) {
+		drain(*context);
+	}
+	drain(m_tcpContext);
 
-		c->sendMessage(qba);
-		c->forceFlush();
+	// Voice is sent right away, but all packets drained for a user (and whatever else is queued for them) go out
+	// together. The queues of everybody else are left to the pending flushQueuedMessages().
+	for (ServerUser *user : receivers) {
+		user->flushQueue();
 	}
 }
 
@@ -1823,18 +2166,72 @@ void Server::sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protoc
 void Server::sendProtoExcept(ServerUser *u, const ::google::protobuf::Message &msg,
 							 Mumble::Protocol::TCPMessageType msgType, Version::full_t version,
 							 Version::CompareMode mode) {
+	// Every change of the state of a channel or user is broadcast, which is thus where the cached states are dropped
+	m_stateSyncCache.messageBroadcast(msgType, msg);
+
+	assert(mode == Version::CompareMode::AtLeast || mode == Version::CompareMode::LessThan);
+
+	// The message is serialised once and the resulting buffer is shared by the queues of all receivers
 	QByteArray cache;
-	foreach (ServerUser *usr, qhUsers)
-		if ((usr != u) && (usr->sState == ServerUser::Authenticated)) {
-			assert(mode == Version::CompareMode::AtLeast || mode == Version::CompareMode::LessThan);
-
-			const bool isUnknown = version == Version::UNKNOWN;
-			const bool fulfillsVersionRequirement =
-				mode == Version::CompareMode::AtLeast ? usr->m_version >= version : usr->m_version < version;
-			if (isUnknown || fulfillsVersionRequirement) {
-				usr->sendMessage(msg, msgType, cache);
+	for (auto it = m_broadcastReceivers.constBegin(); it != m_broadcastReceivers.constEnd(); ++it) {
+		const bool isUnknown = version == Version::UNKNOWN;
+		const bool fulfillsVersionRequirement =
+			mode == Version::CompareMode::AtLeast ? it.key() >= version : it.key() < version;
+		if (!isUnknown && !fulfillsVersionRequirement) {
+			continue;
+		}
+
+		if (cache.isEmpty()) {
+			Connection::messageToNetwork(msg, msgType, cache);
+		}
+
+		for (ServerUser *usr : it.value()) {
+			if (usr != u) {
+				queueMessage(usr, cache);
 			}
 		}
+	}
+}
+
+void Server::addBroadcastReceiver(ServerUser *user) {
+	m_broadcastReceivers[user->m_version].append(user);
+}
+
+void Server::removeBroadcastReceiver(ServerUser *user) {
+	auto it = m_broadcastReceivers.find(user->m_version);
+	if (it == m_broadcastReceivers.end()) {
+		return;
+	}
+
+	it->removeOne(user);
+	if (it->isEmpty()) {
+		m_broadcastReceivers.erase(it);
+	}
+}
+
+void Server::queueMessage(ServerUser *user, const QByteArray &message, bool droppable) {
+	if (!user->queueMessage(message, droppable)) {
+		// The user's queue is going to be flushed already (or the message has been dropped)
+		return;
+	}
+
+	if (m_queuedSessions.isEmpty()) {
+		QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&Server::flushQueuedMessages, this)));
+	}
+	m_queuedSessions.append(user->uiSession);
+}
+
+void Server::flushQueuedMessages() {
+	QVector< unsigned int > sessions;
+	sessions.swap(m_queuedSessions);
+
+	for (unsigned int session : sessions) {
+		// Users that have disconnected in the meantime took their queue with them
+		ServerUser *user = qhUsers.value(session);
+		if (user) {
+			user->flushQueue();
+		}
+	}
 }
 
 void Server::removeChannel(unsigned int id) {
@@ -1851,15 +2248,25 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 		dest = chan->cParent;
 
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 		chan->unlink(nullptr);
 	}
+	{
+		// The ID of the channel may be reused by a channel created later on
+		QMutexLocker qml(&qmCache);
+		acCache.clearChannels({ chan->iId });
+	}
+	// The users of the formerly linked channels can't speak into the channel anymore
+	std::vector< unsigned int > linkedSessions = getLinkGroupSessions(chan->iId);
+	m_linkClosure.removeChannel(chan->iId);
+	m_speakableLinks.clear();
+	clearWhisperTargetCache({ chan->iId }, {});
 
 	foreach (c, chan->qlChannels) { removeChannel(c, dest); }
 
 	foreach (p, chan->qlUsers) {
 		{
-			QWriteLocker wl(&qrwlVoiceThread);
+			VoiceWriteLocker wl(&qrwlVoiceThread);
 			chan->removeUser(p);
 		}
 
@@ -1898,10 +2305,12 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 	sendAll(mpcr);
 
 	removeChannelDB(chan);
+	// Clears the receivers of the channel, such that the snapshot doesn't keep referring to them
+	updateRouting({ chan->iId }, linkedSessions);
 	emit channelRemoved(chan);
 
 	if (chan->cParent) {
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 		chan->cParent->removeChannel(chan);
 	}
 
@@ -1961,7 +2370,7 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 	Channel *old = p->cChannel;
 
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 		c->addUser(p);
 
 		bool mayspeak = ChanACL::hasPermission(static_cast< ServerUser * >(p), c, ChanACL::Speak, nullptr);
@@ -1980,6 +2389,12 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 		}
 	}
 
+	// The speaker itself is updated along with its permissions
+	if (old) {
+		updateRouting({ old->iId, c->iId }, {});
+	} else {
+		updateRouting({ c->iId }, {});
+	}
 	clearACLCache(p);
 	setLastChannel(p);
 
@@ -1994,11 +2409,16 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 }
 
 bool Server::hasPermission(ServerUser *p, Channel *c, QFlags< ChanACL::Perm > perm) {
-	QMutexLocker qml(&qmCache);
-	return ChanACL::hasPermission(p, c, perm, &acCache);
+	return (effectivePermissions(p, c) & perm) != ChanACL::None;
 }
 
 QFlags< ChanACL::Perm > Server::effectivePermissions(ServerUser *p, Channel *c) {
+	// Cached permissions can be looked up without locking
+	const ChanACL::Permissions cached = acCache.get(*p, c->iId);
+	if (cached & ChanACL::Cached) {
+		return cached;
+	}
+
 	QMutexLocker qml(&qmCache);
 	return ChanACL::effectivePermissions(p, c, &acCache);
 }
@@ -2014,7 +2434,7 @@ void Server::sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequ
 		// Abuse that hasPermission will update acCache with the latest permissions (all of them,
 		// not only the requested one) so that we can pull this information out of it afterwards.
 		ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-		perm = acCache.value(u)->value(c);
+		perm = acCache.get(*u, c->iId);
 	}
 
 	if (explicitlyRequested) {
@@ -2052,7 +2472,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 			match = false;
 		} else {
 			ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-			unsigned int perm = acCache.value(u)->value(c);
+			unsigned int perm = acCache.get(*u, c->iId);
 			if (perm != i.value())
 				match = false;
 		}
@@ -2070,7 +2490,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 	}
 
 	ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-	unsigned int perm = acCache.value(u)->value(c);
+	unsigned int perm = acCache.get(*u, c->iId);
 	u->qmPermissionSent.insert(static_cast< int >(c->iId), perm);
 
 	mppq.Clear();
@@ -2088,14 +2508,13 @@ void Server::clearACLCache(User *p) {
 		QMutexLocker qml(&qmCache);
 
 		if (p) {
-			ChanACL::ChanCache *h = acCache.take(p);
-			delete h;
+			acCache.clearUser(*static_cast< ServerUser * >(p));
+			m_speakableLinks.remove(p->uiSession);
 
 			flushClientPermissionCache(static_cast< ServerUser * >(p), mppq);
 		} else {
-			foreach (ChanACL::ChanCache *h, acCache)
-				delete h;
 			acCache.clear();
+			m_speakableLinks.clear();
 
 			foreach (ServerUser *u, qhUsers)
 				if (u->sState == ServerUser::Authenticated)
@@ -2103,42 +2522,340 @@ void Server::clearACLCache(User *p) {
 		}
 
 		// A change in ACLs could also change a user's suppression state
-		MumbleProto::UserState mpus;
-		auto processingFunction = [&](ServerUser *user) {
-			bool maySpeak = ChanACL::hasPermission(user, user->cChannel, ChanACL::Speak, &acCache);
-
-			if (maySpeak == user->bSuppress) {
-				// Mirror a user's ability to speak in the current channel (by means of the ACLs) in the suppress
-				// property (not being allowed to speak -> suppressed and vice versa)
-				user->bSuppress = !maySpeak;
-
-				mpus.Clear();
-				mpus.set_session(user->uiSession);
-				mpus.set_suppress(true);
-				sendAll(mpus);
-			}
-		};
-
 		if (p) {
-			processingFunction(static_cast< ServerUser * >(p));
+			updateSuppression(static_cast< ServerUser * >(p));
 		} else {
 			for (ServerUser *currentUser : qhUsers) {
-				processingFunction(currentUser);
+				updateSuppression(currentUser);
 			}
 		}
 	}
 
 	// A change in ACLs means that the user might be able to whisper
 	// to users it didn't have permission to do before (or vice versa)
-	clearWhisperTargetCache();
+	if (p) {
+		// The user's memberships only matter in the channel the user is in (which might have just changed) and the
+		// channels the user is listening to. Targets the user is part of already depend on the session.
+		std::vector< unsigned int > channelIDs;
+		for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(p->uiSession)) {
+			channelIDs.push_back(channelID);
+		}
+		if (p->cChannel) {
+			channelIDs.push_back(p->cChannel->iId);
+		}
+
+		clearWhisperTargetCache(std::move(channelIDs), { p->uiSession });
+	} else {
+		clearWhisperTargetCache();
+	}
+
+	// The same goes for speaking into linked channels. This is also called whenever a user enters a channel.
+	if (p) {
+		updateRouting({}, { p->uiSession });
+	} else {
+		updateRouting();
+	}
+}
+
+void Server::clearChannelACLCache(Channel *channel) {
+	MumbleProto::PermissionQuery mppq;
+
+	// ACLs and groups only ever apply to the channel they are defined in and its subchannels
+	QSet< Channel * > channels = channel->allChildren();
+	channels.insert(channel);
+
+	std::vector< unsigned int > channelIDs;
+	channelIDs.reserve(static_cast< std::size_t >(channels.size()));
+	for (const Channel *c : channels) {
+		channelIDs.push_back(c->iId);
+	}
+
+	{
+		QMutexLocker qml(&qmCache);
+
+		acCache.clearChannels(channelIDs);
+		m_speakableLinks.clear();
+
+		for (ServerUser *u : qhUsers) {
+			bool affected = channels.contains(u->cChannel);
+			for (auto it = u->qmPermissionSent.constBegin(); !affected && it != u->qmPermissionSent.constEnd();
+				 ++it) {
+				affected = channels.contains(qhChannels.value(static_cast< unsigned int >(it.key())));
+			}
+
+			if (!affected) {
+				continue;
+			}
+
+			if (u->sState == ServerUser::Authenticated) {
+				flushClientPermissionCache(u, mppq);
+			}
+			updateSuppression(u);
+		}
+	}
+
+	// Whether entering the channel is restricted is part of its state, but changes to it are sent to each user
+	// separately
+	m_stateSyncCache.invalidateChannel(channel->iId);
+
+	// If the channel has just been moved, the targets including the children of any of its new parents have to be
+	// recomputed as well
+	if (channel->cParent) {
+		channelIDs.push_back(channel->cParent->iId);
+	}
+	clearWhisperTargetCache(std::move(channelIDs), {});
+	// Permissions might have been revoked, which has to take effect right away
+	updateRouting();
+}
+
+void Server::updateSuppression(ServerUser *user) {
+	if (!user->cChannel) {
+		// The user is still authenticating
+		return;
+	}
+
+	bool maySpeak = ChanACL::hasPermission(user, user->cChannel, ChanACL::Speak, &acCache);
+
+	if (maySpeak == user->bSuppress) {
+		// Mirror a user's ability to speak in the current channel (by means of the ACLs) in the suppress
+		// property (not being allowed to speak -> suppressed and vice versa)
+		user->bSuppress = !maySpeak;
+
+		MumbleProto::UserState mpus;
+		mpus.set_session(user->uiSession);
+		mpus.set_suppress(true);
+		sendAll(mpus);
+	}
+}
+
+bool Server::startPasswordHash(ServerUser *user, const MumbleProto::Authenticate &msg) {
+	if (!m_passwordHasher) {
+		return false;
+	}
+
+	QPointer< ServerUser > pointer            = user;
+	const ServerUser::PasswordHash &requested = user->m_passwordHash;
+
+	user->m_passwordHashPending =
+		m_passwordHasher->start(this, user->haAddress, requested.salt, requested.password, requested.iterations,
+								[this, pointer, msg](const QString &hash) {
+									QCoreApplication::instance()->postEvent(
+										this, new ExecEvent(boost::bind(&Server::passwordHashed, this, pointer, msg,
+																		hash)));
+								});
+
+	return user->m_passwordHashPending;
+}
+
+void Server::passwordHashed(QPointer< ServerUser > user, MumbleProto::Authenticate msg, QString hash) {
+	if (!user || !user->m_passwordHashPending) {
+		return;
+	}
+
+	user->m_passwordHashPending = false;
+
+	if (qhUsers.value(user->uiSession) != user) {
+		return;
+	}
+
+	user->m_passwordHash.hash = hash;
+
+	msgAuthenticate(user, msg);
+}
+
+std::shared_ptr< const RoutingSnapshot > Server::buildRoutingSnapshot(const ServerUser *excludedUser) {
+	std::shared_ptr< RoutingSnapshot > snapshot = std::make_shared< RoutingSnapshot >();
+
+	for (const Channel *c : qhChannels) {
+		snapshot->setChannel(c->iId, buildRoutingReceivers(*c, excludedUser));
+	}
+
+	QMutexLocker qml(&qmCache);
+
+	for (ServerUser *u : qhUsers) {
+		if (u != excludedUser) {
+			updateRoutingSpeaker(*snapshot, *u);
+		}
+	}
+
+	return snapshot;
+}
+
+std::shared_ptr< const RoutingSnapshot > Server::patchRoutingSnapshot(const std::vector< unsigned int > &channelIDs,
+																	  const std::vector< unsigned int > &sessions,
+																	  const ServerUser *excludedUser) {
+	// Only the main thread publishes snapshots, so the current one can't change in the meantime
+	std::shared_ptr< RoutingSnapshot > snapshot =
+		std::make_shared< RoutingSnapshot >(*std::atomic_load(&m_routingSnapshot));
+
+	for (unsigned int channelID : channelIDs) {
+		const Channel *c = qhChannels.value(channelID);
+		if (c) {
+			snapshot->setChannel(channelID, buildRoutingReceivers(*c, excludedUser));
+		} else {
+			// The channel has been removed
+			std::size_t index;
+			if (snapshot->findChannel(channelID, index)) {
+				snapshot->setChannel(channelID, {});
+			}
+		}
+	}
+
+	QMutexLocker qml(&qmCache);
+
+	for (unsigned int session : sessions) {
+		ServerUser *u = qhUsers.value(session);
+		if (u && u != excludedUser) {
+			updateRoutingSpeaker(*snapshot, *u);
+		} else {
+			snapshot->removeSpeaker(session);
+		}
+	}
+
+	return snapshot;
+}
+
+std::vector< RoutingSnapshot::Receiver > Server::buildRoutingReceivers(const Channel &c,
+																		const ServerUser *excludedUser) {
+	std::vector< RoutingSnapshot::Receiver > receivers;
+
+	// Everyone listening to the channel
+	for (unsigned int session : m_channelListenerManager.getListenersForChannel(c.iId)) {
+		ServerUser *listener = qhUsers.value(session);
+		if (listener && listener != excludedUser) {
+			receivers.push_back({ listener, Mumble::Protocol::AudioContext::LISTEN,
+								  m_channelListenerManager.getListenerVolumeAdjustment(session, c.iId) });
+		}
+	}
+
+	// Everyone in the channel
+	for (User *p : c.qlUsers) {
+		if (p != excludedUser) {
+			receivers.push_back({ static_cast< ServerUser * >(p), Mumble::Protocol::AudioContext::NORMAL,
+								  VolumeAdjustment::fromFactor(1.0f) });
+		}
+	}
+
+	return receivers;
+}
+
+void Server::updateRoutingSpeaker(RoutingSnapshot &snapshot, ServerUser &user) {
+	Channel *c = user.cChannel;
+	if (user.sState != ServerUser::Authenticated || !c) {
+		snapshot.removeSpeaker(user.uiSession);
+		return;
+	}
+
+	// Channels that have been created after the snapshot are added on demand
+	auto channelIndex = [this, &snapshot](const Channel &channel) {
+		std::size_t index;
+		if (!snapshot.findChannel(channel.iId, index)) {
+			index = snapshot.setChannel(channel.iId, buildRoutingReceivers(channel));
+		}
+		return index;
+	};
+
+	RoutingSnapshot::Speaker speaker;
+	speaker.channel   = channelIndex(*c);
+	speaker.channelID = c->iId;
+	speaker.mixed     = m_mixedChannels.contains(c->iId);
+
+	for (unsigned int linkedChannelID : getSpeakableLinks(user)) {
+		const Channel *linkedChannel = qhChannels.value(linkedChannelID);
+		if (linkedChannel) {
+			speaker.linkedChannels.push_back(channelIndex(*linkedChannel));
+		}
+	}
+
+	snapshot.setSpeaker(user.uiSession, std::move(speaker));
+}
+
+QVector< unsigned int > Server::getSpeakableLinks(ServerUser &user) {
+	auto it = m_speakableLinks.constFind(user.uiSession);
+	if (it != m_speakableLinks.constEnd()) {
+		return *it;
+	}
+
+	QVector< unsigned int > speakableLinks;
+
+	for (unsigned int linkedChannelID : m_linkClosure.getLinkGroup(user.cChannel->iId)) {
+		Channel *linkedChannel = qhChannels.value(linkedChannelID);
+
+		if (linkedChannel && linkedChannel != user.cChannel
+			&& ChanACL::hasPermission(&user, linkedChannel, ChanACL::Speak, &acCache)) {
+			speakableLinks.append(linkedChannelID);
+		}
+	}
+
+	m_speakableLinks.insert(user.uiSession, speakableLinks);
+
+	return speakableLinks;
+}
+
+void Server::publishRoutingSnapshot(std::shared_ptr< const RoutingSnapshot > snapshot) {
+	std::atomic_store(&m_routingSnapshot, std::move(snapshot));
+	m_routingVersion.fetch_add(1, std::memory_order_release);
+}
+
+void Server::updateRouting() {
+	publishRoutingSnapshot(buildRoutingSnapshot());
+}
+
+void Server::updateRouting(const std::vector< unsigned int > &channelIDs, const std::vector< unsigned int > &sessions) {
+	publishRoutingSnapshot(patchRoutingSnapshot(channelIDs, sessions));
+}
+
+std::vector< unsigned int > Server::getLinkGroupSessions(unsigned int channelID) const {
+	std::vector< unsigned int > sessions;
+
+	QVector< unsigned int > group = m_linkClosure.getLinkGroup(channelID);
+	if (group.isEmpty()) {
+		// The channel isn't linked to any other one
+		group.append(channelID);
+	}
+
+	for (unsigned int linkedChannelID : group) {
+		const Channel *linkedChannel = qhChannels.value(linkedChannelID);
+		if (!linkedChannel) {
+			continue;
+		}
+
+		for (const User *p : linkedChannel->qlUsers) {
+			sessions.push_back(p->uiSession);
+		}
+	}
+
+	return sessions;
 }
 
 void Server::clearWhisperTargetCache() {
-	QWriteLocker lock(&qrwlVoiceThread);
+	VoiceWriteLocker lock(&qrwlVoiceThread);
 
 	foreach (ServerUser *u, qhUsers) { u->qmTargetCache.clear(); }
 }
 
+void Server::clearWhisperTargetCache(std::vector< unsigned int > channelIDs, std::vector< unsigned int > sessions) {
+	std::sort(channelIDs.begin(), channelIDs.end());
+	std::sort(sessions.begin(), sessions.end());
+
+	VoiceWriteLocker lock(&qrwlVoiceThread);
+
+	for (ServerUser *u : qhUsers) {
+		if (std::binary_search(sessions.begin(), sessions.end(), u->uiSession)) {
+			u->qmTargetCache.clear();
+			continue;
+		}
+
+		for (auto it = u->qmTargetCache.begin(); it != u->qmTargetCache.end();) {
+			if (it->dependsOn(channelIDs, sessions)) {
+				it = u->qmTargetCache.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+}
+
 QString Server::addressToString(const QHostAddress &adr, unsigned short port) {
 	HostAddress ha(adr);
 
@@ -2359,6 +3076,21 @@ bool Server::canNest(Channel *newParent, Channel *channel) const {
 	return (parentLevel + channelDepth) < iChannelNestingLimit;
 }
 
+static bool compareSessions(const ServerUser *lhs, const ServerUser *rhs) {
+	return lhs->uiSession < rhs->uiSession;
+}
+
+static void sortAndRemoveDuplicates(std::vector< unsigned int > &list) {
+	std::sort(list.begin(), list.end());
+	list.erase(std::unique(list.begin(), list.end()), list.end());
+}
+
+static void sortReceivers(std::vector< ServerUser * > &receivers, const ServerUser &speaker) {
+	receivers.erase(std::remove(receivers.begin(), receivers.end(), &speaker), receivers.end());
+	std::sort(receivers.begin(), receivers.end(), compareSessions);
+	receivers.erase(std::unique(receivers.begin(), receivers.end()), receivers.end());
+}
+
 WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, const WhisperTarget &target) {
 	ZoneScoped;
 
@@ -2368,6 +3100,9 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 
 	if (!target.channels.empty()) {
 		for (const WhisperTarget::Channel &currentTarget : target.channels) {
+			// Also a dependency if the channel doesn't exist (yet)
+			cache.channelDependencies.push_back(currentTarget.id);
+
 			Channel *targetChannel = qhChannels.value(currentTarget.id);
 
 			if (targetChannel) {
@@ -2380,7 +3115,7 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 					if (ChanACL::hasPermission(&speaker, targetChannel, ChanACL::Whisper, &acCache)) {
 						for (User *p : targetChannel->qlUsers) {
 							// Add users of the target channel
-							cache.channelTargets.insert(static_cast< ServerUser * >(p));
+							cache.channelTargets.push_back(static_cast< ServerUser * >(p));
 						}
 
 						for (unsigned int currentSession :
@@ -2414,13 +3149,15 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 					const QString &targetGroup = redirect.isEmpty() ? currentTarget.targetGroup : redirect;
 
 					for (Channel *subTargetChan : channels) {
+						cache.channelDependencies.push_back(subTargetChan->iId);
+
 						if (ChanACL::hasPermission(&speaker, subTargetChan, ChanACL::Whisper, &acCache)) {
 							for (User *p : subTargetChan->qlUsers) {
 								ServerUser *su = static_cast< ServerUser * >(p);
 
 								if (!restrictToGroup
 									|| Group::appliesToUser(*subTargetChan, *subTargetChan, targetGroup, *su)) {
-									cache.channelTargets.insert(su);
+									cache.channelTargets.push_back(su);
 								}
 							}
 
@@ -2443,17 +3180,59 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 		}
 	}
 
+	// Make sure the speaker themselves is not contained in these lists
+	sortReceivers(cache.channelTargets, speaker);
+
 	for (unsigned int id : target.sessions) {
+		// Also a dependency if there is no such user (yet)
+		cache.sessionDependencies.push_back(id);
+
 		ServerUser *pDst = qhUsers.value(id);
-		if (pDst && ChanACL::hasPermission(&speaker, pDst->cChannel, ChanACL::Whisper, &acCache)
-			&& !cache.channelTargets.contains(pDst))
-			cache.directTargets.insert(pDst);
+		if (!pDst || !pDst->cChannel) {
+			continue;
+		}
+
+		cache.channelDependencies.push_back(pDst->cChannel->iId);
+
+		if (ChanACL::hasPermission(&speaker, pDst->cChannel, ChanACL::Whisper, &acCache)
+			&& !std::binary_search(cache.channelTargets.begin(), cache.channelTargets.end(), pDst, compareSessions))
+			cache.directTargets.push_back(pDst);
 	}
 
-	// Make sure the speaker themselves is not contained in these lists
-	cache.channelTargets.remove(&speaker);
-	cache.directTargets.remove(&speaker);
-	cache.listeningTargets.remove(&speaker);
+	sortReceivers(cache.directTargets, speaker);
+
+	// If a user listens to several of the targeted channels, the loudest volume adjustment wins
+	std::sort(cache.listeningTargets.begin(), cache.listeningTargets.end(),
+			  [](const WhisperTargetCache::Listener &lhs, const WhisperTargetCache::Listener &rhs) {
+				  if (lhs.user->uiSession != rhs.user->uiSession) {
+					  return lhs.user->uiSession < rhs.user->uiSession;
+				  }
+
+				  return lhs.volumeAdjustment.factor > rhs.volumeAdjustment.factor;
+			  });
+	cache.listeningTargets.erase(
+		std::unique(cache.listeningTargets.begin(), cache.listeningTargets.end(),
+					[](const WhisperTargetCache::Listener &lhs, const WhisperTargetCache::Listener &rhs) {
+						return lhs.user == rhs.user;
+					}),
+		cache.listeningTargets.end());
+	cache.listeningTargets.erase(std::remove_if(cache.listeningTargets.begin(), cache.listeningTargets.end(),
+												[&speaker](const WhisperTargetCache::Listener &listener) {
+													return listener.user == &speaker;
+												}),
+								 cache.listeningTargets.end());
+
+	for (const std::vector< ServerUser * > *receivers : { &cache.channelTargets, &cache.directTargets }) {
+		for (const ServerUser *receiver : *receivers) {
+			cache.sessionDependencies.push_back(receiver->uiSession);
+		}
+	}
+	for (const WhisperTargetCache::Listener &listener : cache.listeningTargets) {
+		cache.sessionDependencies.push_back(listener.user->uiSession);
+	}
+
+	sortAndRemoveDuplicates(cache.channelDependencies);
+	sortAndRemoveDuplicates(cache.sessionDependencies);
 
 	return cache;
 }
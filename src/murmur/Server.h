@@ -13,15 +13,28 @@
 #endif
 
 #include "ACL.h"
+#include "ActiveSpeakerLimiter.h"
 #include "AudioReceiverBuffer.h"
 #include "Ban.h"
+#include "BanIndex.h"
 #include "ChannelListenerManager.h"
+#include "ConnectionIOPool.h"
+#include "CryptWorkerPool.h"
 #include "HostAddress.h"
+#include "LinkClosure.h"
 #include "Mumble.pb.h"
 #include "MumbleProtocol.h"
+#include "PasswordHasher.h"
+#include "PeerTable.h"
+#include "PermissionCache.h"
+#include "RoutingSnapshot.h"
+#include "StateSyncCache.h"
 #include "Timer.h"
+#include "UDPBatch.h"
 #include "User.h"
 #include "Version.h"
+#include "VoiceLock.h"
+#include "VoiceWorker.h"
 #include "VolumeAdjustment.h"
 
 #ifndef Q_MOC_RUN
@@ -30,8 +43,10 @@
 
 #include <QtCore/QEvent>
 #include <QtCore/QMutex>
+#include <QtCore/QPointer>
 #include <QtCore/QQueue>
 #include <QtCore/QReadWriteLock>
+#include <QtCore/QSet>
 #include <QtCore/QSocketNotifier>
 #include <QtCore/QStringList>
 #include <QtCore/QThread>
@@ -49,6 +64,12 @@
 #	include <winsock2.h>
 #endif
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class AudioMixer;
+class VoiceThreadPool;
 class Zeroconf;
 class Channel;
 class PacketDataStream;
@@ -114,6 +135,10 @@ public:
 	int iMaxBandwidth;
 	unsigned int iMaxUsers;
 	unsigned int iMaxUsersPerChannel;
+	unsigned int iMaxActiveSpeakers;
+	unsigned int iActiveSpeakersChannelSize;
+	QString qsMixedChannels;
+	int iMixingBitrate;
 	unsigned int iDefaultChan;
 	bool bRememberChan;
 	int iRememberChanDuration;
@@ -177,11 +202,10 @@ public:
 	ChannelListenerManager m_channelListenerManager;
 
 
+	/// Used for answering pings in udpActivated() while the voice threads are not running
 	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_udpDecoder;
 	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_tcpTunnelDecoder;
 	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > m_udpPingEncoder;
-	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_udpAudioEncoder;
-	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_tcpAudioEncoder;
 
 	gsl::span< const Mumble::Protocol::byte >
 		handlePing(const Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
@@ -209,8 +233,94 @@ private:
 	int iChannelNestingLimit;
 	int iChannelCountLimit;
 
-	AudioReceiverBuffer m_udpAudioReceivers;
-	AudioReceiverBuffer m_tcpAudioReceivers;
+	/// The routing state for voice packets that have been tunnelled through TCP. These are handled on the main thread.
+	VoiceThreadContext m_tcpContext;
+	/// Whether the main thread has already been asked to drain the tunnel queues
+	std::atomic< bool > m_tcpTransmitPending;
+
+	/// Threads helping the voice threads with encrypting large fan-outs, shared by all virtual servers (see
+	/// Meta::m_cryptPool). Null if disabled.
+	CryptWorkerPool *m_cryptPool;
+	/// Threads performing the socket I/O of the client connections, shared by all virtual servers (see
+	/// Meta::m_connectionPool). Null if that happens on the main thread.
+	ConnectionIOPool *m_connectionPool;
+	/// Threads verifying the passwords of authenticating users, shared by all virtual servers (see
+	/// Meta::m_passwordHasher). Null if that happens on the main thread.
+	PasswordHasher *m_passwordHasher;
+
+	/// The routing state of every voice thread. Index 0 belongs to the Server thread itself.
+	std::vector< std::unique_ptr< VoiceThreadContext > > m_voiceContexts;
+	/// The voice threads besides the Server thread
+	std::vector< std::unique_ptr< VoiceWorker > > m_voiceWorkers;
+	/// The voice threads shared by all virtual servers (see Meta::m_voicePool). If set, the voice sockets are handed
+	/// to these instead of running the Server thread and m_voiceWorkers. Always null on platforms other than Linux.
+	VoiceThreadPool *m_voicePool;
+
+	/// The routing snapshot the voice threads currently use. Only ever accessed through std::atomic_load and
+	/// std::atomic_store.
+	std::shared_ptr< const RoutingSnapshot > m_routingSnapshot;
+	/// Incremented whenever a new routing snapshot has been published, such that the voice threads only have
+	/// to fetch the snapshot if it has actually changed
+	std::atomic< unsigned int > m_routingVersion;
+	/// Who may speak in the channels subject to iMaxActiveSpeakers. Shared by all voice threads.
+	ActiveSpeakerLimiter m_activeSpeakers;
+	/// The IDs of the channels listed in qsMixedChannels. Only accessed by the main thread.
+	QSet< unsigned int > m_mixedChannels;
+#ifdef USE_SERVER_MIXING
+	/// The mixers of the channels in m_mixedChannels by channel ID. They are created by the voice threads once the
+	/// first speaker speaks in the respective channel and dropped whenever the mixing configuration changes.
+	QHash< unsigned int, std::shared_ptr< AudioMixer > > m_mixers;
+	QMutex m_mixerMutex;
+#endif
+	/// The result of getSpeakableLinks per user session. Entries are dropped whenever the permissions of the
+	/// respective user change (which includes entering a channel) and all entries are dropped whenever links
+	/// change. Only accessed by the main thread.
+	QHash< unsigned int, QVector< unsigned int > > m_speakableLinks;
+
+	/// Builds a routing snapshot from the current state of the server
+	///
+	/// @param excludedUser A user that is about to be removed and thus must not be part of the snapshot
+	std::shared_ptr< const RoutingSnapshot > buildRoutingSnapshot(const ServerUser *excludedUser = nullptr);
+	/// Builds a routing snapshot from the current one, in which only the given channels and speakers are updated
+	///
+	/// @param channelIDs The channels whose users or listeners have changed (including removed channels)
+	/// @param sessions The users whose channel, permissions or state have changed (including removed users)
+	/// @param excludedUser A user that is about to be removed and thus must not be part of the snapshot
+	std::shared_ptr< const RoutingSnapshot > patchRoutingSnapshot(const std::vector< unsigned int > &channelIDs,
+																  const std::vector< unsigned int > &sessions,
+																  const ServerUser *excludedUser = nullptr);
+	std::vector< RoutingSnapshot::Receiver > buildRoutingReceivers(const Channel &c,
+																	const ServerUser *excludedUser = nullptr);
+	/// Sets (or removes) the routing information of the given user in the given snapshot. The caller has to hold
+	/// qmCache.
+	void updateRoutingSpeaker(RoutingSnapshot &snapshot, ServerUser &user);
+	/// @returns The IDs of the channels linked to the user's channel that the user has permission to speak in.
+	/// 	The caller has to hold qmCache.
+	QVector< unsigned int > getSpeakableLinks(ServerUser &user);
+	/// @returns The sessions of the users in the given channel and in all channels linked to it
+	std::vector< unsigned int > getLinkGroupSessions(unsigned int channelID) const;
+	void publishRoutingSnapshot(std::shared_ptr< const RoutingSnapshot > snapshot);
+	/// Rebuilds the routing snapshot from scratch and hands it to the voice threads. Used for changes that
+	/// potentially affect everyone, such as edited ACLs.
+	void updateRouting();
+	/// Hands a routing snapshot to the voice threads in which the given channels and speakers are updated (see
+	/// patchRoutingSnapshot). Has to be called whenever something changes that influences whom regular speech is
+	/// routed to (channel membership, links, listeners or permissions), before control returns to the event loop.
+	/// Otherwise, e.g. a user that has been moved would keep hearing and being heard in the old channel.
+	void updateRouting(const std::vector< unsigned int > &channelIDs, const std::vector< unsigned int > &sessions);
+
+	/// The authenticated users by client version, such that broadcasts only have to check each version once. Only
+	/// accessed by the main thread.
+	QHash< Version::full_t, QVector< ServerUser * > > m_broadcastReceivers;
+	/// The sessions of the users that have queued messages. Only accessed by the main thread.
+	QVector< unsigned int > m_queuedSessions;
+	void addBroadcastReceiver(ServerUser *user);
+	void removeBroadcastReceiver(ServerUser *user);
+	/// Queues the given serialised message for the given user. The queued messages of all users are sent once the
+	/// current event has been processed, with a single write per user. Droppable messages (i.e. voice) are dropped
+	/// for users that don't keep up with reading the data sent to them.
+	void queueMessage(ServerUser *user, const QByteArray &message, bool droppable = false);
+	void flushQueuedMessages();
 
 public slots:
 	void regSslError(const QList< QSslError > &);
@@ -227,20 +337,36 @@ public:
 	static QSslKey privateKeyFromPEM(const QByteArray &buf, const QByteArray &pass = QByteArray());
 	void initializeCert();
 	const QString getDigest() const;
+	/// @returns Whether the handshake with a client may proceed despite the given errors. This is called in the
+	/// 	thread performing the I/O of the connection.
+	static bool acceptsSslErrors(const QList< QSslError > &errors);
+	/// Parses a message received from a client. This is called in the thread performing the I/O of the connection, so
+	/// that the main thread only has to handle the parsed message. Tunnelled voice packets are left unparsed.
+	///
+	/// @returns Whether the message is valid
+	static bool parseMessage(Mumble::Protocol::TCPMessageType type, const QByteArray &data,
+							 std::shared_ptr< ::google::protobuf::Message > &msg);
+	/// Passes a parsed message to its handler
+	void handleMessage(Mumble::Protocol::TCPMessageType type, ::google::protobuf::Message &msg, ServerUser *u);
 
 public slots:
 	void newClient();
 	void connectionClosed(QAbstractSocket::SocketError, const QString &);
 	void sslError(const QList< QSslError > &);
 	void message(Mumble::Protocol::TCPMessageType, const QByteArray &, ServerUser *cCon = nullptr);
+	/// Handles a message that has already been parsed by parseMessage()
+	void parsedMessage(Mumble::Protocol::TCPMessageType type, std::shared_ptr< ::google::protobuf::Message > msg);
 	void checkTimeout();
-	void tcpTransmitData(QByteArray, unsigned int);
+	/// Removes the bans that have expired
+	void expireBans();
+	/// Sends all queued tunnelled voice packets to their receivers
+	void tcpTransmitData();
 	void doSync(unsigned int);
 	void encrypted();
 	void udpActivated(int);
 signals:
 	void reqSync(unsigned int);
-	void tcpTransmit(QByteArray, unsigned int id);
+	void tcpTransmit();
 
 public:
 	int iServerNum;
@@ -259,14 +385,14 @@ public:
 
 	/// This lock provides synchronization between the
 	/// main thread (where control channel messages and
-	/// RPC happens), and the Server's voice thread.
+	/// RPC happens), and the Server's voice threads.
 	///
-	/// These are the only two threads in Murmur that
+	/// These are the only threads in Murmur that
 	/// access a Server's data.
 	///
 	/// The easiest way to understand the locking strategy
 	/// and synchronization between the main thread and the
-	/// Server's voice thread is by using the concept of
+	/// Server's voice threads is by using the concept of
 	/// ownership.
 	///
 	/// A thread owning an object means that it is the only
@@ -279,48 +405,88 @@ public:
 	///
 	/// When processing incoming voice data (and re-
 	/// broadcasting) that voice data), the Server's voice
-	/// thread needs to access various parts of Server's data,
+	/// threads need to access various parts of Server's data,
 	/// such as qhUsers, qhChannels, User->cChannel, etc.
 	/// However, these are owned by the main thread.
 	///
-	/// To ensure correct synchronization between the two
+	/// To ensure correct synchronization between the
 	/// threads, the contract for using qrwlVoiceThread is
 	/// as follows:
 	///
-	///  - When the Server's voice thread needs to read data
+	///  - When a voice thread needs to read data
 	///    owned by the main thread, it must hold a read lock
 	///    on qrwlVoiceThread.
 	///
-	///  - The Server's voice thread does not write to any data
+	///  - The voice threads do not write to any data
 	///    that is owned by the main thread.
 	///
 	///  - When the main thread needs to write to data owned by
-	///    itself that is accessed by the voice thread, it must
+	///    itself that is accessed by the voice threads, it must
 	///    hold a write lock on qrwlVoiceThread.
 	///
 	///  - When the main thread needs to read data that is owned
 	///    by itself, it DOES NOT hold a lock on qrwlVoiceThread.
 	///    That is because ownership of data guarantees that no
 	///    other thread can write to that data.
-	QReadWriteLock qrwlVoiceThread;
+	///
+	/// Every voice thread read-locks its own slot of the lock,
+	/// so the voice threads never contend with each other.
+	VoiceLock qrwlVoiceThread;
 	QHash< unsigned int, ServerUser * > qhUsers;
-	QHash< QPair< HostAddress, quint16 >, ServerUser * > qhPeerUsers;
+	/// The users whose UDP address is known
+	PeerTable m_udpPeers;
 	QHash< HostAddress, QSet< ServerUser * > > qhHostUsers;
 	QHash< unsigned int, Channel * > qhChannels;
+	/// The groups of channels that are linked to each other. Kept in sync with the links of the channels in
+	/// qhChannels. Only accessed by the main thread.
+	LinkClosure m_linkClosure;
 
 	QMutex qmCache;
-	ChanACL::ACLCache acCache;
+	/// Lookups may happen without holding qmCache, everything else requires it
+	PermissionCache acCache;
 
 	QHash< int, QString > qhUserNameCache;
 	QHash< QString, int > qhUserIDCache;
 
 	QList< Ban > qlBans;
 
-	void addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user, const Channel &channel);
-	void processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-					Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder);
-	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force = false);
+	/// The serialised channel and user states sent to clients that have just authenticated
+	StateSyncCache m_stateSyncCache;
+	/// The bans of qlBans by address and expiry. getBans() and saveBans() rebuild it, so everything modifying
+	/// qlBans has to call one of them.
+	BanIndex m_banIndex;
+	/// Fires once the next temporary ban has expired
+	QTimer *m_banExpiryTimer;
+	void updateBanIndex();
+	void scheduleBanExpiry();
+
+	void addListener(std::vector< WhisperTargetCache::Listener > &listeners, ServerUser &user, const Channel &channel);
+	void processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, VoiceThreadContext &context);
+	/// Sends the given audio to the receivers in the context's AudioReceiverBuffer
+	void sendAudio(Mumble::Protocol::AudioData &audioData, VoiceThreadContext &context);
+#ifdef USE_SERVER_MIXING
+	/// Hands the given audio of a speaker in a mixed channel to the channel's AudioMixer and sends whatever the
+	/// mixer has mixed in return
+	void mixAudio(const ServerUser &u, const RoutingSnapshot::Speaker &speaker,
+				  const Mumble::Protocol::AudioData &audioData, VoiceThreadContext &context);
+	/// Drops all mixers, such that they are created with the current configuration again
+	void clearMixers();
+#endif
+	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, VoiceThreadContext &context,
+					 bool force = false);
+	/// Encrypts the given packet for all receivers of the fan-out starting at the given index. Large fan-outs
+	/// are encrypted in parallel on the crypt worker pool.
+	void encryptFanout(CryptFanout &fanout, std::size_t begin, const unsigned char *data, int len);
+	void processDatagram(VoiceThreadContext &context, const UDPDatagram &datagram, unsigned char *buffer);
 	void run();
+	/// Receives and routes voice packets on the sockets of the voice thread with the given index until the
+	/// voice threads are stopped.
+	void voiceLoop(std::size_t index);
+#ifdef Q_OS_LINUX
+	/// Receives and routes the voice packets that are currently queued on the given socket with the context of the
+	/// voice thread with the given index
+	void receiveVoice(std::size_t index, int socket, UDPReceiveBatch &receiveBatch);
+#endif
 
 	bool validateChannelName(const QString &name);
 	bool validateUserName(const QString &name);
@@ -332,7 +498,24 @@ public:
 	void sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequested = false);
 	void flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mpqq);
 	void clearACLCache(User *p = nullptr);
+	/// Drops the cached permissions of all users in the given channel and its subchannels. This is all that is
+	/// needed after the ACLs or groups of the channel have changed (or the channel has been moved).
+	void clearChannelACLCache(Channel *channel);
+	/// Suppresses the given user if it may not speak in its channel anymore and vice versa. Assumes that qmCache
+	/// is held.
+	void updateSuppression(ServerUser *user);
+	/// Drops the cached whisper targets of all users
 	void clearWhisperTargetCache();
+	/// Drops the cached whisper targets that depend on any of the given channels or sessions (see
+	/// WhisperTargetCache::dependsOn) as well as all cached whisper targets of the users with the given sessions
+	void clearWhisperTargetCache(std::vector< unsigned int > channelIDs, std::vector< unsigned int > sessions);
+
+	/// Starts computing the password hash requested by authenticate() for the given user in the background. Once it
+	/// is known, the authentication is resumed by passing the given message to msgAuthenticate() again.
+	///
+	/// @returns Whether the computation has been started. It isn't, if there are too many pending ones already.
+	bool startPasswordHash(ServerUser *user, const MumbleProto::Authenticate &msg);
+	void passwordHashed(QPointer< ServerUser > user, MumbleProto::Authenticate msg, QString hash);
 
 	void sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
 					  Version::full_t version, Version::CompareMode mode);
@@ -434,6 +617,11 @@ public:
 	int authenticate(QString &name, const QString &pw, int sessionId = 0, const QStringList &emails = QStringList(),
 					 const QString &certhash = QString(), bool bStrongCert = false,
 					 const QList< QSslCertificate > & = QList< QSslCertificate >());
+	/// Computes the PBKDF2 hash of the given password for authenticate(). For users that are authenticating while
+	/// password hashes are computed in the background, the hash has to be computed by startPasswordHash() first.
+	///
+	/// @returns Whether the hash is known. If not, authenticate() has to be called again once it has been computed.
+	bool getPasswordHash(int sessionId, const QString &salt, const QString &password, int iterations, QString &hash);
 	Channel *addChannel(Channel *c, const QString &name, bool temporary = false, int position = 0,
 						unsigned int maxUsers = 0);
 	void removeChannelDB(const Channel *c);
@@ -462,6 +650,8 @@ public:
 	void removeLink(Channel *c, Channel *l);
 	void getBans();
 	void saveBans();
+	/// Deletes the given bans from the database, leaving the other ones alone
+	void deleteBans(const QList< Ban > &bans);
 	QVariant getConf(const QString &key, QVariant def);
 	void setConf(const QString &key, const QVariant &value);
 	void dblog(const QString &str) const;
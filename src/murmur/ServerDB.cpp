@@ -14,6 +14,7 @@
 #include "ACL.h"
 #include "Channel.h"
 #include "Connection.h"
+#include "DBWriteQueue.h"
 #include "Group.h"
 #include "Meta.h"
 #include "PBKDF2.h"
@@ -48,22 +49,25 @@ class TransactionHolder {
 public:
 	QSqlQuery *qsqQuery;
 	TransactionHolder() {
-		ServerDB::db->transaction();
+		ServerDB::beginTransaction();
 		qsqQuery = new QSqlQuery();
 	}
 
 	~TransactionHolder() {
 		qsqQuery->clear();
 		delete qsqQuery;
-		ServerDB::db->commit();
+		ServerDB::commitTransaction();
 	}
 	TransactionHolder(const TransactionHolder &other) {
-		ServerDB::db->transaction();
+		ServerDB::beginTransaction();
 		qsqQuery = other.qsqQuery ? new QSqlQuery(*other.qsqQuery) : 0;
 	}
 };
 
-QSqlDatabase *ServerDB::db = nullptr;
+QSqlDatabase *ServerDB::db         = nullptr;
+DBWriteQueue *ServerDB::writeQueue = nullptr;
+int ServerDB::transactionDepth     = 0;
+bool ServerDB::transactionLocked   = false;
 Timer ServerDB::tLogClean;
 QString ServerDB::qsUpgradeSuffix;
 
@@ -873,16 +877,97 @@ ServerDB::ServerDB() {
 		}
 	}
 	query.clear();
+
+	// A second connection to an in-memory database would refer to a database of its own
+	if (Meta::mp.iDBWriteDelay > 0 && db->databaseName() != QLatin1String(":memory:")) {
+		writeQueue = new DBWriteQueue(*db, Meta::mp.iDBWriteDelay, static_cast< std::size_t >(Meta::mp.iDBWriteBatch));
+	}
 }
 
 ServerDB::~ServerDB() {
+	// Commits the pending writes
+	delete writeQueue;
+	writeQueue = nullptr;
+
 	db->close();
 	delete db;
 	db = nullptr;
 }
 
+QSqlDatabase &ServerDB::database() {
+	if (writeQueue && QThread::currentThread() == writeQueue) {
+		return writeQueue->database();
+	}
+
+	return *db;
+}
+
+void ServerDB::queueWrite(const std::function< void(QSqlQuery &) > &write) {
+	if (writeQueue) {
+		writeQueue->enqueue(write);
+		return;
+	}
+
+	TransactionHolder th;
+	write(*th.qsqQuery);
+}
+
+void ServerDB::flushWrites() {
+	if (!writeQueue) {
+		return;
+	}
+
+	if (transactionLocked) {
+		// The queue can't commit before the running transaction ends
+		for (const DBWriteQueue::Write &write : writeQueue->takePending()) {
+			QSqlQuery query;
+			write(query);
+		}
+		return;
+	}
+
+	writeQueue->flush();
+}
+
+void ServerDB::beginTransaction() {
+	if (transactionDepth++ > 0) {
+		return;
+	}
+
+	if (!writeQueue) {
+		db->transaction();
+		return;
+	}
+
+	writeQueue->transactionMutex().lock();
+	transactionLocked = true;
+
+	if (!DBWriteQueue::beginTransaction(*db)) {
+		qWarning("ServerDB: Failed to start a transaction: %s", qPrintable(db->lastError().text()));
+	}
+}
+
+void ServerDB::commitTransaction() {
+	if (--transactionDepth > 0) {
+		return;
+	}
+
+	if (!transactionLocked) {
+		db->commit();
+		return;
+	}
+
+	if (!db->commit()) {
+		qWarning("ServerDB: Failed to commit a transaction: %s", qPrintable(db->lastError().text()));
+		db->rollback();
+	}
+
+	transactionLocked = false;
+	writeQueue->transactionMutex().unlock();
+}
+
 bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
-	if (!db->isValid()) {
+	if (!database().isValid()) {
 		qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
 		return false;
 	}
@@ -903,9 +988,9 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 	if (query.prepare(q)) {
 		return true;
 	} else {
-		db->close();
-		if (!db->open()) {
-			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(db->lastError().text()));
+		database().close();
+		if (!database().open()) {
+			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(database().lastError().text()));
 		}
 		query = QSqlQuery();
 		if (query.prepare(q)) {
@@ -914,7 +999,7 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 		}
 
 		if (fatal) {
-			*db = QSqlDatabase();
+			database() = QSqlDatabase();
 			qFatal("SQL Prepare Error [%s]: %s", qPrintable(q), qPrintable(query.lastError().text()));
 		} else if (warn) {
 			qDebug("SQL Prepare Error [%s]: %s", qPrintable(q), qPrintable(query.lastError().text()));
@@ -925,7 +1010,7 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 
 bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
 	if (!str.isEmpty()) {
-		if (!db->isValid()) {
+		if (!database().isValid()) {
 			qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
 			return false;
 		}
@@ -947,7 +1032,7 @@ bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn
 			return true;
 		} else {
 			if (fatal) {
-				*db = QSqlDatabase();
+				database() = QSqlDatabase();
 				qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 			} else if (warn) {
 				qDebug("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
@@ -966,7 +1051,7 @@ bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn)
 		return true;
 	} else {
 		if (fatal) {
-			*db = QSqlDatabase();
+			database() = QSqlDatabase();
 			qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 		} else if (warn) {
 			qDebug("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
@@ -982,7 +1067,7 @@ bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 		return true;
 	} else {
 		if (fatal) {
-			*db = QSqlDatabase();
+			database() = QSqlDatabase();
 			qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 		} else
 			qDebug("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
@@ -991,6 +1076,9 @@ bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 }
 
 void Server::initialize() {
+	// Writes queued while this server was running before may still be pending
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1115,6 +1203,8 @@ int Server::registerUser(const QMap< int, QString > &info) {
 	int id = 0;
 
 	{
+		ServerDB::flushWrites();
+
 		TransactionHolder th;
 
 		QSqlQuery &query = *th.qsqQuery;
@@ -1175,6 +1265,8 @@ bool Server::unregisterUserDB(int id) {
 		return false;
 	}
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1201,6 +1293,8 @@ QList< UserInfo > Server::getRegisteredUsersEx() {
 		users.insert(it.key(), UserInfo(it.key(), it.value()));
 	}
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1227,6 +1321,8 @@ QMap< int, QString > Server::getRegisteredUsers(const QString &filter) {
 
 	emit getRegisteredUsersSig(filter, m);
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1255,6 +1351,8 @@ bool Server::isUserId(int id) {
 	if (res >= 0)
 		return (res > 0);
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1275,6 +1373,8 @@ QMap< int, QString > Server::getRegistration(int id) {
 	if (res >= 0)
 		return info;
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1299,8 +1399,32 @@ QMap< int, QString > Server::getRegistration(int id) {
 	return info;
 }
 
+bool Server::getPasswordHash(int sessionId, const QString &salt, const QString &password, int iterations,
+							 QString &hash) {
+	ServerUser *user = sessionId > 0 ? qhUsers.value(static_cast< unsigned int >(sessionId)) : nullptr;
+
+	if (!m_passwordHasher || !user || user->sState != ServerUser::Connected) {
+		hash = PBKDF2::getHash(salt, password, iterations);
+		return true;
+	}
+
+	ServerUser::PasswordHash &computed = user->m_passwordHash;
+	if (!computed.hash.isEmpty() && computed.salt == salt && computed.password == password
+		&& computed.iterations == iterations) {
+		hash = computed.hash;
+		// The hash is only good for a single attempt
+		computed = ServerUser::PasswordHash();
+		return true;
+	}
+
+	computed = { salt, iterations, password, QString() };
+
+	return false;
+}
+
 /// @return UserID of authenticated user, -1 for authentication failures, -2 for unknown user (fallthrough),
-///         -3 for authentication failures where the data could (temporarily) not be verified.
+///         -3 for authentication failures where the data could (temporarily) not be verified, -4 if the password
+///         hash has to be computed by startPasswordHash() first.
 int Server::authenticate(QString &name, const QString &password, int sessionId, const QStringList &emails,
 						 const QString &certhash, bool bStrongCert, const QList< QSslCertificate > &certs) {
 	int res = bForceExternalAuth ? -3 : -2;
@@ -1310,35 +1434,36 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 	if (res != -2) {
 		// External authentication handled it. Ignore certificate completely.
 		if (res != -1) {
-			TransactionHolder th;
-			QSqlQuery &query = *th.qsqQuery;
-
 			int lchan = readLastChannel(res);
 			if (lchan < 0)
 				lchan = 0;
 
-			if (Meta::mp.qsDBDriver == "QPSQL") {
-				SQLPREP("INSERT INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES "
-						"(:server_id,:user_id,:name,:lastchannel) ON CONFLICT (`server_id`, `user_id`) DO UPDATE SET "
-						"`name` = :u_name, `lastchannel` = :u_lastchannel WHERE `%1users`.`server_id` = :u_server_id "
-						"AND `%1users`.`user_id` = :u_user_id");
-				query.bindValue(":server_id", iServerNum);
-				query.bindValue(":user_id", res);
-				query.bindValue(":name", name);
-				query.bindValue(":lastchannel", lchan);
-				query.bindValue(":u_server_id", iServerNum);
-				query.bindValue(":u_user_id", res);
-				query.bindValue(":u_name", name);
-				query.bindValue(":u_lastchannel", lchan);
-				SQLEXEC();
-			} else {
-				SQLPREP("REPLACE INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES (?,?,?,?)");
-				query.addBindValue(iServerNum);
-				query.addBindValue(res);
-				query.addBindValue(name);
-				query.addBindValue(lchan);
-				SQLEXEC();
-			}
+			const int serverID = iServerNum;
+			const int userID   = res;
+			ServerDB::queueWrite([serverID, userID, name, lchan](QSqlQuery &query) {
+				if (Meta::mp.qsDBDriver == "QPSQL") {
+					SQLPREP("INSERT INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES "
+							"(:server_id,:user_id,:name,:lastchannel) ON CONFLICT (`server_id`, `user_id`) DO UPDATE "
+							"SET `name` = :u_name, `lastchannel` = :u_lastchannel WHERE `%1users`.`server_id` = "
+							":u_server_id AND `%1users`.`user_id` = :u_user_id");
+					query.bindValue(":server_id", serverID);
+					query.bindValue(":user_id", userID);
+					query.bindValue(":name", name);
+					query.bindValue(":lastchannel", lchan);
+					query.bindValue(":u_server_id", serverID);
+					query.bindValue(":u_user_id", userID);
+					query.bindValue(":u_name", name);
+					query.bindValue(":u_lastchannel", lchan);
+					SQLEXEC();
+				} else {
+					SQLPREP("REPLACE INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES (?,?,?,?)");
+					query.addBindValue(serverID);
+					query.addBindValue(userID);
+					query.addBindValue(name);
+					query.addBindValue(lchan);
+					SQLEXEC();
+				}
+			});
 		}
 		if (res >= 0) {
 			qhUserNameCache.remove(res);
@@ -1347,6 +1472,8 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 		return res;
 	}
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -1385,7 +1512,12 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 					}
 				}
 			} else {
-				if (PBKDF2::getHash(storedSalt, password, storedKdfIterations) == storedPasswordHash) {
+				QString passwordHash;
+				if (!getPasswordHash(sessionId, storedSalt, password, storedKdfIterations, passwordHash)) {
+					return -4;
+				}
+
+				if (passwordHash == storedPasswordHash) {
 					name = query.value(1).toString();
 					res  = query.value(0).toInt();
 
@@ -1529,6 +1661,8 @@ bool Server::setInfo(int id, const QMap< int, QString > &setinfo) {
 	if (res >= 0)
 		return (res > 0);
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -1630,6 +1764,8 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 	if (res >= 0)
 		return (res > 0);
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1643,6 +1779,8 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 }
 
 void ServerDB::writeSUPW(int srvnum, const QString &pwHash, const QString &saltHash, const QVariant &kdfIterations) {
+	flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -1701,6 +1839,8 @@ QString Server::getUserName(int id) {
 		return name;
 	}
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT `name` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
@@ -1730,6 +1870,8 @@ int Server::getUserID(const QString &name) {
 		return id;
 	}
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1752,6 +1894,8 @@ QByteArray Server::getUserTexture(int id) {
 		return qba;
 	}
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1770,9 +1914,14 @@ QByteArray Server::getUserTexture(int id) {
 
 void Server::addLink(Channel *c, Channel *l) {
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 		c->link(l);
 	}
+	m_linkClosure.addLink(c->iId, l->iId);
+	m_speakableLinks.clear();
+	clearWhisperTargetCache({ c->iId, l->iId }, {});
+	// Everyone in the merged group may be able to speak into more channels now
+	updateRouting({}, getLinkGroupSessions(c->iId));
 
 	if (c->bTemporary || l->bTemporary)
 		return;
@@ -1793,9 +1942,20 @@ void Server::addLink(Channel *c, Channel *l) {
 
 void Server::removeLink(Channel *c, Channel *l) {
 	{
-		QWriteLocker wl(&qrwlVoiceThread);
+		VoiceWriteLocker wl(&qrwlVoiceThread);
 		c->unlink(l);
 	}
+	// The group might split up, in which case everyone in the former group is part of one of the new ones
+	m_linkClosure.removeLink(c->iId, l->iId);
+	m_speakableLinks.clear();
+	clearWhisperTargetCache({ c->iId, l->iId }, {});
+	std::vector< unsigned int > sessions = getLinkGroupSessions(c->iId);
+	if (!m_linkClosure.isLinked(c->iId, l->iId)) {
+		for (unsigned int session : getLinkGroupSessions(l->iId)) {
+			sessions.push_back(session);
+		}
+	}
+	updateRouting({}, sessions);
 
 	if (c->bTemporary || l->bTemporary)
 		return;
@@ -1866,11 +2026,17 @@ Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int
 	c->iPosition  = position;
 	c->uiMaxUsers = maxUsers;
 	qhChannels.insert(id, c);
+
+	// The new channel is one of the children of its parent and its ID might have been used for a whisper target before
+	clearWhisperTargetCache({ id, p->iId }, {});
+
 	return c;
 }
 
 void Server::removeChannelDB(const Channel *c) {
 	if (!c->bTemporary) {
+		ServerDB::flushWrites();
+
 		TransactionHolder th;
 
 		QSqlQuery &query = *th.qsqQuery;
@@ -2163,8 +2329,9 @@ void Server::readLinks() {
 		Channel *c = qhChannels.value(cid);
 		Channel *l = qhChannels.value(lid);
 		if (c && l) {
-			QWriteLocker wl(&qrwlVoiceThread);
+			VoiceWriteLocker wl(&qrwlVoiceThread);
 			c->link(l);
+			m_linkClosure.addLink(cid, lid);
 		}
 	}
 }
@@ -2176,18 +2343,21 @@ void Server::setLastChannel(const User *p) {
 	if (p->cChannel->bTemporary)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
-	if (Meta::mp.qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(p->cChannel->iId);
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	const unsigned int channelID = p->cChannel->iId;
+	const int serverID           = iServerNum;
+	const int userID             = p->iId;
+	ServerDB::queueWrite([channelID, serverID, userID](QSqlQuery &query) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
+		} else {
+			SQLPREP(
+				"UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		}
+		query.addBindValue(channelID);
+		query.addBindValue(serverID);
+		query.addBindValue(userID);
+		SQLEXEC();
+	});
 }
 
 int Server::readLastChannel(int id) {
@@ -2197,6 +2367,8 @@ int Server::readLastChannel(int id) {
 	if (!Meta::mp.bRememberChan)
 		return -1;
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2255,18 +2427,20 @@ void Server::setLastDisconnect(const User *p) {
 	if (p->iId < 0)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
-	if (Meta::mp.qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		// MySQL or PostgreSQL
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	const int serverID = iServerNum;
+	const int userID   = p->iId;
+	ServerDB::queueWrite([serverID, userID](QSqlQuery &query) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			SQLPREP(
+				"UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
+		} else {
+			// MySQL or PostgreSQL
+			SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		}
+		query.addBindValue(serverID);
+		query.addBindValue(userID);
+		SQLEXEC();
+	});
 }
 
 void Server::dumpChannel(const Channel *c) {
@@ -2322,6 +2496,8 @@ void Server::getBans() {
 		if (ban.isValid())
 			qlBans << ban;
 	}
+
+	updateBanIndex();
 }
 
 void Server::saveBans() {
@@ -2345,6 +2521,26 @@ void Server::saveBans() {
 		query.addBindValue(ban.iDuration);
 		SQLEXEC();
 	}
+
+	updateBanIndex();
+}
+
+void Server::deleteBans(const QList< Ban > &bans) {
+	TransactionHolder th;
+
+	QSqlQuery &query = *th.qsqQuery;
+	// Some databases store the start with less precision than the in-memory copy has. Any ban of the same range and
+	// duration that started even earlier has expired as well.
+	SQLPREP("DELETE FROM `%1bans` WHERE `server_id` = ? AND `base` = ? AND `mask` = ? AND `duration` = ? AND "
+			"`start` <= ?");
+	foreach (const Ban &ban, bans) {
+		query.addBindValue(iServerNum);
+		query.addBindValue(ban.haAddress.toByteArray());
+		query.addBindValue(ban.iMask);
+		query.addBindValue(ban.iDuration);
+		query.addBindValue(ban.qdtStart);
+		SQLEXEC();
+	}
 }
 
 QVariant Server::getConf(const QString &key, QVariant def) {
@@ -2385,14 +2581,12 @@ void Server::setConf(const QString &key, const QVariant &value) {
 }
 
 void Server::dblog(const QString &str) const {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
 	// Is logging disabled?
 	if (Meta::mp.iLogDays < 0)
 		return;
 
 	// Once per hour
+	QString qsCleanup;
 	if (Meta::mp.iLogDays > 0) {
 		if (ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL)) {
 			QString qstr;
@@ -2403,15 +2597,22 @@ void Server::dblog(const QString &str) const {
 			} else {
 				qstr = QString::fromLatin1("msgtime < now() - INTERVAL %1 day").arg(Meta::mp.iLogDays);
 			}
-			ServerDB::prepare(query, QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr);
-			SQLEXEC();
+			qsCleanup = QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr;
 		}
 	}
 
-	SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(str);
-	SQLEXEC();
+	const int serverID = iServerNum;
+	ServerDB::queueWrite([serverID, str, qsCleanup](QSqlQuery &query) {
+		if (!qsCleanup.isEmpty()) {
+			ServerDB::prepare(query, qsCleanup);
+			SQLEXEC();
+		}
+
+		SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
+		query.addBindValue(serverID);
+		query.addBindValue(str);
+		SQLEXEC();
+	});
 }
 
 void Server::loadChannelListenersOf(const ServerUser &user) {
@@ -2420,6 +2621,8 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 		return;
 	}
 
+	ServerDB::flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2429,6 +2632,8 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 	query.addBindValue(user.iId);
 	SQLEXEC();
 
+	std::vector< unsigned int > channelIDs;
+
 	while (query.next()) {
 		unsigned int channelID = query.value(0).toUInt();
 		float volume           = query.value(1).toFloat();
@@ -2436,6 +2641,7 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 
 		if (enabled) {
 			m_channelListenerManager.addListener(user.uiSession, channelID);
+			channelIDs.push_back(channelID);
 		}
 
 		// We load the volume adjustment regardless of whether the listener is currently enabled in case the listener
@@ -2443,39 +2649,46 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 		m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, channelID,
 															 VolumeAdjustment::fromFactor(volume));
 	}
+
+	updateRouting(channelIDs, {});
 }
 
 void Server::addChannelListener(const ServerUser &user, const Channel &channel) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		// Update or insert entry
-		SQLPREP(
-			"SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
+		const int serverID           = iServerNum;
+		const int userID             = user.iId;
+		const unsigned int channelID = channel.iId;
+		ServerDB::queueWrite([serverID, userID, channelID](QSqlQuery &query) {
+			// Update or insert entry
+			SQLPREP("SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND "
+					"`channel_id` = ?");
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
 
-		SQLEXEC();
+			SQLEXEC();
 
-		bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
+			bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
 
-		if (entryAlreadyExists) {
-			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
-					"`channel_id` = ?");
-		} else {
-			SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
-		}
+			if (entryAlreadyExists) {
+				SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
+						"`channel_id` = ?");
+			} else {
+				SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
+			}
 
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
 
-		SQLEXEC();
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.addListener(user.uiSession, channel.iId);
+	// Whisper targets contain the listeners of the targeted channels
+	clearWhisperTargetCache({ channel.iId }, {});
+	updateRouting({ channel.iId }, {});
 }
 
 void Server::disableChannelListener(const ServerUser &user, const Channel &channel) {
@@ -2484,20 +2697,24 @@ void Server::disableChannelListener(const ServerUser &user, const Channel &chann
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		// Explicit cast to int is required for Postgresql
-		query.addBindValue(static_cast< int >(false));
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverID           = iServerNum;
+		const int userID             = user.iId;
+		const unsigned int channelID = channel.iId;
+		ServerDB::queueWrite([serverID, userID, channelID](QSqlQuery &query) {
+			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
+					"`channel_id` = ?");
+			// Explicit cast to int is required for Postgresql
+			query.addBindValue(static_cast< int >(false));
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
+	clearWhisperTargetCache({ channel.iId }, {});
+	updateRouting({ channel.iId }, {});
 }
 
 void Server::deleteChannelListener(const ServerUser &user, const Channel &channel) {
@@ -2506,38 +2723,48 @@ void Server::deleteChannelListener(const ServerUser &user, const Channel &channe
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverID           = iServerNum;
+		const int userID             = user.iId;
+		const unsigned int channelID = channel.iId;
+		ServerDB::queueWrite([serverID, userID, channelID](QSqlQuery &query) {
+			SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
+	clearWhisperTargetCache({ channel.iId }, {});
+	updateRouting({ channel.iId }, {});
 }
 
 void Server::setChannelListenerVolume(const ServerUser &user, const Channel &channel, float volumeAdjustment) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		query.addBindValue(volumeAdjustment);
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverID           = iServerNum;
+		const int userID             = user.iId;
+		const unsigned int channelID = channel.iId;
+		ServerDB::queueWrite([serverID, userID, channelID, volumeAdjustment](QSqlQuery &query) {
+			SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND `user_id` = ? "
+					"AND `channel_id` = ?");
+			query.addBindValue(volumeAdjustment);
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, channel.iId,
 														 VolumeAdjustment::fromFactor(volumeAdjustment));
+	clearWhisperTargetCache({ channel.iId }, {});
+	updateRouting({ channel.iId }, {});
 }
 
 void ServerDB::wipeLogs() {
+	flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2545,6 +2772,8 @@ void ServerDB::wipeLogs() {
 }
 
 QList< QPair< unsigned int, QString > > ServerDB::getLog(int server_id, unsigned int offs_min, unsigned int offs_max) {
+	flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2572,6 +2801,8 @@ QList< QPair< unsigned int, QString > > ServerDB::getLog(int server_id, unsigned
 }
 
 int ServerDB::getLogLen(int server_id) {
+	flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2674,6 +2905,8 @@ int ServerDB::addServer() {
 }
 
 void ServerDB::deleteServer(int server_id) {
+	flushWrites();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("DELETE FROM `%1servers` WHERE `server_id` = ?");
@@ -10,10 +10,13 @@
 
 #include "Timer.h"
 
+#include <functional>
+
 class Server;
 class Channel;
 class User;
 class Connection;
+class DBWriteQueue;
 class QSqlDatabase;
 class QSqlQuery;
 
@@ -62,10 +65,31 @@ public:
 	static bool query(QSqlQuery &, const QString &, bool fatal = true, bool warn = true);
 	static bool exec(QSqlQuery &, const QString &str = QString(), bool fatal = true, bool warn = true);
 	static bool execBatch(QSqlQuery &, const QString &str = QString(), bool fatal = true);
+	/// @returns The connection to be used by the calling thread
+	static QSqlDatabase &database();
+	/// Performs the given write. If the write-behind queue is enabled, this happens later on the database thread,
+	/// together with other writes in a single transaction. Thus the write must not access anything that might be gone
+	/// by then.
+	static void queueWrite(const std::function< void(QSqlQuery &) > &write);
+	/// Blocks until all queued writes have been committed. Has to be called before data that might have been written
+	/// by means of queueWrite is read or written synchronously. Within a transaction, the queued writes are performed
+	/// as part of that transaction instead.
+	static void flushWrites();
+	/// Starts a transaction on the main connection, unless one is running already. The write-behind queue doesn't
+	/// commit until the matching commitTransaction().
+	static void beginTransaction();
+	static void commitTransaction();
 	// No copy; private declaration without implementation
 	ServerDB(const ServerDB &);
 
 private:
+	/// Performs the writes passed to queueWrite. Null if these are performed synchronously.
+	static DBWriteQueue *writeQueue;
+	/// The amount of nested transactions on the main connection. Only the outermost one is an actual transaction.
+	static int transactionDepth;
+	/// Whether the running transaction holds the transaction mutex of writeQueue
+	static bool transactionLocked;
+
 	static void loadOrSetupMetaPBKDF2IterationCount(QSqlQuery &query);
 	static void writeSUPW(int srvnum, const QString &pwHash, const QString &saltHash, const QVariant &kdfIterations);
 };
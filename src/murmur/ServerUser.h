@@ -12,10 +12,10 @@
 #	include "win.h"
 #endif
 
+#include "BandwidthRecord.h"
 #include "ClientType.h"
 #include "Connection.h"
 #include "HostAddress.h"
-#include "Timer.h"
 #include "User.h"
 
 #include <QtCore/QElapsedTimer>
@@ -29,29 +29,6 @@
 
 #include <vector>
 
-// Unfortunately, this needs to be "large enough" to hold
-// enough frames to account for both short-term and
-// long-term "maladjustments".
-
-#define N_BANDWIDTH_SLOTS 360
-
-struct BandwidthRecord {
-	int iRecNum;
-	int iSum;
-	Timer tFirst;
-	Timer tIdleControl;
-	unsigned short a_iBW[N_BANDWIDTH_SLOTS];
-	Timer a_qtWhen[N_BANDWIDTH_SLOTS];
-	mutable QMutex qmMutex;
-
-	BandwidthRecord();
-	bool addFrame(int size, int maxpersec);
-	int onlineSeconds() const;
-	int idleSeconds() const;
-	void resetIdleSeconds();
-	int bandwidth() const;
-};
-
 struct WhisperTarget {
 	struct Channel {
 		unsigned int id;
@@ -66,10 +43,26 @@ struct WhisperTarget {
 
 class ServerUser;
 
+/// The receivers of a whisper target, as computed by Server::createWhisperTargetCacheFor. All lists are sorted by
+/// session ID and don't contain duplicates.
 struct WhisperTargetCache {
-	QSet< ServerUser * > channelTargets;
-	QSet< ServerUser * > directTargets;
-	QHash< ServerUser *, VolumeAdjustment > listeningTargets;
+	struct Listener {
+		ServerUser *user;
+		VolumeAdjustment volumeAdjustment;
+	};
+
+	std::vector< ServerUser * > channelTargets;
+	std::vector< ServerUser * > directTargets;
+	std::vector< Listener > listeningTargets;
+
+	/// The IDs of all channels whose users, listeners, ACLs, links or children went into computing the receivers
+	std::vector< unsigned int > channelDependencies;
+	/// The sessions of all receivers as well as the sessions that are whispered to directly
+	std::vector< unsigned int > sessionDependencies;
+
+	/// @returns Whether the receivers might change if anything about any of the given channels or sessions changes.
+	/// 	Both lists have to be sorted.
+	bool dependsOn(const std::vector< unsigned int > &channelIDs, const std::vector< unsigned int > &sessions) const;
 };
 
 class Server;
@@ -130,6 +123,18 @@ public:
 	bool bVerified;
 	QStringList qslEmail;
 
+	/// A password hash that is computed in the background while the user is authenticating
+	struct PasswordHash {
+		QString salt;
+		int iterations = 0;
+		QString password;
+		/// Empty as long as the hash hasn't been computed yet
+		QString hash;
+	};
+	PasswordHash m_passwordHash;
+	/// Holds whether authenticating the user waits for m_passwordHash to be computed
+	bool m_passwordHashPending;
+
 	HostAddress haAddress;
 
 	/// Holds whether the user is using TCP
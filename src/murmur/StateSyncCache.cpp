@@ -0,0 +1,114 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "StateSyncCache.h"
+
+#include <QtCore/QtEndian>
+
+const QByteArray &StateSyncCache::channelState(unsigned int channelID, const ChannelStateBuilder &build) {
+	auto it = m_channelStates.find(channelID);
+	if (it == m_channelStates.end()) {
+		MumbleProto::ChannelState mpcs;
+		build(mpcs);
+
+		it = m_channelStates.insert(channelID, serialize(mpcs));
+	}
+
+	return *it;
+}
+
+const QByteArray &StateSyncCache::channelLinks(unsigned int channelID, const ChannelStateBuilder &build) {
+	auto it = m_channelLinks.find(channelID);
+	if (it == m_channelLinks.end()) {
+		MumbleProto::ChannelState mpcs;
+		build(mpcs);
+
+		it = m_channelLinks.insert(channelID, mpcs.links_size() > 0 ? serialize(mpcs) : QByteArray());
+	}
+
+	return *it;
+}
+
+const QByteArray &StateSyncCache::userState(unsigned int session, const UserStateBuilder &build) {
+	auto it = m_userStates.find(session);
+	if (it == m_userStates.end()) {
+		MumbleProto::UserState mpus;
+		build(mpus);
+
+		it = m_userStates.insert(session, serialize(mpus));
+	}
+
+	return *it;
+}
+
+void StateSyncCache::messageBroadcast(Mumble::Protocol::TCPMessageType type, const ::google::protobuf::Message &msg) {
+	switch (type) {
+		case Mumble::Protocol::TCPMessageType::ChannelState: {
+			const MumbleProto::ChannelState &mpcs = static_cast< const MumbleProto::ChannelState & >(msg);
+
+			m_channelStates.remove(mpcs.channel_id());
+			m_channelLinks.remove(mpcs.channel_id());
+
+			// Links are mutual, so the linked channels change as well
+			for (unsigned int linkedChannelID : mpcs.links()) {
+				m_channelLinks.remove(linkedChannelID);
+			}
+			for (unsigned int linkedChannelID : mpcs.links_add()) {
+				m_channelLinks.remove(linkedChannelID);
+			}
+			for (unsigned int linkedChannelID : mpcs.links_remove()) {
+				m_channelLinks.remove(linkedChannelID);
+			}
+			break;
+		}
+		case Mumble::Protocol::TCPMessageType::ChannelRemove:
+			// Removing a channel implicitly removes its links, and the users in it are moved elsewhere
+			m_channelStates.remove(static_cast< const MumbleProto::ChannelRemove & >(msg).channel_id());
+			m_channelLinks.clear();
+			break;
+		case Mumble::Protocol::TCPMessageType::UserState:
+			m_userStates.remove(static_cast< const MumbleProto::UserState & >(msg).session());
+			break;
+		case Mumble::Protocol::TCPMessageType::UserRemove:
+			m_userStates.remove(static_cast< const MumbleProto::UserRemove & >(msg).session());
+			break;
+		default:
+			break;
+	}
+}
+
+void StateSyncCache::invalidateChannel(unsigned int channelID) {
+	m_channelStates.remove(channelID);
+}
+
+void StateSyncCache::clear() {
+	m_channelStates.clear();
+	m_channelLinks.clear();
+	m_userStates.clear();
+}
+
+void StateSyncCache::appendMessage(QByteArray &buffer, Mumble::Protocol::TCPMessageType type,
+								   const QByteArray &message, const QByteArray &fields) {
+	unsigned char header[6];
+	qToBigEndian< quint16 >(static_cast< quint16 >(type), &header[0]);
+	qToBigEndian< quint32 >(static_cast< quint32 >(message.size() + fields.size()), &header[2]);
+
+	buffer.append(reinterpret_cast< const char * >(header), sizeof(header));
+	buffer.append(message);
+	buffer.append(fields);
+}
+
+QByteArray StateSyncCache::serialize(const ::google::protobuf::Message &msg) {
+#if GOOGLE_PROTOBUF_VERSION >= 3004000
+	const std::size_t len = msg.ByteSizeLong();
+#else
+	// ByteSize() has been deprecated as of protobuf v3.4
+	const std::size_t len = static_cast< std::size_t >(msg.ByteSize());
+#endif
+	QByteArray serialized(static_cast< int >(len), Qt::Uninitialized);
+	msg.SerializeToArray(serialized.data(), static_cast< int >(len));
+
+	return serialized;
+}
@@ -0,0 +1,62 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_STATESYNCCACHE_H_
+#define MUMBLE_MURMUR_STATESYNCCACHE_H_
+
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+
+#include <functional>
+
+/// Caches the serialised ChannelState and UserState messages that make up the state a client receives after it has
+/// authenticated, so that these don't have to be built and serialised again for every client that joins.
+///
+/// The cached messages are the ones sent to clients of version 1.2.2 or newer and don't contain any fields that depend
+/// on the receiving client. Such fields are serialised separately and appended when sending, which protobuf parses
+/// as if they had been part of the message in the first place.
+///
+/// Whenever the state of a channel or user changes, the change is broadcast to all clients. The cache listens to
+/// these broadcasts in order to drop the affected messages. Changes that aren't broadcast have to be reported
+/// explicitly.
+class StateSyncCache {
+public:
+	using ChannelStateBuilder = std::function< void(MumbleProto::ChannelState &) >;
+	using UserStateBuilder    = std::function< void(MumbleProto::UserState &) >;
+
+	/// @returns The state of the given channel (without its links), which is built by the given function if it isn't
+	/// 	cached yet
+	const QByteArray &channelState(unsigned int channelID, const ChannelStateBuilder &build);
+	/// @returns The links of the given channel, which are built by the given function if they aren't cached yet. Empty
+	/// 	if the channel isn't linked.
+	const QByteArray &channelLinks(unsigned int channelID, const ChannelStateBuilder &build);
+	/// @returns The state of the user with the given session, which is built by the given function if it isn't cached
+	/// 	yet
+	const QByteArray &userState(unsigned int session, const UserStateBuilder &build);
+
+	/// Drops the messages affected by the given message, which is about to be broadcast
+	void messageBroadcast(Mumble::Protocol::TCPMessageType type, const ::google::protobuf::Message &msg);
+	/// Drops the state of the given channel
+	void invalidateChannel(unsigned int channelID);
+	/// Drops all cached messages
+	void clear();
+
+	/// Appends the given serialised message, followed by the given serialised fields, to the given buffer in the
+	/// format messages are sent over the network in
+	static void appendMessage(QByteArray &buffer, Mumble::Protocol::TCPMessageType type, const QByteArray &message,
+							  const QByteArray &fields = QByteArray());
+	/// @returns The given message in serialised form
+	static QByteArray serialize(const ::google::protobuf::Message &msg);
+
+protected:
+	QHash< unsigned int, QByteArray > m_channelStates;
+	QHash< unsigned int, QByteArray > m_channelLinks;
+	QHash< unsigned int, QByteArray > m_userStates;
+};
+
+#endif
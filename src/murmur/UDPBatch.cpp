@@ -0,0 +1,254 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UDPBatch.h"
+
+#include "HostAddress.h"
+#include "Meta.h"
+#include "Utils.h"
+
+#ifdef Q_OS_WIN
+#	include <qos2.h>
+#	include <ws2tcpip.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+using send_size_t = int;
+#else
+using send_size_t = std::size_t;
+#endif
+
+void UDPDatagram::reply(const unsigned char *replyData, std::size_t replyLength) const {
+#ifdef Q_OS_LINUX
+	// There will be space for only one header, and the only data we have asked for is the incoming
+	// address. So we can reuse most of the same msg and control data.
+	// We are only reading from the buffer and thus the const_cast should be fine
+	header->msg_iov[0].iov_base = const_cast< unsigned char * >(replyData);
+	header->msg_iov[0].iov_len  = replyLength;
+	::sendmsg(socket, header, 0);
+#else
+	::sendto(socket, reinterpret_cast< const char * >(replyData), static_cast< send_size_t >(replyLength), 0,
+			 reinterpret_cast< struct sockaddr * >(from), fromLength);
+#endif
+}
+
+#ifdef Q_OS_LINUX
+UDPReceiveBatch::UDPReceiveBatch(std::size_t capacity) {
+	setCapacity(capacity);
+}
+
+void UDPReceiveBatch::setCapacity(std::size_t capacity) {
+	capacity = std::max(capacity, static_cast< std::size_t >(1));
+
+	m_slots.resize(capacity);
+	m_headers.resize(capacity);
+}
+
+std::size_t UDPReceiveBatch::capacity() const {
+	return m_slots.size();
+}
+
+int UDPReceiveBatch::receive(int socket) {
+	m_socket = socket;
+
+	for (std::size_t i = 0; i < m_slots.size(); ++i) {
+		Slot &slot = m_slots[i];
+
+#	if defined(__LP64__)
+		slot.iov.iov_base = slot.data + 4;
+#	else
+		slot.iov.iov_base = slot.data;
+#	endif
+		slot.iov.iov_len = Mumble::Protocol::MAX_UDP_PACKET_SIZE;
+
+		struct msghdr &msg = m_headers[i].msg_hdr;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name       = reinterpret_cast< struct sockaddr * >(&slot.from);
+		msg.msg_namelen    = sizeof(slot.from);
+		msg.msg_iov        = &slot.iov;
+		msg.msg_iovlen     = 1;
+		msg.msg_control    = slot.control;
+		msg.msg_controllen = sizeof(slot.control);
+
+		m_headers[i].msg_len = 0;
+	}
+
+	// MSG_TRUNC makes msg_len report the real size of datagrams that did not fit into the buffer, which
+	// allows to discard them later on instead of processing a cut-off packet.
+	int received;
+	do {
+		received = ::recvmmsg(socket, m_headers.data(), static_cast< unsigned int >(m_headers.size()),
+							  MSG_DONTWAIT | MSG_TRUNC, nullptr);
+	} while (received < 0 && errno == EINTR);
+
+	return received;
+}
+
+UDPDatagram UDPReceiveBatch::datagram(std::size_t index) {
+	Slot &slot = m_slots[index];
+
+	UDPDatagram datagram;
+	datagram.socket     = m_socket;
+	datagram.data       = static_cast< unsigned char * >(slot.iov.iov_base);
+	datagram.length     = static_cast< qint32 >(m_headers[index].msg_len);
+	datagram.from       = &slot.from;
+	datagram.fromLength = m_headers[index].msg_hdr.msg_namelen;
+	datagram.header     = &m_headers[index].msg_hdr;
+
+	return datagram;
+}
+#endif
+
+
+UDPSendBatch::UDPSendBatch(std::size_t capacity) : m_socket(INVALID_SOCKET) {
+	setCapacity(capacity);
+}
+
+void UDPSendBatch::setCapacity(std::size_t capacity) {
+	flush();
+
+#ifdef Q_OS_LINUX
+	capacity = std::min(std::max(capacity, static_cast< std::size_t >(1)), MAX_CAPACITY);
+
+	m_headers.resize(capacity);
+#else
+	// Without sendmmsg() every datagram is sent right away and thus a single buffer suffices
+	capacity = 1;
+#endif
+	m_slots.resize(capacity);
+}
+
+std::size_t UDPSendBatch::capacity() const {
+	return m_slots.size();
+}
+
+unsigned char *UDPSendBatch::nextBuffer() {
+#if defined(__LP64__)
+	return m_slots[m_size].data + 4;
+#else
+	return m_slots[m_size].data;
+#endif
+}
+
+void UDPSendBatch::commit(udp_socket_t socket, const sockaddr_storage &to, const sockaddr_storage &localAddress,
+						  std::size_t length) {
+#ifdef Q_OS_LINUX
+	if (m_size > 0 && socket != m_socket) {
+		// sendmmsg() can only send on a single socket at once
+		unsigned char *buffer = nextBuffer();
+		flush();
+		memmove(nextBuffer(), buffer, length);
+	}
+#endif
+
+	enqueue(socket, to, localAddress, nextBuffer(), length);
+}
+
+void UDPSendBatch::commit(udp_socket_t socket, const sockaddr_storage &to, const sockaddr_storage &localAddress,
+						  const unsigned char *data, std::size_t length) {
+#ifdef Q_OS_LINUX
+	if (m_size > 0 && socket != m_socket) {
+		flush();
+	}
+#endif
+
+	enqueue(socket, to, localAddress, data, length);
+}
+
+void UDPSendBatch::enqueue(udp_socket_t socket, const sockaddr_storage &to, const sockaddr_storage &localAddress,
+						   const unsigned char *data, std::size_t length) {
+#ifdef Q_OS_LINUX
+	Slot &slot = m_slots[m_size];
+
+	memcpy(&slot.to, &to, sizeof(to));
+	// The datagram is only read from and thus the const_cast should be fine
+	slot.iov.iov_base = const_cast< unsigned char * >(data);
+	slot.iov.iov_len  = length;
+
+	memset(slot.control, 0, sizeof(slot.control));
+
+	struct msghdr &msg = m_headers[m_size].msg_hdr;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name    = reinterpret_cast< struct sockaddr * >(&slot.to);
+	msg.msg_namelen = static_cast< socklen_t >((to.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6)
+																		   : sizeof(struct sockaddr_in));
+	msg.msg_iov        = &slot.iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = slot.control;
+	msg.msg_controllen =
+		CMSG_SPACE((to.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo) : sizeof(struct in_pktinfo));
+
+	// Make sure the datagram originates from the address the client is connected to via TCP
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	HostAddress tcpha(localAddress);
+	if (to.ss_family == AF_INET6) {
+		cmsg->cmsg_level            = IPPROTO_IPV6;
+		cmsg->cmsg_type             = IPV6_PKTINFO;
+		cmsg->cmsg_len              = CMSG_LEN(sizeof(struct in6_pktinfo));
+		struct in6_pktinfo *pktinfo = reinterpret_cast< struct in6_pktinfo * >(CMSG_DATA(cmsg));
+		memcpy(&pktinfo->ipi6_addr.s6_addr[0], tcpha.getByteRepresentation().data(),
+			   sizeof(pktinfo->ipi6_addr.s6_addr));
+	} else {
+		if (tcpha.isV6())
+			return;
+
+		cmsg->cmsg_level             = IPPROTO_IP;
+		cmsg->cmsg_type              = IP_PKTINFO;
+		cmsg->cmsg_len               = CMSG_LEN(sizeof(struct in_pktinfo));
+		struct in_pktinfo *pktinfo   = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
+		pktinfo->ipi_spec_dst.s_addr = tcpha.toIPv4();
+	}
+
+	m_socket = socket;
+	++m_size;
+
+	if (m_size == m_slots.size()) {
+		flush();
+	}
+#else
+	Q_UNUSED(localAddress);
+
+#	ifdef Q_OS_WIN
+	DWORD dwFlow = 0;
+	if (Meta::hQoS)
+		QOSAddSocketToFlow(Meta::hQoS, socket,
+						   reinterpret_cast< struct sockaddr * >(const_cast< sockaddr_storage * >(&to)),
+						   QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&dwFlow));
+#	endif
+	::sendto(socket, reinterpret_cast< const char * >(data), static_cast< send_size_t >(length), 0,
+			 reinterpret_cast< const struct sockaddr * >(&to),
+			 (to.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+#	ifdef Q_OS_WIN
+	if (Meta::hQoS && dwFlow)
+		QOSRemoveSocketFromFlow(Meta::hQoS, 0, dwFlow, 0);
+#	endif
+#endif
+}
+
+void UDPSendBatch::flush() {
+#ifdef Q_OS_LINUX
+	std::size_t sent = 0;
+	while (sent < m_size) {
+		int ret = ::sendmmsg(m_socket, &m_headers[sent], static_cast< unsigned int >(m_size - sent), 0);
+		if (ret > 0) {
+			sent += static_cast< std::size_t >(ret);
+		} else if (ret < 0 && errno == EINTR) {
+			continue;
+		} else {
+			// The datagram at the front could not be sent. Drop it just like a failing sendmsg() would have
+			// and carry on with the rest of the batch.
+			++sent;
+		}
+	}
+#endif
+	m_size = 0;
+}
+
+std::size_t UDPSendBatch::size() const {
+	return m_size;
+}
@@ -0,0 +1,150 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_UDPBATCH_H_
+#define MUMBLE_MURMUR_UDPBATCH_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QtGlobal>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#else
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef Q_OS_WIN
+using udp_socket_t  = SOCKET;
+using udp_socklen_t = int;
+#else
+using udp_socket_t  = int;
+using udp_socklen_t = socklen_t;
+#endif
+
+/// A single datagram as received by the voice thread.
+struct UDPDatagram {
+	udp_socket_t socket;
+	/// Points to the encrypted payload. On LP64 platforms the payload is placed
+	/// such that everything after the 4 byte crypt header is 8-byte aligned.
+	unsigned char *data;
+	qint32 length;
+	sockaddr_storage *from;
+	udp_socklen_t fromLength;
+#ifdef Q_OS_LINUX
+	/// The header this datagram has been received with. Its control data holds the
+	/// IP_PKTINFO of the incoming datagram, which is reused for replies so that they
+	/// originate from the address the client has sent the datagram to.
+	struct msghdr *header;
+#endif
+
+	/// Sends the given (unencrypted) data back to the sender of this datagram.
+	void reply(const unsigned char *replyData, std::size_t replyLength) const;
+};
+
+#ifdef Q_OS_LINUX
+/// Receives up to capacity() datagrams from a socket with a single recvmmsg() call.
+class UDPReceiveBatch {
+public:
+	UDPReceiveBatch(std::size_t capacity = 1);
+
+	void setCapacity(std::size_t capacity);
+	std::size_t capacity() const;
+
+	/// Receives as many datagrams as are available (but at most capacity()) without blocking.
+	/// @returns The number of datagrams received or -1 on error
+	int receive(int socket);
+
+	/// @returns The datagram with the given index as filled in by the last call to receive()
+	UDPDatagram datagram(std::size_t index);
+
+protected:
+	struct Slot {
+		alignas(8) unsigned char data[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+		sockaddr_storage from;
+		struct iovec iov;
+		uint8_t control[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+	};
+
+	int m_socket = -1;
+	std::vector< Slot > m_slots;
+	std::vector< struct mmsghdr > m_headers;
+};
+#endif
+
+/// Collects encrypted voice datagrams so that a whole fan-out can be handed to the
+/// kernel at once. On Linux the queued datagrams are sent with a single sendmmsg()
+/// call per socket, everywhere else every datagram is sent as soon as it is committed.
+class UDPSendBatch {
+public:
+	/// The maximum amount of datagrams sent with a single system call (UIO_MAXIOV)
+	static constexpr std::size_t MAX_CAPACITY = 1024;
+
+	UDPSendBatch(std::size_t capacity = 1);
+
+	/// Sets the amount of datagrams that are queued before they are sent. This flushes
+	/// any datagrams that are currently queued.
+	void setCapacity(std::size_t capacity);
+	std::size_t capacity() const;
+
+	/// @returns A buffer of MAX_UDP_PACKET_SIZE + 4 bytes the next datagram can be written to. On LP64
+	/// 	platforms everything after the first 4 bytes of the buffer is 8-byte aligned.
+	unsigned char *nextBuffer();
+
+	/// Queues the datagram that has been written to the buffer returned by the last call to nextBuffer().
+	///
+	/// @param socket The socket to send the datagram on
+	/// @param to The address of the receiver
+	/// @param localAddress The local address the datagram shall originate from
+	/// @param length The length of the datagram
+	void commit(udp_socket_t socket, const sockaddr_storage &to, const sockaddr_storage &localAddress,
+				std::size_t length);
+
+	/// Queues a datagram that lives in a buffer outside of the batch. The buffer has to stay valid until the
+	/// batch gets flushed, as the datagram is not copied into the batch.
+	///
+	/// @param socket The socket to send the datagram on
+	/// @param to The address of the receiver
+	/// @param localAddress The local address the datagram shall originate from
+	/// @param data The datagram
+	/// @param length The length of the datagram
+	void commit(udp_socket_t socket, const sockaddr_storage &to, const sockaddr_storage &localAddress,
+				const unsigned char *data, std::size_t length);
+
+	/// Sends all queued datagrams
+	void flush();
+
+	/// @returns The amount of currently queued datagrams
+	std::size_t size() const;
+
+protected:
+	struct Slot {
+		alignas(8) unsigned char data[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+#ifdef Q_OS_LINUX
+		sockaddr_storage to;
+		struct iovec iov;
+		uint8_t control[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+#endif
+	};
+
+	udp_socket_t m_socket;
+	std::size_t m_size = 0;
+	std::vector< Slot > m_slots;
+#ifdef Q_OS_LINUX
+	std::vector< struct mmsghdr > m_headers;
+#endif
+
+	void enqueue(udp_socket_t socket, const sockaddr_storage &to, const sockaddr_storage &localAddress,
+				 const unsigned char *data, std::size_t length);
+};
+
+#endif
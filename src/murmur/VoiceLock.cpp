@@ -0,0 +1,124 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "VoiceLock.h"
+
+#include <QtCore/QThread>
+
+#include <algorithm>
+#include <new>
+
+thread_local std::size_t VoiceLock::s_threadSlot = 0;
+
+void VoiceLock::SlotsDeleter::operator()(Slot *slots) const {
+	for (std::size_t i = 0; i < count; ++i) {
+		slots[i].~Slot();
+	}
+
+	qFreeAligned(slots);
+}
+
+VoiceLock::VoiceLock(std::size_t slots) : m_slots(nullptr, SlotsDeleter{ 0 }), m_slotCount(0), m_writer(nullptr) {
+	setSlotCount(slots);
+}
+
+void VoiceLock::setSlotCount(std::size_t slots) {
+	m_slotCount = std::max(slots, static_cast< std::size_t >(1));
+
+	void *memory = qMallocAligned(m_slotCount * sizeof(Slot), alignof(Slot));
+	if (!memory) {
+		throw std::bad_alloc();
+	}
+
+	Slot *newSlots = static_cast< Slot * >(memory);
+	for (std::size_t i = 0; i < m_slotCount; ++i) {
+		new (&newSlots[i]) Slot();
+	}
+
+	m_slots = std::unique_ptr< Slot[], SlotsDeleter >(newSlots, SlotsDeleter{ m_slotCount });
+}
+
+std::size_t VoiceLock::slotCount() const {
+	return m_slotCount;
+}
+
+QReadWriteLock &VoiceLock::readSlot() {
+	return m_slots[s_threadSlot % m_slotCount].lock;
+}
+
+void VoiceLock::lockForRead() {
+	readSlot().lockForRead();
+}
+
+void VoiceLock::lockForWrite() {
+	// Always lock the slots in the same order to avoid deadlocks between writers
+	for (std::size_t i = 0; i < m_slotCount; ++i) {
+		m_slots[i].lock.lockForWrite();
+	}
+
+	m_writer.store(QThread::currentThreadId(), std::memory_order_release);
+}
+
+void VoiceLock::unlock() {
+	if (m_writer.load(std::memory_order_acquire) == QThread::currentThreadId()) {
+		m_writer.store(nullptr, std::memory_order_release);
+
+		for (std::size_t i = m_slotCount; i > 0; --i) {
+			m_slots[i - 1].lock.unlock();
+		}
+	} else {
+		readSlot().unlock();
+	}
+}
+
+void VoiceLock::setThreadSlot(std::size_t slot) {
+	s_threadSlot = slot;
+}
+
+
+VoiceReadLocker::VoiceReadLocker(VoiceLock *lock) : m_lock(lock), m_locked(false) {
+	relock();
+}
+
+VoiceReadLocker::~VoiceReadLocker() {
+	unlock();
+}
+
+void VoiceReadLocker::unlock() {
+	if (m_locked) {
+		m_lock->unlock();
+		m_locked = false;
+	}
+}
+
+void VoiceReadLocker::relock() {
+	if (!m_locked) {
+		m_lock->lockForRead();
+		m_locked = true;
+	}
+}
+
+
+VoiceWriteLocker::VoiceWriteLocker(VoiceLock *lock) : m_lock(lock), m_locked(false) {
+	relock();
+}
+
+VoiceWriteLocker::~VoiceWriteLocker() {
+	unlock();
+}
+
+void VoiceWriteLocker::unlock() {
+	if (m_locked) {
+		m_lock->unlock();
+		m_locked = false;
+	}
+}
+
+void VoiceWriteLocker::relock() {
+	if (!m_locked) {
+		m_lock->lockForWrite();
+		m_locked = true;
+	}
+}
@@ -0,0 +1,94 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICELOCK_H_
+#define MUMBLE_MURMUR_VOICELOCK_H_
+
+#include <QtCore/QReadWriteLock>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/// A read-write lock that is optimized for many threads reading concurrently.
+///
+/// The lock consists of multiple slots, each of which is a separate QReadWriteLock
+/// living on its own cache line. A thread that wants to read only locks the slot
+/// that has been assigned to it (see setThreadSlot), which means that readers on
+/// different slots never touch shared memory. Writers on the other hand have to
+/// lock every slot.
+///
+/// This is used to let multiple voice threads read the Server's data at the same
+/// time, while the (rare) writes from the main thread exclude all of them.
+class VoiceLock {
+public:
+	explicit VoiceLock(std::size_t slots = 1);
+
+	/// Changes the amount of slots. This must only be called while nobody holds the lock.
+	void setSlotCount(std::size_t slots);
+	std::size_t slotCount() const;
+
+	void lockForRead();
+	void lockForWrite();
+	/// Releases the lock, regardless of whether it has been locked for reading or for writing.
+	void unlock();
+
+	/// Assigns the calling thread to the given slot. Threads that don't call this use slot 0.
+	static void setThreadSlot(std::size_t slot);
+
+protected:
+	/// Every slot lives on its own cache line (two on CPUs that prefetch pairs of them) to avoid false sharing
+	/// between readers
+	struct alignas(128) Slot {
+		QReadWriteLock lock;
+	};
+
+	/// Destroys the slots and frees their memory. Before C++17, new[] ignores the alignment of over-aligned types,
+	/// so the slots are allocated with qMallocAligned().
+	struct SlotsDeleter {
+		std::size_t count;
+
+		void operator()(Slot *slots) const;
+	};
+
+	std::unique_ptr< Slot[], SlotsDeleter > m_slots;
+	std::size_t m_slotCount;
+	/// The thread that currently holds the write lock (if any)
+	std::atomic< Qt::HANDLE > m_writer;
+
+	static thread_local std::size_t s_threadSlot;
+
+	QReadWriteLock &readSlot();
+};
+
+/// Counterpart of QReadLocker for VoiceLock
+class VoiceReadLocker {
+public:
+	explicit VoiceReadLocker(VoiceLock *lock);
+	~VoiceReadLocker();
+
+	void unlock();
+	void relock();
+
+protected:
+	VoiceLock *m_lock;
+	bool m_locked;
+};
+
+/// Counterpart of QWriteLocker for VoiceLock
+class VoiceWriteLocker {
+public:
+	explicit VoiceWriteLocker(VoiceLock *lock);
+	~VoiceWriteLocker();
+
+	void unlock();
+	void relock();
+
+protected:
+	VoiceLock *m_lock;
+	bool m_locked;
+};
+
+#endif
@@ -0,0 +1,178 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "VoiceThreadPool.h"
+
+#ifdef Q_OS_LINUX
+#	include "Server.h"
+#	include "UDPBatch.h"
+#	include "VoiceLock.h"
+
+#	include <QtCore/QMutexLocker>
+#	include <QtCore/QReadLocker>
+#	include <QtCore/QThread>
+#	include <QtCore/QWriteLocker>
+
+#	include <tracy/Tracy.hpp>
+
+#	include <cerrno>
+#	include <cstdint>
+
+#	include <sys/epoll.h>
+#	include <sys/eventfd.h>
+#	include <unistd.h>
+
+class VoiceThreadPool::Worker : public QThread {
+public:
+	Worker(VoiceThreadPool &pool) : QThread(), m_pool(pool) {}
+
+protected:
+	VoiceThreadPool &m_pool;
+
+	void run() Q_DECL_OVERRIDE {
+		tracy::SetThreadName("Audio");
+
+		m_pool.workerLoop();
+	}
+};
+
+VoiceThreadPool::VoiceThreadPool(std::size_t threadCount, std::size_t batchSize) : m_batchSize(batchSize) {
+	m_epoll     = epoll_create1(EPOLL_CLOEXEC);
+	m_stopEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (m_epoll < 0 || m_stopEvent < 0) {
+		qFatal("VoiceThreadPool: Failed to create epoll instance");
+	}
+
+	// The stop event is level-triggered and never read, so that every thread gets to see it
+	struct epoll_event event;
+	event.events  = EPOLLIN;
+	event.data.fd = m_stopEvent;
+	epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_stopEvent, &event);
+
+	for (std::size_t i = 0; i < threadCount; ++i) {
+		m_workers.push_back(std::make_unique< Worker >(*this));
+		m_workers.back()->start(QThread::HighestPriority);
+	}
+}
+
+VoiceThreadPool::~VoiceThreadPool() {
+	const std::uint64_t value = 1;
+	if (::write(m_stopEvent, &value, sizeof(value)) != sizeof(value)) {
+		qWarning("VoiceThreadPool: Failed to signal voice threads");
+	}
+
+	for (std::unique_ptr< Worker > &worker : m_workers) {
+		worker->wait();
+	}
+
+	close(m_stopEvent);
+	close(m_epoll);
+}
+
+std::size_t VoiceThreadPool::threadCount() const {
+	return m_workers.size();
+}
+
+void VoiceThreadPool::addSockets(Server &server, std::size_t contextIndex, const QList< int > &sockets) {
+	std::shared_ptr< Context > context = std::make_shared< Context >();
+	context->server                    = &server;
+	context->index                     = contextIndex;
+
+	QWriteLocker l(&m_socketsLock);
+
+	for (int socket : sockets) {
+		m_sockets.insert(socket, context);
+
+		struct epoll_event event;
+		event.events  = EPOLLIN | EPOLLONESHOT;
+		event.data.fd = socket;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, socket, &event) != 0) {
+			server.log(QString("Failed to add UDP socket to the shared voice threads: %1").arg(errno));
+		}
+	}
+}
+
+void VoiceThreadPool::removeServer(Server &server) {
+	std::vector< std::shared_ptr< Context > > removed;
+
+	{
+		QWriteLocker l(&m_socketsLock);
+
+		for (auto it = m_sockets.begin(); it != m_sockets.end();) {
+			if (it.value()->server == &server) {
+				epoll_ctl(m_epoll, EPOLL_CTL_DEL, it.key(), nullptr);
+				removed.push_back(it.value());
+				it = m_sockets.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	// Threads that have picked up one of the sockets before it got removed might still be processing its datagrams
+	for (std::shared_ptr< Context > &context : removed) {
+		QMutexLocker l(&context->mutex);
+		context->removed = true;
+	}
+}
+
+void VoiceThreadPool::workerLoop() {
+	UDPReceiveBatch receiveBatch(m_batchSize);
+	struct epoll_event ready;
+
+	while (true) {
+		// Only a single socket is picked up at a time: As the sockets are ONESHOT, every further socket reported by
+		// the same call would wait for this thread to finish the previous ones, while other threads might be idle.
+		const int count = epoll_wait(m_epoll, &ready, 1, -1);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			qCritical("VoiceThreadPool: epoll_wait failure");
+			return;
+		}
+
+		if (count == 0) {
+			continue;
+		}
+
+		const int socket = ready.data.fd;
+
+		if (socket == m_stopEvent) {
+			return;
+		}
+
+		std::shared_ptr< Context > context;
+		{
+			QReadLocker l(&m_socketsLock);
+			context = m_sockets.value(socket);
+		}
+
+		// The socket has been removed in the meantime
+		if (!context) {
+			continue;
+		}
+
+		{
+			QMutexLocker l(&context->mutex);
+			if (context->removed) {
+				continue;
+			}
+
+			VoiceLock::setThreadSlot(context->index);
+
+			context->server->receiveVoice(context->index, socket, receiveBatch);
+		}
+
+		// Datagrams that didn't fit into the batch make the socket report again right away. If the socket has been
+		// removed in the meantime, this either fails or re-arms a socket that has been added with the same descriptor
+		// since, which is harmless as the contexts are locked anyway.
+		struct epoll_event event;
+		event.events  = EPOLLIN | EPOLLONESHOT;
+		event.data.fd = socket;
+		epoll_ctl(m_epoll, EPOLL_CTL_MOD, socket, &event);
+	}
+}
+#endif
@@ -0,0 +1,75 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICETHREADPOOL_H_
+#define MUMBLE_MURMUR_VOICETHREADPOOL_H_
+
+#include <QtCore/QtGlobal>
+
+#ifdef Q_OS_LINUX
+#	include <QtCore/QHash>
+#	include <QtCore/QList>
+#	include <QtCore/QMutex>
+#	include <QtCore/QReadWriteLock>
+
+#	include <cstddef>
+#	include <memory>
+#	include <vector>
+
+class Server;
+
+/// A fixed set of voice threads shared by all virtual servers of the process (Linux only).
+///
+/// Without the pool, every virtual server that has users runs voice threads of its own, which for hosts with many
+/// small virtual servers means lots of mostly idle threads. The pool instead waits for the UDP sockets of all
+/// servers with a single epoll instance. Sockets are registered with EPOLLONESHOT, such that a socket is only ever
+/// handled by one thread, which re-arms it once it has received the queued datagrams. Threads pick up one socket at
+/// a time, so that ready sockets are spread across all idle threads.
+///
+/// The datagrams are routed with the VoiceThreadContext the socket belongs to, so the state of the servers stays
+/// as isolated as with voice threads of their own.
+class VoiceThreadPool {
+public:
+	/// @param threadCount The amount of threads
+	/// @param batchSize The maximum amount of datagrams received with a single system call
+	VoiceThreadPool(std::size_t threadCount, std::size_t batchSize);
+	~VoiceThreadPool();
+
+	std::size_t threadCount() const;
+
+	/// Starts routing the datagrams arriving on the given sockets with the voice thread context of the given server
+	/// that has the given index
+	void addSockets(Server &server, std::size_t contextIndex, const QList< int > &sockets);
+	/// Stops routing the datagrams of the given server. Returns once none of the threads is processing datagrams of
+	/// the server anymore.
+	void removeServer(Server &server);
+
+protected:
+	class Worker;
+
+	struct Context {
+		Server *server;
+		std::size_t index;
+		/// Held while datagrams are processed with the context. The sockets of a context (one per bind address)
+		/// might become readable at the same time, but a context must only be used by one thread at a time.
+		QMutex mutex;
+		/// Whether the context has been removed from the pool. Protected by mutex.
+		bool removed = false;
+	};
+
+	int m_epoll;
+	/// Becomes readable once the threads are supposed to stop
+	int m_stopEvent;
+	std::size_t m_batchSize;
+	/// The context every registered socket belongs to
+	QHash< int, std::shared_ptr< Context > > m_sockets;
+	QReadWriteLock m_socketsLock;
+	std::vector< std::unique_ptr< Worker > > m_workers;
+
+	void workerLoop();
+};
+#endif
+
+#endif
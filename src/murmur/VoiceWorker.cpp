@@ -0,0 +1,22 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "VoiceWorker.h"
+
+#include "Server.h"
+#include "VoiceLock.h"
+
+#include <tracy/Tracy.hpp>
+
+VoiceWorker::VoiceWorker(Server &server, std::size_t index) : QThread(), m_server(server), m_index(index) {
+}
+
+void VoiceWorker::run() {
+	tracy::SetThreadName("Audio");
+
+	VoiceLock::setThreadSlot(m_index);
+
+	m_server.voiceLoop(m_index);
+}
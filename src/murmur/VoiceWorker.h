@@ -0,0 +1,89 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICEWORKER_H_
+#define MUMBLE_MURMUR_VOICEWORKER_H_
+
+#include "AudioReceiverBuffer.h"
+#include "CryptWorkerPool.h"
+#include "MumbleProtocol.h"
+#include "RoutingSnapshot.h"
+#include "SPSCQueue.h"
+#include "UDPBatch.h"
+
+#ifdef USE_SERVER_MIXING
+#	include "AudioMixer.h"
+#endif
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QThread>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Server;
+
+/// A voice packet that has to be tunnelled through the TCP connection of a user, which
+/// can only be written to from the main thread.
+struct TunnelledVoice {
+	/// The complete UDPTunnel message. It is shared among all receivers of the same packet.
+	QByteArray message;
+	unsigned int session;
+};
+
+/// All state a thread needs for routing voice packets. Every voice thread owns one
+/// of these, so that packets can be decoded, re-encoded and sent without having to
+/// synchronize with any of the other voice threads.
+struct VoiceThreadContext {
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > decoder;
+	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > pingEncoder;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > audioEncoder;
+	AudioReceiverBuffer receivers;
+	/// The time (see Timer::now()) the packets currently being processed have been received at. It is read once per
+	/// batch of packets.
+	quint64 receiveTime = 0;
+	UDPSendBatch sendBatch;
+	CryptFanout fanout;
+	/// The indices of the entries of the fan-out, grouped by the socket they are sent on
+	std::vector< std::size_t > fanoutOrder;
+
+	/// The voice packets to be sent to users that don't use UDP. The queue is drained by the main thread.
+	SPSCQueue< TunnelledVoice > tunnelQueue{ 4096 };
+
+	/// The routing snapshot this thread is using and the version it had when it was fetched
+	std::shared_ptr< const RoutingSnapshot > routing;
+	unsigned int routingVersion = 0;
+
+#ifdef USE_SERVER_MIXING
+	/// The output of the last AudioMixer this thread has handed a frame to
+	std::vector< AudioMixer::Frame > mixedFrames;
+#endif
+
+	/// The UDP sockets this thread is receiving on. If there are multiple voice threads,
+	/// every thread has its own SO_REUSEPORT socket per bind address and the kernel
+	/// distributes the clients among them.
+	QList< udp_socket_t > sockets;
+};
+
+/// An additional voice thread of a Server. The first voice thread is the Server
+/// thread itself, every further one is represented by a VoiceWorker.
+class VoiceWorker : public QThread {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(VoiceWorker)
+
+public:
+	VoiceWorker(Server &server, std::size_t index);
+
+protected:
+	Server &m_server;
+	std::size_t m_index;
+
+	void run() Q_DECL_OVERRIDE;
+};
+
+#endif
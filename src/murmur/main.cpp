@@ -173,6 +173,9 @@ void cleanup(int signum) {
 
 	meta->killAll();
 
+	// The ServerDB isn't destroyed on exit, so the pending writes have to be committed explicitly
+	ServerDB::flushWrites();
+
 	qWarning("Shutting down");
 
 #ifdef USE_DBUS
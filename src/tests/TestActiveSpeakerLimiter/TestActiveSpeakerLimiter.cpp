@@ -0,0 +1,125 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ActiveSpeakerLimiter.h"
+
+#include <QObject>
+#include <QtTest>
+
+static constexpr quint64 START = 1234567890ULL;
+static constexpr quint64 FRAME = 20 * 1000ULL;
+
+static constexpr unsigned int CHANNEL = 1;
+
+class TestActiveSpeakerLimiter : public QObject {
+	Q_OBJECT
+private slots:
+	void limit();
+	void terminator();
+	void timeout();
+	void channels();
+	void unorderedTimes();
+	void preemption();
+};
+
+void TestActiveSpeakerLimiter::limit() {
+	ActiveSpeakerLimiter limiter;
+
+	QVERIFY(limiter.admit(CHANNEL, 1, 2, false, START));
+	QVERIFY(limiter.admit(CHANNEL, 2, 2, false, START));
+	QVERIFY(!limiter.admit(CHANNEL, 3, 2, false, START));
+
+	// The speakers that got a slot keep it while they keep speaking
+	for (quint64 time = START + FRAME; time < START + 100 * FRAME; time += FRAME) {
+		QVERIFY(limiter.admit(CHANNEL, 1, 2, false, time));
+		QVERIFY(limiter.admit(CHANNEL, 2, 2, false, time));
+		QVERIFY(!limiter.admit(CHANNEL, 3, 2, false, time));
+	}
+
+	QCOMPARE(limiter.activeSpeakers(CHANNEL), static_cast< std::size_t >(2));
+}
+
+void TestActiveSpeakerLimiter::terminator() {
+	ActiveSpeakerLimiter limiter;
+
+	QVERIFY(limiter.admit(CHANNEL, 1, 1, false, START));
+	QVERIFY(!limiter.admit(CHANNEL, 2, 1, false, START + FRAME));
+	// The terminator of a speaker without a slot is dropped as well
+	QVERIFY(!limiter.admit(CHANNEL, 2, 1, true, START + FRAME));
+
+	// The terminator is forwarded and frees the slot
+	QVERIFY(limiter.admit(CHANNEL, 1, 1, true, START + 2 * FRAME));
+	QCOMPARE(limiter.activeSpeakers(CHANNEL), static_cast< std::size_t >(0));
+
+	QVERIFY(limiter.admit(CHANNEL, 2, 1, false, START + 3 * FRAME));
+	QVERIFY(!limiter.admit(CHANNEL, 1, 1, false, START + 3 * FRAME));
+}
+
+void TestActiveSpeakerLimiter::timeout() {
+	ActiveSpeakerLimiter limiter;
+
+	QVERIFY(limiter.admit(CHANNEL, 1, 1, false, START));
+	QVERIFY(!limiter.admit(CHANNEL, 2, 1, false, START + ActiveSpeakerLimiter::SPEAKER_TIMEOUT));
+
+	// Speaker 1 has stopped without a terminator
+	QVERIFY(limiter.admit(CHANNEL, 2, 1, false, START + ActiveSpeakerLimiter::SPEAKER_TIMEOUT + 1));
+	QVERIFY(!limiter.admit(CHANNEL, 1, 1, false, START + ActiveSpeakerLimiter::SPEAKER_TIMEOUT + 1));
+}
+
+void TestActiveSpeakerLimiter::channels() {
+	ActiveSpeakerLimiter limiter;
+
+	QVERIFY(limiter.admit(CHANNEL, 1, 1, false, START));
+	QVERIFY(limiter.admit(CHANNEL + 1, 2, 1, false, START));
+	QVERIFY(!limiter.admit(CHANNEL + 1, 3, 1, false, START));
+
+	QCOMPARE(limiter.activeSpeakers(CHANNEL), static_cast< std::size_t >(1));
+	QCOMPARE(limiter.activeSpeakers(CHANNEL + 1), static_cast< std::size_t >(1));
+	QCOMPARE(limiter.activeSpeakers(CHANNEL + 2), static_cast< std::size_t >(0));
+
+	// A larger limit applies immediately
+	QVERIFY(limiter.admit(CHANNEL + 1, 3, 2, false, START));
+}
+
+void TestActiveSpeakerLimiter::unorderedTimes() {
+	ActiveSpeakerLimiter limiter;
+
+	QVERIFY(limiter.admit(CHANNEL, 1, 1, false, START + 10 * FRAME));
+	// A frame that has been received earlier by another thread neither expires the slot nor moves it back in time
+	QVERIFY(limiter.admit(CHANNEL, 1, 1, false, START));
+	QVERIFY(!limiter.admit(CHANNEL, 2, 1, false, START + 10 * FRAME + ActiveSpeakerLimiter::SPEAKER_TIMEOUT));
+}
+
+void TestActiveSpeakerLimiter::preemption() {
+	ActiveSpeakerLimiter limiter;
+
+	QVERIFY(limiter.admit(CHANNEL, 1, 2, false, START));
+	QVERIFY(limiter.admit(CHANNEL, 2, 2, false, START + FRAME));
+
+	// Both speakers transmit continuously, the others have to wait until the slots have been held long enough
+	quint64 time = START + FRAME;
+	for (; time < START + ActiveSpeakerLimiter::MINIMUM_HOLD; time += FRAME) {
+		QVERIFY(limiter.admit(CHANNEL, 1, 2, false, time));
+		QVERIFY(limiter.admit(CHANNEL, 2, 2, false, time));
+		QVERIFY(!limiter.admit(CHANNEL, 3, 2, false, time));
+	}
+
+	// The speaker that has held its slot the longest loses it
+	QVERIFY(limiter.admit(CHANNEL, 3, 2, false, time));
+	QVERIFY(!limiter.admit(CHANNEL, 1, 2, false, time));
+	QVERIFY(limiter.admit(CHANNEL, 2, 2, false, time));
+	QCOMPARE(limiter.activeSpeakers(CHANNEL), static_cast< std::size_t >(2));
+
+	// Now speaker 2 has held its slot long enough, while the new speaker keeps its slot for the minimum time as well
+	time += FRAME;
+	QVERIFY(limiter.admit(CHANNEL, 1, 2, false, time));
+	QVERIFY(!limiter.admit(CHANNEL, 2, 2, false, time));
+	QVERIFY(!limiter.admit(CHANNEL, 4, 2, false, time));
+	QVERIFY(limiter.admit(CHANNEL, 3, 2, false, time));
+	QVERIFY(!limiter.admit(CHANNEL, 2, 2, false, START + ActiveSpeakerLimiter::MINIMUM_HOLD + 2 * FRAME));
+}
+
+QTEST_MAIN(TestActiveSpeakerLimiter)
+#include "TestActiveSpeakerLimiter.moc"
@@ -0,0 +1,344 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioMixer.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <opus.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+static constexpr double PI       = 3.14159265358979323846;
+static constexpr quint64 START   = 1234567890ULL;
+static constexpr int BITRATE     = 64000;
+static constexpr float AMPLITUDE = 0.2f;
+/// The mixed frames at the beginning of a stream that are ignored while the codecs settle
+static constexpr std::size_t WARMUP_FRAMES = 5;
+
+/// Encodes a sine tone into Opus frames like a client would
+class Tone {
+public:
+	Tone(unsigned int session, double frequency) : session(session), m_frequency(frequency) {
+		int error   = OPUS_OK;
+		m_encoder   = opus_encoder_create(AudioMixer::SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, &error);
+		m_generated = 0;
+		opus_encoder_ctl(m_encoder, OPUS_SET_BITRATE(BITRATE));
+	}
+	~Tone() { opus_encoder_destroy(m_encoder); }
+
+	Tone(const Tone &) = delete;
+	Tone &operator=(const Tone &) = delete;
+
+	const unsigned int session;
+
+	/// @returns The next frame of the tone
+	std::vector< unsigned char > next() {
+		std::vector< float > samples(AudioMixer::FRAME_SAMPLES);
+		for (float &sample : samples) {
+			sample = AMPLITUDE
+					 * static_cast< float >(std::sin(2 * PI * m_frequency * static_cast< double >(m_generated++)
+													 / AudioMixer::SAMPLE_RATE));
+		}
+
+		std::vector< unsigned char > frame(1275);
+		const opus_int32 length = opus_encode_float(m_encoder, samples.data(), static_cast< int >(samples.size()),
+													frame.data(), static_cast< opus_int32 >(frame.size()));
+		frame.resize(static_cast< std::size_t >(std::max(length, 0)));
+
+		return frame;
+	}
+
+protected:
+	const double m_frequency;
+	OpusEncoder *m_encoder;
+	std::size_t m_generated;
+};
+
+/// The mixed frames received by a speaker or by the listeners
+struct Received {
+	std::vector< AudioMixer::Frame > frames;
+	/// The decoded audio of every frame
+	std::vector< std::vector< float > > audio;
+	/// The sender of every stream, in the order the streams have been started
+	std::vector< unsigned int > senders;
+};
+
+/// Feeds the frames of the speakers into a mixer and sorts out what comes back
+class Channel {
+public:
+	AudioMixer mixer;
+	Received listeners;
+	std::map< unsigned int, Received > speakers;
+
+	Channel() : mixer(BITRATE) {}
+
+	void addFrame(unsigned int session, const std::vector< unsigned char > &data, bool isLastFrame, quint64 now) {
+		std::vector< AudioMixer::Frame > frames;
+
+		mixer.addFrame(session, data.data(), data.size(), isLastFrame, now, frames);
+
+		for (AudioMixer::Frame &frame : frames) {
+			Received &received = frame.forListeners ? listeners : speakers[frame.receiver];
+
+			if (received.frames.empty() || received.frames.back().isLastFrame) {
+				received.senders.push_back(frame.sender);
+			}
+
+			OpusDecoder *&decoder = m_decoders[frame.forListeners ? 0 : frame.receiver];
+			if (!decoder) {
+				int error = OPUS_OK;
+				decoder   = opus_decoder_create(AudioMixer::SAMPLE_RATE, 1, &error);
+			}
+
+			std::vector< float > audio(AudioMixer::FRAME_SAMPLES);
+			const int decoded = opus_decode_float(decoder, frame.opusData.data(),
+												  static_cast< opus_int32 >(frame.opusData.size()), audio.data(),
+												  static_cast< int >(audio.size()), 0);
+			audio.resize(static_cast< std::size_t >(std::max(decoded, 0)));
+
+			received.audio.push_back(std::move(audio));
+			received.frames.push_back(std::move(frame));
+		}
+	}
+
+	void addFrame(Tone &tone, quint64 now) { addFrame(tone.session, tone.next(), false, now); }
+
+	~Channel() {
+		for (auto &entry : m_decoders) {
+			opus_decoder_destroy(entry.second);
+		}
+	}
+
+protected:
+	std::map< unsigned int, OpusDecoder * > m_decoders;
+};
+
+/// @returns The power of the given frequency in the given frames
+static double power(const std::vector< std::vector< float > > &audio, std::size_t begin, std::size_t end,
+					double frequency) {
+	// Goertzel algorithm
+	const double coefficient = 2 * std::cos(2 * PI * frequency / AudioMixer::SAMPLE_RATE);
+
+	double previous       = 0;
+	double beforePrevious = 0;
+	std::size_t count     = 0;
+	for (std::size_t i = begin; i < end && i < audio.size(); ++i) {
+		for (float sample : audio[i]) {
+			const double current = sample + coefficient * previous - beforePrevious;
+			beforePrevious       = previous;
+			previous             = current;
+			++count;
+		}
+	}
+
+	if (count == 0) {
+		return 0;
+	}
+
+	const double magnitude =
+		previous * previous + beforePrevious * beforePrevious - coefficient * previous * beforePrevious;
+
+	return magnitude / (static_cast< double >(count) * static_cast< double >(count));
+}
+
+/// Checks the properties every stream of mixed frames has to have
+static void checkStreams(const Channel &channel) {
+	const std::vector< AudioMixer::Frame > &listenerFrames = channel.listeners.frames;
+
+	QVERIFY(!listenerFrames.empty());
+	QVERIFY(listenerFrames.back().isLastFrame);
+
+	for (std::size_t i = 1; i < listenerFrames.size(); ++i) {
+		QVERIFY(listenerFrames[i].frameNumber > listenerFrames[i - 1].frameNumber);
+		// The sender of a stream only changes after it has been terminated
+		if (!listenerFrames[i - 1].isLastFrame) {
+			QCOMPARE(listenerFrames[i].sender, listenerFrames[i - 1].sender);
+		}
+	}
+
+	for (const auto &entry : channel.speakers) {
+		const std::vector< AudioMixer::Frame > &frames = entry.second.frames;
+
+		QVERIFY(frames.back().isLastFrame);
+
+		for (std::size_t i = 0; i < frames.size(); ++i) {
+			// Nobody receives a mix on their own behalf
+			QVERIFY(frames[i].sender != entry.first);
+
+			// All frames mixed at the same time share their frame number, such that a client switching between the
+			// mix for the listeners and a mix of its own sees increasing numbers
+			const bool mixedTogether =
+				std::any_of(listenerFrames.begin(), listenerFrames.end(), [&frames, i](const AudioMixer::Frame &frame) {
+					return frame.frameNumber == frames[i].frameNumber;
+				});
+			QVERIFY(mixedTogether);
+
+			if (i > 0) {
+				QVERIFY(frames[i].frameNumber > frames[i - 1].frameNumber);
+				if (!frames[i - 1].isLastFrame) {
+					QCOMPARE(frames[i].sender, frames[i - 1].sender);
+				}
+			}
+		}
+	}
+}
+
+class TestAudioMixer : public QObject {
+	Q_OBJECT
+private slots:
+	void mix();
+	void senders();
+	void lateSpeaker();
+	void jitter();
+};
+
+void TestAudioMixer::mix() {
+	Channel channel;
+	Tone tone1(1, 400), tone2(2, 1000), tone3(3, 2500);
+
+	quint64 time = START;
+	for (int i = 0; i < 50; ++i, time += AudioMixer::FRAME_DURATION) {
+		channel.addFrame(tone1, time);
+		channel.addFrame(tone2, time);
+		channel.addFrame(tone3, time);
+	}
+	channel.addFrame(1, {}, true, time);
+	channel.addFrame(2, {}, true, time);
+	channel.addFrame(3, {}, true, time);
+
+	checkStreams(channel);
+
+	// The listeners hear everybody
+	const Received &listeners = channel.listeners;
+	const std::size_t end     = listeners.audio.size() - WARMUP_FRAMES;
+	QVERIFY(end > WARMUP_FRAMES);
+	const double listenerPower1 = power(listeners.audio, WARMUP_FRAMES, end, 400);
+	const double listenerPower2 = power(listeners.audio, WARMUP_FRAMES, end, 1000);
+	const double listenerPower3 = power(listeners.audio, WARMUP_FRAMES, end, 2500);
+	// A sine of amplitude A results in a power of A^2 / 4
+	const double expected = AMPLITUDE * AMPLITUDE / 4;
+	QVERIFY(listenerPower1 > expected / 4);
+	QVERIFY(listenerPower2 > expected / 4);
+	QVERIFY(listenerPower3 > expected / 4);
+
+	// The speakers hear everybody but themselves
+	const std::map< unsigned int, double > frequencies = { { 1, 400 }, { 2, 1000 }, { 3, 2500 } };
+	QCOMPARE(channel.speakers.size(), static_cast< std::size_t >(3));
+	for (const auto &entry : channel.speakers) {
+		const Received &received = entry.second;
+		const std::size_t last   = received.audio.size() - WARMUP_FRAMES;
+		QVERIFY(last > WARMUP_FRAMES);
+
+		for (const auto &frequency : frequencies) {
+			const double speakerPower = power(received.audio, WARMUP_FRAMES, last, frequency.second);
+			if (frequency.first == entry.first) {
+				QVERIFY(speakerPower < expected / 100);
+			} else {
+				QVERIFY(speakerPower > expected / 4);
+			}
+		}
+	}
+}
+
+void TestAudioMixer::senders() {
+	Channel channel;
+	Tone tone1(1, 400), tone2(2, 1000), tone3(3, 2500);
+
+	quint64 time = START;
+	for (int i = 0; i < 20; ++i, time += AudioMixer::FRAME_DURATION) {
+		channel.addFrame(tone1, time);
+		channel.addFrame(tone2, time);
+		channel.addFrame(tone3, time);
+	}
+
+	// The first speaker stops, the others continue
+	channel.addFrame(1, {}, true, time);
+	for (int i = 0; i < 20; ++i, time += AudioMixer::FRAME_DURATION) {
+		channel.addFrame(tone2, time);
+		channel.addFrame(tone3, time);
+	}
+	channel.addFrame(2, {}, true, time);
+	channel.addFrame(3, {}, true, time);
+
+	checkStreams(channel);
+
+	// The streams that have been sent on behalf of the first speaker have been terminated and continued on behalf of
+	// another one
+	QCOMPARE(channel.listeners.senders, std::vector< unsigned int >({ 1, 2 }));
+	QCOMPARE(channel.speakers[2].senders, std::vector< unsigned int >({ 1, 3 }));
+	QCOMPARE(channel.speakers[3].senders, std::vector< unsigned int >({ 1, 2 }));
+	// The first speaker listens to the mix again once it has stopped
+	for (const AudioMixer::Frame &frame : channel.listeners.frames) {
+		const bool firstSpeaking = std::binary_search(frame.speakers.begin(), frame.speakers.end(), 1U);
+		QCOMPARE(firstSpeaking, frame.sender == 1);
+	}
+
+	// The mix of the first speaker ends along with its transmission
+	QCOMPARE(channel.speakers[1].senders, std::vector< unsigned int >({ 2 }));
+	QVERIFY(channel.speakers[1].frames.size() < channel.speakers[2].frames.size() / 2 + 1);
+}
+
+void TestAudioMixer::lateSpeaker() {
+	Channel channel;
+	Tone tone1(1, 400), tone2(2, 1000), tone3(3, 2500);
+
+	quint64 time = START;
+	for (int i = 0; i < 40; ++i, time += AudioMixer::FRAME_DURATION) {
+		channel.addFrame(tone1, time);
+		channel.addFrame(tone2, time);
+		if (i >= 20) {
+			channel.addFrame(tone3, time);
+		}
+	}
+	channel.addFrame(1, {}, true, time);
+	channel.addFrame(2, {}, true, time);
+	channel.addFrame(3, {}, true, time);
+
+	checkStreams(channel);
+
+	// The mix of the speaker that joined later continues the numbering of the mix for the listeners
+	const std::vector< AudioMixer::Frame > &frames = channel.speakers[3].frames;
+	QVERIFY(!frames.empty());
+	QVERIFY(frames.front().frameNumber >= 20 * 2);
+}
+
+void TestAudioMixer::jitter() {
+	Channel channel;
+	Tone tone1(1, 400), tone2(2, 1000);
+
+	quint64 time = START;
+	for (int i = 0; i < 50; ++i, time += AudioMixer::FRAME_DURATION) {
+		channel.addFrame(tone1, time);
+
+		if (i == 20 || i == 21) {
+			// These frames get lost and have to be concealed
+			tone2.next();
+			continue;
+		}
+
+		// Every other frame arrives just before the next frame of the first speaker
+		channel.addFrame(tone2, i % 2 == 0 ? time : time + AudioMixer::FRAME_DURATION - 1);
+	}
+	channel.addFrame(1, {}, true, time);
+	channel.addFrame(2, {}, true, time);
+
+	checkStreams(channel);
+
+	// The second speaker is heard in every frame, without dropping out
+	const Received &listeners = channel.listeners;
+	const double expected     = AMPLITUDE * AMPLITUDE / 4;
+	for (std::size_t i = WARMUP_FRAMES; i + WARMUP_FRAMES < listeners.audio.size(); ++i) {
+		QVERIFY(!listeners.frames[i].isLastFrame);
+		QVERIFY2(power(listeners.audio, i, i + 1, 1000) > expected / 64, qPrintable(QString::number(i)));
+	}
+}
+
+QTEST_MAIN(TestAudioMixer)
+#include "TestAudioMixer.moc"
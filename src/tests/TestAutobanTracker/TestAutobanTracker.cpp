@@ -0,0 +1,109 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AutobanTracker.h"
+
+#include <QObject>
+#include <QtTest>
+
+HostAddress toAddress(const QString &address) {
+	return HostAddress(QHostAddress(address));
+}
+
+class TestAutobanTracker : public QObject {
+	Q_OBJECT
+private slots:
+	void banAndExpire();
+	void refill();
+	void reset();
+	void boundedMemory();
+	void ipv6Prefix();
+};
+
+void TestAutobanTracker::banAndExpire() {
+	// 3 attempts per 10 seconds, banned for 60 seconds
+	AutobanTracker tracker(3, 10000, 60000, 16, 128);
+	const HostAddress address = toAddress("192.0.2.1");
+
+	for (int i = 0; i < 3; ++i) {
+		QVERIFY(!tracker.attempt(address, 1000));
+	}
+	QVERIFY(tracker.attempt(address, 1000));
+
+	// Other addresses aren't affected
+	QVERIFY(!tracker.attempt(toAddress("192.0.2.2"), 1000));
+
+	QVERIFY(tracker.attempt(address, 60999));
+	QVERIFY(!tracker.attempt(address, 61000));
+}
+
+void TestAutobanTracker::refill() {
+	AutobanTracker tracker(2, 10000, 60000, 16, 128);
+	const HostAddress address = toAddress("192.0.2.1");
+
+	// Attempts that are spread over the timeframe don't cause a ban
+	for (std::uint64_t now = 0; now < 100000; now += 5000) {
+		QVERIFY(!tracker.attempt(address, now));
+	}
+}
+
+void TestAutobanTracker::reset() {
+	AutobanTracker tracker(2, 10000, 60000, 16, 128);
+	const HostAddress address = toAddress("192.0.2.1");
+
+	QVERIFY(!tracker.attempt(address, 0));
+	QVERIFY(!tracker.attempt(address, 0));
+
+	tracker.reset(address);
+
+	QVERIFY(!tracker.attempt(address, 0));
+	QVERIFY(!tracker.attempt(address, 0));
+	QVERIFY(tracker.attempt(address, 0));
+}
+
+void TestAutobanTracker::boundedMemory() {
+	AutobanTracker tracker(1, 10000, 60000, 4, 128);
+	const HostAddress banned = toAddress("192.0.2.1");
+
+	QVERIFY(!tracker.attempt(banned, 0));
+	QVERIFY(tracker.attempt(banned, 0));
+
+	for (int i = 0; i < 3; ++i) {
+		QVERIFY(!tracker.attempt(toAddress(QString("198.51.100.%1").arg(i)), 0));
+	}
+	QCOMPARE(tracker.size(), static_cast< std::size_t >(4));
+
+	// The banned address has been used more recently than the others, so it is kept
+	QVERIFY(tracker.attempt(banned, 0));
+	QVERIFY(!tracker.attempt(toAddress("198.51.100.3"), 0));
+	QCOMPARE(tracker.size(), static_cast< std::size_t >(4));
+	QVERIFY(tracker.attempt(banned, 0));
+
+	// A flood of new addresses pushes it out
+	for (int i = 0; i < 100; ++i) {
+		tracker.attempt(toAddress(QString("203.0.113.%1").arg(i)), 0);
+	}
+	QCOMPARE(tracker.size(), static_cast< std::size_t >(4));
+	QVERIFY(!tracker.attempt(banned, 0));
+}
+
+void TestAutobanTracker::ipv6Prefix() {
+	AutobanTracker tracker(2, 10000, 60000, 16, 64);
+
+	QVERIFY(!tracker.attempt(toAddress("2001:db8:0:1::1"), 0));
+	QVERIFY(!tracker.attempt(toAddress("2001:db8:0:1::2"), 0));
+	QVERIFY(tracker.attempt(toAddress("2001:db8:0:1:ffff::"), 0));
+
+	// A different /64 network
+	QVERIFY(!tracker.attempt(toAddress("2001:db8:0:2::1"), 0));
+
+	// IPv4 addresses are never aggregated
+	QVERIFY(!tracker.attempt(toAddress("192.0.2.1"), 0));
+	QVERIFY(!tracker.attempt(toAddress("192.0.2.2"), 0));
+	QVERIFY(!tracker.attempt(toAddress("192.0.2.1"), 0));
+}
+
+QTEST_MAIN(TestAutobanTracker)
+#include "TestAutobanTracker.moc"
@@ -0,0 +1,91 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BanIndex.h"
+
+#include <QObject>
+#include <QtTest>
+
+Ban makeBan(const QString &address, int mask, unsigned int duration = 0, int age = 0) {
+	Ban ban;
+	ban.haAddress = HostAddress(QHostAddress(address));
+	// Masks are given for IPv4 addresses, but are stored for their IPv6 representation
+	ban.iMask     = address.contains(':') ? mask : mask + 96;
+	ban.qsReason  = address;
+	ban.qdtStart  = QDateTime::currentDateTimeUtc().addSecs(-age);
+	ban.iDuration = duration;
+
+	return ban;
+}
+
+HostAddress toAddress(const QString &address) {
+	return HostAddress(QHostAddress(address));
+}
+
+class TestBanIndex : public QObject {
+	Q_OBJECT
+private slots:
+	void prefixes();
+	void expiry();
+};
+
+void TestBanIndex::prefixes() {
+	BanIndex index;
+
+	QVERIFY(!index.match(toAddress("10.0.0.1")));
+
+	index.rebuild({ makeBan("10.0.0.0", 8), makeBan("192.168.16.0", 20), makeBan("192.168.1.1", 32),
+					makeBan("2001:db8::", 32) });
+
+	QCOMPARE(index.match(toAddress("10.1.2.3"))->qsReason, QString("10.0.0.0"));
+	QVERIFY(!index.match(toAddress("11.0.0.1")));
+
+	// The mask doesn't end at a byte boundary
+	QCOMPARE(index.match(toAddress("192.168.31.255"))->qsReason, QString("192.168.16.0"));
+	QVERIFY(!index.match(toAddress("192.168.32.0")));
+	QVERIFY(!index.match(toAddress("192.168.15.255")));
+
+	QCOMPARE(index.match(toAddress("192.168.1.1"))->qsReason, QString("192.168.1.1"));
+	QVERIFY(!index.match(toAddress("192.168.1.2")));
+
+	QCOMPARE(index.match(toAddress("2001:db8:1::1"))->qsReason, QString("2001:db8::"));
+	QVERIFY(!index.match(toAddress("2001:db9::1")));
+
+	index.rebuild({});
+
+	QVERIFY(!index.match(toAddress("10.1.2.3")));
+}
+
+void TestBanIndex::expiry() {
+	BanIndex index;
+
+	index.rebuild({ makeBan("10.0.0.0", 8, 60, 120), makeBan("10.0.0.0", 16, 3600), makeBan("10.0.0.0", 24),
+					makeBan("172.16.0.0", 12, 60, 30) });
+
+	QVERIFY(index.nextExpiry().isValid());
+
+	// The expired ban is skipped even before it is collected
+	QVERIFY(!index.match(toAddress("10.1.0.1")));
+	QCOMPARE(index.match(toAddress("10.0.1.1"))->qsReason, QString("10.0.0.0"));
+
+	const QList< Ban > expired = index.takeExpired();
+	QCOMPARE(expired.size(), 1);
+	QCOMPARE(expired.first().iMask, 8 + 96);
+
+	QVERIFY(index.takeExpired().isEmpty());
+
+	// The ban of 172.16.0.0/12 is next
+	QVERIFY(index.nextExpiry() <= QDateTime::currentDateTimeUtc().addSecs(30));
+	QVERIFY(index.match(toAddress("172.20.0.1")));
+
+	// Permanent bans never expire
+	index.rebuild({ makeBan("10.0.0.0", 8) });
+
+	QVERIFY(!index.nextExpiry().isValid());
+	QVERIFY(index.takeExpired().isEmpty());
+}
+
+QTEST_MAIN(TestBanIndex)
+#include "TestBanIndex.moc"
@@ -0,0 +1,110 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BandwidthRecord.h"
+
+#include <QObject>
+#include <QtTest>
+
+// An arbitrary point in time that doesn't fall onto a slot boundary
+static constexpr quint64 START = 1234567890ULL;
+
+static constexpr quint64 MSEC = 1000ULL;
+static constexpr quint64 SEC  = 1000000ULL;
+
+class TestBandwidthRecord : public QObject {
+	Q_OBJECT
+private slots:
+	void withinLimit();
+	void exceedingLimit();
+	void noElapsedTime();
+	void bandwidth();
+	void idleSeconds();
+	void onlineSeconds();
+};
+
+void TestBandwidthRecord::withinLimit() {
+	BandwidthRecord record(START);
+
+	// 500 bytes per second, for longer than the window
+	for (quint64 time = START + 100 * MSEC; time < START + 20 * SEC; time += 100 * MSEC) {
+		QVERIFY(record.addFrame(50, 1000, time));
+	}
+}
+
+void TestBandwidthRecord::exceedingLimit() {
+	BandwidthRecord record(START);
+
+	// 100000 bytes per second
+	quint64 accepted = 0;
+	for (quint64 time = START + 10 * MSEC; time <= START + 20 * SEC; time += 10 * MSEC) {
+		if (record.addFrame(1000, 1000, time)) {
+			accepted += 1000;
+		}
+	}
+
+	// A frame has to fit into the window as a whole, so the accepted data may fall short of the limit a bit
+	QVERIFY(accepted <= 20 * 1000);
+	QVERIFY(accepted >= 15 * 1000);
+
+	// The window drains over time
+	QVERIFY(!record.addFrame(1000, 1000, START + 20 * SEC + 10 * MSEC));
+	QVERIFY(record.addFrame(1000, 1000, START + 30 * SEC));
+}
+
+void TestBandwidthRecord::noElapsedTime() {
+	BandwidthRecord record(START);
+
+	QVERIFY(!record.addFrame(1, 1000000, START));
+	QVERIFY(record.addFrame(1, 1000000, START + 1));
+}
+
+void TestBandwidthRecord::bandwidth() {
+	BandwidthRecord record(START);
+
+	// Too young to tell
+	QVERIFY(record.addFrame(100, 100000, START + 100 * MSEC));
+	QCOMPARE(record.bandwidth(START + 200 * MSEC), 0);
+
+	// 1000 bytes per second
+	quint64 time = START + 200 * MSEC;
+	for (; time < START + 5 * SEC; time += 20 * MSEC) {
+		QVERIFY(record.addFrame(20, 100000, time));
+	}
+
+	const int bandwidth = record.bandwidth(time);
+	QVERIFY(bandwidth >= 900);
+	QVERIFY(bandwidth <= 1100);
+
+	// Silence
+	QCOMPARE(record.bandwidth(time + 2 * SEC), 0);
+	QCOMPARE(record.bandwidth(time + 60 * SEC), 0);
+}
+
+void TestBandwidthRecord::idleSeconds() {
+	BandwidthRecord record(START);
+
+	QCOMPARE(record.idleSeconds(START + 2 * SEC), 2);
+
+	QVERIFY(record.addFrame(100, 100000, START + 5 * SEC));
+	QCOMPARE(record.idleSeconds(START + 8 * SEC + 500 * MSEC), 3);
+
+	record.resetIdleSeconds(START + 7 * SEC);
+	QCOMPARE(record.idleSeconds(START + 8 * SEC + 500 * MSEC), 1);
+
+	// Rejected frames don't count as activity
+	QVERIFY(!record.addFrame(1000000, 1, START + 8 * SEC));
+	QCOMPARE(record.idleSeconds(START + 9 * SEC + 500 * MSEC), 2);
+}
+
+void TestBandwidthRecord::onlineSeconds() {
+	BandwidthRecord record(START);
+
+	QCOMPARE(record.onlineSeconds(START), 0);
+	QCOMPARE(record.onlineSeconds(START + 61 * SEC + 999 * MSEC), 61);
+}
+
+QTEST_MAIN(TestBandwidthRecord)
+#include "TestBandwidthRecord.moc"
@@ -0,0 +1,185 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Connection.h"
+#include "Mumble.pb.h"
+#include "SSL.h"
+#include "SelfSignedCertificate.h"
+
+#include <QObject>
+#include <QtNetwork/QSslKey>
+#include <QtNetwork/QSslSocket>
+#include <QtNetwork/QTcpServer>
+#include <QtTest>
+
+#include <memory>
+
+/// The amount of unsent data above which droppable messages are dropped
+static constexpr qint64 DROP_THRESHOLD = 1024 * 1024;
+/// The size of the messages the peer is flooded with
+static constexpr int MESSAGE_SIZE = 64 * 1024;
+/// The amount of data after which the test gives up waiting for the unsent data to pile up
+static constexpr qint64 MAX_FLOOD = 256 * 1024 * 1024;
+
+/// Accepts a single connection and sets up the TLS server side of it, like Server does
+class SslServer : public QTcpServer {
+public:
+	QSslCertificate certificate;
+	QSslKey key;
+	QSslSocket *socket = nullptr;
+
+protected:
+	void incomingConnection(qintptr descriptor) override {
+		socket = new QSslSocket(this);
+		socket->setSocketDescriptor(descriptor);
+		socket->setLocalCertificate(certificate);
+		socket->setPrivateKey(key);
+	}
+};
+
+class TestConnection : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void backpressure();
+	void parser();
+};
+
+void TestConnection::initTestCase() {
+	MumbleSSL::initialize();
+}
+
+void TestConnection::cleanupTestCase() {
+	MumbleSSL::destroy();
+}
+
+void TestConnection::backpressure() {
+	SslServer server;
+	QVERIFY(SelfSignedCertificate::generateMurmurV2Certificate(server.certificate, server.key));
+	QVERIFY(server.listen(QHostAddress::LocalHost));
+
+	QSslSocket client;
+	client.setPeerVerifyMode(QSslSocket::VerifyNone);
+	client.connectToHostEncrypted(QHostAddress(QHostAddress::LocalHost).toString(), server.serverPort());
+
+	QTRY_VERIFY(server.socket);
+
+	std::unique_ptr< Connection > connection = std::make_unique< Connection >(nullptr, server.socket);
+	connection->setOutputLimits(DROP_THRESHOLD, 0);
+
+	bool encrypted = false;
+	connect(connection.get(), &Connection::encrypted, [&encrypted]() { encrypted = true; });
+	connection->startServerEncryption();
+
+	QTRY_VERIFY(encrypted);
+	QTRY_VERIFY(client.isEncrypted());
+
+	// The client doesn't read anything: Once its small read buffer is full, the data piles up in the kernel and then
+	// in the buffers of the server's socket
+	client.setReadBufferSize(MESSAGE_SIZE);
+
+	const QByteArray message(MESSAGE_SIZE, 'x');
+	qint64 sent = 0;
+	while (connection->unsentBytes() <= DROP_THRESHOLD && sent < MAX_FLOOD) {
+		connection->sendMessage(message);
+		sent += message.size();
+
+		// Let the sockets write whatever the network accepts
+		QCoreApplication::processEvents();
+	}
+
+	QVERIFY2(connection->unsentBytes() > DROP_THRESHOLD, "The unsent data doesn't account for the unread data");
+
+	// Droppable messages are dropped, everything else is still queued
+	const qint64 unsent = connection->unsentBytes();
+	QVERIFY(!connection->queueMessage(message, true));
+	QCOMPARE(connection->unsentBytes(), unsent);
+	QVERIFY(connection->queueMessage(message));
+	connection->flushQueue();
+	sent += message.size();
+
+	// Once the client reads, everything is written
+	qint64 received = 0;
+	connect(&client, &QSslSocket::readyRead, [&client, &received]() { received += client.readAll().size(); });
+	client.setReadBufferSize(0);
+	received += client.readAll().size();
+
+	QTRY_COMPARE_WITH_TIMEOUT(received, sent, 30000);
+	QTRY_COMPARE(connection->unsentBytes(), static_cast< qint64 >(0));
+
+	client.disconnectFromHost();
+}
+
+void TestConnection::parser() {
+	SslServer server;
+	QVERIFY(SelfSignedCertificate::generateMurmurV2Certificate(server.certificate, server.key));
+	QVERIFY(server.listen(QHostAddress::LocalHost));
+
+	QSslSocket client;
+	client.setPeerVerifyMode(QSslSocket::VerifyNone);
+	client.connectToHostEncrypted(QHostAddress(QHostAddress::LocalHost).toString(), server.serverPort());
+
+	QTRY_VERIFY(server.socket);
+
+	std::unique_ptr< Connection > connection = std::make_unique< Connection >(nullptr, server.socket);
+	// Parses pings, rejects versions and leaves everything else alone
+	connection->setMessageParser([](Mumble::Protocol::TCPMessageType type, const QByteArray &data,
+									std::shared_ptr< ::google::protobuf::Message > &msg) {
+		if (type == Mumble::Protocol::TCPMessageType::Version) {
+			return false;
+		}
+		if (type == Mumble::Protocol::TCPMessageType::Ping) {
+			std::shared_ptr< MumbleProto::Ping > ping = std::make_shared< MumbleProto::Ping >();
+			if (!ping->ParseFromArray(data.constData(), data.size())) {
+				return false;
+			}
+			msg = std::move(ping);
+		}
+		return true;
+	});
+
+	QList< Mumble::Protocol::TCPMessageType > unparsed;
+	QList< quint64 > timestamps;
+	connect(connection.get(), &Connection::message,
+			[&unparsed](Mumble::Protocol::TCPMessageType type, const QByteArray &) { unparsed << type; });
+	connect(connection.get(), &Connection::parsedMessage,
+			[&timestamps](Mumble::Protocol::TCPMessageType type, std::shared_ptr< ::google::protobuf::Message > msg) {
+				QCOMPARE(type, Mumble::Protocol::TCPMessageType::Ping);
+				timestamps << static_cast< MumbleProto::Ping & >(*msg).timestamp();
+			});
+
+	bool encrypted = false;
+	connect(connection.get(), &Connection::encrypted, [&encrypted]() { encrypted = true; });
+	connection->startServerEncryption();
+
+	QTRY_VERIFY(encrypted);
+	QTRY_VERIFY(client.isEncrypted());
+
+	QByteArray data;
+	MumbleProto::Ping ping;
+	ping.set_timestamp(42);
+	Connection::messageToNetwork(ping, Mumble::Protocol::TCPMessageType::Ping, data);
+	client.write(data);
+
+	MumbleProto::Version version;
+	version.set_release("Test");
+	Connection::messageToNetwork(version, Mumble::Protocol::TCPMessageType::Version, data);
+	client.write(data);
+
+	MumbleProto::TextMessage text;
+	text.set_message("Test");
+	Connection::messageToNetwork(text, Mumble::Protocol::TCPMessageType::TextMessage, data);
+	client.write(data);
+
+	QTRY_COMPARE(unparsed.size(), 1);
+	QCOMPARE(unparsed.first(), Mumble::Protocol::TCPMessageType::TextMessage);
+	QCOMPARE(timestamps, QList< quint64 >() << 42);
+
+	client.disconnectFromHost();
+}
+
+QTEST_MAIN(TestConnection)
+#include "TestConnection.moc"
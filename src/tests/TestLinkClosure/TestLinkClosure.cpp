@@ -0,0 +1,161 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LinkClosure.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+std::set< unsigned int > toSet(const QVector< unsigned int > &group) {
+	return std::set< unsigned int >(group.begin(), group.end());
+}
+
+class TestLinkClosure : public QObject {
+	Q_OBJECT
+private slots:
+	void chain();
+	void cycle();
+	void removeChannel();
+	void randomOperations();
+};
+
+void TestLinkClosure::chain() {
+	LinkClosure closure;
+
+	QVERIFY(closure.getLinkGroup(1).isEmpty());
+
+	closure.addLink(1, 2);
+	closure.addLink(3, 4);
+
+	QVERIFY(closure.isLinked(1, 2));
+	QVERIFY(!closure.isLinked(2, 3));
+
+	// Merges the two groups
+	closure.addLink(2, 3);
+
+	QVERIFY(closure.isLinked(1, 4));
+	QCOMPARE(toSet(closure.getLinkGroup(4)), std::set< unsigned int >({ 1, 2, 3, 4 }));
+
+	// Splits them again
+	closure.removeLink(3, 2);
+
+	QCOMPARE(toSet(closure.getLinkGroup(1)), std::set< unsigned int >({ 1, 2 }));
+	QCOMPARE(toSet(closure.getLinkGroup(3)), std::set< unsigned int >({ 3, 4 }));
+
+	closure.removeLink(1, 2);
+
+	QVERIFY(closure.getLinkGroup(1).isEmpty());
+	QVERIFY(closure.getLinkGroup(2).isEmpty());
+}
+
+void TestLinkClosure::cycle() {
+	LinkClosure closure;
+
+	closure.addLink(1, 2);
+	closure.addLink(2, 3);
+	closure.addLink(3, 1);
+
+	// There still is a path through the remaining links
+	closure.removeLink(1, 2);
+
+	QCOMPARE(toSet(closure.getLinkGroup(2)), std::set< unsigned int >({ 1, 2, 3 }));
+
+	closure.removeLink(2, 3);
+
+	QCOMPARE(toSet(closure.getLinkGroup(1)), std::set< unsigned int >({ 1, 3 }));
+	QVERIFY(closure.getLinkGroup(2).isEmpty());
+}
+
+void TestLinkClosure::removeChannel() {
+	LinkClosure closure;
+
+	// A star around channel 1 with another link between 4 and 5
+	closure.addLink(1, 2);
+	closure.addLink(1, 3);
+	closure.addLink(1, 4);
+	closure.addLink(4, 5);
+
+	closure.removeChannel(1);
+
+	QVERIFY(closure.getLinkGroup(1).isEmpty());
+	QVERIFY(closure.getLinkGroup(2).isEmpty());
+	QVERIFY(closure.getLinkGroup(3).isEmpty());
+	QCOMPARE(toSet(closure.getLinkGroup(5)), std::set< unsigned int >({ 4, 5 }));
+}
+
+void TestLinkClosure::randomOperations() {
+	constexpr unsigned int channelCount = 30;
+
+	std::mt19937 rng(42);
+	std::uniform_int_distribution< unsigned int > channelDist(0, channelCount - 1);
+	std::uniform_int_distribution< int > operationDist(0, 4);
+
+	LinkClosure closure;
+	std::set< std::pair< unsigned int, unsigned int > > links;
+
+	// Computes the group of the given channel the same way Channel::allLinks does
+	auto referenceGroup = [&](unsigned int channel) {
+		std::set< unsigned int > seen = { channel };
+		std::vector< unsigned int > stack = { channel };
+
+		while (!stack.empty()) {
+			const unsigned int current = stack.back();
+			stack.pop_back();
+
+			for (const auto &link : links) {
+				if (link.first == current && seen.insert(link.second).second) {
+					stack.push_back(link.second);
+				} else if (link.second == current && seen.insert(link.first).second) {
+					stack.push_back(link.first);
+				}
+			}
+		}
+
+		// Unlinked channels have no group
+		return seen.size() > 1 ? seen : std::set< unsigned int >();
+	};
+
+	for (int i = 0; i < 5000; ++i) {
+		const unsigned int first  = channelDist(rng);
+		const unsigned int second = channelDist(rng);
+		const auto link           = std::make_pair(std::min(first, second), std::max(first, second));
+
+		switch (operationDist(rng)) {
+			case 0:
+			case 1:
+				closure.addLink(first, second);
+				if (first != second) {
+					links.insert(link);
+				}
+				break;
+			case 2:
+			case 3:
+				closure.removeLink(first, second);
+				links.erase(link);
+				break;
+			default:
+				closure.removeChannel(first);
+				for (auto it = links.begin(); it != links.end();) {
+					it = (it->first == first || it->second == first) ? links.erase(it) : std::next(it);
+				}
+		}
+
+		for (unsigned int channel = 0; channel < channelCount; ++channel) {
+			const QVector< unsigned int > group = closure.getLinkGroup(channel);
+
+			QCOMPARE(toSet(group), referenceGroup(channel));
+			QCOMPARE(static_cast< std::size_t >(group.size()), toSet(group).size());
+		}
+	}
+}
+
+QTEST_MAIN(TestLinkClosure)
+#include "TestLinkClosure.moc"
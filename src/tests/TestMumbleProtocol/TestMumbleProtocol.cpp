@@ -259,6 +259,67 @@ private slots:
 		do_test_audio< Mumble::Protocol::Role::Server, Mumble::Protocol::Role::Client >();
 	}
 
+	void test_audio_libprotobuf_compatibility() {
+		Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder(
+			Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+		Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder(
+			Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+		std::string payloadData = "I am the payload";
+
+		Mumble::Protocol::AudioData data;
+		data.payload = { reinterpret_cast< const Mumble::Protocol::byte * >(payloadData.c_str()), payloadData.size() };
+		data.frameNumber            = 1234567;
+		data.senderSession          = 300;
+		data.containsPositionalData = true;
+		data.position               = { 1.5f, -2, 1000 };
+		data.isLastFrame            = true;
+		data.targetOrContext        = Mumble::Protocol::AudioContext::WHISPER;
+		data.volumeAdjustment       = VolumeAdjustment::fromFactor(0.3f);
+
+		// The packets are encoded by hand, but have to be understood by libprotobuf
+		gsl::span< const Mumble::Protocol::byte > encodedData = encoder.encodeAudioPacket(data);
+		QVERIFY(!encodedData.empty());
+		QCOMPARE(encodedData[0], static_cast< Mumble::Protocol::byte >(Mumble::Protocol::UDPMessageType::Audio));
+
+		MumbleUDP::Audio msg;
+		QVERIFY(msg.ParseFromArray(encodedData.data() + 1, static_cast< int >(encodedData.size() - 1)));
+
+		QCOMPARE(msg.sender_session(), data.senderSession);
+		QCOMPARE(msg.frame_number(), data.frameNumber);
+		QCOMPARE(msg.opus_data(), payloadData);
+		QCOMPARE(msg.is_terminator(), data.isLastFrame);
+		QVERIFY(msg.has_context());
+		QCOMPARE(msg.context(), data.targetOrContext);
+		QCOMPARE(msg.positional_data_size(), 3);
+		for (int i = 0; i < 3; ++i) {
+			QCOMPARE(msg.positional_data(i), data.position[static_cast< std::size_t >(i)]);
+		}
+		QCOMPARE(msg.volume_adjustment(), data.volumeAdjustment.factor);
+
+		// ... and the other way around, including fields the decoder doesn't know about
+		msg.mutable_unknown_fields()->AddVarint(100, 42);
+		msg.mutable_unknown_fields()->AddLengthDelimited(101, "unknown");
+
+		std::string serialized;
+		QVERIFY(msg.SerializeToString(&serialized));
+		serialized.insert(serialized.begin(), static_cast< char >(Mumble::Protocol::UDPMessageType::Audio));
+
+		QVERIFY(decoder.decode({ reinterpret_cast< const Mumble::Protocol::byte * >(serialized.data()),
+								 serialized.size() }));
+		QCOMPARE(decoder.getAudioData(), data);
+
+		// The payload is not copied out of the decoded packet
+		QVERIFY(decoder.getAudioData().payload.data()
+				>= reinterpret_cast< const Mumble::Protocol::byte * >(serialized.data()));
+		QVERIFY(decoder.getAudioData().payload.data()
+				< reinterpret_cast< const Mumble::Protocol::byte * >(serialized.data() + serialized.size()));
+
+		// Truncated packets are rejected
+		QVERIFY(!decoder.decode({ reinterpret_cast< const Mumble::Protocol::byte * >(serialized.data()),
+								  serialized.size() - 1 }));
+	}
+
 	void test_preEncode_audio_context() {
 		Mumble::Protocol::TestAudioEncoder< Mumble::Protocol::Role::Server > encoder;
 
@@ -0,0 +1,196 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PeerTable.h"
+
+#include <QObject>
+#include <QtTest>
+
+#ifdef Q_OS_WIN
+#	include <ws2tcpip.h>
+#else
+#	include <netinet/in.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <random>
+#include <thread>
+#include <utility>
+
+// The table never dereferences the users it stores, so any unique pointer value will do
+ServerUser *fakeUser(std::uintptr_t id) {
+	return reinterpret_cast< ServerUser * >(id);
+}
+
+sockaddr_storage ipv4Address(std::uint32_t ip, std::uint16_t port) {
+	sockaddr_storage address;
+	memset(&address, 0, sizeof(address));
+
+	sockaddr_in *in     = reinterpret_cast< sockaddr_in * >(&address);
+	in->sin_family      = AF_INET;
+	in->sin_addr.s_addr = htonl(ip);
+	in->sin_port        = htons(port);
+
+	return address;
+}
+
+// The address as it is reported by a dual-stack socket
+sockaddr_storage ipv4MappedAddress(std::uint32_t ip, std::uint16_t port) {
+	sockaddr_storage address;
+	memset(&address, 0, sizeof(address));
+
+	sockaddr_in6 *in6                = reinterpret_cast< sockaddr_in6 * >(&address);
+	in6->sin6_family                 = AF_INET6;
+	in6->sin6_addr.s6_addr[10]       = 0xFF;
+	in6->sin6_addr.s6_addr[11]       = 0xFF;
+	const std::uint32_t networkOrder = htonl(ip);
+	memcpy(&in6->sin6_addr.s6_addr[12], &networkOrder, sizeof(networkOrder));
+	in6->sin6_port = htons(port);
+
+	return address;
+}
+
+class TestPeerTable : public QObject {
+	Q_OBJECT
+private slots:
+	void insertAndFind();
+	void dualStack();
+	void removeRequiresMatchingUser();
+	void randomOperations();
+	void concurrentLookups();
+};
+
+void TestPeerTable::insertAndFind() {
+	PeerTable table;
+
+	QVERIFY(!table.find(ipv4Address(0x7F000001, 64738)));
+
+	table.insert(ipv4Address(0x7F000001, 64738), fakeUser(1));
+	table.insert(ipv4Address(0x7F000001, 64739), fakeUser(2));
+
+	QCOMPARE(table.size(), static_cast< std::size_t >(2));
+	QCOMPARE(table.find(ipv4Address(0x7F000001, 64738)), fakeUser(1));
+	QCOMPARE(table.find(ipv4Address(0x7F000001, 64739)), fakeUser(2));
+	QVERIFY(!table.find(ipv4Address(0x7F000002, 64738)));
+
+	// Inserting an existing address replaces its user
+	table.insert(ipv4Address(0x7F000001, 64738), fakeUser(3));
+
+	QCOMPARE(table.size(), static_cast< std::size_t >(2));
+	QCOMPARE(table.find(ipv4Address(0x7F000001, 64738)), fakeUser(3));
+}
+
+void TestPeerTable::dualStack() {
+	PeerTable table;
+
+	table.insert(ipv4Address(0xC0A80001, 1234), fakeUser(1));
+
+	QCOMPARE(table.find(ipv4MappedAddress(0xC0A80001, 1234)), fakeUser(1));
+
+	table.remove(ipv4MappedAddress(0xC0A80001, 1234), fakeUser(1));
+
+	QVERIFY(!table.find(ipv4Address(0xC0A80001, 1234)));
+	QCOMPARE(table.size(), static_cast< std::size_t >(0));
+}
+
+void TestPeerTable::removeRequiresMatchingUser() {
+	PeerTable table;
+
+	table.insert(ipv4Address(0x0A000001, 5000), fakeUser(1));
+	table.remove(ipv4Address(0x0A000001, 5000), fakeUser(2));
+
+	QCOMPARE(table.find(ipv4Address(0x0A000001, 5000)), fakeUser(1));
+
+	table.remove(ipv4Address(0x0A000001, 5000), fakeUser(1));
+
+	QVERIFY(!table.find(ipv4Address(0x0A000001, 5000)));
+}
+
+void TestPeerTable::randomOperations() {
+	// Use few distinct addresses in order to provoke long probe sequences and growing as well as removals
+	// from the middle of probe sequences
+	std::mt19937 rng(42);
+	std::uniform_int_distribution< std::uint32_t > ipDist(0, 63);
+	std::uniform_int_distribution< std::uint16_t > portDist(0, 63);
+	std::uniform_int_distribution< std::uintptr_t > userDist(1, 1000);
+	std::uniform_int_distribution< int > operationDist(0, 2);
+
+	PeerTable table;
+	std::map< std::pair< std::uint32_t, std::uint16_t >, ServerUser * > reference;
+
+	for (int i = 0; i < 100000; ++i) {
+		const std::uint32_t ip   = ipDist(rng);
+		const std::uint16_t port = portDist(rng);
+		const auto key           = std::make_pair(ip, port);
+
+		auto it                 = reference.find(key);
+		ServerUser *currentUser = it == reference.end() ? nullptr : it->second;
+
+		switch (operationDist(rng)) {
+			case 0: {
+				ServerUser *user = fakeUser(userDist(rng));
+				table.insert(ipv4Address(ip, port), user);
+				reference[key] = user;
+				break;
+			}
+			case 1:
+				table.remove(ipv4MappedAddress(ip, port), currentUser);
+				reference.erase(key);
+				break;
+			default:
+				QCOMPARE(table.find(ipv4Address(ip, port)), currentUser);
+		}
+	}
+
+	QCOMPARE(table.size(), reference.size());
+	for (const auto &current : reference) {
+		QCOMPARE(table.find(ipv4Address(current.first.first, current.first.second)), current.second);
+	}
+}
+
+void TestPeerTable::concurrentLookups() {
+	constexpr std::uint32_t stableUsers = 100;
+
+	PeerTable table;
+	for (std::uint32_t i = 0; i < stableUsers; ++i) {
+		table.insert(ipv4Address(i, 1), fakeUser(i + 1));
+	}
+
+	std::atomic< bool > done(false);
+	std::atomic< int > mismatches(0);
+
+	// The writer keeps adding and removing other addresses (which makes the table grow and shift entries
+	// around) while the reader looks up the addresses that never change
+	std::thread writer([&]() {
+		for (int round = 0; round < 200; ++round) {
+			for (std::uint32_t i = 0; i < 500; ++i) {
+				table.insert(ipv4Address(i, 2), fakeUser(1));
+			}
+			for (std::uint32_t i = 0; i < 500; ++i) {
+				table.remove(ipv4Address(i, 2), fakeUser(1));
+			}
+		}
+
+		done = true;
+	});
+
+	while (!done) {
+		for (std::uint32_t i = 0; i < stableUsers; ++i) {
+			if (table.find(ipv4Address(i, 1)) != fakeUser(i + 1)) {
+				++mismatches;
+			}
+		}
+	}
+
+	writer.join();
+
+	QCOMPARE(mismatches.load(), 0);
+}
+
+QTEST_MAIN(TestPeerTable)
+#include "TestPeerTable.moc"
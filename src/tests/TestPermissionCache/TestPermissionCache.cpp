@@ -0,0 +1,498 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ACL.h"
+#include "Channel.h"
+#include "Group.h"
+#include "PermissionCache.h"
+#include "ServerUser.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+/// A channel tree along with the users in it
+struct Tree {
+	std::unique_ptr< Channel > root;
+	std::vector< Channel * > channels;
+	std::vector< std::unique_ptr< ServerUser > > users;
+
+	Channel *addChannel(Channel *parent) {
+		Channel *channel = new Channel(static_cast< unsigned int >(channels.size()), QString(), parent);
+		if (!parent) {
+			root.reset(channel);
+		}
+		channels.push_back(channel);
+
+		return channel;
+	}
+
+	ServerUser *addUser(int id, Channel *channel) {
+		users.push_back(std::make_unique< ServerUser >(static_cast< unsigned int >(users.size() + 1), id));
+		channel->addUser(users.back().get());
+
+		return users.back().get();
+	}
+};
+
+static ChanACL *addACL(Channel *channel, const QString &group, ChanACL::Permissions allow,
+					   ChanACL::Permissions deny = ChanACL::None) {
+	ChanACL *acl = new ChanACL(channel);
+	acl->qsGroup = group;
+	acl->pAllow  = allow;
+	acl->pDeny   = deny;
+
+	return acl;
+}
+
+/// @returns The IDs of the given channel and all of its subchannels, as the server invalidates them after editing
+/// 	the ACLs or groups of the channel
+static std::vector< unsigned int > subtreeIDs(Channel *channel) {
+	std::vector< unsigned int > ids = { channel->iId };
+	for (const Channel *child : channel->allChildren()) {
+		ids.push_back(child->iId);
+	}
+
+	return ids;
+}
+
+static int uncachedPermissions(ServerUser *user, Channel *channel) {
+	return static_cast< int >(ChanACL::effectivePermissions(user, channel, nullptr));
+}
+
+static int cachedPermissions(ServerUser *user, Channel *channel, PermissionCache &cache) {
+	return static_cast< int >(ChanACL::effectivePermissions(user, channel, &cache) & ~ChanACL::Cached);
+}
+
+/// Checks that the permissions of every user in every channel are the same with and without the cache, both when
+/// they are computed and when they are looked up afterwards
+static void comparePermissions(const Tree &tree, PermissionCache &cache) {
+	for (const std::unique_ptr< ServerUser > &user : tree.users) {
+		for (Channel *channel : tree.channels) {
+			const int expected = uncachedPermissions(user.get(), channel);
+
+			QCOMPARE(cachedPermissions(user.get(), channel, cache), expected);
+			QVERIFY(cache.get(*user, channel->iId) & ChanACL::Cached);
+			QCOMPARE(cachedPermissions(user.get(), channel, cache), expected);
+		}
+	}
+}
+
+/// Checks that the cached group memberships of every user in every channel are the same as the ones determined by
+/// walking up the tree
+static void compareMemberships(const Tree &tree, PermissionCache &cache, const std::vector< const char * > &names) {
+	for (const std::unique_ptr< ServerUser > &user : tree.users) {
+		for (Channel *channel : tree.channels) {
+			for (const char *name : names) {
+				const QString groupName = QLatin1String(name);
+
+				QCOMPARE(cache.isGroupMember(*user, *channel, groupName), Group::isMember(*channel, groupName, *user));
+			}
+		}
+	}
+}
+
+/// Builds the following tree:
+/// Root (admin, staff [not inheritable])
+/// ├── Lobby
+/// └── Games (players)
+///     ├── Quiet (players [not inherited], doesn't inherit ACLs)
+///     └── Loud
+static void buildTree(Tree &tree) {
+	Channel *root  = tree.addChannel(nullptr);
+	Channel *lobby = tree.addChannel(root);
+	Channel *games = tree.addChannel(root);
+	Channel *quiet = tree.addChannel(games);
+	Channel *loud  = tree.addChannel(games);
+
+	Group *admin = new Group(root, QLatin1String("admin"));
+	admin->qsAdd << 1;
+	Group *staff = new Group(root, QLatin1String("staff"));
+	staff->bInheritable = false;
+	staff->qsAdd << 1 << 2;
+	Group *players = new Group(games, QLatin1String("players"));
+	players->qsAdd << 3 << 4;
+	Group *quietPlayers = new Group(quiet, QLatin1String("players"));
+	quietPlayers->bInherit = false;
+	quietPlayers->qsAdd << 4;
+	quietPlayers->qsRemove << 3;
+
+	addACL(root, QLatin1String("admin"), ChanACL::Write);
+	addACL(root, QLatin1String("auth"), ChanACL::MakeTempChannel);
+	addACL(root, QLatin1String("staff"), ChanACL::Kick | ChanACL::Move);
+	addACL(root, QLatin1String("#Token"), ChanACL::Register);
+	addACL(root, QLatin1String("!auth"), ChanACL::None, ChanACL::TextMessage);
+	addACL(lobby, QLatin1String("out"), ChanACL::None, ChanACL::Speak);
+	addACL(games, QLatin1String("~in"), ChanACL::LinkChannel);
+	addACL(games, QLatin1String("players"), ChanACL::MakeChannel);
+	addACL(games, QLatin1String("!~players"), ChanACL::None, ChanACL::Enter);
+	addACL(games, QLatin1String("sub,0,2"), ChanACL::MuteDeafen);
+	addACL(games, QLatin1String("staff"), ChanACL::MakeChannel);
+	quiet->bInheritACL = false;
+	addACL(quiet, QLatin1String("all"), ChanACL::None, ChanACL::Speak);
+	addACL(quiet, QLatin1String("$0123456789abcdef"), ChanACL::Speak);
+	addACL(quiet, QLatin1String("players"), ChanACL::MakeChannel);
+	addACL(loud, QLatin1String("strong"), ChanACL::Listen);
+	ChanACL *deny = addACL(loud, QLatin1String("!players"), ChanACL::None, ChanACL::Traverse);
+	deny->bApplySubs = false;
+
+	// A user with ID 0 would be the superuser, whose permissions are never looked up
+	tree.addUser(1, root);
+	tree.addUser(2, lobby);
+	ServerUser *player = tree.addUser(3, games);
+	player->qslAccessTokens << QLatin1String("token");
+	ServerUser *quietPlayer = tree.addUser(4, quiet);
+	quietPlayer->qsHash    = QLatin1String("0123456789abcdef");
+	quietPlayer->bVerified = true;
+	ServerUser *guest      = tree.addUser(-1, loud);
+	Group *guests          = new Group(loud, QLatin1String("players"));
+	guests->qsTemporary << -static_cast< int >(guest->uiSession);
+}
+
+class TestPermissionCache : public QObject {
+	Q_OBJECT
+private slots:
+	void cachedMatchesUncached();
+	void invalidateSubtree();
+	void invalidateUser();
+	void randomTrees();
+	void parseSpecifications();
+	void specifiers();
+	void groupMemberships();
+};
+
+void TestPermissionCache::cachedMatchesUncached() {
+	Tree tree;
+	buildTree(tree);
+
+	PermissionCache cache;
+	comparePermissions(tree, cache);
+
+	// Make sure the tree actually covers what it is meant to
+	Channel *root  = tree.channels[0];
+	Channel *quiet = tree.channels[3];
+	Channel *loud  = tree.channels[4];
+	QVERIFY(ChanACL::hasPermission(tree.users[0].get(), loud, ChanACL::Write, &cache));
+	QVERIFY(ChanACL::hasPermission(tree.users[1].get(), root, ChanACL::Kick, &cache));
+	QVERIFY(!ChanACL::hasPermission(tree.users[1].get(), loud, ChanACL::Move, &cache));
+	QVERIFY(ChanACL::hasPermission(tree.users[2].get(), root, ChanACL::Register, &cache));
+	QVERIFY(!ChanACL::hasPermission(tree.users[2].get(), quiet, ChanACL::Speak | ChanACL::MakeChannel, &cache));
+	QVERIFY(ChanACL::hasPermission(tree.users[3].get(), quiet, ChanACL::Speak, &cache));
+	QVERIFY(ChanACL::hasPermission(tree.users[3].get(), quiet, ChanACL::MakeChannel, &cache));
+	QVERIFY(!ChanACL::hasPermission(tree.users[4].get(), root, ChanACL::TextMessage, &cache));
+	QVERIFY(ChanACL::hasPermission(tree.users[4].get(), loud, ChanACL::Traverse, &cache));
+}
+
+void TestPermissionCache::invalidateSubtree() {
+	Tree tree;
+	buildTree(tree);
+
+	PermissionCache cache;
+	comparePermissions(tree, cache);
+
+	// Players may no longer make channels in Games and below
+	Channel *games = tree.channels[2];
+	games->qlACL[1]->pAllow = ChanACL::None;
+	games->qlACL[1]->pDeny  = ChanACL::MakeChannel;
+
+	ServerUser *player = tree.users[2].get();
+	QVERIFY(ChanACL::hasPermission(player, games, ChanACL::MakeChannel, &cache));
+	QVERIFY(!ChanACL::hasPermission(player, games, ChanACL::MakeChannel, nullptr));
+
+	cache.clearChannels(subtreeIDs(games));
+
+	// Only the edited subtree has been dropped
+	for (const std::unique_ptr< ServerUser > &user : tree.users) {
+		for (Channel *channel : tree.channels) {
+			const bool edited = (channel == games || channel->cParent == games);
+
+			QCOMPARE(static_cast< bool >(cache.get(*user, channel->iId) & ChanACL::Cached), !edited);
+		}
+	}
+
+	comparePermissions(tree, cache);
+
+	// Group memberships are dropped along with the permissions
+	Channel *quiet = tree.channels[3];
+	quiet->qhGroups.value(QLatin1String("players"))->qsAdd << 3;
+	cache.clearChannels(subtreeIDs(quiet));
+
+	QVERIFY(!ChanACL::hasPermission(player, quiet, ChanACL::MakeChannel, &cache));
+	quiet->qhGroups.value(QLatin1String("players"))->qsRemove.clear();
+	cache.clearChannels(subtreeIDs(quiet));
+
+	QVERIFY(ChanACL::hasPermission(player, quiet, ChanACL::MakeChannel, &cache));
+	comparePermissions(tree, cache);
+}
+
+void TestPermissionCache::invalidateUser() {
+	Tree tree;
+	buildTree(tree);
+
+	PermissionCache cache;
+	comparePermissions(tree, cache);
+
+	// The server drops the permissions of a user whose channel, access tokens or registration changes
+	ServerUser *player = tree.users[2].get();
+	player->qslAccessTokens.clear();
+	tree.channels[4]->addUser(player);
+	cache.clearUser(*player);
+
+	for (const std::unique_ptr< ServerUser > &user : tree.users) {
+		QCOMPARE(static_cast< bool >(cache.get(*user, 0) & ChanACL::Cached), user.get() != player);
+	}
+
+	comparePermissions(tree, cache);
+	QVERIFY(!ChanACL::hasPermission(player, tree.channels[0], ChanACL::Register, &cache));
+}
+
+void TestPermissionCache::randomTrees() {
+	constexpr int channelCount = 30;
+	constexpr int userCount    = 8;
+
+	std::mt19937 rng(42);
+	auto chance = [&rng](int percent) { return std::uniform_int_distribution< int >(0, 99)(rng) < percent; };
+	auto pick   = [&rng](int count) { return std::uniform_int_distribution< int >(0, count - 1)(rng); };
+
+	const std::vector< const char * > specifications = { "all",   "none",  "auth",       "!auth",  "strong",  "in",
+														 "~in",   "!~out", "sub",        "~sub,1", "#token",  "!#TOKEN",
+														 "$hash", "a",     "sub,-1,0,1", "~a",     "!a",      "b",
+														 "!~b",   "c" };
+	const std::vector< const char * > groupNames     = { "a", "b", "c" };
+	const std::vector< ChanACL::Perm > permissions   = { ChanACL::Write,       ChanACL::Traverse, ChanACL::Enter,
+														 ChanACL::Speak,       ChanACL::Whisper,  ChanACL::MakeChannel,
+														 ChanACL::TextMessage, ChanACL::Kick,     ChanACL::Register };
+
+	auto randomPermissions = [&]() {
+		ChanACL::Permissions result = ChanACL::None;
+		for (ChanACL::Perm permission : permissions) {
+			if (chance(20)) {
+				result |= permission;
+			}
+		}
+
+		return result;
+	};
+
+	auto randomMembers = [&](QSet< int > &members) {
+		for (int id = 1; id <= userCount; ++id) {
+			if (chance(25)) {
+				members.insert(id);
+			}
+		}
+	};
+
+	// Replaces the groups and ACLs of the given channel with random ones
+	auto randomize = [&](Channel *channel) {
+		qDeleteAll(channel->qlACL);
+		channel->qlACL.clear();
+		qDeleteAll(channel->qhGroups);
+		channel->qhGroups.clear();
+
+		channel->bInheritACL = !chance(15);
+
+		for (const char *name : groupNames) {
+			if (chance(40)) {
+				Group *group        = new Group(channel, QLatin1String(name));
+				group->bInherit     = !chance(25);
+				group->bInheritable = !chance(25);
+				randomMembers(group->qsAdd);
+				randomMembers(group->qsRemove);
+				if (chance(20)) {
+					group->qsTemporary.insert(-(pick(userCount) + 1));
+				}
+			}
+		}
+
+		const int aclCount = pick(4);
+		for (int i = 0; i < aclCount; ++i) {
+			const char *specification = specifications[pick(static_cast< int >(specifications.size()))];
+
+			ChanACL *acl = addACL(channel, QLatin1String(specification), randomPermissions(), randomPermissions());
+			acl->bApplyHere = !chance(20);
+			acl->bApplySubs = !chance(20);
+			if (chance(15)) {
+				acl->iUserId = pick(userCount) + 1;
+			}
+		}
+	};
+
+	auto randomizeUser = [&](Tree &tree, ServerUser *user) {
+		tree.channels[pick(channelCount)]->addUser(user);
+
+		user->bVerified = chance(50);
+		user->qsHash    = chance(30) ? QLatin1String("hash") : QLatin1String("other");
+		user->qslAccessTokens.clear();
+		if (chance(30)) {
+			user->qslAccessTokens << QLatin1String("Token");
+		}
+	};
+
+	for (int round = 0; round < 5; ++round) {
+		Tree tree;
+
+		tree.addChannel(nullptr);
+		for (int i = 1; i < channelCount; ++i) {
+			tree.addChannel(tree.channels[pick(i)]);
+		}
+		for (Channel *channel : tree.channels) {
+			randomize(channel);
+		}
+
+		for (int i = 0; i < userCount; ++i) {
+			// Unregistered users have no ID
+			randomizeUser(tree, tree.addUser(chance(20) ? -1 : i + 1, tree.channels[0]));
+		}
+
+		PermissionCache cache;
+		comparePermissions(tree, cache);
+		compareMemberships(tree, cache, { "a", "b", "c", "d" });
+
+		for (int i = 0; i < 50; ++i) {
+			if (chance(70)) {
+				Channel *channel = tree.channels[pick(channelCount)];
+
+				randomize(channel);
+				cache.clearChannels(subtreeIDs(channel));
+			} else {
+				ServerUser *user = tree.users[pick(userCount)].get();
+
+				randomizeUser(tree, user);
+				cache.clearUser(*user);
+			}
+
+			comparePermissions(tree, cache);
+			compareMemberships(tree, cache, { "a", "b", "c", "d" });
+		}
+	}
+}
+
+void TestPermissionCache::parseSpecifications() {
+	using Specification = Group::Specification;
+
+	Specification specification = Specification::parse(QLatin1String("!~admin"));
+	QVERIFY(specification.type == Specification::Type::Named);
+	QCOMPARE(specification.name, QString::fromLatin1("admin"));
+	QVERIFY(specification.invert);
+	QVERIFY(specification.aclContext);
+
+	specification = Specification::parse(QLatin1String("~!in"));
+	QVERIFY(specification.type == Specification::Type::In);
+	QVERIFY(specification.invert);
+	QVERIFY(specification.aclContext);
+
+	specification = Specification::parse(QLatin1String("!#Token"));
+	QVERIFY(specification.type == Specification::Type::AccessToken);
+	QCOMPARE(specification.name, QString::fromLatin1("Token"));
+	QVERIFY(specification.invert);
+	QVERIFY(!specification.aclContext);
+
+	// Access tokens and certificate hashes are never meta groups
+	specification = Specification::parse(QLatin1String("#all"));
+	QVERIFY(specification.type == Specification::Type::AccessToken);
+	QCOMPARE(specification.name, QString::fromLatin1("all"));
+
+	specification = Specification::parse(QLatin1String("$0123456789abcdef"));
+	QVERIFY(specification.type == Specification::Type::CertHash);
+	QCOMPARE(specification.name, QString::fromLatin1("0123456789abcdef"));
+	QVERIFY(!specification.invert);
+
+	specification = Specification::parse(QLatin1String("sub"));
+	QVERIFY(specification.type == Specification::Type::Sub);
+	QCOMPARE(specification.subOffset, 0);
+	QCOMPARE(specification.subMinLevel, 1);
+	QCOMPARE(specification.subMaxLevel, 1000);
+
+	specification = Specification::parse(QLatin1String("sub,-1,,3"));
+	QVERIFY(specification.type == Specification::Type::Sub);
+	QCOMPARE(specification.subOffset, -1);
+	QCOMPARE(specification.subMinLevel, 1);
+	QCOMPARE(specification.subMaxLevel, 3);
+
+	QVERIFY(Specification::parse(QLatin1String("subway")).type == Specification::Type::Named);
+	QVERIFY(Specification::parse(QString()).type == Specification::Type::Empty);
+	QVERIFY(Specification::parse(QLatin1String("!~")).type == Specification::Type::Empty);
+}
+
+void TestPermissionCache::specifiers() {
+	Tree tree;
+	buildTree(tree);
+
+	Channel *games          = tree.channels[2];
+	Channel *quiet          = tree.channels[3];
+	ServerUser *player      = tree.users[2].get();
+	ServerUser *quietPlayer = tree.users[3].get();
+
+	auto applies = [](Channel *current, Channel *aclChannel, const char *specification, const ServerUser *user) {
+		return Group::appliesToUser(*current, *aclChannel, QLatin1String(specification), *user);
+	};
+
+	// Access tokens are compared case-insensitively
+	QVERIFY(applies(quiet, games, "#TOKEN", player));
+	QVERIFY(!applies(quiet, games, "!#TOKEN", player));
+	QVERIFY(!applies(quiet, games, "#TOKEN", quietPlayer));
+
+	QVERIFY(applies(quiet, games, "$0123456789abcdef", quietPlayer));
+	QVERIFY(!applies(quiet, games, "$0123456789abcdef", player));
+
+	// ~ evaluates the specification in the channel the ACL is defined in instead of the one it is evaluated for
+	QVERIFY(applies(quiet, games, "in", quietPlayer));
+	QVERIFY(!applies(quiet, games, "~in", quietPlayer));
+	QVERIFY(applies(quiet, games, "~in", player));
+	QVERIFY(applies(quiet, games, "!in", player));
+	QVERIFY(!applies(quiet, games, "players", player));
+	QVERIFY(applies(quiet, games, "~players", player));
+
+	// An empty specification doesn't match anybody, not even when inverted
+	QVERIFY(!applies(quiet, games, "", player));
+	QVERIFY(!applies(quiet, games, "!", player));
+}
+
+void TestPermissionCache::groupMemberships() {
+	Tree tree;
+	buildTree(tree);
+
+	const std::vector< const char * > names = { "admin", "staff", "players", "nobody" };
+
+	PermissionCache cache;
+	compareMemberships(tree, cache, names);
+
+	Channel *root    = tree.channels[0];
+	Channel *lobby   = tree.channels[1];
+	Channel *quiet   = tree.channels[3];
+	Channel *loud    = tree.channels[4];
+	ServerUser *user = tree.users[1].get();
+
+	// Groups that aren't inheritable only exist in their own channel
+	QVERIFY(cache.isGroupMember(*user, *root, QLatin1String("staff")));
+	QVERIFY(!cache.isGroupMember(*user, *lobby, QLatin1String("staff")));
+
+	// Groups that don't inherit ignore the members of the groups in the parent channels
+	QVERIFY(cache.isGroupMember(*tree.users[2], *loud, QLatin1String("players")));
+	QVERIFY(!cache.isGroupMember(*tree.users[2], *quiet, QLatin1String("players")));
+	QVERIFY(cache.isGroupMember(*tree.users[4], *loud, QLatin1String("players")));
+
+	// Making staff inheritable only changes the memberships in the subtree that is dropped
+	root->qhGroups.value(QLatin1String("staff"))->bInheritable = true;
+	QVERIFY(!cache.isGroupMember(*user, *lobby, QLatin1String("staff")));
+
+	cache.clearChannels(subtreeIDs(root));
+	QVERIFY(cache.isGroupMember(*user, *lobby, QLatin1String("staff")));
+	compareMemberships(tree, cache, names);
+
+	// Removing the user from the players of Games only affects Games and its subchannels
+	Channel *games = tree.channels[2];
+	games->qhGroups.value(QLatin1String("players"))->qsRemove << 3;
+	cache.clearChannels(subtreeIDs(games));
+
+	QVERIFY(!cache.isGroupMember(*tree.users[2], *loud, QLatin1String("players")));
+	compareMemberships(tree, cache, names);
+}
+
+QTEST_MAIN(TestPermissionCache)
+#include "TestPermissionCache.moc"